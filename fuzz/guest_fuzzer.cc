@@ -0,0 +1,191 @@
+// libFuzzer target that fuzzes code inside a guest RV32 ELF, in process.
+//
+// The guest initializes itself and calls the function named by
+// --fuzz_entry. The machine is snapshotted on entry to it. Every input
+// then restores the snapshot and copies the input into the --fuzz_input
+// buffer, plus its length into --fuzz_input_len when that symbol exists.
+// It runs until the entry function returns, the --fuzz_stop address is
+// reached or the guest executes ebreak. The restore brings back devices
+// and their pending events with the hart, so every iteration starts
+// alike, and only copies back the pages the previous run dirtied, so an
+// iteration costs roughly what the guest code itself costs.
+//
+// Coverage is the guest's, not the emulator's. Edges between guest blocks
+// are counted into libFuzzer's extra counters, and the emulator itself
+// needs no instrumentation. Emulator errors, nonzero guest exit codes and
+// runs over --fuzz_max_ticks are reported as crashes.
+//
+// Harness flags use the "--" form, which libFuzzer ignores:
+//   guest_fuzzer --fuzz_elf=parser.elf -max_len=4096 corpus/
+
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "lib/cpu/cpu.h"
+#include "status_macros.h"
+
+DEFINE_string(fuzz_elf, "", "Static RV32 ELF holding the code under test.");
+DEFINE_string(fuzz_entry, "fuzz_target",
+              "Function the guest calls once initialized. The machine is snapshotted on "
+              "entry and every input runs it from there.");
+DEFINE_string(fuzz_input, "fuzz_input",
+              "Data symbol the input is copied into; longer inputs are truncated to its size.");
+DEFINE_string(fuzz_input_len, "fuzz_input_len",
+              "Data symbol that receives the input length as a 32-bit word, if present.");
+DEFINE_string(fuzz_stop, "",
+              "Symbol or 0x address where a run ends. Defaults to the return from "
+              "--fuzz_entry.");
+DEFINE_uint64(fuzz_max_ticks, 10'000'000,
+              "Virtual time budget per input; a run that exceeds it is reported as a hang.");
+
+namespace riscv_emu::fuzz {
+
+  namespace constants {
+
+    // Edge counters shared with libFuzzer; a power of two.
+    constexpr uint32_t kCoverageBytes = 1 << 16;
+
+  }  // namespace constants
+
+  namespace {
+
+    __attribute__((used, section("__libfuzzer_extra_counters")))
+    uint8_t coverage[constants::kCoverageBytes];
+
+    struct Harness {
+      std::unique_ptr<Cpu> cpu;
+      Cpu::Snapshot snapshot;
+      loader::Symbol input;
+      std::optional<loader::Symbol> input_len;
+    };
+
+    Harness* harness = nullptr;
+
+    absl::StatusOr<uint32_t> Resolve(const Cpu& cpu, const std::string& name) {
+      uint32_t addr = 0;
+      if (absl::StartsWith(name, "0x") && absl::SimpleHexAtoi(name, &addr)) {
+        return addr;
+      }
+      const std::optional<loader::Symbol> symbol = cpu.FindSymbol(name);
+      if (!symbol.has_value()) {
+        return absl::NotFoundError(absl::StrCat("No symbol ", name, " in ", FLAGS_fuzz_elf));
+      }
+      return symbol->addr;
+    }
+
+    absl::Status CopyIn(memory::Dram& dram, const uint32_t addr, const uint8_t* data,
+                        const size_t size) {
+      ASSIGN_OR_RETURN(uint8_t* dst, dram.GetHostPtr(addr, size));
+      std::memcpy(dst, data, size);
+      dram.NotifyWrite(addr, size);
+      return absl::OkStatus();
+    }
+
+    absl::StatusOr<std::unique_ptr<Harness>> Setup() {
+      if (FLAGS_fuzz_elf.empty()) {
+        return absl::InvalidArgumentError("--fuzz_elf is required");
+      }
+      auto setup = std::make_unique<Harness>();
+      CpuOptions options;
+      // The fuzzing thread has its core to itself.
+      options.compile_threads = 0;
+      setup->cpu = std::make_unique<Cpu>(options);
+      Cpu& cpu = *setup->cpu;
+      RETURN_IF_ERROR(cpu.LoadElf(FLAGS_fuzz_elf, /*patch_libc=*/false));
+
+      const std::optional<loader::Symbol> input = cpu.FindSymbol(FLAGS_fuzz_input);
+      if (!input.has_value() || input->size == 0) {
+        return absl::NotFoundError(absl::StrCat("No sized data symbol ", FLAGS_fuzz_input));
+      }
+      setup->input = *input;
+      setup->input_len = cpu.FindSymbol(FLAGS_fuzz_input_len);
+
+      ASSIGN_OR_RETURN(const uint32_t entry, Resolve(cpu, FLAGS_fuzz_entry));
+      cpu.SetStopPc(entry);
+      RETURN_IF_ERROR(cpu.Boot());
+      ASSIGN_OR_RETURN(const uint32_t pc, cpu.GetNextPc());
+      if (pc != entry) {
+        return absl::FailedPreconditionError(
+            absl::StrCat("The guest stopped before calling ", FLAGS_fuzz_entry));
+      }
+      if (FLAGS_fuzz_stop.empty()) {
+        cpu.SetStopPc(cpu.ReadRegister(engine::constants::kReturnAddressReg));
+      } else {
+        ASSIGN_OR_RETURN(const uint32_t stop, Resolve(cpu, FLAGS_fuzz_stop));
+        cpu.SetStopPc(stop);
+      }
+      ASSIGN_OR_RETURN(setup->snapshot, cpu.TakeSnapshot());
+      cpu.SetCoverageMap(coverage, constants::kCoverageBytes);
+      return setup;
+    }
+
+    absl::Status RunOne(Harness& h, const uint8_t* data, size_t size) {
+      Cpu& cpu = *h.cpu;
+      RETURN_IF_ERROR(cpu.RestoreSnapshot(h.snapshot));
+      size = std::min<size_t>(size, h.input.size);
+      RETURN_IF_ERROR(CopyIn(cpu.GetDram(), h.input.addr, data, size));
+      if (h.input_len.has_value()) {
+        uint8_t len[sizeof(uint32_t)];
+        memory::StoreToHost(len, memory::AccessType::kWord, size);
+        RETURN_IF_ERROR(CopyIn(cpu.GetDram(), h.input_len->addr, len, sizeof(len)));
+      }
+
+      bool timed_out = false;
+      const sched::EventId timeout = cpu.GetScheduler().Schedule(
+          cpu.GetClock() + FLAGS_fuzz_max_ticks, [&](uint64_t) {
+            timed_out = true;
+            cpu.PowerOff();
+            return absl::OkStatus();
+          });
+      const absl::Status status = cpu.Boot();
+      cpu.GetScheduler().Cancel(timeout);
+      RETURN_IF_ERROR(status);
+      if (timed_out) {
+        return absl::DeadlineExceededError("Input ran past --fuzz_max_ticks");
+      }
+      if (cpu.GetExitCode().value_or(0) != 0) {
+        return absl::AbortedError(absl::StrCat("Guest exited with ", *cpu.GetExitCode()));
+      }
+      return absl::OkStatus();
+    }
+
+  }  // namespace
+
+}  // namespace riscv_emu::fuzz
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+  FLAGS_logtostderr = 1;
+  std::vector<char*> flags = {(*argv)[0]};
+  for (int i = 1; i < *argc; ++i) {
+    if (absl::StartsWith((*argv)[i], "--")) {
+      flags.push_back((*argv)[i]);
+    }
+  }
+  int flag_count = static_cast<int>(flags.size());
+  char** flag_args = flags.data();
+  gflags::ParseCommandLineFlags(&flag_count, &flag_args, /*remove_flags=*/false);
+  google::InitGoogleLogging((*argv)[0]);
+
+  absl::StatusOr<std::unique_ptr<riscv_emu::fuzz::Harness>> harness =
+      riscv_emu::fuzz::Setup();
+  if (!harness.ok()) {
+    LOG(ERROR) << harness.status();
+    exit(1);
+  }
+  riscv_emu::fuzz::harness = harness->release();
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  const absl::Status status = riscv_emu::fuzz::RunOne(*riscv_emu::fuzz::harness, data, size);
+  // libFuzzer saves the input on abort.
+  CHECK(status.ok()) << status;
+  return 0;
+}
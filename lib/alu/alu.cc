@@ -44,28 +44,7 @@ absl::StatusOr<uint32_t> Sll(const Wire val1, const Wire val2, bool* hasOverflow
 }
 
 absl::StatusOr<uint32_t> Sra(const Wire val1, const Wire val2, bool* hasOverflow) {
-  Wire result { 0 };
-#ifdef __APPLE__
-  asm (
-    "mov %1, %%eax\n\t"      // Move first reg. to %eax
-    "mov %2, %%ecx\n\t"      // Move second reg. to %%ecx
-    "ror %%cl, %%eax\n\t"   // Rotate right
-    "mov %%eax, %0"          // Move %%eax to 'result'
-    : "=r" (result.i32)
-    : "r" (val1.u32), "r" (val2.u32 & alu::constants::kMaxShiftMask)
-    : "eax", "ecx"
-  );
-#else
-  asm (
-    "mov %1, %%eax\n\t"      // Move first reg. to %eax
-    "mov %2, %%ecx\n\t"      // Move second reg. to %%ecx
-    "ror %%ecx, %%eax\n\t"   // Rotate right
-    "mov %%eax, %0"          // Move %%eax to 'result'
-    : "=r" (result.u32)
-    : "r" (val1.u32), "r" (val2.u32 & alu::constants::kMaxShiftMask)
-    : "eax", "ecx"
-  );
-#endif
+  const Wire result { val1.i32 >> (val2.u32 & alu::constants::kMaxShiftMask) };
   return result.u32;
 }
 
@@ -87,7 +66,10 @@ absl::StatusOr<uint32_t> Alu::DoOp(const AluOp op, const uint32_t val1, const ui
     output = Add(val1, val2, &hasOverflow);
     break;
     case AluOp::kAddAddr:
-    output = Add(val1, val2 & (~0b1U), &hasOverflow);
+    output = Add(val1, val2, &hasOverflow);
+    if (output.ok()) {
+      output = *output & ~0b1U;
+    }
     break;
     case AluOp::kSub:
     output = Sub(val1, val2, &hasOverflow);
@@ -111,6 +93,7 @@ absl::StatusOr<uint32_t> Alu::DoOp(const AluOp op, const uint32_t val1, const ui
     output =  Srl(val1, val2, &hasOverflow);
     break;
     case AluOp::kNone:
+    output = absl::StatusOr<uint32_t>(0);
     break;
     default:
     return absl::InternalError("Invalid ALU operation");
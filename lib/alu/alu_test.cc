@@ -0,0 +1,24 @@
+#include "alu.h"
+#include "gtest/gtest.h"
+
+namespace riscv_emu {
+
+namespace {
+
+TEST(AluTest, SraFillsWithTheSignBit) {
+  Alu alu;
+  EXPECT_EQ(*alu.DoOp(AluOp::kSra, 0x80000000, 4), 0xf8000000);
+  EXPECT_EQ(*alu.DoOp(AluOp::kSra, 0xffffffff, 31), 0xffffffff);
+  EXPECT_EQ(*alu.DoOp(AluOp::kSra, 0x7ffffff0, 4), 0x07ffffff);
+  EXPECT_EQ(*alu.DoOp(AluOp::kSra, 0x80000000, 0), 0x80000000);
+}
+
+TEST(AluTest, SraUsesTheLowFiveShiftBits) {
+  Alu alu;
+  EXPECT_EQ(*alu.DoOp(AluOp::kSra, 0x80000000, 33), 0xc0000000);
+  EXPECT_EQ(*alu.DoOp(AluOp::kSra, 0x80000000, 0xffffffe0), 0x80000000);
+}
+
+}  // namespace
+
+}  // namespace riscv_emu
@@ -0,0 +1,169 @@
+#include "branch_unit.h"
+#include <algorithm>
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+
+namespace riscv_emu::bpred {
+
+namespace {
+
+  bool IsLinkReg(const uint32_t reg) {
+    return reg == constants::kLinkReg || reg == constants::kAltLinkReg;
+  }
+
+  absl::string_view KindName(const SiteKind kind) {
+    switch (kind) {
+     case SiteKind::kConditional:
+      return "branch";
+     case SiteKind::kJump:
+      return "jump";
+     case SiteKind::kCall:
+      return "call";
+     case SiteKind::kReturn:
+      return "return";
+     case SiteKind::kIndirect:
+      return "indirect";
+    }
+    return "?";
+  }
+
+  double Percent(const uint64_t part, const uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * part / whole;
+  }
+
+}  // namespace
+
+absl::Status Validate(const BranchConfig& config) {
+  if (config.btb_entries & (config.btb_entries - 1)) {
+    return absl::InvalidArgumentError("BTB entries must be a power of two");
+  }
+  return Validate(config.direction);
+}
+
+BranchUnit::BranchUnit(const BranchConfig& config)
+    : config_(config), direction_(config.direction), btb_(config.btb_entries),
+      ras_(config.ras_depth) {}
+
+bool BranchUnit::LookupTarget(const uint32_t pc, const uint32_t target) {
+  if (btb_.empty()) {
+    return false;
+  }
+  BtbEntry& entry = btb_[(pc >> 2) & (btb_.size() - 1)];
+  const bool hit = entry.valid && entry.pc == pc && entry.target == target;
+  entry = {pc, target, true};
+  return hit;
+}
+
+void BranchUnit::PushReturn(const uint32_t addr) {
+  if (ras_.empty()) {
+    return;
+  }
+  ras_[ras_top_] = addr;
+  ras_top_ = (ras_top_ + 1) % ras_.size();
+  ras_size_ = std::min<uint32_t>(ras_size_ + 1, ras_.size());
+}
+
+std::optional<uint32_t> BranchUnit::PopReturn() {
+  if (ras_size_ == 0) {
+    return std::nullopt;
+  }
+  ras_top_ = (ras_top_ + ras_.size() - 1) % ras_.size();
+  --ras_size_;
+  return ras_[ras_top_];
+}
+
+bool BranchUnit::Conditional(const uint32_t pc, const uint32_t target, const bool taken) {
+  SiteStats& site = sites_[pc];
+  site.kind = SiteKind::kConditional;
+  ++site.executed;
+  site.taken += taken;
+  const bool predicted = direction_.Predict(pc, target);
+  direction_.Update(taken);
+  if (!taken) {
+    site.mispredicted += predicted;
+    return predicted;
+  }
+  const bool target_hit = LookupTarget(pc, target);
+  if (!predicted) {
+    ++site.mispredicted;
+  } else if (!target_hit) {
+    ++site.target_misses;
+  }
+  return !predicted || !target_hit;
+}
+
+bool BranchUnit::Jump(const uint32_t pc, const uint32_t target, const bool indirect,
+                      const uint32_t rd, const uint32_t rs1) {
+  const bool links = IsLinkReg(rd);
+  const bool returns = indirect && IsLinkReg(rs1) && (!links || rd != rs1);
+  SiteStats& site = sites_[pc];
+  site.kind = links ? SiteKind::kCall
+              : returns ? SiteKind::kReturn
+              : indirect ? SiteKind::kIndirect
+                         : SiteKind::kJump;
+  ++site.executed;
+  ++site.taken;
+  bool target_hit = false;
+  if (returns && !ras_.empty()) {
+    target_hit = PopReturn() == target;
+  } else {
+    target_hit = LookupTarget(pc, target);
+  }
+  if (links) {
+    PushReturn(pc + 4);
+  }
+  site.target_misses += !target_hit;
+  return !target_hit;
+}
+
+std::string BranchUnit::FormatReport(
+    const size_t top, const std::function<std::string(uint32_t)>& symbolize) const {
+  uint64_t branches = 0;
+  uint64_t mispredicted = 0;
+  uint64_t transfers = 0;
+  uint64_t target_misses = 0;
+  uint64_t returns = 0;
+  uint64_t return_misses = 0;
+  std::vector<std::pair<uint32_t, SiteStats>> sites(sites_.begin(), sites_.end());
+  for (const auto& [pc, site] : sites) {
+    if (site.kind == SiteKind::kConditional) {
+      branches += site.executed;
+      mispredicted += site.mispredicted;
+    } else if (site.kind == SiteKind::kReturn) {
+      returns += site.executed;
+      return_misses += site.target_misses;
+    }
+    transfers += site.taken;
+    target_misses += site.target_misses;
+  }
+  std::string report = absl::StrFormat(
+      "branches (%s, %d counters; btb %d, ras %d): conditional %d, mispredicted %d (%.2f%%), "
+      "taken transfers %d, target misses %d (%.2f%%), returns %d, return misses %d\n",
+      SchemeName(config_.direction.scheme),
+      config_.direction.scheme == Scheme::kStatic ? 0 : 1 << config_.direction.table_bits,
+      config_.btb_entries, config_.ras_depth, branches, mispredicted,
+      Percent(mispredicted, branches), transfers, target_misses,
+      Percent(target_misses, transfers), returns, return_misses);
+
+  const auto redirects = [](const SiteStats& site) {
+    return site.mispredicted + site.target_misses;
+  };
+  std::sort(sites.begin(), sites.end(), [&](const auto& a, const auto& b) {
+    return redirects(a.second) != redirects(b.second) ? redirects(a.second) > redirects(b.second)
+                                                      : a.first < b.first;
+  });
+  absl::StrAppend(&report, "sites by redirects:\n");
+  for (size_t i = 0; i < std::min(top, sites.size()) && redirects(sites[i].second) > 0; ++i) {
+    const auto& [pc, site] = sites[i];
+    const std::string symbol = symbolize(pc);
+    absl::StrAppendFormat(&report,
+                          "  0x%08x%s%s (%s): executed %d, taken %.1f%%, mispredicted %d "
+                          "(%.2f%%), target misses %d\n",
+                          pc, symbol.empty() ? "" : " ", symbol, KindName(site.kind),
+                          site.executed, Percent(site.taken, site.executed), site.mispredicted,
+                          Percent(site.mispredicted, site.executed), site.target_misses);
+  }
+  return report;
+}
+
+}  // namespace riscv_emu::bpred
@@ -0,0 +1,98 @@
+#ifndef LIB_BPRED_BRANCH_UNIT_H
+#define LIB_BPRED_BRANCH_UNIT_H
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "lib/bpred/predictor.h"
+
+namespace riscv_emu::bpred {
+
+namespace constants {
+  // Registers the calling convention links through (ra and t0), which mark
+  // jumps as calls and returns.
+  constexpr uint32_t kLinkReg = 1;
+  constexpr uint32_t kAltLinkReg = 5;
+}  // namespace constants
+
+struct BranchConfig {
+  PredictorConfig direction;
+  // Direct-mapped branch target buffer; a power of two. 0 leaves every
+  // taken transfer without a target until it resolves.
+  uint32_t btb_entries = 512;
+  // Return address stack; the oldest entries are overwritten when it is
+  // full. 0 sends returns through the BTB.
+  uint32_t ras_depth = 8;
+};
+
+absl::Status Validate(const BranchConfig& config);
+
+enum class SiteKind : uint8_t {
+  kConditional,
+  kJump,
+  kCall,
+  kReturn,
+  // jalr other than a call or return.
+  kIndirect,
+};
+
+struct SiteStats {
+  SiteKind kind = SiteKind::kConditional;
+  uint64_t executed = 0;
+  uint64_t taken = 0;
+  // Conditional branches that went the other way than predicted.
+  uint64_t mispredicted = 0;
+  // Taken transfers predicted in the right direction whose target the
+  // BTB or return stack did not have.
+  uint64_t target_misses = 0;
+};
+
+// Models the front end's view of control flow: a direction predictor for
+// conditional branches, a BTB for the targets of taken transfers and a
+// return address stack. It is fed outcomes in program order, after they
+// resolve, and keeps statistics per branch site.
+class BranchUnit final {
+ public:
+  // `config` must be valid.
+  explicit BranchUnit(const BranchConfig& config);
+  // Both return whether the front end fetched the wrong path after the
+  // transfer: a mispredicted direction or a missing target.
+  bool Conditional(uint32_t pc, uint32_t target, bool taken);
+  // jal, or jalr when `indirect`. `rd` and `rs1` tell calls and returns
+  // apart, following the hints in the RISC-V spec.
+  bool Jump(uint32_t pc, uint32_t target, bool indirect, uint32_t rd, uint32_t rs1);
+
+  inline const absl::flat_hash_map<uint32_t, SiteStats>& GetSites() const { return sites_; }
+  // Totals, then the `top` sites that cost the most redirects, named by
+  // `symbolize`.
+  std::string FormatReport(size_t top,
+                           const std::function<std::string(uint32_t)>& symbolize) const;
+
+ private:
+  struct BtbEntry {
+    uint32_t pc = 0;
+    uint32_t target = 0;
+    bool valid = false;
+  };
+  // Returns whether the BTB had `target` for `pc`, then records it.
+  bool LookupTarget(uint32_t pc, uint32_t target);
+  void PushReturn(uint32_t addr);
+  std::optional<uint32_t> PopReturn();
+
+  BranchConfig config_;
+  DirectionPredictor direction_;
+  std::vector<BtbEntry> btb_;
+  std::vector<uint32_t> ras_;
+  // Circular; `ras_size_` entries below `ras_top_` are valid.
+  uint32_t ras_top_ = 0;
+  uint32_t ras_size_ = 0;
+  absl::flat_hash_map<uint32_t, SiteStats> sites_;
+};
+
+}  // namespace riscv_emu::bpred
+
+#endif  // LIB_BPRED_BRANCH_UNIT_H
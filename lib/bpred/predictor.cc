@@ -0,0 +1,195 @@
+#include "predictor.h"
+#include <algorithm>
+#include "absl/strings/str_cat.h"
+
+namespace riscv_emu::bpred {
+
+namespace {
+
+  constexpr uint8_t kCounterMax = 3;
+  constexpr uint8_t kCounterTaken = 2;
+  constexpr int8_t kTaggedCounterMin = -4;
+  constexpr int8_t kTaggedCounterMax = 3;
+  constexpr uint8_t kUsefulMax = 3;
+
+  void Train(uint8_t& counter, const bool taken) {
+    if (taken) {
+      counter = std::min<uint8_t>(counter + 1, kCounterMax);
+    } else if (counter > 0) {
+      --counter;
+    }
+  }
+
+}  // namespace
+
+absl::StatusOr<Scheme> ParseScheme(const absl::string_view name) {
+  for (const Scheme scheme : {Scheme::kStatic, Scheme::kBimodal, Scheme::kGshare, Scheme::kTage}) {
+    if (name == SchemeName(scheme)) {
+      return scheme;
+    }
+  }
+  return absl::InvalidArgumentError(absl::StrCat("Unknown branch predictor ", name));
+}
+
+absl::string_view SchemeName(const Scheme scheme) {
+  switch (scheme) {
+   case Scheme::kStatic:
+    return "btfn";
+   case Scheme::kBimodal:
+    return "bimodal";
+   case Scheme::kGshare:
+    return "gshare";
+   case Scheme::kTage:
+    return "tage";
+  }
+  return "?";
+}
+
+absl::Status Validate(const PredictorConfig& config) {
+  // TAGE's tagged tables are a quarter of the base table.
+  const uint32_t min_bits = config.scheme == Scheme::kTage ? 3 : 1;
+  if (config.table_bits < min_bits || config.table_bits > constants::kMaxTableBits) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Pattern tables take ", min_bits, " to ", constants::kMaxTableBits, " index bits"));
+  }
+  if (config.scheme == Scheme::kGshare && config.history_bits > config.table_bits) {
+    return absl::InvalidArgumentError("Gshare history cannot be longer than its index");
+  }
+  return absl::OkStatus();
+}
+
+DirectionPredictor::DirectionPredictor(const PredictorConfig& config) : config_(config) {
+  if (config.scheme == Scheme::kStatic) {
+    return;
+  }
+  counters_.resize(size_t{1} << config.table_bits, 1);
+  if (config.scheme == Scheme::kTage) {
+    tagged_bits_ = config.table_bits - 2;
+    for (std::vector<TaggedEntry>& table : tagged_) {
+      table.resize(size_t{1} << tagged_bits_);
+    }
+  }
+}
+
+uint32_t DirectionPredictor::Fold(uint64_t history, const uint32_t length, const uint32_t bits) {
+  if (length < constants::kMaxHistoryBits) {
+    history &= (uint64_t{1} << length) - 1;
+  }
+  uint32_t folded = 0;
+  for (; history != 0; history >>= bits) {
+    folded ^= history & ((uint64_t{1} << bits) - 1);
+  }
+  return folded;
+}
+
+uint32_t DirectionPredictor::PatternIndex(const uint32_t pc) const {
+  uint32_t index = pc >> 2;
+  if (config_.scheme == Scheme::kGshare) {
+    index ^= Fold(history_, config_.history_bits, config_.table_bits);
+  }
+  return index & ((1U << config_.table_bits) - 1);
+}
+
+bool DirectionPredictor::Predict(const uint32_t pc, const uint32_t target) {
+  switch (config_.scheme) {
+   case Scheme::kStatic:
+    predicted_ = target <= pc;
+    break;
+   case Scheme::kBimodal:
+   case Scheme::kGshare:
+    pattern_index_ = PatternIndex(pc);
+    predicted_ = counters_[pattern_index_] >= kCounterTaken;
+    break;
+   case Scheme::kTage:
+    pattern_index_ = PatternIndex(pc);
+    predicted_ = PredictTage(pc);
+    break;
+  }
+  return predicted_;
+}
+
+bool DirectionPredictor::PredictTage(const uint32_t pc) {
+  const uint32_t index_mask = (1U << tagged_bits_) - 1;
+  const uint32_t tag_mask = (1U << constants::kTageTagBits) - 1;
+  const uint32_t word = pc >> 2;
+  lookup_ = TageLookup();
+  for (int table = constants::kTageTables - 1; table >= 0; --table) {
+    const uint32_t length = constants::kTageHistory[table];
+    lookup_.index[table] =
+        (word ^ (word >> tagged_bits_) ^ Fold(history_, length, tagged_bits_)) & index_mask;
+    lookup_.tag[table] = (word ^ Fold(history_, length, constants::kTageTagBits) ^
+                          (Fold(history_, length, constants::kTageTagBits - 1) << 1)) &
+                         tag_mask;
+    if (tagged_[table][lookup_.index[table]].tag != lookup_.tag[table]) {
+      continue;
+    }
+    if (lookup_.provider < 0) {
+      lookup_.provider = table;
+    } else if (lookup_.alternate < 0) {
+      lookup_.alternate = table;
+    }
+  }
+  const bool base = counters_[pattern_index_] >= kCounterTaken;
+  const auto prediction = [&](const int table) {
+    return table < 0 ? base : tagged_[table][lookup_.index[table]].counter >= 0;
+  };
+  lookup_.provider_taken = prediction(lookup_.provider);
+  lookup_.alternate_taken = prediction(lookup_.alternate);
+  return lookup_.provider_taken;
+}
+
+void DirectionPredictor::UpdateTage(const bool taken) {
+  if (++updates_ % constants::kTageAgingPeriod == 0) {
+    for (std::vector<TaggedEntry>& table : tagged_) {
+      for (TaggedEntry& entry : table) {
+        entry.useful >>= 1;
+      }
+    }
+  }
+  const int provider = lookup_.provider;
+  if (provider < 0) {
+    Train(counters_[pattern_index_], taken);
+  } else {
+    TaggedEntry& entry = tagged_[provider][lookup_.index[provider]];
+    if (lookup_.provider_taken != lookup_.alternate_taken) {
+      if (lookup_.provider_taken == taken) {
+        entry.useful = std::min<uint8_t>(entry.useful + 1, kUsefulMax);
+      } else if (entry.useful > 0) {
+        --entry.useful;
+      }
+    }
+    entry.counter = taken ? std::min<int8_t>(entry.counter + 1, kTaggedCounterMax)
+                          : std::max<int8_t>(entry.counter - 1, kTaggedCounterMin);
+  }
+  if (predicted_ == taken) {
+    return;
+  }
+  // Mispredicted: give the branch an entry over a longer history.
+  for (int table = provider + 1; table < static_cast<int>(constants::kTageTables); ++table) {
+    TaggedEntry& entry = tagged_[table][lookup_.index[table]];
+    if (entry.useful == 0) {
+      entry = {lookup_.tag[table], static_cast<int8_t>(taken ? 0 : -1), 0};
+      return;
+    }
+  }
+  for (int table = provider + 1; table < static_cast<int>(constants::kTageTables); ++table) {
+    --tagged_[table][lookup_.index[table]].useful;
+  }
+}
+
+void DirectionPredictor::Update(const bool taken) {
+  switch (config_.scheme) {
+   case Scheme::kStatic:
+    break;
+   case Scheme::kBimodal:
+   case Scheme::kGshare:
+    Train(counters_[pattern_index_], taken);
+    break;
+   case Scheme::kTage:
+    UpdateTage(taken);
+    break;
+  }
+  history_ = (history_ << 1) | taken;
+}
+
+}  // namespace riscv_emu::bpred
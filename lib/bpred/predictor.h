@@ -0,0 +1,98 @@
+#ifndef LIB_BPRED_PREDICTOR_H
+#define LIB_BPRED_PREDICTOR_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace riscv_emu::bpred {
+
+namespace constants {
+  constexpr uint32_t kMaxTableBits = 24;
+  // Global history is kept in a 64-bit shift register.
+  constexpr uint32_t kMaxHistoryBits = 64;
+  constexpr uint32_t kTageTables = 4;
+  // History lengths of the tagged tables, shortest first.
+  constexpr std::array<uint32_t, kTageTables> kTageHistory = {5, 12, 27, 64};
+  constexpr uint32_t kTageTagBits = 9;
+  // Updates between halvings of the tagged entries' useful counters.
+  constexpr uint64_t kTageAgingPeriod = 1 << 18;
+}  // namespace constants
+
+enum class Scheme {
+  // Backward taken, forward not taken.
+  kStatic,
+  // Two-bit counters indexed by pc.
+  kBimodal,
+  // Two-bit counters indexed by pc xor global history.
+  kGshare,
+  // A bimodal base table and tagged tables over geometrically longer
+  // histories; the longest matching table predicts.
+  kTage,
+};
+
+absl::StatusOr<Scheme> ParseScheme(absl::string_view name);
+absl::string_view SchemeName(Scheme scheme);
+
+struct PredictorConfig {
+  Scheme scheme = Scheme::kGshare;
+  // log2 of the counters in the pattern table, or in TAGE's base table;
+  // its tagged tables hold a quarter as many entries each.
+  uint32_t table_bits = 12;
+  // Global history bits for gshare, at most `table_bits`.
+  uint32_t history_bits = 12;
+};
+
+absl::Status Validate(const PredictorConfig& config);
+
+// Predicts the direction of conditional branches. Every `Predict` must be
+// followed by the `Update` for the same branch before the next one.
+class DirectionPredictor final {
+ public:
+  // `config` must be valid.
+  explicit DirectionPredictor(const PredictorConfig& config);
+  bool Predict(uint32_t pc, uint32_t target);
+  void Update(bool taken);
+
+ private:
+  struct TaggedEntry {
+    uint16_t tag = 0;
+    // Signed three-bit counter; taken when non-negative.
+    int8_t counter = 0;
+    uint8_t useful = 0;
+  };
+  // The tagged tables' view of the branch being predicted.
+  struct TageLookup {
+    std::array<uint32_t, constants::kTageTables> index;
+    std::array<uint16_t, constants::kTageTables> tag;
+    // Longest matching table and the prediction below it, if any.
+    int provider = -1;
+    int alternate = -1;
+    bool provider_taken = false;
+    bool alternate_taken = false;
+  };
+
+  static uint32_t Fold(uint64_t history, uint32_t length, uint32_t bits);
+  uint32_t PatternIndex(uint32_t pc) const;
+  bool PredictTage(uint32_t pc);
+  void UpdateTage(bool taken);
+
+  PredictorConfig config_;
+  // Two-bit saturating counters; taken from 2.
+  std::vector<uint8_t> counters_;
+  std::array<std::vector<TaggedEntry>, constants::kTageTables> tagged_;
+  uint32_t tagged_bits_ = 0;
+  uint64_t history_ = 0;
+  uint32_t pattern_index_ = 0;
+  bool predicted_ = false;
+  TageLookup lookup_;
+  uint64_t updates_ = 0;
+};
+
+}  // namespace riscv_emu::bpred
+
+#endif  // LIB_BPRED_PREDICTOR_H
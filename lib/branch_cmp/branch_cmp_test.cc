@@ -0,0 +1,33 @@
+#include "branch_cmp.h"
+#include "gtest/gtest.h"
+
+namespace riscv_emu::branch {
+
+namespace {
+
+TEST(BranchCompTest, SignedComparesTwosComplement) {
+  const ComparisonResult neg_vs_pos = DoBranchComp(/*is_unsigned=*/false, 0xffffffff, 1);
+  EXPECT_FALSE(neg_vs_pos.branch_eq_);
+  EXPECT_TRUE(neg_vs_pos.branch_lt_);
+  EXPECT_FALSE(DoBranchComp(/*is_unsigned=*/false, 1, 0xffffffff).branch_lt_);
+  EXPECT_TRUE(DoBranchComp(/*is_unsigned=*/false, 0x80000000, 0x7fffffff).branch_lt_);
+}
+
+TEST(BranchCompTest, UnsignedComparesMagnitude) {
+  const ComparisonResult big_vs_small = DoBranchComp(/*is_unsigned=*/true, 0xffffffff, 1);
+  EXPECT_FALSE(big_vs_small.branch_eq_);
+  EXPECT_FALSE(big_vs_small.branch_lt_);
+  EXPECT_TRUE(DoBranchComp(/*is_unsigned=*/true, 0x7fffffff, 0x80000000).branch_lt_);
+}
+
+TEST(BranchCompTest, EqualIsNeverLess) {
+  for (const bool is_unsigned : {false, true}) {
+    const ComparisonResult result = DoBranchComp(is_unsigned, 0x80000000, 0x80000000);
+    EXPECT_TRUE(result.branch_eq_);
+    EXPECT_FALSE(result.branch_lt_);
+  }
+}
+
+}  // namespace
+
+}  // namespace riscv_emu::branch
@@ -0,0 +1,192 @@
+#include "cache.h"
+#include <bit>
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "status_macros.h"
+
+namespace riscv_emu::cachesim {
+
+namespace {
+
+  absl::StatusOr<uint32_t> ParseSize(absl::string_view text) {
+    uint32_t scale = 1;
+    if (!text.empty() && absl::ascii_tolower(text.back()) == 'k') {
+      scale = 1 << 10;
+      text.remove_suffix(1);
+    } else if (!text.empty() && absl::ascii_tolower(text.back()) == 'm') {
+      scale = 1 << 20;
+      text.remove_suffix(1);
+    }
+    uint32_t value = 0;
+    if (!absl::SimpleAtoi(text, &value) || value > UINT32_MAX / scale) {
+      return absl::InvalidArgumentError(absl::StrCat("Bad size ", text));
+    }
+    return value * scale;
+  }
+
+}  // namespace
+
+absl::Status Validate(const CacheConfig& config) {
+  if (!std::has_single_bit(config.size_bytes) || !std::has_single_bit(config.ways) ||
+      !std::has_single_bit(config.line_bytes)) {
+    return absl::InvalidArgumentError("Cache sizes must be powers of two");
+  }
+  if (config.ways > constants::kMaxWays) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Caches have at most ", constants::kMaxWays, " ways"));
+  }
+  if (config.line_bytes < sizeof(uint32_t) ||
+      config.size_bytes < uint64_t{config.ways} * config.line_bytes) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("A ", config.size_bytes, " byte cache cannot hold ", config.ways, " ways of ",
+                     config.line_bytes, " byte lines"));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<CacheConfig> ParseCacheConfig(const absl::string_view spec) {
+  const std::vector<absl::string_view> fields = absl::StrSplit(spec, ':');
+  if (fields.size() < 3) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expected <size>:<ways>:<line bytes>, got ", spec));
+  }
+  CacheConfig config;
+  ASSIGN_OR_RETURN(config.size_bytes, ParseSize(fields[0]));
+  if (!absl::SimpleAtoi(fields[1], &config.ways) ||
+      !absl::SimpleAtoi(fields[2], &config.line_bytes)) {
+    return absl::InvalidArgumentError(absl::StrCat("Bad cache geometry ", spec));
+  }
+  for (size_t i = 3; i < fields.size(); ++i) {
+    if (fields[i] == "plru") {
+      config.replacement = Replacement::kPlru;
+    } else if (fields[i] == "lru") {
+      config.replacement = Replacement::kLru;
+    } else if (fields[i] == "wt") {
+      config.write_back = false;
+    } else if (fields[i] == "nwa") {
+      config.write_allocate = false;
+    } else {
+      return absl::InvalidArgumentError(absl::StrCat("Unknown cache option ", fields[i]));
+    }
+  }
+  RETURN_IF_ERROR(Validate(config));
+  return config;
+}
+
+std::string FormatCacheConfig(const CacheConfig& config) {
+  return absl::StrFormat("%dk %d-way %dB lines, %s, %s, %s", config.size_bytes >> 10,
+                         config.ways, config.line_bytes,
+                         config.replacement == Replacement::kPlru ? "plru" : "lru",
+                         config.write_back ? "write-back" : "write-through",
+                         config.write_allocate ? "write-allocate" : "no-write-allocate");
+}
+
+Cache::Cache(const CacheConfig& config)
+    : config_(config), line_shift_(std::countr_zero(config.line_bytes)),
+      set_mask_(config.size_bytes / config.line_bytes / config.ways - 1),
+      tags_(config.size_bytes / config.line_bytes, kEmpty),
+      dirty_(config.size_bytes / config.line_bytes, 0) {
+  if (config.replacement == Replacement::kLru) {
+    last_use_.resize(tags_.size(), 0);
+  } else {
+    trees_.resize(set_mask_ + 1, 0);
+  }
+}
+
+uint32_t Cache::Match(const uint32_t* tags, const uint32_t line) const {
+  // Branch-free, so the compiler compares all ways at once.
+  uint32_t match = 0;
+  for (uint32_t way = 0; way < config_.ways; ++way) {
+    match |= static_cast<uint32_t>(tags[way] == line) << way;
+  }
+  return match;
+}
+
+uint32_t Cache::Victim(const uint32_t set, const uint32_t* tags) const {
+  if (config_.replacement == Replacement::kLru) {
+    // Empty ways were never used, so they go first.
+    const uint64_t* last_use = &last_use_[set * config_.ways];
+    uint32_t victim = 0;
+    for (uint32_t way = 1; way < config_.ways; ++way) {
+      victim = last_use[way] < last_use[victim] ? way : victim;
+    }
+    return victim;
+  }
+  if (const uint32_t empty = Match(tags, kEmpty); empty != 0) {
+    return std::countr_zero(empty);
+  }
+  // Follow the tree bits, which point away from recent uses.
+  const uint32_t tree = trees_[set];
+  uint32_t node = 1;
+  while (node < config_.ways) {
+    node = 2 * node + ((tree >> node) & 1);
+  }
+  return node - config_.ways;
+}
+
+void Cache::Touch(const uint32_t set, const uint32_t way) {
+  if (config_.replacement == Replacement::kLru) {
+    last_use_[set * config_.ways + way] = ++now_;
+    return;
+  }
+  uint32_t& tree = trees_[set];
+  uint32_t node = way + config_.ways;
+  while (node > 1) {
+    const uint32_t parent = node / 2;
+    // Point the parent at the other half.
+    tree = (tree & ~(1U << parent)) | ((~node & 1) << parent);
+    node = parent;
+  }
+}
+
+Cache::Result Cache::Access(const uint32_t paddr, const bool is_write) {
+  const uint32_t line = paddr >> line_shift_;
+  const uint32_t set = line & set_mask_;
+  uint32_t* tags = &tags_[set * config_.ways];
+  Result result;
+  if (is_write) {
+    ++stats_.writes;
+  } else {
+    ++stats_.reads;
+  }
+
+  uint32_t way = 0;
+  if (const uint32_t match = Match(tags, line); match != 0) {
+    result.hit = true;
+    way = std::countr_zero(match);
+  } else {
+    if (is_write) {
+      ++stats_.write_misses;
+    } else {
+      ++stats_.read_misses;
+    }
+    if (is_write && !config_.write_allocate) {
+      result.write_through = true;
+      return result;
+    }
+    way = Victim(set, tags);
+    uint8_t& dirty = dirty_[set * config_.ways + way];
+    if (tags[way] != kEmpty && dirty) {
+      ++stats_.writebacks;
+      result.writeback = true;
+      result.writeback_paddr = tags[way] << line_shift_;
+    }
+    tags[way] = line;
+    dirty = 0;
+    result.fill = true;
+  }
+  Touch(set, way);
+  if (is_write) {
+    if (config_.write_back) {
+      dirty_[set * config_.ways + way] = 1;
+    } else {
+      result.write_through = true;
+    }
+  }
+  return result;
+}
+
+}  // namespace riscv_emu::cachesim
@@ -0,0 +1,101 @@
+#ifndef LIB_CACHESIM_CACHE_H
+#define LIB_CACHESIM_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace riscv_emu::cachesim {
+
+namespace constants {
+  // Hit and victim masks hold a bit per way.
+  constexpr uint32_t kMaxWays = 32;
+}  // namespace constants
+
+enum class Replacement {
+  kLru,
+  // Tree pseudo-LRU, as most hardware implements it.
+  kPlru,
+};
+
+struct CacheConfig {
+  uint32_t size_bytes = 32 * 1024;
+  uint32_t ways = 8;
+  uint32_t line_bytes = 64;
+  Replacement replacement = Replacement::kLru;
+  // Writes stay in the cache until their line is evicted; otherwise they
+  // are passed on to the next level at once.
+  bool write_back = true;
+  // Write misses load the line; otherwise they only go to the next level.
+  bool write_allocate = true;
+};
+
+// Sizes must be powers of two, with at least one set.
+absl::Status Validate(const CacheConfig& config);
+// Parses "<size>:<ways>:<line bytes>" with a k or m suffix allowed on the
+// size, e.g. "32k:8:64", optionally followed by ":plru", ":wt" (write
+// through) and ":nwa" (no write allocate).
+absl::StatusOr<CacheConfig> ParseCacheConfig(absl::string_view spec);
+std::string FormatCacheConfig(const CacheConfig& config);
+
+struct CacheStats {
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+  uint64_t read_misses = 0;
+  uint64_t write_misses = 0;
+  // Dirty lines written to the next level on eviction.
+  uint64_t writebacks = 0;
+};
+
+// One set-associative level, indexed and tagged by physical address. Only
+// tags are modelled; the data lives in RAM as usual.
+class Cache final {
+ public:
+  // What an access needs from the next level.
+  struct Result {
+    bool hit = false;
+    // The line is loaded from the next level.
+    bool fill = false;
+    // The write itself goes to the next level.
+    bool write_through = false;
+    // A dirty line was evicted and must be written back.
+    bool writeback = false;
+    uint32_t writeback_paddr = 0;
+  };
+
+  // `config` must be valid.
+  explicit Cache(const CacheConfig& config);
+  Result Access(uint32_t paddr, bool is_write);
+  inline uint32_t GetLineShift() const { return line_shift_; }
+  inline const CacheConfig& GetConfig() const { return config_; }
+  inline const CacheStats& GetStats() const { return stats_; }
+
+ private:
+  // Never a line number, so empty ways need no valid bit.
+  static constexpr uint32_t kEmpty = ~0U;
+
+  // Bit per way of the set holding `line`.
+  uint32_t Match(const uint32_t* tags, uint32_t line) const;
+  uint32_t Victim(uint32_t set, const uint32_t* tags) const;
+  void Touch(uint32_t set, uint32_t way);
+
+  CacheConfig config_;
+  uint32_t line_shift_;
+  uint32_t set_mask_;
+  // Per set, `ways` consecutive entries, so the ways of a set are compared
+  // in one vectorized loop.
+  std::vector<uint32_t> tags_;
+  std::vector<uint8_t> dirty_;
+  // LRU: last use of each way. PLRU: one tree of way - 1 bits per set.
+  std::vector<uint64_t> last_use_;
+  std::vector<uint32_t> trees_;
+  uint64_t now_ = 0;
+  CacheStats stats_;
+};
+
+}  // namespace riscv_emu::cachesim
+
+#endif  // LIB_CACHESIM_CACHE_H
@@ -0,0 +1,134 @@
+#include "hierarchy.h"
+#include <algorithm>
+#include <bit>
+#include <utility>
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "lib/memory/dram.h"
+
+namespace riscv_emu::cachesim {
+
+namespace {
+
+  double Percent(const uint64_t part, const uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * part / whole;
+  }
+
+  std::string FormatLevel(const absl::string_view name, const Cache& cache) {
+    const CacheStats& stats = cache.GetStats();
+    const uint64_t accesses = stats.reads + stats.writes;
+    const uint64_t misses = stats.read_misses + stats.write_misses;
+    return absl::StrFormat(
+        "%s (%s): reads %d, writes %d, misses %d (%.2f%%), read misses %d, write misses %d, "
+        "writebacks %d",
+        name, FormatCacheConfig(cache.GetConfig()), stats.reads, stats.writes, misses,
+        Percent(misses, accesses), stats.read_misses, stats.write_misses, stats.writebacks);
+  }
+
+}  // namespace
+
+Hierarchy::Hierarchy(const HierarchyConfig& config)
+    : l1i_(config.l1i), l1d_(config.l1d), l2_(config.l2),
+      fetch_line_shift_(l1i_.GetLineShift()),
+      region_shift_(std::countr_zero(config.region_bytes)),
+      regions_((memory::constants::kDramSize + config.region_bytes - 1) / config.region_bytes) {}
+
+bool Hierarchy::AccessL2(const Cache::Result& l1, const uint32_t paddr) {
+  if (l1.writeback) {
+    AccessMemory(l2_.Access(l1.writeback_paddr, /*is_write=*/true));
+  }
+  bool missed = false;
+  if (l1.fill) {
+    const Cache::Result l2 = l2_.Access(paddr, /*is_write=*/false);
+    missed = !l2.hit;
+    AccessMemory(l2);
+  }
+  if (l1.write_through) {
+    const Cache::Result l2 = l2_.Access(paddr, /*is_write=*/true);
+    missed |= !l2.hit;
+    AccessMemory(l2);
+  }
+  return missed;
+}
+
+void Hierarchy::AccessMemory(const Cache::Result& l2) {
+  memory_reads_ += l2.fill;
+  memory_writes_ += l2.writeback + l2.write_through;
+}
+
+void Hierarchy::Flush() {
+  for (size_t i = 0; i < batched_; ++i) {
+    const Pending& access = batch_[i];
+    PcStats& pc = pcs_[access.pc];
+    if (access.kind == Kind::kFetch) {
+      const Cache::Result l1 = l1i_.Access(access.paddr, /*is_write=*/false);
+      ++pc.fetches;
+      if (!l1.hit) {
+        ++pc.fetch_misses;
+        pc.l2_misses += AccessL2(l1, access.paddr);
+      }
+      continue;
+    }
+    const Cache::Result l1 = l1d_.Access(access.paddr, access.kind == Kind::kStore);
+    const bool l2_missed = AccessL2(l1, access.paddr);
+    ++pc.data_accesses;
+    pc.data_misses += !l1.hit;
+    pc.l2_misses += l2_missed;
+    const uint32_t index = access.paddr >> region_shift_;
+    if (index < regions_.size()) {
+      RegionStats& region = regions_[index];
+      ++region.accesses;
+      region.l1_misses += !l1.hit;
+      region.l2_misses += l2_missed;
+    }
+  }
+  batched_ = 0;
+}
+
+std::string Hierarchy::FormatReport(const size_t top) {
+  Flush();
+  std::string report = absl::StrCat(FormatLevel("l1i", l1i_), "\n", FormatLevel("l1d", l1d_),
+                                    "\n", FormatLevel("l2", l2_), "\n");
+  absl::StrAppendFormat(&report, "memory: line reads %d, writes %d\n", memory_reads_,
+                        memory_writes_);
+
+  std::vector<std::pair<uint32_t, PcStats>> pcs(pcs_.begin(), pcs_.end());
+  const auto misses = [](const PcStats& stats) {
+    return stats.fetch_misses + stats.data_misses;
+  };
+  std::sort(pcs.begin(), pcs.end(), [&](const auto& a, const auto& b) {
+    return misses(a.second) != misses(b.second) ? misses(a.second) > misses(b.second)
+                                                : a.first < b.first;
+  });
+  absl::StrAppend(&report, "pcs by L1 misses:\n");
+  for (size_t i = 0; i < std::min(top, pcs.size()) && misses(pcs[i].second) > 0; ++i) {
+    const auto& [pc, stats] = pcs[i];
+    absl::StrAppendFormat(&report,
+                          "  0x%08x: fetches %d, fetch misses %d, data %d, data misses %d, "
+                          "l2 misses %d\n",
+                          pc, stats.fetches, stats.fetch_misses, stats.data_accesses,
+                          stats.data_misses, stats.l2_misses);
+  }
+
+  std::vector<uint32_t> regions;
+  for (uint32_t i = 0; i < regions_.size(); ++i) {
+    if (regions_[i].l1_misses > 0) {
+      regions.push_back(i);
+    }
+  }
+  std::sort(regions.begin(), regions.end(), [&](const uint32_t a, const uint32_t b) {
+    return regions_[a].l1_misses != regions_[b].l1_misses
+               ? regions_[a].l1_misses > regions_[b].l1_misses
+               : a < b;
+  });
+  absl::StrAppend(&report, "data regions by L1 misses:\n");
+  for (size_t i = 0; i < std::min(top, regions.size()); ++i) {
+    const RegionStats& stats = regions_[regions[i]];
+    absl::StrAppendFormat(&report, "  0x%08x: accesses %d, l1 misses %d (%.2f%%), l2 misses %d\n",
+                          regions[i] << region_shift_, stats.accesses, stats.l1_misses,
+                          Percent(stats.l1_misses, stats.accesses), stats.l2_misses);
+  }
+  return report;
+}
+
+}  // namespace riscv_emu::cachesim
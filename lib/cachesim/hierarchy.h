@@ -0,0 +1,115 @@
+#ifndef LIB_CACHESIM_HIERARCHY_H
+#define LIB_CACHESIM_HIERARCHY_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "absl/container/flat_hash_map.h"
+#include "lib/cachesim/cache.h"
+
+namespace riscv_emu::cachesim {
+
+namespace constants {
+  // Accesses buffered before they are simulated.
+  constexpr size_t kBatchSize = 4096;
+  constexpr uint32_t kDefaultRegionBytes = 4096;
+}  // namespace constants
+
+struct HierarchyConfig {
+  CacheConfig l1i;
+  CacheConfig l1d;
+  CacheConfig l2 = {.size_bytes = 256 * 1024, .ways = 16};
+  // Data accesses are also counted per region of RAM this large; a power
+  // of two.
+  uint32_t region_bytes = constants::kDefaultRegionBytes;
+};
+
+// Counts attributed to the instruction that made the accesses.
+struct PcStats {
+  uint64_t fetches = 0;
+  uint64_t fetch_misses = 0;
+  uint64_t data_accesses = 0;
+  uint64_t data_misses = 0;
+  // Misses of either kind that also missed in L2.
+  uint64_t l2_misses = 0;
+};
+
+struct RegionStats {
+  uint64_t accesses = 0;
+  uint64_t l1_misses = 0;
+  uint64_t l2_misses = 0;
+};
+
+// Split L1 instruction and data caches over a unified L2, fed with the
+// hart's RAM accesses. Accesses are buffered and simulated in batches, so
+// the hart only pays for a store into the buffer.
+//
+// Instruction fetches are modelled per line, as through a fetch buffer:
+// fetches from the line fetched last are not cache accesses. Page table
+// walks and device DMA are not modelled.
+class Hierarchy final {
+ public:
+  // `config` must be valid.
+  explicit Hierarchy(const HierarchyConfig& config);
+  // The instruction at `pc` was fetched from `paddr`.
+  inline void Fetch(const uint32_t pc, const uint32_t paddr) {
+    const uint32_t line = paddr >> fetch_line_shift_;
+    if (line != last_fetch_line_) {
+      last_fetch_line_ = line;
+      Push({pc, paddr, Kind::kFetch});
+    }
+  }
+  // The instruction at `pc` loaded from or stored to `paddr`, in RAM.
+  inline void Data(const uint32_t pc, const uint32_t paddr, const bool is_store) {
+    Push({pc, paddr, is_store ? Kind::kStore : Kind::kLoad});
+  }
+  // Simulates the buffered accesses; stats are only current after this.
+  void Flush();
+
+  inline const Cache& GetL1i() const { return l1i_; }
+  inline const Cache& GetL1d() const { return l1d_; }
+  inline const Cache& GetL2() const { return l2_; }
+  // Lines read from and written to RAM by L2.
+  inline uint64_t GetMemoryReads() const { return memory_reads_; }
+  inline uint64_t GetMemoryWrites() const { return memory_writes_; }
+  inline const absl::flat_hash_map<uint32_t, PcStats>& GetPcStats() const { return pcs_; }
+  inline const std::vector<RegionStats>& GetRegionStats() const { return regions_; }
+  // Totals per level, then the `top` pcs and regions with the most misses.
+  std::string FormatReport(size_t top);
+
+ private:
+  enum class Kind : uint8_t { kFetch, kLoad, kStore };
+  struct Pending {
+    uint32_t pc;
+    uint32_t paddr;
+    Kind kind;
+  };
+  inline void Push(const Pending& access) {
+    batch_[batched_++] = access;
+    if (batched_ == batch_.size()) {
+      Flush();
+    }
+  }
+  // Passes what an L1 access needs on to L2. Returns whether the access
+  // itself missed there.
+  bool AccessL2(const Cache::Result& l1, uint32_t paddr);
+  void AccessMemory(const Cache::Result& l2);
+
+  Cache l1i_;
+  Cache l1d_;
+  Cache l2_;
+  uint32_t fetch_line_shift_;
+  uint32_t last_fetch_line_ = ~0U;
+  uint32_t region_shift_;
+  std::array<Pending, constants::kBatchSize> batch_;
+  size_t batched_ = 0;
+  uint64_t memory_reads_ = 0;
+  uint64_t memory_writes_ = 0;
+  absl::flat_hash_map<uint32_t, PcStats> pcs_;
+  std::vector<RegionStats> regions_;
+};
+
+}  // namespace riscv_emu::cachesim
+
+#endif  // LIB_CACHESIM_HIERARCHY_H
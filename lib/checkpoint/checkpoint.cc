@@ -0,0 +1,207 @@
+#include "checkpoint.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <random>
+#include <unistd.h>
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "lib/checkpoint/state.h"
+#include "status_macros.h"
+
+namespace riscv_emu::checkpoint {
+
+namespace {
+
+  constexpr uint32_t kRamPages = memory::constants::kDramSize / constants::kPageSize;
+  // Magic through base path length.
+  constexpr size_t kHeaderBytes = 44;
+  constexpr size_t kPageEntryBytes = 8;
+
+  bool IsZeroPage(const uint8_t* page) {
+    return page[0] == 0 && std::memcmp(page, page + 1, constants::kPageSize - 1) == 0;
+  }
+
+  absl::Status ReadAt(const int fd, const uint64_t offset, const size_t len, std::string& out) {
+    out.resize(len);
+    size_t done = 0;
+    while (done < len) {
+      const ssize_t n = pread(fd, out.data() + done, len - done, offset + done);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return absl::DataLossError("Truncated checkpoint");
+      }
+      done += n;
+    }
+    return absl::OkStatus();
+  }
+
+}  // namespace
+
+absl::StatusOr<uint64_t> Checkpoint::Write(const absl::string_view path,
+                                           const absl::string_view state, memory::Dram& dram,
+                                           const std::optional<Base>& base,
+                                           const std::vector<uint32_t>& pages) {
+  ASSIGN_OR_RETURN(const uint8_t* ram, dram.GetHostPtr(0, memory::constants::kDramSize));
+  // (RAM page, stored) in RAM order; unstored pages are zero.
+  std::vector<std::pair<uint32_t, bool>> entries;
+  if (base.has_value()) {
+    std::vector<uint32_t> sorted = pages;
+    std::sort(sorted.begin(), sorted.end());
+    for (const uint32_t page : sorted) {
+      entries.push_back({page, !IsZeroPage(ram + page * constants::kPageSize)});
+    }
+  } else {
+    for (uint32_t page = 0; page < kRamPages; ++page) {
+      if (!IsZeroPage(ram + page * constants::kPageSize)) {
+        entries.push_back({page, true});
+      }
+    }
+  }
+
+  std::random_device random;
+  uint64_t id = 0;
+  while (id == 0) {
+    id = (static_cast<uint64_t>(random()) << 32) | random();
+  }
+  const std::string base_path = base.has_value() ? base->path : "";
+  const size_t meta_bytes =
+      kHeaderBytes + base_path.size() + state.size() + entries.size() * kPageEntryBytes;
+  const uint32_t first_data_page = (meta_bytes + constants::kPageSize - 1) / constants::kPageSize;
+
+  StateWriter meta;
+  meta.Bytes(absl::string_view(constants::kMagic, sizeof(constants::kMagic)));
+  meta.U32(constants::kVersion);
+  meta.U64(id);
+  meta.U64(base.has_value() ? base->id : 0);
+  meta.U32(memory::constants::kDramSize);
+  meta.U32(entries.size());
+  meta.U64(state.size());
+  meta.U32(base_path.size());
+  meta.Bytes(base_path);
+  meta.Bytes(state);
+  uint32_t file_page = first_data_page;
+  for (const auto& [page, stored] : entries) {
+    meta.U32(page);
+    meta.U32(stored ? file_page++ : 0);
+  }
+  std::string header = meta.GetData();
+  header.resize(first_data_page * constants::kPageSize, '\0');
+
+  std::ofstream out(std::string(path), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to create ", path));
+  }
+  out.write(header.data(), static_cast<std::streamsize>(header.size()));
+  for (const auto& [page, stored] : entries) {
+    if (stored) {
+      out.write(reinterpret_cast<const char*>(ram + page * constants::kPageSize),
+                constants::kPageSize);
+    }
+  }
+  out.close();
+  if (out.fail()) {
+    return absl::DataLossError(absl::StrCat("Failed to write ", path));
+  }
+  VLOG(1) << "Checkpoint " << path << ": " << entries.size() << " pages, "
+          << file_page - first_data_page << " stored";
+  return id;
+}
+
+absl::StatusOr<Checkpoint> Checkpoint::Open(const absl::string_view path) {
+  const int fd = open(std::string(path).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return absl::NotFoundError(absl::StrCat("Failed to open ", path));
+  }
+  Checkpoint checkpoint(fd);
+
+  std::string header;
+  RETURN_IF_ERROR(ReadAt(fd, 0, kHeaderBytes, header));
+  StateReader in(header);
+  const absl::string_view magic = in.Bytes(sizeof(constants::kMagic));
+  if (magic != absl::string_view(constants::kMagic, sizeof(constants::kMagic)) ||
+      in.U32() != constants::kVersion) {
+    return absl::InvalidArgumentError(absl::StrCat(path, " is not a version ",
+                                                   constants::kVersion, " checkpoint"));
+  }
+  checkpoint.id_ = in.U64();
+  const uint64_t base_id = in.U64();
+  const uint32_t ram_size = in.U32();
+  const uint32_t page_count = in.U32();
+  const uint64_t state_len = in.U64();
+  const uint32_t base_path_len = in.U32();
+  if (ram_size != memory::constants::kDramSize) {
+    return absl::FailedPreconditionError(
+        absl::StrCat(path, " was saved with ", ram_size, " bytes of RAM"));
+  }
+  if (page_count > kRamPages || state_len > (uint64_t{1} << 32)) {
+    return absl::DataLossError(absl::StrCat(path, " is corrupt"));
+  }
+
+  std::string meta;
+  RETURN_IF_ERROR(ReadAt(fd, kHeaderBytes,
+                         base_path_len + state_len + page_count * kPageEntryBytes, meta));
+  in = StateReader(meta);
+  const absl::string_view base_path = in.Bytes(base_path_len);
+  if (base_id != 0) {
+    checkpoint.base_ = Base{base_id, std::string(base_path)};
+  }
+  checkpoint.state_ = std::string(in.Bytes(state_len));
+  for (uint32_t i = 0; i < page_count; ++i) {
+    const uint32_t page = in.U32();
+    const uint32_t file_page = in.U32();
+    const bool ascending = checkpoint.pages_.empty() || page > checkpoint.pages_.back().first;
+    if (page >= kRamPages || !ascending) {
+      return absl::DataLossError(absl::StrCat(path, " has a corrupt page table"));
+    }
+    checkpoint.pages_.push_back({page, file_page});
+  }
+  RETURN_IF_ERROR(in.GetStatus());
+  return checkpoint;
+}
+
+Checkpoint::Checkpoint(Checkpoint&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)), id_(other.id_), base_(std::move(other.base_)),
+      state_(std::move(other.state_)), pages_(std::move(other.pages_)) {}
+
+Checkpoint::~Checkpoint() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+absl::Status Checkpoint::MapPages(memory::Dram& dram) const {
+  uint32_t next_page = 0;
+  for (size_t i = 0; i < pages_.size();) {
+    const auto [page, file_page] = pages_[i];
+    if (!base_.has_value() && page > next_page) {
+      RETURN_IF_ERROR(dram.ZeroPages(next_page * constants::kPageSize,
+                                     (page - next_page) * constants::kPageSize));
+    }
+    // Map runs of consecutive pages in one call.
+    uint32_t run = 1;
+    while (i + run < pages_.size() && pages_[i + run].first == page + run &&
+           pages_[i + run].second == (file_page == 0 ? 0 : file_page + run)) {
+      ++run;
+    }
+    if (file_page == 0) {
+      RETURN_IF_ERROR(dram.ZeroPages(page * constants::kPageSize, run * constants::kPageSize));
+    } else {
+      RETURN_IF_ERROR(dram.MapFile(page * constants::kPageSize, run * constants::kPageSize, fd_,
+                                   file_page * constants::kPageSize));
+    }
+    i += run;
+    next_page = page + run;
+  }
+  if (!base_.has_value() && next_page < kRamPages) {
+    RETURN_IF_ERROR(dram.ZeroPages(next_page * constants::kPageSize,
+                                   (kRamPages - next_page) * constants::kPageSize));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace riscv_emu::checkpoint
@@ -0,0 +1,76 @@
+#ifndef LIB_CHECKPOINT_CHECKPOINT_H
+#define LIB_CHECKPOINT_CHECKPOINT_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "lib/memory/dram.h"
+
+namespace riscv_emu::checkpoint {
+
+namespace constants {
+  constexpr char kMagic[4] = {'R', 'V', 'C', 'K'};
+  constexpr uint32_t kVersion = 4;
+  constexpr uint64_t kPageSize = uint64_t{1} << memory::constants::kPageShift;
+}  // namespace constants
+
+// A saved machine: the state of the hart and devices, as encoded by the
+// CPU, plus RAM pages. Pages are stored page-aligned so a restore maps
+// them copy-on-write instead of reading them, which keeps restores at a
+// few milliseconds whatever the RAM size.
+//
+// A full checkpoint stores every nonzero page; the rest are zero. An
+// incremental one names a base checkpoint and stores only the pages
+// written since that base was saved or restored, zero or not. Restoring
+// it restores the base first. Either way the file carries the complete
+// hart and device state.
+//
+// Layout, little-endian: magic, version, id, base id (0 for none), RAM
+// size, page count, state length, base path length, then the base path,
+// the state and the page table. The page table holds (RAM page, file
+// page) pairs, file page 0 meaning a zero page. Page data follows from
+// the next page boundary.
+class Checkpoint final {
+ public:
+  struct Base {
+    uint64_t id = 0;
+    std::string path;
+  };
+
+  // Writes `state` and RAM to `path` and returns the new checkpoint's id.
+  // With a `base`, only the RAM pages in `pages` are stored.
+  static absl::StatusOr<uint64_t> Write(absl::string_view path, absl::string_view state,
+                                        memory::Dram& dram, const std::optional<Base>& base,
+                                        const std::vector<uint32_t>& pages);
+  static absl::StatusOr<Checkpoint> Open(absl::string_view path);
+  Checkpoint(Checkpoint&& other) noexcept;
+  Checkpoint& operator=(Checkpoint&& other) = delete;
+  ~Checkpoint();
+
+  inline uint64_t GetId() const { return id_; }
+  inline const std::optional<Base>& GetBase() const { return base_; }
+  inline absl::string_view GetState() const { return state_; }
+  // Maps the stored pages into `dram`. A full checkpoint also zeroes every
+  // page it does not store; an incremental one leaves them to its base.
+  // The file must not change while the mapping is in use.
+  absl::Status MapPages(memory::Dram& dram) const;
+
+ private:
+  explicit Checkpoint(int fd) : fd_(fd) {}
+
+  int fd_;
+  uint64_t id_ = 0;
+  std::optional<Base> base_;
+  std::string state_;
+  // (RAM page, file page), ascending by RAM page.
+  std::vector<std::pair<uint32_t, uint32_t>> pages_;
+};
+
+}  // namespace riscv_emu::checkpoint
+
+#endif  // LIB_CHECKPOINT_CHECKPOINT_H
@@ -0,0 +1,53 @@
+#include "state.h"
+
+namespace riscv_emu::checkpoint {
+
+void StateWriter::U8(const uint8_t val) { Put(val, sizeof(val)); }
+void StateWriter::U16(const uint16_t val) { Put(val, sizeof(val)); }
+void StateWriter::U32(const uint32_t val) { Put(val, sizeof(val)); }
+void StateWriter::U64(const uint64_t val) { Put(val, sizeof(val)); }
+
+void StateWriter::Put(const uint64_t val, const size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    data_.push_back(static_cast<char>(val >> (8 * i)));
+  }
+}
+
+uint8_t StateReader::U8() { return Get(sizeof(uint8_t)); }
+uint16_t StateReader::U16() { return Get(sizeof(uint16_t)); }
+uint32_t StateReader::U32() { return Get(sizeof(uint32_t)); }
+uint64_t StateReader::U64() { return Get(sizeof(uint64_t)); }
+
+absl::string_view StateReader::Bytes(const size_t len) {
+  if (data_.size() < len) {
+    truncated_ = true;
+    data_ = absl::string_view();
+    return data_;
+  }
+  const absl::string_view bytes = data_.substr(0, len);
+  data_.remove_prefix(len);
+  return bytes;
+}
+
+uint64_t StateReader::Get(const size_t bytes) {
+  if (data_.size() < bytes) {
+    truncated_ = true;
+    data_ = absl::string_view();
+    return 0;
+  }
+  uint64_t val = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    val |= static_cast<uint64_t>(static_cast<uint8_t>(data_[i])) << (8 * i);
+  }
+  data_.remove_prefix(bytes);
+  return val;
+}
+
+absl::Status StateReader::GetStatus() const {
+  if (truncated_) {
+    return absl::DataLossError("Truncated checkpoint state");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace riscv_emu::checkpoint
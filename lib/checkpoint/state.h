@@ -0,0 +1,53 @@
+#ifndef LIB_CHECKPOINT_STATE_H
+#define LIB_CHECKPOINT_STATE_H
+
+#include <cstdint>
+#include <string>
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+
+namespace riscv_emu::checkpoint {
+
+// Little-endian encoding of machine state. Each component writes its
+// fields in a fixed order and reads them back in the same order; the
+// checkpoint version covers the layout.
+class StateWriter final {
+ public:
+  void U8(uint8_t val);
+  void U16(uint16_t val);
+  void U32(uint32_t val);
+  void U64(uint64_t val);
+  inline void Bool(const bool val) { U8(val ? 1 : 0); }
+  inline void Bytes(const absl::string_view bytes) { data_.append(bytes.data(), bytes.size()); }
+  inline const std::string& GetData() const { return data_; }
+
+ private:
+  void Put(uint64_t val, size_t bytes);
+
+  std::string data_;
+};
+
+// Reads past the end return 0 and are reported by `GetStatus`, so a
+// component can read all of its fields and check once.
+class StateReader final {
+ public:
+  explicit StateReader(absl::string_view data) : data_(data) {}
+  uint8_t U8();
+  uint16_t U16();
+  uint32_t U32();
+  uint64_t U64();
+  inline bool Bool() { return U8() != 0; }
+  absl::string_view Bytes(size_t len);
+  absl::Status GetStatus() const;
+  inline bool AtEnd() const { return data_.empty(); }
+
+ private:
+  uint64_t Get(size_t bytes);
+
+  absl::string_view data_;
+  bool truncated_ = false;
+};
+
+}  // namespace riscv_emu::checkpoint
+
+#endif  // LIB_CHECKPOINT_STATE_H
@@ -1,10 +1,14 @@
 #include "cpu.h"
 #include "status_macros.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "absl/status/statusor.h"
 #include "lib/logic/wire.h"
 #include "lib/branch_cmp/branch_cmp.h"
+#include "lib/loader/elf.h"
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 namespace riscv_emu {
 
@@ -27,6 +31,18 @@ namespace riscv_emu {
       return absl::OkStatus();
     }
 
+    uint32_t AccessSize(const memory::AccessType type) {
+      switch (type) {
+       case memory::AccessType::kHalfword:
+       case memory::AccessType::kHalfwordUnsigned:
+        return sizeof(uint16_t);
+       case memory::AccessType::kWord:
+        return sizeof(uint32_t);
+       default:
+        return sizeof(uint8_t);
+      }
+    }
+
     void PrintRegisters(uint32_t registers[32]) {
       VLOG(1) << "Register debug info:";
       for (int i = 0; i < 32; ++i) {
@@ -42,27 +58,156 @@ namespace riscv_emu {
 
   }  // namespace
 
-absl::Status Cpu::Fetch() {
+Cpu::Cpu(const CpuOptions options)
+    : options_(options),
+      bus_(scheduler_, clock_, [this](perfs::irq::Line line, bool level) { SetIrq(line, level); }),
+      hostcalls_(bus_.GetDram()),
+      syscalls_(bus_.GetDram(), hostcalls_),
+      mmu_(bus_.GetDram(), pmp_) {
+  hostcalls_.SetBufferMap([this](const uint32_t addr, const uint32_t len, const bool is_write) {
+    return MapGuestBuffer(addr, len, is_write);
+  });
+  if (options_.code_cache_bytes > 0) {
+    code_cache_ = std::make_unique<engine::CodeCache>(bus_.GetDram(), options_.code_cache_bytes);
+    compiler_ = std::make_unique<engine::Compiler>(options_.compile_threads,
+                                                   options_.tier_up_threshold);
+    indirect_ = std::make_unique<engine::IndirectPredictor>();
+    bus_.GetDram().SetCodeWriteListener([this](const uint64_t at_index, const uint64_t len) {
+      code_cache_->Invalidate(at_index, len);
+    });
+  }
+  if (options_.history_interval > 0) {
+    history_ = std::make_unique<history::History>(options_.history_bytes);
+    // Replays after a rewind need the host inputs again.
+    input_log_ = replay::InputLog::Journal(clock_, instret_);
+    ConnectInputLog();
+    // The first snapshot is of the machine as booted.
+    scheduler_.ScheduleBackground(clock_, [this](uint64_t) { return RecordHistory(); });
+  }
+  if (options_.cache_sim.has_value()) {
+    models_.caches = std::make_unique<cachesim::Hierarchy>(*options_.cache_sim);
+  }
+  if (options_.branch_sim.has_value()) {
+    models_.branches = std::make_unique<bpred::BranchUnit>(*options_.branch_sim);
+  }
+  if (options_.pipeline_sim.has_value()) {
+    models_.pipeline = std::make_unique<timing::Pipeline>(*options_.pipeline_sim);
+  }
+  if (options_.call_graph) {
+    models_.calls = std::make_unique<profile::CallGraph>();
+  }
+  if (options_.sampling.has_value()) {
+    sampler_ = std::make_unique<timing::Sampler>(*options_.sampling);
+    ScheduleSampling();
+  }
+}
+
+absl::Status Cpu::RecordInputs(const absl::string_view path) {
+  ASSIGN_OR_RETURN(input_log_, replay::InputLog::Record(path, clock_, instret_));
+  ConnectInputLog();
+  return absl::OkStatus();
+}
+
+absl::Status Cpu::ReplayInputs(const absl::string_view path) {
+  ASSIGN_OR_RETURN(input_log_, replay::InputLog::Replay(path, clock_, instret_));
+  ConnectInputLog();
+  return absl::OkStatus();
+}
+
+absl::Status Cpu::EnableHeatmap(const memory::HeatmapConfig& config,
+                                const absl::string_view path) {
+  ASSIGN_OR_RETURN(models_.heatmap, memory::Heatmap::Create(config, path));
+  bus_.GetDram().SetHeatmap(models_.heatmap.get());
+  ScheduleHeatmap(config.interval);
+  return absl::OkStatus();
+}
+
+void Cpu::ScheduleHeatmap(const uint64_t interval) {
+  const uint64_t at = (clock_ / interval + 1) * interval;
+  scheduler_.ScheduleBackground(at, [this, interval](const uint64_t now) {
+    ScheduleHeatmap(interval);
+    // Detached while instructions are rerun.
+    if (models_.heatmap == nullptr) {
+      return absl::OkStatus();
+    }
+    return models_.heatmap->EndWindow(now);
+  });
+}
+
+void Cpu::ConnectInputLog() {
+  if (history_ != nullptr) {
+    input_log_->KeepInputs();
+  }
+  bus_.SetInputLog(input_log_.get());
+  hostcalls_.SetInputLog(input_log_.get());
+  syscalls_.SetInputLog(input_log_.get());
+}
+
+absl::StatusOr<uint32_t> Cpu::NextPc() const {
+  if (redirect_pc_.has_value()) {
+    return *redirect_pc_;
+  }
   switch (decoder_.GetPcSel()) {
    case decoder::PcSel::kPcPlus4:
-    pc_ += 4;
-    break;
+    return pc_ + 4;
    case decoder::PcSel::kAluOut:
-    pc_ = alu_out_;
-    break;
+    return alu_out_;
    default:
     return absl::InternalError("Invalid PC select");
   }
+}
+
+void Cpu::RaiseException(const csr::Exception cause, const uint32_t tval) {
+  VLOG(2) << "Exception " << std::dec << static_cast<uint32_t>(cause) << " at 0x" << std::hex
+          << pc_;
+  redirect_pc_ = csrs_.EnterTrap(static_cast<uint32_t>(cause), tval, pc_);
+  exception_ = true;
+  if (models_.pipeline != nullptr) {
+    models_.pipeline->Trap();
+  }
+  if (models_.calls != nullptr) {
+    models_.calls->Trap(pc_, *redirect_pc_);
+  }
+}
+
+absl::Status Cpu::Fetch() {
+  ASSIGN_OR_RETURN(pc_, NextPc());
+  redirect_pc_.reset();
+  exception_ = false;
 
   VLOG(1) << "PC: 0x" << std::hex << pc_;
+  if (!memory::IsAligned(pc_, memory::AccessType::kWord)) {
+    RaiseException(csr::Exception::kInstrAddrMisaligned, pc_);
+    return absl::OkStatus();
+  }
+  const mmu::Translation fetch = mmu_.Translate(pc_, mmu::Access::kFetch, csrs_.GetPrivilege());
+  if (fetch.fault.has_value()) {
+    RaiseException(*fetch.fault, pc_);
+    return absl::OkStatus();
+  }
+  if (!pmp_.IsAllowed(fetch.paddr, sizeof(instr_), pmp::constants::kExec, csrs_.GetPrivilege())) {
+    RaiseException(csr::Exception::kInstrAccessFault, pc_);
+    return absl::OkStatus();
+  }
+  if (models_.caches != nullptr && fetch.host != nullptr) {
+    models_.caches->Fetch(pc_, fetch.paddr);
+  }
+  if (models_.heatmap != nullptr && fetch.host != nullptr) {
+    models_.heatmap->Record(fetch.paddr, memory::Access::kExecute);
+  }
+  if (fetch.host != nullptr) {
+    instr_ = memory::LoadFromHost(fetch.host, memory::AccessType::kWord);
+    VLOG(1) << "Instruction: 0x" << std::hex << instr_;
+    return absl::OkStatus();
+  }
   bus_.SetDramAccessType(memory::AccessType::kWord);
-  absl::StatusOr<uint32_t> instr = bus_.Read(pc_);
+  absl::StatusOr<uint32_t> instr = bus_.Read(fetch.paddr);
   if (!instr.ok()) {
     if (absl::IsOutOfRange(instr.status())) {
-    // TODO: Raise exception and loop PC to addr. 0x0.
-    } else {
-      return instr.status();
+      RaiseException(csr::Exception::kInstrAccessFault, pc_);
+      return absl::OkStatus();
     }
+    return instr.status();
   }
   VLOG(1) << "Instruction: 0x" << std::hex << *instr;
   instr_ = *instr;
@@ -73,12 +218,10 @@ absl::Status Cpu::Decode() {
   absl::Status decoder_status = decoder_.Decode(instr_);
   if (!decoder_status.ok()) {
     if (absl::IsInvalidArgument(decoder_status)) {
-      // TODO: Raise exception.
-      // But for now, exit.
-      return decoder_status;
-    } else {
-      return decoder_status;
+      RaiseException(csr::Exception::kIllegalInstr, instr_);
+      return absl::OkStatus();
     }
+    return decoder_status;
   }
   if(decoder_.GetESel() == decoder::ESel::kEBreak) {
     power_is_on_ = false;
@@ -130,40 +273,342 @@ absl::Status Cpu::Execute() {
   VLOG(3) << "B output: 0x" << std::hex << b_out_;
   VLOG(3) << "Alu output: 0x" << std::hex << alu_out_;
 
+  return ExecuteSystem();
+}
+
+absl::Status Cpu::ExecuteSystem() {
+  const decoder::CsrOp csr_op = decoder_.GetCsrOp();
+  const csr::Privilege priv = csrs_.GetPrivilege();
+  if (csr_op != decoder::CsrOp::kNone) {
+    const uint32_t addr = decoder_.GetCsrAddr();
+    // csrrs/csrrc with x0 (or a zero immediate) must not write.
+    const bool has_src = decoder_.GetRs1() != 0;
+    const bool writes = csr_op == decoder::CsrOp::kReadWrite || has_src;
+    // Address bits 9:8 hold the lowest privilege allowed, and 11:10 == 0b11
+    // marks a read-only CSR.
+    if (static_cast<uint32_t>(priv) < ((addr >> 8) & 0b11) || (writes && (addr >> 10) == 0b11)) {
+      RaiseException(csr::Exception::kIllegalInstr, instr_);
+      return absl::OkStatus();
+    }
+    const absl::StatusOr<uint32_t> csr_out = ReadCsr(addr);
+    if (absl::IsNotFound(csr_out.status())) {
+      RaiseException(csr::Exception::kIllegalInstr, instr_);
+      return absl::OkStatus();
+    }
+    RETURN_IF_ERROR(csr_out.status());
+    csr_out_ = *csr_out;
+    uint32_t src = decoder_.GetRs1();
+    if (!decoder_.IsCsrImm()) {
+      ASSIGN_OR_RETURN(src, GetRegister(registers_, decoder_.GetRs1()));
+    }
+    std::optional<uint32_t> csr_in;
+    switch (csr_op) {
+     case decoder::CsrOp::kReadWrite:
+      csr_in = src;
+      break;
+     case decoder::CsrOp::kReadSet:
+      if (has_src) {
+        csr_in = csr_out_ | src;
+      }
+      break;
+     case decoder::CsrOp::kReadClear:
+      if (has_src) {
+        csr_in = csr_out_ & ~src;
+      }
+      break;
+     default:
+      return absl::InternalError("Invalid CSR operation");
+    }
+    if (csr_in.has_value()) {
+      const absl::Status status = WriteCsr(addr, *csr_in);
+      if (absl::IsNotFound(status)) {
+        RaiseException(csr::Exception::kIllegalInstr, instr_);
+        return absl::OkStatus();
+      }
+      RETURN_IF_ERROR(status);
+    }
+  }
+
+  switch (decoder_.GetESel()) {
+   case decoder::ESel::kMRet:
+    if (priv != csr::Privilege::kMachine) {
+      RaiseException(csr::Exception::kIllegalInstr, instr_);
+      break;
+    }
+    redirect_pc_ = csrs_.ReturnFromTrap();
+    if (models_.calls != nullptr) {
+      models_.calls->TrapReturn();
+    }
+    RequestInterruptCheck();
+    break;
+   case decoder::ESel::kSRet:
+    if (priv == csr::Privilege::kUser) {
+      RaiseException(csr::Exception::kIllegalInstr, instr_);
+      break;
+    }
+    redirect_pc_ = csrs_.ReturnFromSupervisorTrap();
+    if (models_.calls != nullptr) {
+      models_.calls->TrapReturn();
+    }
+    RequestInterruptCheck();
+    break;
+   case decoder::ESel::kSfenceVma: {
+    if (priv == csr::Privilege::kUser) {
+      RaiseException(csr::Exception::kIllegalInstr, instr_);
+      break;
+    }
+    std::optional<uint32_t> vaddr;
+    if (decoder_.GetRs1() != 0) {
+      ASSIGN_OR_RETURN(vaddr, GetRegister(registers_, decoder_.GetRs1()));
+    }
+    mmu_.Flush(vaddr);
+    break;
+   }
+   case decoder::ESel::kFenceI:
+    bus_.GetDram().InvalidateCode();
+    break;
+   case decoder::ESel::kWfi:
+    if (!csrs_.IsInterruptPending()) {
+      RETURN_IF_ERROR(WaitForInterrupt());
+    }
+    break;
+   case decoder::ESel::kECall:
+    // Host calls bypass the guest's own protection, so only M-mode code
+    // (or the lone process of --user_mode) may make them.
+    if (registers_[hostcall::constants::kMagicReg] == hostcall::constants::kMagic &&
+        (priv == csr::Privilege::kMachine || options_.user_mode)) {
+      RETURN_IF_ERROR(RunHostCall());
+    } else if (options_.user_mode) {
+      RETURN_IF_ERROR(RunSyscall());
+    } else {
+      // kECallFromU/S/M are consecutive in privilege order.
+      RaiseException(static_cast<csr::Exception>(
+          static_cast<uint32_t>(csr::Exception::kECallFromU) + static_cast<uint32_t>(priv)), 0);
+    }
+    break;
+   default:
+    break;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<uint32_t> Cpu::ReadCsr(const uint32_t addr) {
+  switch (addr) {
+   case csr::constants::kCycle:
+   case csr::constants::kMcycle:
+   case csr::constants::kCycleh:
+   case csr::constants::kMcycleh:
+   case csr::constants::kTime:
+   case csr::constants::kTimeh:
+   case csr::constants::kInstret:
+   case csr::constants::kMinstret:
+   case csr::constants::kInstreth:
+   case csr::constants::kMinstreth:
+    // Counters advance without scheduler events.
+    idle_loop_.OnSideEffect();
+    break;
+   default:
+    break;
+  }
+  switch (addr) {
+   case csr::constants::kCycle:
+   case csr::constants::kMcycle:
+    return static_cast<uint32_t>(clock_);
+   case csr::constants::kCycleh:
+   case csr::constants::kMcycleh:
+    return static_cast<uint32_t>(clock_ >> 32);
+   case csr::constants::kTime:
+    return static_cast<uint32_t>(bus_.GetMtime());
+   case csr::constants::kTimeh:
+    return static_cast<uint32_t>(bus_.GetMtime() >> 32);
+   case csr::constants::kInstret:
+   case csr::constants::kMinstret:
+    return static_cast<uint32_t>(instret_);
+   case csr::constants::kInstreth:
+   case csr::constants::kMinstreth:
+    return static_cast<uint32_t>(instret_ >> 32);
+   default:
+    if (pmp::Pmp::IsPmpCsr(addr)) {
+      return pmp_.Read(addr);
+    }
+    return csrs_.Read(addr);
+  }
+}
+
+absl::Status Cpu::WriteCsr(const uint32_t addr, const uint32_t val) {
+  idle_loop_.OnSideEffect();
+  if (pmp::Pmp::IsPmpCsr(addr)) {
+    pmp_.Write(addr, val);
+    return absl::OkStatus();
+  }
+  RETURN_IF_ERROR(csrs_.Write(addr, val));
+  switch (addr) {
+   case csr::constants::kSatp:
+    mmu_.SetSatp(csrs_.GetSatp());
+    break;
+   case csr::constants::kMstatus:
+   case csr::constants::kSstatus:
+    mmu_.SetStatus(csrs_.IsSumSet(), csrs_.IsMxrSet());
+    RequestInterruptCheck();
+    break;
+   case csr::constants::kMie:
+   case csr::constants::kSie:
+   case csr::constants::kMip:
+   case csr::constants::kSip:
+   case csr::constants::kMideleg:
+    RequestInterruptCheck();
+    break;
+   default:
+    break;
+  }
+  return absl::OkStatus();
+}
+
+void Cpu::SetIrq(const perfs::irq::Line line, const bool level) {
+  switch (line) {
+   case perfs::irq::Line::kSoftware:
+    csrs_.SetPending(csr::Interrupt::kMachineSoftware, level);
+    break;
+   case perfs::irq::Line::kTimer:
+    csrs_.SetPending(csr::Interrupt::kMachineTimer, level);
+    break;
+   case perfs::irq::Line::kExternal:
+    csrs_.SetPending(csr::Interrupt::kMachineExternal, level);
+    break;
+  }
+  if (level) {
+    RequestInterruptCheck();
+  }
+}
+
+void Cpu::RequestInterruptCheck() {
+  // The scheduler is the only way out of the inner run loop, so post an
+  // event that is already due; `Boot` checks interrupts after servicing it.
+  scheduler_.Schedule(clock_, [](uint64_t) { return absl::OkStatus(); });
+}
+
+absl::Status Cpu::CheckInterrupts() {
+  const std::optional<uint32_t> cause = csrs_.GetPendingInterrupt();
+  if (!cause.has_value()) {
+    return absl::OkStatus();
+  }
+  // Interrupts are taken between instructions, so resume at the
+  // instruction that would have been fetched next.
+  ASSIGN_OR_RETURN(const uint32_t epc, NextPc());
+  redirect_pc_ = csrs_.EnterTrap(*cause, /*tval=*/0, epc);
+  if (models_.pipeline != nullptr) {
+    models_.pipeline->Trap();
+  }
+  if (models_.calls != nullptr) {
+    models_.calls->Trap(epc, *redirect_pc_);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Cpu::WaitForInterrupt() {
+  const uint64_t deadline = scheduler_.NextWakeDeadline();
+  if (deadline == sched::constants::kNever) {
+    LOG(WARNING) << "wfi with no pending events, powering off";
+    power_is_on_ = false;
+    return absl::OkStatus();
+  }
+  // `Step` retires the wfi itself, which lands the clock on the deadline.
+  if (deadline <= clock_ + 1) {
+    return absl::OkStatus();
+  }
+  const uint64_t idle_ticks = deadline - clock_ - 1;
+  VLOG(2) << "wfi: skipping " << std::dec << idle_ticks << " ticks";
+  if (options_.sleep_on_wfi) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(
+        idle_ticks * (1'000'000'000 / cpu::constants::kClockHz)));
+  }
+  clock_ += idle_ticks;
   return absl::OkStatus();
 }
 
 absl::Status Cpu::Memory() {
-  bus_.SetDramAccessType(decoder_.GetMemSel());
+  const decoder::MemOp mem_op = decoder_.GetMemOp();
+  if (mem_op == decoder::MemOp::kNone) {
+    return absl::OkStatus();
+  }
   ASSIGN_OR_RETURN(const uint32_t rs2_out, GetRegister(registers_, decoder_.GetRs2()));
-  absl::StatusOr<uint32_t> mem_out;
-  absl::Status mem_write_status;
-  switch (decoder_.GetMemOp()) {
-   case decoder::MemOp::kNone:
-    break;
-   case decoder::MemOp::kRead:
-    mem_out = bus_.Read(alu_out_);
+  return AccessMemory(alu_out_, decoder_.GetMemSel(), mem_op == decoder::MemOp::kWrite, rs2_out);
+}
+
+absl::Status Cpu::AccessMemory(const uint32_t vaddr, const memory::AccessType type,
+                               const bool is_store, const uint32_t store_val) {
+  if (!memory::IsAligned(vaddr, type)) {
+    RaiseException(is_store ? csr::Exception::kStoreAddrMisaligned
+                            : csr::Exception::kLoadAddrMisaligned, vaddr);
+    return absl::OkStatus();
+  }
+  const csr::Privilege priv = csrs_.GetDataPrivilege();
+  const mmu::Translation target = mmu_.Translate(
+      vaddr, is_store ? mmu::Access::kStore : mmu::Access::kLoad, priv);
+  if (target.fault.has_value()) {
+    RaiseException(*target.fault, vaddr);
+    return absl::OkStatus();
+  }
+  if (!pmp_.IsAllowed(target.paddr, AccessSize(type),
+                      is_store ? pmp::constants::kWrite : pmp::constants::kRead, priv)) {
+    RaiseException(is_store ? csr::Exception::kStoreAccessFault
+                            : csr::Exception::kLoadAccessFault, vaddr);
+    return absl::OkStatus();
+  }
+  if (is_store && watch_.has_value() && target.paddr < watch_->end &&
+      target.paddr + AccessSize(type) > watch_->begin) {
+    watch_->last_hit = instret_;
+  }
+  if (models_.caches != nullptr && target.host != nullptr) {
+    models_.caches->Data(pc_, target.paddr, is_store);
+  }
+  // RAM goes straight through the host pointer. MMIO and stores into pages
+  // holding cached code take the bus.
+  if (target.host != nullptr &&
+      !(is_store && bus_.GetDram().IsCodePage(target.paddr))) {
+    if (models_.heatmap != nullptr) {
+      models_.heatmap->Record(target.paddr, is_store ? memory::Access::kWrite
+                                                     : memory::Access::kRead);
+    }
+    if (!is_store) {
+      mem_out_ = memory::LoadFromHost(target.host, type);
+    } else {
+      idle_loop_.OnSideEffect();
+      if (write_log_ != nullptr) {
+        write_log_->push_back({target.paddr, type, memory::LoadFromHost(target.host, type),
+                               store_val, target.host});
+      }
+      memory::StoreToHost(target.host, type, store_val);
+      bus_.GetDram().MarkDirty(target.paddr);
+    }
+    return absl::OkStatus();
+  }
+
+  bus_accessed_ = true;
+  bus_.SetDramAccessType(type);
+  if (!is_store) {
+    if (idle_loop_.IsTracking() && bus_.IsTimeSource(target.paddr)) {
+      idle_loop_.OnSideEffect();
+    }
+    const absl::StatusOr<uint32_t> mem_out = bus_.Read(target.paddr);
     if (!mem_out.ok()) {
       if (absl::IsOutOfRange(mem_out.status())) {
-        // TODO: Raise a bus error exception.
-        break;
+        RaiseException(csr::Exception::kLoadAccessFault, vaddr);
+        return absl::OkStatus();
       }
       return mem_out.status();
     }
     mem_out_ = *mem_out;
-    break;
-   case decoder::MemOp::kWrite:
-    mem_write_status = bus_.Write(alu_out_, rs2_out);
-    if (!mem_write_status.ok()) {
-      if (absl::IsOutOfRange(mem_write_status)) {
-        // TODO: Raise a bus error exception.
-        break;
-      }
-      return mem_write_status;
+    return absl::OkStatus();
+  }
+  idle_loop_.OnSideEffect();
+  const absl::Status mem_write_status = bus_.Write(target.paddr, store_val);
+  if (!mem_write_status.ok()) {
+    if (absl::IsOutOfRange(mem_write_status)) {
+      RaiseException(csr::Exception::kStoreAccessFault, vaddr);
+      return absl::OkStatus();
     }
-    break;
-   default:
-    return absl::InternalError("Invalid memory operation");
+    return mem_write_status;
   }
   return absl::OkStatus();
 }
@@ -183,22 +628,237 @@ absl::Status Cpu::Writeback() {
    case decoder::WbSel::kPcPlus4:
     RETURN_IF_ERROR(SetRegister(registers_, decoder_.GetRd(), pc_ + 4));
     break;
+   case decoder::WbSel::kCsrOut:
+    RETURN_IF_ERROR(SetRegister(registers_, decoder_.GetRd(), csr_out_));
+    break;
    default:
     return absl::InternalError("Invalid writeback");
   }
   return absl::OkStatus();
 }
 
-absl::Status Cpu::Boot() {
-  power_is_on_ = true;
+void Cpu::DetectIdleLoop(const uint32_t pc, const uint32_t target) {
+  if (!idle_loop_.OnTakenBranch(pc, target, registers_)) {
+    return;
+  }
+  const uint64_t deadline = scheduler_.NextWakeDeadline();
+  if (deadline == sched::constants::kNever) {
+    // Nothing can ever change what the loop observes; keep spinning as
+    // the hardware would.
+    LOG_FIRST_N(WARNING, 1) << "Guest is spinning with no pending events at 0x" << std::hex << pc;
+    return;
+  }
+  // `Step` retires the branch itself, which lands the clock on the deadline.
+  if (deadline > clock_ + 1) {
+    VLOG(2) << "Fast-forwarding idle loop by " << std::dec << deadline - clock_ - 1 << " ticks";
+    clock_ = deadline - 1;
+  }
+  idle_loop_.Reset();
+}
 
-  while (power_is_on_) {
-    RETURN_IF_ERROR(Fetch());
+absl::Status Cpu::Step() {
+  RETURN_IF_ERROR(Fetch());
+  if (!exception_) {
     RETURN_IF_ERROR(Decode());
     RETURN_IF_ERROR(Execute());
+  }
+  if (!exception_) {
     RETURN_IF_ERROR(Memory());
+  }
+  if (!exception_) {
     RETURN_IF_ERROR(Writeback());
-    PrintRegisters(registers_);
+    if (decoder_.GetPcSel() == decoder::PcSel::kAluOut) {
+      DetectIdleLoop(pc_, alu_out_);
+    }
+    if (HasInstrModels()) {
+      RecordRetired(instr_, decoder_.GetPcSel() == decoder::PcSel::kAluOut, alu_out_);
+    }
+    ++instret_;
+  }
+  PrintRegisters(registers_);
+  ++clock_;
+  return absl::OkStatus();
+}
+
+void Cpu::RecordRetired(const uint32_t instr, const bool taken, const uint32_t target) {
+  const timing::InstrInfo info = timing::Classify(instr);
+  // Without a predictor the front end falls through.
+  bool redirect = taken;
+  if (models_.branches != nullptr) {
+    switch (info.kind) {
+     case timing::InstrKind::kBranch:
+      redirect = models_.branches->Conditional(pc_, target, taken);
+      break;
+     case timing::InstrKind::kJump:
+     case timing::InstrKind::kIndirectJump:
+      redirect = models_.branches->Jump(pc_, target,
+                                        info.kind == timing::InstrKind::kIndirectJump, info.rd,
+                                        info.rs1);
+      break;
+     default:
+      break;
+    }
+  }
+  if (models_.pipeline != nullptr) {
+    models_.pipeline->Retire(info, redirect);
+  }
+  if (models_.calls != nullptr) {
+    // Sampling leaves the pipeline's cycles with gaps. The clock ticks
+    // for this instruction only after it retires.
+    const bool pipeline_cycles = models_.pipeline != nullptr && !options_.sampling.has_value();
+    models_.calls->Retire(pc_, info, target,
+                          pipeline_cycles ? models_.pipeline->GetCycles() : clock_ + 1);
+  }
+}
+
+absl::Status Cpu::RunHostCall() {
+  hostcall::Args args;
+  for (size_t i = 0; i < args.size(); ++i) {
+    args[i] = registers_[hostcall::constants::kArgReg + i];
+  }
+  ASSIGN_OR_RETURN(registers_[hostcall::constants::kArgReg],
+                   hostcalls_.Call(registers_[hostcall::constants::kFuncReg], args));
+  // Host calls may write guest memory or depend on the host.
+  idle_loop_.OnSideEffect();
+  if (hostcalls_.GetExitCode().has_value()) {
+    power_is_on_ = false;
+  }
+  return absl::OkStatus();
+}
+
+std::optional<uint32_t> Cpu::MapGuestBuffer(const uint32_t vaddr, const uint32_t len,
+                                            const bool is_write) {
+  const uint64_t end = uint64_t{vaddr} + len;
+  if (end > (uint64_t{1} << 32)) {
+    return std::nullopt;
+  }
+  const csr::Privilege priv = csrs_.GetDataPrivilege();
+  const mmu::Access access = is_write ? mmu::Access::kStore : mmu::Access::kLoad;
+  const uint8_t perm = is_write ? pmp::constants::kWrite : pmp::constants::kRead;
+  const mmu::Translation first = mmu_.Translate(vaddr, access, priv);
+  for (uint64_t at = vaddr; at < end;) {
+    const uint64_t chunk =
+        std::min<uint64_t>(end, (at | mmu::constants::kPageOffsetMask) + 1) - at;
+    const mmu::Translation target = mmu_.Translate(at, access, priv);
+    // The host works on one contiguous run of RAM.
+    if (target.fault.has_value() || target.host == nullptr ||
+        target.paddr != first.paddr + (at - vaddr) ||
+        !pmp_.IsAllowed(target.paddr, chunk, perm, priv)) {
+      return std::nullopt;
+    }
+    at += chunk;
+  }
+  return first.paddr;
+}
+
+absl::Status Cpu::RunSyscall() {
+  syscall::Args args;
+  for (size_t i = 0; i < args.size(); ++i) {
+    args[i] = registers_[syscall::constants::kArgReg + i];
+  }
+  ASSIGN_OR_RETURN(registers_[syscall::constants::kArgReg],
+                   syscalls_.Call(registers_[syscall::constants::kNumberReg], args));
+  idle_loop_.OnSideEffect();
+  if (hostcalls_.GetExitCode().has_value()) {
+    power_is_on_ = false;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Cpu::LoadElf(const absl::string_view path, const bool patch_libc,
+                          const std::vector<std::string>& argv,
+                          const std::vector<std::string>& envp) {
+  ASSIGN_OR_RETURN(const loader::Image image, loader::LoadElf(path, bus_.GetDram()));
+  if (patch_libc) {
+    RETURN_IF_ERROR(hostcalls_.PatchFunctions(image));
+  }
+  if (options_.user_mode) {
+    ASSIGN_OR_RETURN(registers_[2], syscalls_.SetupProcess(image, argv, envp));
+  }
+  pc_ = image.entry - 0x4;
+  symbols_ = image.functions;
+  symbols_.insert(image.objects.begin(), image.objects.end());
+  if (models_.calls != nullptr) {
+    models_.calls->SetSymbols(image.functions);
+  }
+  return absl::OkStatus();
+}
+
+std::optional<loader::Symbol> Cpu::FindSymbol(const absl::string_view name) const {
+  const auto it = symbols_.find(name);
+  if (it == symbols_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+std::string Cpu::Symbolize(const uint32_t pc) const {
+  for (const auto& [name, symbol] : symbols_) {
+    if (pc >= symbol.addr && pc - symbol.addr < symbol.size) {
+      return absl::StrFormat("%s+0x%x", name, pc - symbol.addr);
+    }
+  }
+  return "";
+}
+
+absl::StatusOr<Cpu::Snapshot> Cpu::TakeSnapshot() {
+  if (hostcalls_.HasOpenFiles()) {
+    return absl::FailedPreconditionError("The guest has host files open");
+  }
+  checkpoint::StateWriter out;
+  RETURN_IF_ERROR(SaveMachineState(out));
+  last_checkpoint_.reset();
+  if (history_ != nullptr) {
+    history_->Clear();
+  }
+  return Snapshot{.state = out.GetData(), .ram = bus_.GetDram().TakeSnapshot()};
+}
+
+absl::Status Cpu::RestoreSnapshot(const Snapshot& snapshot) {
+  // The host must be done writing into RAM before it is rolled back.
+  bus_.DropDiskRequests();
+  bus_.GetDram().RestoreSnapshot(snapshot.ram);
+  RETURN_IF_ERROR(LoadMachineState(snapshot.state));
+  hostcalls_.CloseFiles();
+  prev_location_ = 0;
+  // The dirty-page list now starts from the snapshot.
+  last_checkpoint_.reset();
+  if (history_ != nullptr) {
+    history_->Clear();
+  }
+  ResumeAfterRestore();
+  return absl::OkStatus();
+}
+
+void Cpu::SetCoverageMap(uint8_t* map, const uint32_t size) {
+  coverage_ = map;
+  coverage_mask_ = size - 1;
+  prev_location_ = 0;
+}
+
+absl::Status Cpu::Boot() {
+  power_is_on_ = true;
+
+  while (power_is_on_) {
+    // Run uninterrupted up to the next device deadline, then service
+    // whatever is due. Devices are never polled per instruction.
+    while (power_is_on_ && clock_ < scheduler_.NextDeadline()) {
+      if (code_cache_ != nullptr) {
+        RETURN_IF_ERROR(RunBlocks());
+        continue;
+      }
+      ASSIGN_OR_RETURN(const uint32_t pc, NextPc());
+      if (EnterBlock(pc)) {
+        RETURN_IF_ERROR(InterpretRun());
+      }
+    }
+    const uint64_t wakes = scheduler_.GetWakeCount();
+    RETURN_IF_ERROR(scheduler_.RunDue(clock_));
+    // Device state may have changed under a loop being tracked.
+    if (scheduler_.GetWakeCount() != wakes) {
+      idle_loop_.Reset();
+    }
+    RETURN_IF_ERROR(CheckInterrupts());
   }
   return absl::OkStatus();
 }
@@ -2,27 +2,160 @@
 #define LIB_CPU_CPU_H
 
 #include <stdint.h>
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 #include "lib/logic/wire.h"
 #include "lib/alu/alu.h"
+#include "lib/bpred/branch_unit.h"
+#include "lib/cachesim/hierarchy.h"
+#include "lib/checkpoint/checkpoint.h"
+#include "lib/checkpoint/state.h"
+#include "lib/engine/code_cache.h"
+#include "lib/engine/compiler.h"
+#include "lib/engine/indirect.h"
+#include "lib/hostcall/hostcall.h"
+#include "lib/loader/elf.h"
 #include "lib/perfs/bus.h"
+#include "lib/profile/call_graph.h"
+#include "lib/replay/input_log.h"
+#include "lib/sched/scheduler.h"
+#include "lib/syscall/linux.h"
+#include "lib/timing/pipeline.h"
+#include "lib/timing/sampler.h"
+#include "csr.h"
+#include "history.h"
+#include "idle_loop.h"
 #include "instr_decoder.h"
+#include "mmu.h"
+#include "pmp.h"
 #include "glog/logging.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 
 namespace riscv_emu {
 
+  namespace cpu::constants {
+
+    // Nominal rate of the virtual clock, used to convert idle ticks into
+    // host time.
+    constexpr uint64_t kClockHz = 10'000'000;
+    // Spreads block addresses over the coverage map.
+    constexpr uint32_t kCoverageHash = 0x9e3779b1;
+
+  }  // namespace cpu::constants
+
+struct CpuOptions {
+  // On wfi, sleep the host thread for the virtual time being skipped
+  // instead of only fast-forwarding the clock.
+  bool sleep_on_wfi = false;
+  // Run the guest as a Linux user process: ecalls are syscalls forwarded
+  // to the host instead of no-ops.
+  bool user_mode = false;
+  // Byte budget for predecoded blocks. 0 runs every instruction through
+  // the interpreter.
+  uint64_t code_cache_bytes = engine::constants::kDefaultCodeCacheBytes;
+  // Background threads compiling hot blocks; 0 compiles on the guest
+  // thread.
+  uint32_t compile_threads = engine::constants::kDefaultCompileThreads;
+  // Interpreted runs of a block before it is compiled.
+  uint32_t tier_up_threshold = engine::constants::kDefaultTierUpThreshold;
+  // Checks every Nth compiled block against the interpreter and stops at
+  // the first difference. 0 disables checking.
+  uint32_t lockstep_interval = 0;
+  // Snapshots the machine for reverse execution every this many ticks; 0
+  // disables it.
+  uint64_t history_interval = 0;
+  // Memory the snapshots may take, including a copy of RAM. The oldest are
+  // dropped beyond it.
+  uint64_t history_bytes = history::constants::kDefaultBudgetBytes;
+  // Performance models, fed from the hart's execution for profiling. The
+  // configurations must be valid.
+  // Caches over the hart's RAM accesses.
+  std::optional<cachesim::HierarchyConfig> cache_sim;
+  // Branch prediction over the hart's control transfers.
+  std::optional<bpred::BranchConfig> branch_sim;
+  // An in-order 5-stage pipeline running the hart's instructions; with
+  // `branch_sim`, its predictions decide the control stalls.
+  std::optional<timing::PipelineConfig> pipeline_sim;
+  // Runs the models only in periodic windows and estimates the whole
+  // run's CPI from them. Needs `pipeline_sim`, and cannot be combined with
+  // `history_interval`.
+  std::optional<timing::SamplingConfig> sampling;
+  // Attributes the hart's instructions, loads, stores and cycles to the
+  // functions of the loaded ELF along its calls. Cycles are the pipeline's
+  // with `pipeline_sim` and without `sampling`, else virtual clock ticks.
+  bool call_graph = false;
+};
+
+struct LockstepStats {
+  uint64_t checked = 0;
+  // Sampled blocks that touched a device or code and ran unchecked.
+  uint64_t skipped = 0;
+};
+
 class Cpu final {
  private:
-  uint32_t clock_;
+  CpuOptions options_;
+  // Virtual time, advanced by one tick per retired instruction and
+  // fast-forwarded while the hart idles in wfi.
+  uint64_t clock_ = 0;
+  uint64_t instret_ = 0;
   uint32_t pc_ = 0x8000 - 0x4;
+  // Overrides the decoder's pc select for the next fetch: trap entry/exit,
+  // or where the block engine left off.
+  std::optional<uint32_t> redirect_pc_;
+  // The current instruction raised a synchronous exception; its remaining
+  // stages are skipped and it does not retire.
+  bool exception_ = false;
   uint32_t instr_; 
   bool power_is_on_;
   Alu alu_;
+  sched::Scheduler scheduler_;
   perfs::bus::Bus bus_;
+  hostcall::HostCalls hostcalls_;
+  syscall::LinuxSyscalls syscalls_;
+  pmp::Pmp pmp_;
+  mmu::Mmu mmu_;
   decoder::InstrDecoder decoder_;
+  csr::CsrFile csrs_;
+  idle::IdleLoopDetector idle_loop_;
+  // Absent when the block engine is disabled.
+  std::unique_ptr<engine::CodeCache> code_cache_;
+  std::unique_ptr<engine::Compiler> compiler_;
+  std::unique_ptr<engine::IndirectPredictor> indirect_;
+  std::unique_ptr<replay::InputLog> input_log_;
+  // Performance models, each absent unless enabled in `CpuOptions`. Both
+  // engines feed them, but reruns of instructions they have seen run with
+  // them detached: lockstep checks and replays after a rewind.
+  struct Models {
+    std::unique_ptr<cachesim::Hierarchy> caches;
+    std::unique_ptr<bpred::BranchUnit> branches;
+    std::unique_ptr<timing::Pipeline> pipeline;
+    std::unique_ptr<profile::CallGraph> calls;
+    // Also fed by RAM itself, with what devices and the host access.
+    std::unique_ptr<memory::Heatmap> heatmap;
+  };
+  Models models_;
+  // The timing models while they are parked between sampled windows; the
+  // call graph stays attached.
+  Models parked_models_;
+  // Attached or parked, whichever holds them.
+  inline const Models& GetModels() const {
+    return parked_models_.pipeline != nullptr ? parked_models_ : models_;
+  }
+  // Symbols of the loaded ELF, functions and data alike.
+  absl::flat_hash_map<std::string, loader::Symbol> symbols_;
+  std::optional<uint32_t> stop_pc_;
+  uint8_t* coverage_ = nullptr;
+  uint32_t coverage_mask_ = 0;
+  uint32_t prev_location_ = 0;
 
   uint32_t alu_out_;
   uint32_t mem_out_;
+  uint32_t csr_out_;
   uint32_t a_out_;
   uint32_t b_out_;
 
@@ -33,10 +166,250 @@ class Cpu final {
   absl::Status Execute();
   absl::Status Memory();
   absl::Status Writeback();
+  absl::Status Step();
+  // Loads land in `mem_out_`.
+  absl::Status AccessMemory(uint32_t vaddr, memory::AccessType type, bool is_store,
+                            uint32_t store_val);
+
+  absl::Status ExecuteSystem();
+  absl::StatusOr<uint32_t> ReadCsr(uint32_t addr);
+  absl::Status WriteCsr(uint32_t addr, uint32_t val);
+  absl::StatusOr<uint32_t> NextPc() const;
+  void RaiseException(csr::Exception cause, uint32_t tval);
+  void SetIrq(perfs::irq::Line line, bool level);
+  // Breaks out of the run loop so pending interrupts are re-evaluated.
+  void RequestInterruptCheck();
+  absl::Status CheckInterrupts();
+  absl::Status WaitForInterrupt();
+  absl::Status RunHostCall();
+  // Host calls' view of a guest buffer: its physical address, if the
+  // hart may access all of it at its data privilege and it is one
+  // contiguous run of RAM.
+  std::optional<uint32_t> MapGuestBuffer(uint32_t vaddr, uint32_t len, bool is_write);
+  absl::Status RunSyscall();
+  void ConnectInputLog();
+  void DetectIdleLoop(uint32_t pc, uint32_t target);
+  // Feeds the instruction at `pc_` to the models as it retires. `taken`
+  // and `target` give the outcome of a control transfer.
+  void RecordRetired(uint32_t instr, bool taken, uint32_t target);
+  inline bool HasInstrModels() const {
+    return models_.branches != nullptr || models_.pipeline != nullptr || models_.calls != nullptr;
+  }
+  // Called where each straight-line run starts: counts the edge into it
+  // and stops at `stop_pc_`. Returns false if the run must end here.
+  inline bool EnterBlock(const uint32_t pc) {
+    if (coverage_ != nullptr) {
+      const uint32_t location = (pc >> 2) * cpu::constants::kCoverageHash;
+      ++coverage_[(location ^ prev_location_) & coverage_mask_];
+      prev_location_ = location >> 1;
+    }
+    if (stop_pc_ == pc) {
+      power_is_on_ = false;
+      return false;
+    }
+    return true;
+  }
+
+  // Block engine (cpu_blocks.cc). Runs up to the next deadline: compiled
+  // blocks where available, the interpreter (tier 0) everywhere else.
+  absl::Status RunBlocks();
+  // Returns the compiled block to run at `pc`, chaining it to the exit
+  // `prev` left through, or predicting it if that was a jalr. Returns
+  // nullptr if the interpreter must run it. Cold blocks are counted
+  // towards compilation.
+  engine::Block* FindBlock(uint32_t pc, engine::Block* prev, engine::Exit prev_exit);
+  // Tier 0: interprets up to and including the next control transfer, so
+  // the pc it stops at is a block head again.
+  absl::Status InterpretRun(uint32_t max_instrs = engine::constants::kMaxBlockInstrs);
+  bool InstallBlock(const engine::CompiledBlock& compiled);
+  // Leaves the pc to resume at in `redirect_pc_`. `exit` is set if the
+  // block ran to its end, through a static exit that may be chained or
+  // through `kIndirect`.
+  absl::Status RunBlock(engine::Block& block, std::optional<engine::Exit>& exit);
+  // Runs a load or store op at `base + op.imm`. Returns true if the block
+  // must stop: the access trapped or rewrote cached code.
+  absl::StatusOr<bool> RunMemoryOp(const engine::Op& op, uint32_t base, uint64_t epoch);
+
+  // Differential checking (cpu_lockstep.cc).
+  struct MemWrite {
+    uint32_t paddr;
+    memory::AccessType type;
+    uint32_t old_val;
+    uint32_t new_val;
+    uint8_t* host;
+  };
+  // Everything a block can change besides RAM.
+  struct ArchState {
+    std::array<uint32_t, 32> registers;
+    uint32_t pc;
+    std::optional<uint32_t> redirect_pc;
+    bool exception;
+    uint64_t clock;
+    uint64_t instret;
+    uint32_t alu_out;
+    csr::CsrFile csrs;
+    decoder::InstrDecoder decoder;
+    idle::IdleLoopDetector idle_loop;
+  };
+  ArchState SaveState() const;
+  void RestoreState(const ArchState& state);
+  // Runs `block` through the interpreter, rolls the hart and RAM back and
+  // runs it again as a block, then compares the two. Blocks that touched
+  // a device or rewrote code cannot be rolled back; their interpreted run
+  // stands unchecked.
+  absl::Status RunBlockChecked(engine::Block& block, std::optional<engine::Exit>& exit);
+  // Describes how `fast` differs from `reference`, or returns "".
+  std::string DescribeDivergence(const ArchState& reference, const ArchState& fast,
+                                 const std::vector<MemWrite>& reference_writes,
+                                 const std::vector<MemWrite>& fast_writes) const;
+  // Set while a checked block runs: RAM stores are logged so they can be
+  // undone, and any access through the bus is flagged.
+  std::vector<MemWrite>* write_log_ = nullptr;
+  bool bus_accessed_ = false;
+  uint64_t blocks_run_ = 0;
+  LockstepStats lockstep_stats_;
+
+  // Checkpoints (cpu_checkpoint.cc). Hart and device state is encoded
+  // between instructions, with the next pc standing in for the decoder.
+  absl::Status SaveMachineState(checkpoint::StateWriter& out) const;
+  absl::Status LoadMachineState(absl::string_view state);
+  // After a restore: re-arms the background events `LoadMachineState`
+  // cleared and ends the calls the restore cut short.
+  void ResumeAfterRestore();
+  // The checkpoint last saved or restored; RAM's dirty pages are relative
+  // to it.
+  std::optional<checkpoint::Checkpoint::Base> last_checkpoint_;
+
+  // Reverse execution (cpu_history.cc).
+  void ScheduleHistory();
+  absl::Status RecordHistory();
+  absl::Status RestoreHistory(size_t index);
+  // Runs until exactly `instret` instructions have retired.
+  absl::Status RunToInstret(uint64_t instret);
+  // Absent unless `CpuOptions::history_interval` is set.
+  std::unique_ptr<history::History> history_;
+
+  // Sampled simulation (cpu_sampling.cc).
+  enum class SamplePhase : uint8_t { kWarm, kMeasure, kEnd };
+  // Parks the models and waits for the next period with room for a whole
+  // warm-up.
+  void ScheduleSampling();
+  // Moves the timing models between `models_` and `parked_models_`.
+  void ParkModels();
+  void AttachModels();
+  void ScheduleSamplePhase(SamplePhase phase, uint64_t period_start);
+  void RunSamplePhase(SamplePhase phase, uint64_t period_start, uint64_t now);
+  // Ends a heatmap window every `interval` ticks.
+  void ScheduleHeatmap(uint64_t interval);
+  // Absent unless `CpuOptions::sampling` is set.
+  std::unique_ptr<timing::Sampler> sampler_;
+  // The pipeline's instructions and cycles when the window being measured
+  // started.
+  uint64_t window_instructions_ = 0;
+  uint64_t window_cycles_ = 0;
+  // Set while searching for a write: hart stores and other RAM writes to
+  // [begin, end) record the instret they happen at.
+  struct Watch {
+    uint32_t begin;
+    uint32_t end;
+    std::optional<uint64_t> last_hit;
+  };
+  std::optional<Watch> watch_;
 
  public:
-  Cpu() = default;
+  explicit Cpu(CpuOptions options = CpuOptions());
   absl::Status Boot();
+  inline absl::Status AttachDisk(absl::string_view path, bool read_only) {
+    return bus_.AttachDisk(path, read_only);
+  }
+  // Logs every input whose value or timing depends on the host to `path`,
+  // or feeds the inputs logged there back at the same points, so runs can
+  // be repeated exactly. Call before booting.
+  absl::Status RecordInputs(absl::string_view path);
+  absl::Status ReplayInputs(absl::string_view path);
+  // Counts the hart's, the devices' and the host's accesses to RAM into a
+  // heatmap streamed to `path`; `config` must be valid. Call before
+  // booting.
+  absl::Status EnableHeatmap(const memory::HeatmapConfig& config, absl::string_view path);
+  // Loads a static RV32 ELF and boots from its entry point. With
+  // `patch_libc`, known libc routines are redirected to host calls. In
+  // user mode, `argv` and `envp` are passed on the initial stack.
+  absl::Status LoadElf(absl::string_view path, bool patch_libc,
+                       const std::vector<std::string>& argv = {},
+                       const std::vector<std::string>& envp = {});
+  // Exit code passed by the guest through the exit host call, if any.
+  inline std::optional<int> GetExitCode() const { return hostcalls_.GetExitCode(); }
+  // Looks up a function or data symbol of the ELF loaded by `LoadElf`.
+  std::optional<loader::Symbol> FindSymbol(absl::string_view name) const;
+
+  // In-process snapshots, for running many short executions from one
+  // starting point, e.g. when fuzzing. A snapshot covers the whole
+  // machine, devices and their pending events included, so each run from
+  // it starts exactly alike.
+  struct Snapshot {
+    // As encoded for checkpoints.
+    std::string state;
+    std::vector<uint8_t> ram;
+  };
+  // Fails while disk requests are in flight or the guest has host files
+  // open, which cannot be rolled back.
+  absl::StatusOr<Snapshot> TakeSnapshot();
+  // Only the RAM written since the snapshot was taken or last restored is
+  // copied back. Host files opened since are closed.
+  absl::Status RestoreSnapshot(const Snapshot& snapshot);
+  // `Boot` returns once the hart is about to execute `pc`. This is checked
+  // where straight-line runs start, so `pc` must be a jump or branch
+  // target, such as a function entry or a return address.
+  inline void SetStopPc(const std::optional<uint32_t> pc) { stop_pc_ = pc; }
+  // Ends `Boot` at the next instruction boundary, e.g. from a scheduler
+  // event bounding the run.
+  inline void PowerOff() { power_is_on_ = false; }
+  // Counts control-flow edges between straight-line runs into `map`, AFL
+  // style: one counter per (previous block, block) pair, hashed. `size`
+  // must be a power of two; nullptr stops recording.
+  void SetCoverageMap(uint8_t* map, uint32_t size);
+  // Saves the whole machine to `path`: hart, devices and RAM. With
+  // `incremental`, only the RAM written since the last checkpoint was
+  // saved or restored is stored, and the new file refers to that one,
+  // which must be kept. Fails while disk requests are in flight or the
+  // guest has host files open. Call between runs of `Boot`.
+  absl::Status SaveCheckpoint(absl::string_view path, bool incremental = false);
+  // Restores a checkpoint, and the chain of checkpoints it was saved on
+  // top of. RAM is mapped from the files copy-on-write, so they must not
+  // change while the machine runs. The same disk must be attached.
+  absl::Status RestoreCheckpoint(absl::string_view path);
+  // Reverse execution, with `CpuOptions::history_interval` set. Both go
+  // back to the nearest earlier snapshot and replay forward from it, which
+  // repeats the run exactly: host inputs are handed back from memory. The
+  // guest's output is produced again and disk writes are not undone.
+  // Snapshots are skipped while disk requests are in flight or the guest
+  // has host files open. Call between runs of `Boot`.
+  // Goes back `count` retired instructions.
+  absl::Status StepBack(uint64_t count = 1);
+  // Goes back to the last store by the hart to [paddr, paddr + len), so
+  // that it is the next instruction to execute. Fails if there is none
+  // since the oldest snapshot.
+  absl::Status RunBackToWrite(uint32_t paddr, uint32_t len = 4);
+  inline uint64_t GetInstret() const { return instret_; }
+  inline uint32_t ReadRegister(const uint32_t reg) const { return registers_[reg & 31]; }
+  // Where the hart resumes, e.g. after `Boot` returned at the stop pc.
+  inline absl::StatusOr<uint32_t> GetNextPc() const { return NextPc(); }
+  inline memory::Dram& GetDram() { return bus_.GetDram(); }
+  inline sched::Scheduler& GetScheduler() { return scheduler_; }
+  inline uint64_t GetClock() const { return clock_; }
+  inline const engine::CodeCache* GetCodeCache() const { return code_cache_.get(); }
+  inline const engine::Compiler* GetCompiler() const { return compiler_.get(); }
+  inline const engine::IndirectPredictor* GetIndirectPredictor() const { return indirect_.get(); }
+  inline const LockstepStats& GetLockstepStats() const { return lockstep_stats_; }
+  inline cachesim::Hierarchy* GetCacheSim() { return GetModels().caches.get(); }
+  inline const bpred::BranchUnit* GetBranchSim() const { return GetModels().branches.get(); }
+  inline const timing::Pipeline* GetPipelineSim() const { return GetModels().pipeline.get(); }
+  inline const timing::Sampler* GetSampler() const { return sampler_.get(); }
+  inline profile::CallGraph* GetCallGraph() { return models_.calls.get(); }
+  inline memory::Heatmap* GetHeatmap() { return models_.heatmap.get(); }
+  // Names the function holding `pc` as "name+0xoffset", or returns "" if no
+  // symbol of the loaded ELF covers it.
+  std::string Symbolize(uint32_t pc) const;
 };
 
 }  // namespace riscv_emu
@@ -0,0 +1,384 @@
+// Block engine: runs predecoded blocks from the code cache and falls back
+// to `Step` for everything a block leaves out or that has not been
+// compiled yet. Architectural effects match the interpreter instruction by
+// instruction, including where it stops for a scheduler deadline, so the
+// tiers are interchangeable and swapping a block in is never observable.
+
+#include <algorithm>
+#include <cstring>
+#include "cpu.h"
+#include "status_macros.h"
+
+namespace riscv_emu {
+
+  namespace {
+
+    constexpr uint32_t kInstrBytes = 4;
+
+    bool IsTaken(const engine::OpKind kind, const uint32_t rs1, const uint32_t rs2) {
+      switch (kind) {
+       case engine::OpKind::kBeq:
+        return rs1 == rs2;
+       case engine::OpKind::kBne:
+        return rs1 != rs2;
+       case engine::OpKind::kBlt:
+        return static_cast<int32_t>(rs1) < static_cast<int32_t>(rs2);
+       case engine::OpKind::kBge:
+        return static_cast<int32_t>(rs1) >= static_cast<int32_t>(rs2);
+       case engine::OpKind::kBltu:
+        return rs1 < rs2;
+       case engine::OpKind::kBgeu:
+        return rs1 >= rs2;
+       default:
+        return false;
+      }
+    }
+
+  }  // namespace
+
+absl::Status Cpu::RunBlocks() {
+  engine::Block* prev = nullptr;
+  engine::Exit prev_exit = engine::kFallthrough;
+  while (power_is_on_ && clock_ < scheduler_.NextDeadline()) {
+    if (compiler_->HasResults()) {
+      compiler_->Drain([this](const engine::CompiledBlock& compiled) {
+        return InstallBlock(compiled);
+      });
+      // Installing may have evicted `prev`.
+      prev = nullptr;
+    }
+    ASSIGN_OR_RETURN(const uint32_t pc, NextPc());
+    if (!EnterBlock(pc)) {
+      break;
+    }
+    engine::Block* block = FindBlock(pc, prev, prev_exit);
+    prev = nullptr;
+    if (block == nullptr) {
+      RETURN_IF_ERROR(InterpretRun());
+      continue;
+    }
+    if (block->size == 0) {
+      RETURN_IF_ERROR(Step());
+      continue;
+    }
+    std::optional<engine::Exit> exit;
+    if (options_.lockstep_interval > 0 && ++blocks_run_ % options_.lockstep_interval == 0) {
+      RETURN_IF_ERROR(RunBlockChecked(*block, exit));
+    } else {
+      RETURN_IF_ERROR(RunBlock(*block, exit));
+    }
+    if (block->has_exit[engine::kReturn] &&
+        (exit == engine::kTaken || exit == engine::kIndirect)) {
+      indirect_->PushCall(*block);
+    }
+    prev = exit.has_value() ? block : nullptr;
+    prev_exit = exit.value_or(engine::kFallthrough);
+  }
+  return absl::OkStatus();
+}
+
+engine::Block* Cpu::FindBlock(const uint32_t pc, engine::Block* prev,
+                              const engine::Exit prev_exit) {
+  // Fetch faults, MMIO and misaligned pcs are left to the interpreter.
+  const csr::Privilege priv = csrs_.GetPrivilege();
+  const mmu::Translation fetch = mmu_.Translate(pc, mmu::Access::kFetch, priv);
+  if (fetch.fault.has_value() || fetch.host == nullptr ||
+      !memory::IsAligned(pc, memory::AccessType::kWord)) {
+    return nullptr;
+  }
+
+  // After a jalr, returns resume through the caller's return exit and
+  // other targets are predicted per jalr site.
+  engine::Block* from = prev;
+  engine::Exit from_exit = prev_exit;
+  engine::Block* block = nullptr;
+  if (prev != nullptr && prev_exit == engine::kIndirect) {
+    engine::Block* caller = nullptr;
+    if (engine::IsReturn(prev->ops[prev->size - 1])) {
+      caller = indirect_->PopCaller(pc);
+    }
+    if (caller != nullptr) {
+      from = caller;
+      from_exit = engine::kReturn;
+    } else {
+      block = indirect_->Find(*prev, pc);
+    }
+  }
+  if (from != nullptr && from_exit != engine::kIndirect) {
+    block = from->exits[from_exit].target;
+  }
+
+  // A chained or predicted successor is only trusted while the mapping
+  // still agrees.
+  if (block == nullptr || block->pc != pc || block->paddr != fetch.paddr) {
+    block = code_cache_->Lookup(pc, fetch.paddr);
+    if (block == nullptr) {
+      if (compiler_->Touch(pc, fetch.paddr)) {
+        compiler_->Enqueue(pc, fetch.paddr, fetch.host);
+      }
+      return nullptr;
+    }
+    if (from != nullptr && from_exit == engine::kIndirect) {
+      indirect_->Record(*from, pc, *block);
+    } else if (from != nullptr && from->has_exit[from_exit] && from->exit_pc[from_exit] == pc) {
+      code_cache_->Chain(*from, from_exit, *block);
+    }
+  }
+
+  // PMP may deny execution below page granularity.
+  const uint32_t len = kInstrBytes * std::max<uint32_t>(block->size, 1);
+  if (!pmp_.IsAllowed(fetch.paddr, len, pmp::constants::kExec, priv)) {
+    return nullptr;
+  }
+  return block;
+}
+
+absl::Status Cpu::InterpretRun(const uint32_t max_instrs) {
+  for (uint32_t i = 0; i < max_instrs; ++i) {
+    if (i > 0 && (!power_is_on_ || clock_ >= scheduler_.NextDeadline())) {
+      break;
+    }
+    RETURN_IF_ERROR(Step());
+    if (exception_ || redirect_pc_.has_value() ||
+        decoder_.GetPcSel() == decoder::PcSel::kAluOut) {
+      break;
+    }
+  }
+  return absl::OkStatus();
+}
+
+bool Cpu::InstallBlock(const engine::CompiledBlock& compiled) {
+  // The compiler worked from a snapshot; drop the block if the guest has
+  // rewritten its code since.
+  const absl::StatusOr<uint8_t*> code =
+      bus_.GetDram().GetHostPtr(compiled.block.paddr, compiled.code_len);
+  if (!code.ok() || std::memcmp(*code, compiled.code.data(), compiled.code_len) != 0) {
+    return false;
+  }
+  code_cache_->Insert(compiled.block);
+  return true;
+}
+
+absl::StatusOr<bool> Cpu::RunMemoryOp(const engine::Op& op, const uint32_t base,
+                                       const uint64_t epoch) {
+  const bool is_store = op.kind == engine::OpKind::kStore;
+  RETURN_IF_ERROR(AccessMemory(base + op.imm, op.mem_type, is_store, registers_[op.rs2]));
+  if (exception_) {
+    return true;
+  }
+  if (!is_store) {
+    if (op.rd != 0) {
+      registers_[op.rd] = mem_out_;
+    }
+    return false;
+  }
+  // The store rewrote cached code, possibly this very block.
+  if (code_cache_->GetEpoch() != epoch) {
+    redirect_pc_ = pc_ + kInstrBytes;
+    return true;
+  }
+  return false;
+}
+
+absl::Status Cpu::RunBlock(engine::Block& block, std::optional<engine::Exit>& exit) {
+  block.referenced = true;
+  redirect_pc_.reset();
+  exception_ = false;
+  const uint64_t epoch = code_cache_->GetEpoch();
+  // The models classify instructions by their encoding.
+  const uint8_t* code = nullptr;
+  if (HasInstrModels()) {
+    ASSIGN_OR_RETURN(code, bus_.GetDram().GetHostPtr(block.paddr, block.size * kInstrBytes));
+  }
+
+  uint32_t pc = block.pc;
+  for (uint32_t i = 0; i < block.size; ++i, pc += kInstrBytes) {
+    const engine::Op& op = block.ops[i];
+    // Stop exactly where `Boot` would have for a device event. A fused
+    // pair straddling the deadline is split by the interpreter.
+    const uint64_t deadline = scheduler_.NextDeadline();
+    if (i > 0 && clock_ >= deadline) {
+      redirect_pc_ = pc;
+      return absl::OkStatus();
+    }
+    if (engine::IsFused(op.kind) && clock_ + 1 >= deadline) {
+      redirect_pc_ = pc;
+      return InterpretRun();
+    }
+    pc_ = pc;
+    if (models_.caches != nullptr) {
+      models_.caches->Fetch(pc, block.paddr + i * kInstrBytes);
+    }
+    if (models_.heatmap != nullptr) {
+      models_.heatmap->Record(block.paddr + i * kInstrBytes, memory::Access::kExecute);
+    }
+    const uint32_t rs1 = registers_[op.rs1];
+    const uint32_t rs2 = registers_[op.rs2];
+    // A fused op retires its first half here and continues as `next`,
+    // which the common tail retires.
+    const engine::Op* next = engine::IsFused(op.kind) ? &block.ops[i + 1] : nullptr;
+    const auto retire_first = [&] {
+      if (code != nullptr) {
+        RecordRetired(memory::LoadFromHost(code + i * kInstrBytes, memory::AccessType::kWord),
+                      /*taken=*/false, 0);
+      }
+      ++instret_;
+      ++clock_;
+      ++i;
+      pc += kInstrBytes;
+      pc_ = pc;
+      if (models_.caches != nullptr) {
+        models_.caches->Fetch(pc, block.paddr + i * kInstrBytes);
+      }
+      if (models_.heatmap != nullptr) {
+        models_.heatmap->Record(block.paddr + i * kInstrBytes, memory::Access::kExecute);
+      }
+    };
+    uint32_t target = 0;
+    bool taken = false;
+    bool stop = false;
+    switch (op.kind) {
+     case engine::OpKind::kNop:
+      break;
+     case engine::OpKind::kLoadImm:
+      registers_[op.rd] = op.imm;
+      break;
+     case engine::OpKind::kJal:
+      target = op.imm;
+      taken = true;
+      if (op.rd != 0) {
+        registers_[op.rd] = pc + kInstrBytes;
+      }
+      break;
+     case engine::OpKind::kJalr:
+      target = (rs1 + op.imm) & ~0b1U;
+      taken = true;
+      if (op.rd != 0) {
+        registers_[op.rd] = pc + kInstrBytes;
+      }
+      break;
+     case engine::OpKind::kBeq:
+     case engine::OpKind::kBne:
+     case engine::OpKind::kBlt:
+     case engine::OpKind::kBge:
+     case engine::OpKind::kBltu:
+     case engine::OpKind::kBgeu:
+      taken = IsTaken(op.kind, rs1, rs2);
+      target = op.imm;
+      break;
+     case engine::OpKind::kLoad:
+     case engine::OpKind::kStore: {
+      ASSIGN_OR_RETURN(stop, RunMemoryOp(op, rs1, epoch));
+      break;
+     }
+     case engine::OpKind::kAddi:
+     case engine::OpKind::kAdd:
+      registers_[op.rd] = rs1 + (op.kind == engine::OpKind::kAdd ? rs2 : op.imm);
+      break;
+     case engine::OpKind::kSub:
+      registers_[op.rd] = rs1 - rs2;
+      break;
+     case engine::OpKind::kXori:
+      registers_[op.rd] = rs1 ^ op.imm;
+      break;
+     case engine::OpKind::kXor:
+      registers_[op.rd] = rs1 ^ rs2;
+      break;
+     case engine::OpKind::kOri:
+      registers_[op.rd] = rs1 | op.imm;
+      break;
+     case engine::OpKind::kOr:
+      registers_[op.rd] = rs1 | rs2;
+      break;
+     case engine::OpKind::kAndi:
+      registers_[op.rd] = rs1 & op.imm;
+      break;
+     case engine::OpKind::kAnd:
+      registers_[op.rd] = rs1 & rs2;
+      break;
+     case engine::OpKind::kSlli:
+      registers_[op.rd] = rs1 << op.imm;
+      break;
+     case engine::OpKind::kSll:
+      registers_[op.rd] = rs1 << (rs2 & alu::constants::kMaxShiftMask);
+      break;
+     case engine::OpKind::kSrli:
+      registers_[op.rd] = rs1 >> op.imm;
+      break;
+     case engine::OpKind::kSrl:
+      registers_[op.rd] = rs1 >> (rs2 & alu::constants::kMaxShiftMask);
+      break;
+     case engine::OpKind::kSrai:
+      registers_[op.rd] = static_cast<uint32_t>(static_cast<int32_t>(rs1) >> op.imm);
+      break;
+     case engine::OpKind::kSra:
+      registers_[op.rd] = static_cast<uint32_t>(
+          static_cast<int32_t>(rs1) >> (rs2 & alu::constants::kMaxShiftMask));
+      break;
+
+     case engine::OpKind::kLoadImmAddi:
+      // Both halves write the same register; only the sum stays visible.
+      retire_first();
+      registers_[next->rd] = op.imm + next->imm;
+      break;
+     case engine::OpKind::kLoadImmJalr:
+      registers_[op.rd] = op.imm;
+      retire_first();
+      target = (op.imm + next->imm) & ~0b1U;
+      taken = true;
+      if (next->rd != 0) {
+        registers_[next->rd] = pc + kInstrBytes;
+      }
+      break;
+     case engine::OpKind::kLoadImmLoad:
+     case engine::OpKind::kLoadImmStore: {
+      registers_[op.rd] = op.imm;
+      retire_first();
+      ASSIGN_OR_RETURN(stop, RunMemoryOp(*next, op.imm, epoch));
+      break;
+     }
+     case engine::OpKind::kSlliSrli:
+      registers_[op.rd] = rs1 << op.imm;
+      retire_first();
+      registers_[next->rd] = registers_[next->rs1] >> next->imm;
+      break;
+     case engine::OpKind::kSlliSrai:
+      registers_[op.rd] = rs1 << op.imm;
+      retire_first();
+      registers_[next->rd] =
+          static_cast<uint32_t>(static_cast<int32_t>(registers_[next->rs1]) >> next->imm);
+      break;
+     case engine::OpKind::kAddiBranch:
+     case engine::OpKind::kAndiBranch:
+      registers_[op.rd] = op.kind == engine::OpKind::kAddiBranch ? rs1 + op.imm : rs1 & op.imm;
+      retire_first();
+      taken = IsTaken(next->kind, registers_[next->rs1], registers_[next->rs2]);
+      target = next->imm;
+      break;
+    }
+    if (taken) {
+      DetectIdleLoop(pc, target);
+    }
+    if (code != nullptr && !exception_) {
+      RecordRetired(memory::LoadFromHost(code + i * kInstrBytes, memory::AccessType::kWord),
+                    taken, target);
+    }
+    if (!exception_) {
+      ++instret_;
+    }
+    ++clock_;
+    if (stop) {
+      return absl::OkStatus();
+    }
+    if (taken) {
+      redirect_pc_ = target;
+      exit = op.kind == engine::OpKind::kJalr ? engine::kIndirect : engine::kTaken;
+      return absl::OkStatus();
+    }
+  }
+  redirect_pc_ = pc;
+  exit = engine::kFallthrough;
+  return absl::OkStatus();
+}
+
+}  // namespace riscv_emu
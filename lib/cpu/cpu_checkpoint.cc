@@ -0,0 +1,138 @@
+// Whole-machine checkpoints. The hart and devices are encoded field by
+// field between instructions; RAM goes to the checkpoint file page by
+// page and comes back as a copy-on-write mapping of it.
+
+#include <utility>
+#include "cpu.h"
+#include "absl/strings/str_cat.h"
+#include "status_macros.h"
+
+namespace riscv_emu {
+
+absl::Status Cpu::SaveCheckpoint(const absl::string_view path, const bool incremental) {
+  if (incremental && !last_checkpoint_.has_value()) {
+    return absl::FailedPreconditionError(
+        "An incremental checkpoint needs a checkpoint saved or restored first");
+  }
+  if (hostcalls_.HasOpenFiles()) {
+    return absl::FailedPreconditionError("The guest has host files open");
+  }
+  checkpoint::StateWriter out;
+  RETURN_IF_ERROR(SaveMachineState(out));
+  memory::Dram& dram = bus_.GetDram();
+  ASSIGN_OR_RETURN(const uint64_t id,
+                   checkpoint::Checkpoint::Write(
+                       path, out.GetData(), dram,
+                       incremental ? last_checkpoint_ : std::nullopt, dram.GetDirtyPages()));
+  dram.ClearDirty();
+  last_checkpoint_ = checkpoint::Checkpoint::Base{id, std::string(path)};
+  if (history_ != nullptr) {
+    history_->Clear();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Cpu::RestoreCheckpoint(const absl::string_view path) {
+  // Newest first.
+  std::vector<checkpoint::Checkpoint> chain;
+  ASSIGN_OR_RETURN(checkpoint::Checkpoint newest, checkpoint::Checkpoint::Open(path));
+  chain.push_back(std::move(newest));
+  while (chain.back().GetBase().has_value()) {
+    const checkpoint::Checkpoint::Base base = *chain.back().GetBase();
+    ASSIGN_OR_RETURN(checkpoint::Checkpoint older, checkpoint::Checkpoint::Open(base.path));
+    if (older.GetId() != base.id) {
+      return absl::FailedPreconditionError(
+          absl::StrCat(base.path, " is not the checkpoint ", path, " was saved on top of"));
+    }
+    chain.push_back(std::move(older));
+  }
+
+  memory::Dram& dram = bus_.GetDram();
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    RETURN_IF_ERROR(it->MapPages(dram));
+  }
+  RETURN_IF_ERROR(LoadMachineState(chain.front().GetState()));
+  dram.InvalidateCode();
+  dram.ClearDirty();
+  last_checkpoint_ = checkpoint::Checkpoint::Base{chain.front().GetId(), std::string(path)};
+  if (history_ != nullptr) {
+    history_->Clear();
+  }
+  ResumeAfterRestore();
+  VLOG(1) << "Restored " << path << " (" << chain.size() << " files) at clock " << clock_;
+  return absl::OkStatus();
+}
+
+void Cpu::ResumeAfterRestore() {
+  if (history_ != nullptr) {
+    ScheduleHistory();
+  }
+  if (sampler_ != nullptr) {
+    ScheduleSampling();
+  }
+  // The calls open before the restore will not return.
+  if (models_.calls != nullptr) {
+    models_.calls->Unwind();
+  }
+  if (models_.heatmap != nullptr) {
+    ScheduleHeatmap(models_.heatmap->GetConfig().interval);
+  }
+}
+
+absl::Status Cpu::SaveMachineState(checkpoint::StateWriter& out) const {
+  ASSIGN_OR_RETURN(const uint32_t next_pc, NextPc());
+  for (uint32_t reg = 1; reg < 32; ++reg) {
+    out.U32(registers_[reg]);
+  }
+  out.U32(next_pc);
+  out.U64(clock_);
+  out.U64(instret_);
+  idle_loop_.Save(out);
+  csrs_.Save(out);
+  const pmp::Pmp::Registers pmp = pmp_.GetRegisters();
+  for (const uint8_t cfg : pmp.cfg) {
+    out.U8(cfg);
+  }
+  for (const uint32_t addr : pmp.addr) {
+    out.U32(addr);
+  }
+  syscalls_.Save(out);
+  return bus_.Save(out);
+}
+
+absl::Status Cpu::LoadMachineState(const absl::string_view state) {
+  checkpoint::StateReader in(state);
+  for (uint32_t reg = 1; reg < 32; ++reg) {
+    registers_[reg] = in.U32();
+  }
+  redirect_pc_ = in.U32();
+  exception_ = false;
+  clock_ = in.U64();
+  instret_ = in.U64();
+  RETURN_IF_ERROR(idle_loop_.Load(in));
+  RETURN_IF_ERROR(csrs_.Load(in));
+  pmp::Pmp::Registers pmp;
+  for (uint8_t& cfg : pmp.cfg) {
+    cfg = in.U8();
+  }
+  for (uint32_t& addr : pmp.addr) {
+    addr = in.U32();
+  }
+  pmp_.SetRegisters(pmp);
+  RETURN_IF_ERROR(syscalls_.Load(in));
+  // Devices re-arm their events against the restored clock.
+  scheduler_.Clear();
+  RETURN_IF_ERROR(bus_.Load(in));
+  RETURN_IF_ERROR(in.GetStatus());
+  if (!in.AtEnd()) {
+    return absl::DataLossError("Unexpected data after the checkpoint state");
+  }
+
+  mmu_.SetSatp(csrs_.GetSatp());
+  mmu_.SetStatus(csrs_.IsSumSet(), csrs_.IsMxrSet());
+  hostcalls_.ResetExitCode();
+  RequestInterruptCheck();
+  return absl::OkStatus();
+}
+
+}  // namespace riscv_emu
@@ -0,0 +1,139 @@
+// Reverse execution. Snapshots are taken on multiples of the history
+// interval by a background event, so they neither wake the hart nor
+// change what it runs, and a replay takes them at the same points as the
+// run it repeats. Going back restores the nearest earlier snapshot and
+// runs forward to the target instret with the host inputs taken from the
+// input log, which makes the replay an exact repeat of the original run.
+
+#include <algorithm>
+#include <utility>
+#include "cpu.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "status_macros.h"
+
+namespace riscv_emu {
+
+void Cpu::ScheduleHistory() {
+  const uint64_t interval = options_.history_interval;
+  scheduler_.ScheduleBackground((clock_ / interval + 1) * interval,
+                                [this](uint64_t) { return RecordHistory(); });
+}
+
+absl::Status Cpu::RecordHistory() {
+  ScheduleHistory();
+  // Host file offsets cannot be rolled back.
+  if (hostcalls_.HasOpenFiles()) {
+    return absl::OkStatus();
+  }
+  checkpoint::StateWriter out;
+  const absl::Status status = SaveMachineState(out);
+  if (absl::IsFailedPrecondition(status)) {
+    // Disk requests are in flight; try again at the next interval.
+    return absl::OkStatus();
+  }
+  RETURN_IF_ERROR(status);
+  history_->Record(bus_.GetDram(), clock_, instret_, input_log_->GetPosition(), out.GetData());
+  input_log_->Forget(history_->Get(0).input_position);
+  // The dirty-page list is the history's from now on.
+  last_checkpoint_.reset();
+  return absl::OkStatus();
+}
+
+absl::Status Cpu::RestoreHistory(const size_t index) {
+  // The host must be done writing into RAM before it is rolled back.
+  bus_.DropDiskRequests();
+  // Rolling RAM back is not guest traffic; keep it out of the heatmap.
+  bus_.GetDram().SetHeatmap(nullptr);
+  const history::History::Snapshot& snapshot = history_->Rewind(bus_.GetDram(), index);
+  bus_.GetDram().SetHeatmap(models_.heatmap.get());
+  RETURN_IF_ERROR(LoadMachineState(snapshot.state));
+  RETURN_IF_ERROR(input_log_->Rewind(snapshot.input_position));
+  ScheduleHistory();
+  if (models_.calls != nullptr) {
+    models_.calls->Unwind();
+  }
+  if (models_.heatmap != nullptr) {
+    ScheduleHeatmap(models_.heatmap->GetConfig().interval);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Cpu::RunToInstret(const uint64_t instret) {
+  // The models have seen these instructions already.
+  Models models = std::move(models_);
+  bus_.GetDram().SetHeatmap(nullptr);
+  absl::Status status;
+  while (status.ok() && instret_ < instret) {
+    // Every instruction takes at least a tick, so stopping this many ticks
+    // out cannot overshoot. Exceptions and wfi take more, hence the loop.
+    bool reached = false;
+    const sched::EventId stop = scheduler_.ScheduleBackground(
+        clock_ + (instret - instret_), [this, &reached](uint64_t) {
+          reached = true;
+          PowerOff();
+          return absl::OkStatus();
+        });
+    status = Boot();
+    scheduler_.Cancel(stop);
+    if (status.ok() && !reached) {
+      status = absl::FailedPreconditionError(absl::StrCat(
+          "The guest stopped at instret ", instret_, " before reaching ", instret));
+    }
+  }
+  models_ = std::move(models);
+  bus_.GetDram().SetHeatmap(models_.heatmap.get());
+  return status;
+}
+
+absl::Status Cpu::StepBack(const uint64_t count) {
+  if (history_ == nullptr) {
+    return absl::FailedPreconditionError("Reverse execution needs a history interval");
+  }
+  const uint64_t target = instret_ - std::min(count, instret_);
+  const std::optional<size_t> index = history_->FindAtOrBefore(target);
+  if (!index.has_value()) {
+    return absl::OutOfRangeError(absl::StrCat("Instret ", target, " is older than the history"));
+  }
+  RETURN_IF_ERROR(RestoreHistory(*index));
+  return RunToInstret(target);
+}
+
+absl::Status Cpu::RunBackToWrite(const uint32_t paddr, const uint32_t len) {
+  if (history_ == nullptr) {
+    return absl::FailedPreconditionError("Reverse execution needs a history interval");
+  }
+  // Replay one interval at a time, newest first, until one holds a write.
+  const uint64_t now = instret_;
+  uint64_t end = now;
+  while (true) {
+    const std::optional<size_t> index =
+        end == 0 ? std::nullopt : history_->FindAtOrBefore(end - 1);
+    if (!index.has_value()) {
+      if (end != now) {
+        // Leave the machine where it was.
+        RETURN_IF_ERROR(RestoreHistory(*history_->FindAtOrBefore(now)));
+        RETURN_IF_ERROR(RunToInstret(now));
+      }
+      return absl::NotFoundError(absl::StrFormat(
+          "No store to 0x%08x since the oldest snapshot", paddr));
+    }
+    const uint64_t start = history_->Get(*index).instret;
+    RETURN_IF_ERROR(RestoreHistory(*index));
+    watch_ = Watch{paddr, paddr + len, std::nullopt};
+    // Devices, host calls and page-table walks write RAM too.
+    bus_.GetDram().SetWriteWatch(paddr, paddr + len, [this] { watch_->last_hit = instret_; });
+    const absl::Status status = RunToInstret(end);
+    bus_.GetDram().ClearWriteWatch();
+    const std::optional<uint64_t> hit = watch_->last_hit;
+    watch_.reset();
+    RETURN_IF_ERROR(status);
+    if (hit.has_value()) {
+      RETURN_IF_ERROR(RestoreHistory(*history_->FindAtOrBefore(*hit)));
+      return RunToInstret(*hit);
+    }
+    end = start;
+  }
+}
+
+}  // namespace riscv_emu
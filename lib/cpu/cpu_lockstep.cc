@@ -0,0 +1,147 @@
+// Differential checking: sampled blocks run twice, once through the
+// five-stage interpreter, which is the reference, and once as compiled
+// blocks, and the run stops at the first block where the two disagree on
+// registers, the next pc, counters, trap state or RAM writes. Each check
+// only needs the hart's own state and the RAM it wrote, so it costs two
+// runs of one block and corpus runs can be checked in parallel processes.
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include "cpu.h"
+#include "absl/strings/str_format.h"
+#include "status_macros.h"
+
+namespace riscv_emu {
+
+  namespace {
+
+    // Trap state a block can change; the rest is only written by system
+    // instructions, which blocks never contain.
+    constexpr uint32_t kCheckedCsrs[] = {
+        csr::constants::kMstatus, csr::constants::kMepc, csr::constants::kMcause,
+        csr::constants::kMtval, csr::constants::kSepc, csr::constants::kScause,
+        csr::constants::kStval,
+    };
+
+  }  // namespace
+
+Cpu::ArchState Cpu::SaveState() const {
+  ArchState state{.pc = pc_,
+                  .redirect_pc = redirect_pc_,
+                  .exception = exception_,
+                  .clock = clock_,
+                  .instret = instret_,
+                  .alu_out = alu_out_,
+                  .csrs = csrs_,
+                  .decoder = decoder_,
+                  .idle_loop = idle_loop_};
+  std::copy(std::begin(registers_), std::end(registers_), state.registers.begin());
+  return state;
+}
+
+void Cpu::RestoreState(const ArchState& state) {
+  std::copy(state.registers.begin(), state.registers.end(), std::begin(registers_));
+  pc_ = state.pc;
+  redirect_pc_ = state.redirect_pc;
+  exception_ = state.exception;
+  clock_ = state.clock;
+  instret_ = state.instret;
+  alu_out_ = state.alu_out;
+  csrs_ = state.csrs;
+  decoder_ = state.decoder;
+  idle_loop_ = state.idle_loop;
+}
+
+absl::Status Cpu::RunBlockChecked(engine::Block& block, std::optional<engine::Exit>& exit) {
+  const ArchState before = SaveState();
+  std::vector<MemWrite> reference_writes;
+  write_log_ = &reference_writes;
+  bus_accessed_ = false;
+  const absl::Status reference_status = InterpretRun(block.size);
+  write_log_ = nullptr;
+  RETURN_IF_ERROR(reference_status);
+  if (bus_accessed_) {
+    // Device accesses cannot be undone, so this run has to stand.
+    ++lockstep_stats_.skipped;
+    exit.reset();
+    return absl::OkStatus();
+  }
+
+  const ArchState reference = SaveState();
+  ASSIGN_OR_RETURN(const uint32_t reference_pc, NextPc());
+  for (auto write = reference_writes.rbegin(); write != reference_writes.rend(); ++write) {
+    memory::StoreToHost(write->host, write->type, write->old_val);
+  }
+  RestoreState(before);
+
+  std::vector<MemWrite> fast_writes;
+  write_log_ = &fast_writes;
+  // The models have seen these instructions already.
+  Models models = std::move(models_);
+  const absl::Status fast_status = RunBlock(block, exit);
+  models_ = std::move(models);
+  write_log_ = nullptr;
+  RETURN_IF_ERROR(fast_status);
+  ASSIGN_OR_RETURN(const uint32_t fast_pc, NextPc());
+  ++lockstep_stats_.checked;
+
+  std::string divergence;
+  if (bus_accessed_) {
+    divergence = "the block accessed a device, the interpreter did not";
+  } else if (fast_pc != reference_pc) {
+    divergence = absl::StrFormat("next pc 0x%08x, expected 0x%08x", fast_pc, reference_pc);
+  } else {
+    divergence = DescribeDivergence(reference, SaveState(), reference_writes, fast_writes);
+  }
+  if (divergence.empty()) {
+    return absl::OkStatus();
+  }
+  return absl::InternalError(absl::StrFormat(
+      "Lockstep divergence in the block at 0x%08x (%d ops, paddr 0x%08x) entered at instret "
+      "%d, after %d clean checks: %s",
+      block.pc, block.size, block.paddr, before.instret, lockstep_stats_.checked - 1,
+      divergence));
+}
+
+std::string Cpu::DescribeDivergence(const ArchState& reference, const ArchState& fast,
+                                    const std::vector<MemWrite>& reference_writes,
+                                    const std::vector<MemWrite>& fast_writes) const {
+  for (uint32_t reg = 1; reg < reference.registers.size(); ++reg) {
+    if (fast.registers[reg] != reference.registers[reg]) {
+      return absl::StrFormat("x%d is 0x%08x, expected 0x%08x", reg, fast.registers[reg],
+                             reference.registers[reg]);
+    }
+  }
+  if (fast.instret != reference.instret || fast.clock != reference.clock) {
+    return absl::StrFormat("instret/clock %d/%d, expected %d/%d", fast.instret, fast.clock,
+                           reference.instret, reference.clock);
+  }
+  if (fast.csrs.GetPrivilege() != reference.csrs.GetPrivilege()) {
+    return absl::StrFormat("privilege %d, expected %d",
+                           static_cast<int>(fast.csrs.GetPrivilege()),
+                           static_cast<int>(reference.csrs.GetPrivilege()));
+  }
+  for (const uint32_t addr : kCheckedCsrs) {
+    const uint32_t got = fast.csrs.Read(addr).value_or(0);
+    const uint32_t want = reference.csrs.Read(addr).value_or(0);
+    if (got != want) {
+      return absl::StrFormat("csr 0x%03x is 0x%08x, expected 0x%08x", addr, got, want);
+    }
+  }
+  const size_t common = std::min(fast_writes.size(), reference_writes.size());
+  for (size_t i = 0; i < common; ++i) {
+    const MemWrite& got = fast_writes[i];
+    const MemWrite& want = reference_writes[i];
+    if (got.paddr != want.paddr || got.type != want.type || got.new_val != want.new_val) {
+      return absl::StrFormat("store %d wrote 0x%08x to 0x%08x, expected 0x%08x to 0x%08x", i,
+                             got.new_val, got.paddr, want.new_val, want.paddr);
+    }
+  }
+  if (fast_writes.size() != reference_writes.size()) {
+    return absl::StrFormat("%d stores, expected %d", fast_writes.size(), reference_writes.size());
+  }
+  return "";
+}
+
+}  // namespace riscv_emu
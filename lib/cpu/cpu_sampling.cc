@@ -0,0 +1,96 @@
+// Sampled simulation. The hart runs with the models parked for most of
+// each period, then attaches them for a warm-up window, which refills the
+// caches, predictors and pipeline, and a measured window, whose CPI is one
+// sample. Phases change on background events, so sampling neither wakes
+// the hart nor changes what it runs; parking only moves the models aside,
+// and the hart and RAM are left in place. An event that fires late, after
+// the hart idled past it, shortens its window.
+
+#include <algorithm>
+#include <utility>
+#include "cpu.h"
+
+namespace riscv_emu {
+
+namespace {
+
+  // Ticks from the start of a period to its warm-up.
+  uint64_t WarmOffset(const timing::SamplingConfig& config) {
+    return config.period - config.warmup - config.measure;
+  }
+
+  // First period whose warm-up starts at or after `now`.
+  uint64_t NextPeriod(const timing::SamplingConfig& config, const uint64_t now) {
+    const uint64_t offset = WarmOffset(config);
+    if (now <= offset) {
+      return 0;
+    }
+    return (now - offset + config.period - 1) / config.period * config.period;
+  }
+
+}  // namespace
+
+void Cpu::ScheduleSampling() {
+  if (models_.pipeline != nullptr) {
+    ParkModels();
+  }
+  ScheduleSamplePhase(SamplePhase::kWarm, NextPeriod(sampler_->GetConfig(), clock_));
+}
+
+void Cpu::ParkModels() {
+  parked_models_.caches = std::move(models_.caches);
+  parked_models_.branches = std::move(models_.branches);
+  parked_models_.pipeline = std::move(models_.pipeline);
+}
+
+void Cpu::AttachModels() {
+  models_.caches = std::move(parked_models_.caches);
+  models_.branches = std::move(parked_models_.branches);
+  models_.pipeline = std::move(parked_models_.pipeline);
+}
+
+void Cpu::ScheduleSamplePhase(const SamplePhase phase, const uint64_t period_start) {
+  const timing::SamplingConfig& config = sampler_->GetConfig();
+  uint64_t at = period_start + config.period;
+  switch (phase) {
+   case SamplePhase::kWarm:
+    at = period_start + WarmOffset(config);
+    break;
+   case SamplePhase::kMeasure:
+    at -= config.measure;
+    break;
+   case SamplePhase::kEnd:
+    break;
+  }
+  scheduler_.ScheduleBackground(at, [this, phase, period_start](const uint64_t now) {
+    RunSamplePhase(phase, period_start, now);
+    return absl::OkStatus();
+  });
+}
+
+void Cpu::RunSamplePhase(const SamplePhase phase, const uint64_t period_start,
+                         const uint64_t now) {
+  switch (phase) {
+   case SamplePhase::kWarm:
+    AttachModels();
+    ScheduleSamplePhase(SamplePhase::kMeasure, period_start);
+    break;
+   case SamplePhase::kMeasure:
+    window_instructions_ = models_.pipeline->GetStats().instructions;
+    window_cycles_ = models_.pipeline->GetCycles();
+    ScheduleSamplePhase(SamplePhase::kEnd, period_start);
+    break;
+   case SamplePhase::kEnd: {
+    sampler_->AddWindow(models_.pipeline->GetStats().instructions - window_instructions_,
+                        models_.pipeline->GetCycles() - window_cycles_);
+    ParkModels();
+    // Periods the hart idled through are skipped.
+    const uint64_t period = sampler_->GetConfig().period;
+    ScheduleSamplePhase(SamplePhase::kWarm,
+                        std::max(period_start + period, NextPeriod(sampler_->GetConfig(), now)));
+    break;
+   }
+  }
+}
+
+}  // namespace riscv_emu
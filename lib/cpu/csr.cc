@@ -0,0 +1,292 @@
+#include "csr.h"
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+
+namespace riscv_emu::csr {
+
+namespace {
+
+constexpr uint32_t Bit(const Interrupt irq) {
+  return 1U << static_cast<uint32_t>(irq);
+}
+
+constexpr uint32_t Bit(const Exception cause) {
+  return 1U << static_cast<uint32_t>(cause);
+}
+
+constexpr uint32_t kSupervisorInterrupts = Bit(Interrupt::kSupervisorSoftware) |
+                                           Bit(Interrupt::kSupervisorTimer) |
+                                           Bit(Interrupt::kSupervisorExternal);
+constexpr uint32_t kMieWriteMask = kSupervisorInterrupts |
+                                   Bit(Interrupt::kMachineSoftware) |
+                                   Bit(Interrupt::kMachineTimer) |
+                                   Bit(Interrupt::kMachineExternal);
+// The M-level bits are driven by devices; software only owns the S-level
+// ones (and only SSIP from S-mode).
+constexpr uint32_t kMipWriteMask = kSupervisorInterrupts;
+constexpr uint32_t kSipWriteMask = Bit(Interrupt::kSupervisorSoftware);
+// Only S-level interrupts can be delegated.
+constexpr uint32_t kMidelegWriteMask = kSupervisorInterrupts;
+// Everything but an ecall from M-mode, which never traps below M.
+constexpr uint32_t kMedelegWriteMask = 0xffff & ~Bit(Exception::kECallFromM);
+
+constexpr uint32_t kTvecModeMask = constants::kMtvecModeMask;
+
+// Highest priority first, as mandated by the privileged spec.
+constexpr Interrupt kInterruptPriority[] = {
+  Interrupt::kMachineExternal,
+  Interrupt::kMachineSoftware,
+  Interrupt::kMachineTimer,
+  Interrupt::kSupervisorExternal,
+  Interrupt::kSupervisorSoftware,
+  Interrupt::kSupervisorTimer,
+};
+
+uint32_t TrapVector(const uint32_t tvec, const uint32_t cause) {
+  const uint32_t base = tvec & ~kTvecModeMask;
+  const bool is_interrupt = cause & constants::kInterruptBit;
+  if (is_interrupt && (tvec & kTvecModeMask) == constants::kMtvecModeVectored) {
+    return base + 4 * (cause & ~constants::kInterruptBit);
+  }
+  return base;
+}
+
+}  // namespace
+
+absl::StatusOr<uint32_t> CsrFile::Read(const uint32_t addr) const {
+  switch (addr) {
+   case constants::kSstatus:
+    return mstatus_ & constants::kSstatusMask;
+   case constants::kSie:
+    return mie_ & mideleg_;
+   case constants::kStvec:
+    return stvec_;
+   case constants::kScounteren:
+   case constants::kMcounteren:
+    // cycle, time and instret are always accessible.
+    return 0b111;
+   case constants::kSscratch:
+    return sscratch_;
+   case constants::kSepc:
+    return sepc_;
+   case constants::kScause:
+    return scause_;
+   case constants::kStval:
+    return stval_;
+   case constants::kSip:
+    return mip_ & mideleg_;
+   case constants::kSatp:
+    return satp_;
+   case constants::kMstatus:
+    return mstatus_;
+   case constants::kMisa:
+    return constants::kMisaValue;
+   case constants::kMedeleg:
+    return medeleg_;
+   case constants::kMideleg:
+    return mideleg_;
+   case constants::kMie:
+    return mie_;
+   case constants::kMtvec:
+    return mtvec_;
+   case constants::kMscratch:
+    return mscratch_;
+   case constants::kMepc:
+    return mepc_;
+   case constants::kMcause:
+    return mcause_;
+   case constants::kMtval:
+    return mtval_;
+   case constants::kMip:
+    return mip_;
+   case constants::kMhartid:
+    return 0;
+   default:
+    return absl::NotFoundError(absl::StrCat("Unsupported CSR 0x", absl::Hex(addr)));
+  }
+}
+
+absl::Status CsrFile::Write(const uint32_t addr, const uint32_t val) {
+  switch (addr) {
+   case constants::kSstatus:
+    mstatus_ = (mstatus_ & ~constants::kSstatusMask) | (val & constants::kSstatusMask);
+    break;
+   case constants::kSie:
+    mie_ = (mie_ & ~mideleg_) | (val & mideleg_);
+    break;
+   case constants::kStvec:
+    stvec_ = val;
+    break;
+   case constants::kScounteren:
+   case constants::kMcounteren:
+   case constants::kMisa:
+    // WARL: writes are ignored, all implemented bits are read-only.
+    break;
+   case constants::kSscratch:
+    sscratch_ = val;
+    break;
+   case constants::kSepc:
+    sepc_ = val & ~0b11U;
+    break;
+   case constants::kScause:
+    scause_ = val;
+    break;
+   case constants::kStval:
+    stval_ = val;
+    break;
+   case constants::kSip: {
+    const uint32_t mask = kSipWriteMask & mideleg_;
+    mip_ = (mip_ & ~mask) | (val & mask);
+    break;
+   }
+   case constants::kSatp:
+    satp_ = val & constants::kSatpWriteMask;
+    break;
+   case constants::kMstatus: {
+    mstatus_ = val & constants::kMstatusWriteMask;
+    // MPP is WARL; the reserved encoding 2 reads back as U.
+    if (((mstatus_ & constants::kMstatusMppMask) >> constants::kMstatusMppShift) == 0b10) {
+      mstatus_ &= ~constants::kMstatusMppMask;
+    }
+    break;
+   }
+   case constants::kMedeleg:
+    medeleg_ = val & kMedelegWriteMask;
+    break;
+   case constants::kMideleg:
+    mideleg_ = val & kMidelegWriteMask;
+    break;
+   case constants::kMip:
+    mip_ = (mip_ & ~kMipWriteMask) | (val & kMipWriteMask);
+    break;
+   case constants::kMie:
+    mie_ = val & kMieWriteMask;
+    break;
+   case constants::kMtvec:
+    mtvec_ = val;
+    break;
+   case constants::kMscratch:
+    mscratch_ = val;
+    break;
+   case constants::kMepc:
+    mepc_ = val & ~0b11U;
+    break;
+   case constants::kMcause:
+    mcause_ = val;
+    break;
+   case constants::kMtval:
+    mtval_ = val;
+    break;
+   default:
+    return absl::NotFoundError(absl::StrCat("Unsupported CSR 0x", absl::Hex(addr)));
+  }
+  return absl::OkStatus();
+}
+
+uint32_t CsrFile::EnterTrap(const uint32_t cause, const uint32_t tval, const uint32_t epc) {
+  VLOG(2) << "Trap: cause 0x" << std::hex << cause << ", epc 0x" << epc;
+  const bool is_interrupt = cause & constants::kInterruptBit;
+  const uint32_t deleg = is_interrupt ? mideleg_ : medeleg_;
+  const uint32_t code = cause & ~constants::kInterruptBit;
+  if (priv_ != Privilege::kMachine && code < 32 && (deleg & (1U << code))) {
+    sepc_ = epc;
+    scause_ = cause;
+    stval_ = tval;
+    // SPIE <- SIE, SIE <- 0, SPP <- privilege.
+    const bool sie = mstatus_ & constants::kMstatusSie;
+    mstatus_ &= ~(constants::kMstatusSie | constants::kMstatusSpie | constants::kMstatusSpp);
+    mstatus_ |= (sie ? constants::kMstatusSpie : 0) |
+                (priv_ == Privilege::kSupervisor ? constants::kMstatusSpp : 0);
+    priv_ = Privilege::kSupervisor;
+    return TrapVector(stvec_, cause);
+  }
+
+  mepc_ = epc;
+  mcause_ = cause;
+  mtval_ = tval;
+  // MPIE <- MIE, MIE <- 0, MPP <- privilege.
+  const bool mie = mstatus_ & constants::kMstatusMie;
+  mstatus_ &= ~(constants::kMstatusMie | constants::kMstatusMpie | constants::kMstatusMppMask);
+  mstatus_ |= (mie ? constants::kMstatusMpie : 0) |
+              (static_cast<uint32_t>(priv_) << constants::kMstatusMppShift);
+  priv_ = Privilege::kMachine;
+  return TrapVector(mtvec_, cause);
+}
+
+uint32_t CsrFile::ReturnFromTrap() {
+  const bool mpie = mstatus_ & constants::kMstatusMpie;
+  priv_ = static_cast<Privilege>(
+      (mstatus_ & constants::kMstatusMppMask) >> constants::kMstatusMppShift);
+  // MIE <- MPIE, MPIE <- 1, MPP <- U.
+  mstatus_ &= ~(constants::kMstatusMie | constants::kMstatusMppMask);
+  mstatus_ |= (mpie ? constants::kMstatusMie : 0) | constants::kMstatusMpie;
+  if (priv_ != Privilege::kMachine) {
+    mstatus_ &= ~constants::kMstatusMprv;
+  }
+  return mepc_;
+}
+
+uint32_t CsrFile::ReturnFromSupervisorTrap() {
+  const bool spie = mstatus_ & constants::kMstatusSpie;
+  priv_ = (mstatus_ & constants::kMstatusSpp) ? Privilege::kSupervisor : Privilege::kUser;
+  // SIE <- SPIE, SPIE <- 1, SPP <- U.
+  mstatus_ &= ~(constants::kMstatusSie | constants::kMstatusSpp | constants::kMstatusMprv);
+  mstatus_ |= (spie ? constants::kMstatusSie : 0) | constants::kMstatusSpie;
+  return sepc_;
+}
+
+Privilege CsrFile::GetDataPrivilege() const {
+  if (priv_ == Privilege::kMachine && (mstatus_ & constants::kMstatusMprv)) {
+    return static_cast<Privilege>(
+        (mstatus_ & constants::kMstatusMppMask) >> constants::kMstatusMppShift);
+  }
+  return priv_;
+}
+
+void CsrFile::SetPending(const Interrupt irq, const bool level) {
+  if (level) {
+    mip_ |= Bit(irq);
+  } else {
+    mip_ &= ~Bit(irq);
+  }
+}
+
+std::optional<uint32_t> CsrFile::GetPendingInterrupt() const {
+  const uint32_t pending = mip_ & mie_;
+  if (pending == 0) {
+    return std::nullopt;
+  }
+  // Interrupts for a more privileged mode are always enabled; for the
+  // current mode they follow its xIE bit; for a lower mode never.
+  const bool m_enabled = priv_ != Privilege::kMachine || (mstatus_ & constants::kMstatusMie);
+  const bool s_enabled = priv_ == Privilege::kUser ||
+      (priv_ == Privilege::kSupervisor && (mstatus_ & constants::kMstatusSie));
+  const uint32_t enabled = (m_enabled ? pending & ~mideleg_ : 0) |
+                           (s_enabled ? pending & mideleg_ : 0);
+  for (const Interrupt irq : kInterruptPriority) {
+    if (enabled & Bit(irq)) {
+      return constants::kInterruptBit | static_cast<uint32_t>(irq);
+    }
+  }
+  return std::nullopt;
+}
+
+void CsrFile::Save(checkpoint::StateWriter& out) const {
+  out.U8(static_cast<uint8_t>(priv_));
+  for (const uint32_t val : {mstatus_, medeleg_, mideleg_, mie_, mip_, mtvec_, mscratch_, mepc_,
+                             mcause_, mtval_, stvec_, sscratch_, sepc_, scause_, stval_, satp_}) {
+    out.U32(val);
+  }
+}
+
+absl::Status CsrFile::Load(checkpoint::StateReader& in) {
+  priv_ = static_cast<Privilege>(in.U8());
+  for (uint32_t* val : {&mstatus_, &medeleg_, &mideleg_, &mie_, &mip_, &mtvec_, &mscratch_,
+                        &mepc_, &mcause_, &mtval_, &stvec_, &sscratch_, &sepc_, &scause_,
+                        &stval_, &satp_}) {
+    *val = in.U32();
+  }
+  return in.GetStatus();
+}
+
+}  // namespace riscv_emu::csr
@@ -0,0 +1,176 @@
+#ifndef LIB_CPU_CSR_H
+#define LIB_CPU_CSR_H
+
+#include <cstdint>
+#include <optional>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "lib/checkpoint/state.h"
+
+namespace riscv_emu::csr {
+
+namespace constants {
+
+  // Supervisor-mode CSR addresses.
+  constexpr uint32_t kSstatus = 0x100;
+  constexpr uint32_t kSie = 0x104;
+  constexpr uint32_t kStvec = 0x105;
+  constexpr uint32_t kScounteren = 0x106;
+  constexpr uint32_t kSscratch = 0x140;
+  constexpr uint32_t kSepc = 0x141;
+  constexpr uint32_t kScause = 0x142;
+  constexpr uint32_t kStval = 0x143;
+  constexpr uint32_t kSip = 0x144;
+  constexpr uint32_t kSatp = 0x180;
+
+  // Machine-mode CSR addresses.
+  constexpr uint32_t kMstatus = 0x300;
+  constexpr uint32_t kMisa = 0x301;
+  constexpr uint32_t kMedeleg = 0x302;
+  constexpr uint32_t kMideleg = 0x303;
+  constexpr uint32_t kMie = 0x304;
+  constexpr uint32_t kMtvec = 0x305;
+  constexpr uint32_t kMcounteren = 0x306;
+  constexpr uint32_t kMscratch = 0x340;
+  constexpr uint32_t kMepc = 0x341;
+  constexpr uint32_t kMcause = 0x342;
+  constexpr uint32_t kMtval = 0x343;
+  constexpr uint32_t kMip = 0x344;
+  constexpr uint32_t kMhartid = 0xf14;
+
+  // Counters. These are owned by the `Cpu`, not the `CsrFile`.
+  constexpr uint32_t kCycle = 0xc00;
+  constexpr uint32_t kTime = 0xc01;
+  constexpr uint32_t kInstret = 0xc02;
+  constexpr uint32_t kCycleh = 0xc80;
+  constexpr uint32_t kTimeh = 0xc81;
+  constexpr uint32_t kInstreth = 0xc82;
+  constexpr uint32_t kMcycle = 0xb00;
+  constexpr uint32_t kMinstret = 0xb02;
+  constexpr uint32_t kMcycleh = 0xb80;
+  constexpr uint32_t kMinstreth = 0xb82;
+
+  constexpr uint32_t kMstatusSie = 1U << 1;
+  constexpr uint32_t kMstatusMie = 1U << 3;
+  constexpr uint32_t kMstatusSpie = 1U << 5;
+  constexpr uint32_t kMstatusMpie = 1U << 7;
+  constexpr uint32_t kMstatusSpp = 1U << 8;
+  constexpr uint32_t kMstatusMppShift = 11;
+  constexpr uint32_t kMstatusMppMask = 0b11U << kMstatusMppShift;
+  constexpr uint32_t kMstatusMprv = 1U << 17;
+  constexpr uint32_t kMstatusSum = 1U << 18;
+  constexpr uint32_t kMstatusMxr = 1U << 19;
+  constexpr uint32_t kMstatusWriteMask = kMstatusSie | kMstatusMie | kMstatusSpie |
+                                         kMstatusMpie | kMstatusSpp | kMstatusMppMask |
+                                         kMstatusMprv | kMstatusSum | kMstatusMxr;
+  // The subset of `mstatus` visible through `sstatus`.
+  constexpr uint32_t kSstatusMask = kMstatusSie | kMstatusSpie | kMstatusSpp |
+                                    kMstatusSum | kMstatusMxr;
+
+  // Sv32 only, no ASIDs (ASIDLEN = 0).
+  constexpr uint32_t kSatpModeSv32 = 1U << 31;
+  constexpr uint32_t kSatpPpnMask = 0x3fffff;
+  constexpr uint32_t kSatpWriteMask = kSatpModeSv32 | kSatpPpnMask;
+
+  constexpr uint32_t kMtvecModeMask = 0b11;
+  constexpr uint32_t kMtvecModeVectored = 0b01;
+
+  // MXL=1 (32-bit), I extension, S and U modes.
+  constexpr uint32_t kMisaValue = (1U << 30) | (1U << 8) | (1U << 18) | (1U << 20);
+
+  constexpr uint32_t kInterruptBit = 1U << 31;
+
+}  // namespace constants
+
+enum class Privilege : uint32_t {
+  kUser = 0,
+  kSupervisor = 1,
+  kMachine = 3,
+};
+
+// Interrupt causes double as `mip`/`mie` bit positions.
+enum class Interrupt : uint32_t {
+  kSupervisorSoftware = 1,
+  kMachineSoftware = 3,
+  kSupervisorTimer = 5,
+  kMachineTimer = 7,
+  kSupervisorExternal = 9,
+  kMachineExternal = 11,
+};
+
+enum class Exception : uint32_t {
+  kInstrAddrMisaligned = 0,
+  kInstrAccessFault = 1,
+  kIllegalInstr = 2,
+  kBreakpoint = 3,
+  kLoadAddrMisaligned = 4,
+  kLoadAccessFault = 5,
+  kStoreAddrMisaligned = 6,
+  kStoreAccessFault = 7,
+  kECallFromU = 8,
+  kECallFromS = 9,
+  kECallFromM = 11,
+  kInstrPageFault = 12,
+  kLoadPageFault = 13,
+  kStorePageFault = 15,
+};
+
+class CsrFile final {
+ public:
+  // CSRs this hart does not implement are NotFound; the hart raises an
+  // illegal-instruction exception for them.
+  absl::StatusOr<uint32_t> Read(uint32_t addr) const;
+  absl::Status Write(uint32_t addr, uint32_t val);
+
+  // Takes a trap into M-mode, or into S-mode when the current privilege
+  // is below M and `medeleg`/`mideleg` delegates the cause. Latches the
+  // epc/cause/tval of the target mode, stacks its interrupt enable and
+  // privilege, and returns the address of the trap handler.
+  uint32_t EnterTrap(uint32_t cause, uint32_t tval, uint32_t epc);
+  // Restores the interrupt enable and privilege and returns `mepc` (mret).
+  uint32_t ReturnFromTrap();
+  // As `ReturnFromTrap`, from an S-mode trap (sret).
+  uint32_t ReturnFromSupervisorTrap();
+
+  inline Privilege GetPrivilege() const { return priv_; }
+  // Privilege that loads and stores are checked against: `mstatus.MPP`
+  // while M-mode has MPRV set.
+  Privilege GetDataPrivilege() const;
+  inline uint32_t GetSatp() const { return satp_; }
+  inline bool IsSumSet() const { return mstatus_ & constants::kMstatusSum; }
+  inline bool IsMxrSet() const { return mstatus_ & constants::kMstatusMxr; }
+
+  // Drives a hardware-owned `mip` bit; software cannot write these.
+  void SetPending(Interrupt irq, bool level);
+  // True if any enabled interrupt is pending, regardless of `mstatus.MIE`.
+  // This is the wake-up condition for wfi.
+  inline bool IsInterruptPending() const { return (mip_ & mie_) != 0; }
+  // Cause of the interrupt to take now, if any.
+  std::optional<uint32_t> GetPendingInterrupt() const;
+
+  void Save(checkpoint::StateWriter& out) const;
+  absl::Status Load(checkpoint::StateReader& in);
+
+ private:
+  Privilege priv_ = Privilege::kMachine;
+  uint32_t mstatus_ = 0;
+  uint32_t medeleg_ = 0;
+  uint32_t mideleg_ = 0;
+  uint32_t mie_ = 0;
+  uint32_t mip_ = 0;
+  uint32_t mtvec_ = 0;
+  uint32_t mscratch_ = 0;
+  uint32_t mepc_ = 0;
+  uint32_t mcause_ = 0;
+  uint32_t mtval_ = 0;
+  uint32_t stvec_ = 0;
+  uint32_t sscratch_ = 0;
+  uint32_t sepc_ = 0;
+  uint32_t scause_ = 0;
+  uint32_t stval_ = 0;
+  uint32_t satp_ = 0;
+};
+
+}  // namespace riscv_emu::csr
+
+#endif  // LIB_CPU_CSR_H
@@ -0,0 +1,91 @@
+#include "history.h"
+#include <cstring>
+#include "glog/logging.h"
+
+namespace riscv_emu::history {
+
+namespace {
+
+  constexpr uint64_t kPageBytes = uint64_t{1} << memory::constants::kPageShift;
+
+}  // namespace
+
+uint64_t History::SizeOf(const Snapshot& snapshot) {
+  return sizeof(Snapshot) + snapshot.state.size() +
+         snapshot.undo_pages.size() * sizeof(uint32_t) + snapshot.undo_data.size();
+}
+
+void History::Record(memory::Dram& dram, const uint64_t clock, const uint64_t instret,
+                     const uint64_t input_position, std::string state) {
+  if (snapshots_.empty()) {
+    shadow_ = dram.TakeSnapshot();
+    bytes_ = shadow_.size();
+  } else {
+    Snapshot& previous = snapshots_.back();
+    bytes_ -= SizeOf(previous);
+    const uint8_t* ram = dram.GetHostPtr(0, memory::constants::kDramSize).value();
+    for (const uint32_t page : dram.GetDirtyPages()) {
+      const uint64_t at_index = page * kPageBytes;
+      uint8_t* shadow = shadow_.data() + at_index;
+      if (std::memcmp(shadow, ram + at_index, kPageBytes) == 0) {
+        continue;
+      }
+      previous.undo_pages.push_back(page);
+      previous.undo_data.insert(previous.undo_data.end(), shadow, shadow + kPageBytes);
+      std::memcpy(shadow, ram + at_index, kPageBytes);
+    }
+    bytes_ += SizeOf(previous);
+    dram.ClearDirty();
+  }
+
+  snapshots_.push_back(Snapshot{clock, instret, input_position, std::move(state), {}, {}});
+  bytes_ += SizeOf(snapshots_.back());
+  while (bytes_ > budget_bytes_ && snapshots_.size() > 1) {
+    bytes_ -= SizeOf(snapshots_.front());
+    snapshots_.pop_front();
+  }
+  VLOG(2) << "History: " << snapshots_.size() << " snapshots in " << bytes_ << " bytes";
+}
+
+const History::Snapshot& History::Rewind(memory::Dram& dram, const size_t index) {
+  CHECK_LT(index, snapshots_.size());
+  // Back to the newest snapshot, then undo one interval at a time.
+  dram.RestoreSnapshot(shadow_);
+  uint8_t* ram = dram.GetHostPtr(0, memory::constants::kDramSize).value();
+  while (snapshots_.size() > index + 1) {
+    bytes_ -= SizeOf(snapshots_.back());
+    snapshots_.pop_back();
+    Snapshot& snapshot = snapshots_.back();
+    bytes_ -= SizeOf(snapshot);
+    for (size_t i = 0; i < snapshot.undo_pages.size(); ++i) {
+      const uint64_t at_index = snapshot.undo_pages[i] * kPageBytes;
+      const uint8_t* data = snapshot.undo_data.data() + i * kPageBytes;
+      std::memcpy(ram + at_index, data, kPageBytes);
+      std::memcpy(shadow_.data() + at_index, data, kPageBytes);
+      // Invalidates cached code on the page.
+      dram.NotifyWrite(at_index, kPageBytes);
+    }
+    snapshot.undo_pages = {};
+    snapshot.undo_data = {};
+    bytes_ += SizeOf(snapshot);
+  }
+  dram.ClearDirty();
+  return snapshots_.back();
+}
+
+std::optional<size_t> History::FindAtOrBefore(const uint64_t instret) const {
+  for (size_t i = snapshots_.size(); i-- > 0;) {
+    if (snapshots_[i].instret <= instret) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+void History::Clear() {
+  snapshots_.clear();
+  shadow_.clear();
+  bytes_ = 0;
+}
+
+}  // namespace riscv_emu::history
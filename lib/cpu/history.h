@@ -0,0 +1,66 @@
+#ifndef LIB_CPU_HISTORY_H
+#define LIB_CPU_HISTORY_H
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+#include "lib/memory/dram.h"
+
+namespace riscv_emu::history {
+
+namespace constants {
+  constexpr uint64_t kDefaultBudgetBytes = uint64_t{64} << 20;
+}  // namespace constants
+
+// Bounded ring of periodic snapshots for reverse execution. A snapshot
+// holds the encoded hart and device state; RAM is kept as undo pages
+// instead. A shadow copy of RAM as of the newest snapshot is brought up
+// to date from the dirty pages at every snapshot, and the contents those
+// pages had are attached to the previous snapshot. Going back to a
+// snapshot therefore copies only the pages written since it was taken.
+// Memory use is the shadow copy plus the pages written per interval, and
+// the oldest snapshots are dropped to stay within the budget.
+class History final {
+ public:
+  struct Snapshot {
+    uint64_t clock;
+    uint64_t instret;
+    // Inputs handed to the guest so far, see `replay::InputLog`.
+    uint64_t input_position;
+    std::string state;
+    // Pages the next snapshot changed, with their contents as of this one.
+    std::vector<uint32_t> undo_pages;
+    std::vector<uint8_t> undo_data;
+  };
+
+  explicit History(const uint64_t budget_bytes) : budget_bytes_(budget_bytes) {}
+  // Takes the newest snapshot and clears the dirty pages of `dram`, which
+  // must only be cleared here from then on.
+  void Record(memory::Dram& dram, uint64_t clock, uint64_t instret, uint64_t input_position,
+              std::string state);
+  // Rolls RAM back to snapshot `index`, 0 being the oldest, drops the
+  // snapshots after it and returns it.
+  const Snapshot& Rewind(memory::Dram& dram, size_t index);
+  // The newest snapshot taken at or before `instret` retired instructions.
+  std::optional<size_t> FindAtOrBefore(uint64_t instret) const;
+  // Forgets every snapshot, e.g. after something else cleared the dirty
+  // pages.
+  void Clear();
+  inline size_t GetSize() const { return snapshots_.size(); }
+  inline const Snapshot& Get(const size_t index) const { return snapshots_[index]; }
+  inline uint64_t GetBytes() const { return bytes_; }
+
+ private:
+  static uint64_t SizeOf(const Snapshot& snapshot);
+
+  const uint64_t budget_bytes_;
+  std::vector<uint8_t> shadow_;
+  std::deque<Snapshot> snapshots_;
+  uint64_t bytes_ = 0;
+};
+
+}  // namespace riscv_emu::history
+
+#endif  // LIB_CPU_HISTORY_H
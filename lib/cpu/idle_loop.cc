@@ -0,0 +1,53 @@
+#include "idle_loop.h"
+#include <algorithm>
+#include <cstring>
+#include "glog/logging.h"
+
+namespace riscv_emu::idle {
+
+bool IdleLoopDetector::OnTakenBranch(const uint32_t pc, const uint32_t target,
+                                     const uint32_t registers[32]) {
+  if (target > pc || pc - target > constants::kMaxLoopBytes) {
+    return false;
+  }
+  if (is_tracking_ && pc == branch_pc_ && target == target_ && !has_side_effect_ &&
+      std::equal(registers, registers + 32, registers_)) {
+    VLOG(2) << "Idle loop detected at 0x" << std::hex << target << "-0x" << pc;
+    return true;
+  }
+  is_tracking_ = true;
+  has_side_effect_ = false;
+  branch_pc_ = pc;
+  target_ = target;
+  std::memcpy(registers_, registers, sizeof(registers_));
+  return false;
+}
+
+void IdleLoopDetector::Save(checkpoint::StateWriter& out) const {
+  out.Bool(is_tracking_);
+  if (!is_tracking_) {
+    return;
+  }
+  out.Bool(has_side_effect_);
+  out.U32(branch_pc_);
+  out.U32(target_);
+  for (const uint32_t reg : registers_) {
+    out.U32(reg);
+  }
+}
+
+absl::Status IdleLoopDetector::Load(checkpoint::StateReader& in) {
+  is_tracking_ = in.Bool();
+  if (!is_tracking_) {
+    return in.GetStatus();
+  }
+  has_side_effect_ = in.Bool();
+  branch_pc_ = in.U32();
+  target_ = in.U32();
+  for (uint32_t& reg : registers_) {
+    reg = in.U32();
+  }
+  return in.GetStatus();
+}
+
+}  // namespace riscv_emu::idle
@@ -0,0 +1,50 @@
+#ifndef LIB_CPU_IDLE_LOOP_H
+#define LIB_CPU_IDLE_LOOP_H
+
+#include <cstdint>
+#include "absl/status/status.h"
+#include "lib/checkpoint/state.h"
+
+namespace riscv_emu::idle {
+
+namespace constants {
+  // Only loops whose backward branch spans at most this many bytes are
+  // tracked; polling loops are a handful of instructions.
+  constexpr uint32_t kMaxLoopBytes = 64;
+}  // namespace constants
+
+// Recognises polling loops that can make no progress until a device event
+// fires. A loop qualifies once one full iteration, measured between two
+// consecutive executions of its backward branch, leaves every register
+// unchanged and performs no stores, CSR writes or reads of a free-running
+// time source. The next iteration is then bound to behave identically,
+// and since device state only changes when a scheduler event fires, the
+// guest can be fast-forwarded straight to that event.
+class IdleLoopDetector final {
+ public:
+  // Called for every taken control transfer from `pc` to `target` after
+  // the instruction has written back. Returns true if the loop closing at
+  // `pc` is provably idle.
+  bool OnTakenBranch(uint32_t pc, uint32_t target, const uint32_t registers[32]);
+  // The current iteration did something observable.
+  inline void OnSideEffect() { has_side_effect_ = true; }
+  // Forget the tracked loop, e.g. after device state may have changed.
+  inline void Reset() { is_tracking_ = false; }
+  inline bool IsTracking() const { return is_tracking_; }
+
+  // Checkpoints carry the tracked iteration, so a restored run detects
+  // the same loops at the same points as the run it was saved from.
+  void Save(checkpoint::StateWriter& out) const;
+  absl::Status Load(checkpoint::StateReader& in);
+
+ private:
+  bool is_tracking_ = false;
+  bool has_side_effect_ = false;
+  uint32_t branch_pc_ = 0;
+  uint32_t target_ = 0;
+  uint32_t registers_[32];
+};
+
+}  // namespace riscv_emu::idle
+
+#endif  // LIB_CPU_IDLE_LOOP_H
@@ -205,7 +205,10 @@ absl::Status InstrDecoder::DecodeBTypeInstr() {
   op_ = logic::Opcode::kBType;
   b_sel_ = BSel::kImmOut;
   a_sel_ = ASel::kPcOut;
-  is_branch_unsigned_ = true;
+  ASSIGN_OR_RETURN(const uint32_t func3, logic::GetFunc3(instr_));
+  is_branch_unsigned_ =
+      func3 == static_cast<uint32_t>(branch::ComparisonType::kLessThanUnsigned) ||
+      func3 == static_cast<uint32_t>(branch::ComparisonType::kGreaterThanOrEqualUnsigned);
   pc_sel_ = PcSel::kPcPlus4;
   reg_write_en_ = false;
   imm_sel_ = imm::ImmSel::kBType;
@@ -269,7 +272,7 @@ absl::Status InstrDecoder::DecodeAuiPcTypeInstr() {
   reg_write_en_ = (rd_sel_ != 0) ? true : false;
   wb_sel_ = WbSel::kAluOut;
   imm_sel_ = imm::ImmSel::kUType;
-  alu_sel_ = AluOp::kBCopy;
+  alu_sel_ = AluOp::kAdd;
   mem_op_ = MemOp::kNone;
   return absl::OkStatus();
 }
@@ -312,22 +315,73 @@ absl::Status InstrDecoder::DecodeJalrTypeInstr() {
 }
 
 absl::Status InstrDecoder::DecodeFenceTypeInstr() {
-  VLOG(5) << "Decoding U-type instruction";
+  VLOG(5) << "Decoding fence instruction";
   op_ = logic::Opcode::kFenceType;
+  a_sel_ = ASel::kNone;
+  b_sel_ = BSel::kNone;
+  alu_sel_ = AluOp::kNone;
   pc_sel_ = PcSel::kPcPlus4;
   reg_write_en_ = false;
   mem_op_ = MemOp::kNone;
+
+  // Memory is coherent for a single hart, so fence is a no-op; fence.i
+  // must drop any cached translation of the instruction stream.
+  ASSIGN_OR_RETURN(const uint32_t func3, logic::GetFunc3(instr_));
+  switch (func3) {
+   case 0b000:
+    break;
+   case 0b001:
+    e_sel_ = ESel::kFenceI;
+    break;
+   default:
+    return absl::InvalidArgumentError("invalid fence instruction");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status InstrDecoder::DecodeCsrInstr(const uint32_t func3) {
+  VLOG(5) << "Decoding CSR instruction";
+  // Set register selects.
+  ASSIGN_OR_RETURN(rs1_sel_, logic::GetRs1(instr_));
+  ASSIGN_OR_RETURN(rd_sel_, logic::GetRd(instr_));
+  ASSIGN_OR_RETURN(csr_addr_, logic::GetCsr(instr_));
+
+  // Set selects.
+  wb_sel_ = WbSel::kCsrOut;
+  reg_write_en_ = (rd_sel_ != 0) ? true : false;
+  is_csr_imm_ = func3 & 0b100;
+  switch (func3 & 0b11) {
+   case static_cast<uint32_t>(CsrOp::kReadWrite):
+    csr_op_ = CsrOp::kReadWrite;
+    break;
+   case static_cast<uint32_t>(CsrOp::kReadSet):
+    csr_op_ = CsrOp::kReadSet;
+    break;
+   case static_cast<uint32_t>(CsrOp::kReadClear):
+    csr_op_ = CsrOp::kReadClear;
+    break;
+   default:
+    return absl::InvalidArgumentError("Invalid func3 encoding");
+  }
   return absl::OkStatus();
 }
 
 absl::Status InstrDecoder::DecodeETypeInstr() {
   VLOG(5) << "Decoding E-type instruction";
   op_ = logic::Opcode::kEType;
+  a_sel_ = ASel::kNone;
+  b_sel_ = BSel::kNone;
   pc_sel_ = PcSel::kPcPlus4;
   reg_write_en_ = false;
+  alu_sel_ = AluOp::kNone;
   mem_op_ = MemOp::kNone;
 
-  ASSIGN_OR_RETURN(const uint32_t sel, logic::GetRs2(instr_));
+  ASSIGN_OR_RETURN(const uint32_t func3, logic::GetFunc3(instr_));
+  if (func3 != 0) {
+    return DecodeCsrInstr(func3);
+  }
+  // With func3 == 0 the CSR field holds the func12 system opcode.
+  ASSIGN_OR_RETURN(const uint32_t sel, logic::GetCsr(instr_));
   switch (sel) {
    case 0b1:  // ebreak
     e_sel_ = ESel::kEBreak;
@@ -335,14 +389,31 @@ absl::Status InstrDecoder::DecodeETypeInstr() {
    case 0b0:
     e_sel_ = ESel::kECall;
     break;
+   case 0x302:
+    e_sel_ = ESel::kMRet;
+    break;
+   case 0x102:
+    e_sel_ = ESel::kSRet;
+    break;
+   case 0x105:
+    e_sel_ = ESel::kWfi;
+    break;
    default:
-    return absl::InternalError("invalid system call");
+    // sfence.vma carries rs2 (the ASID) in the low bits of func12.
+    if ((sel >> 5) == 0b0001001) {
+      e_sel_ = ESel::kSfenceVma;
+      break;
+    }
+    return absl::InvalidArgumentError("invalid system call");
   }
   return absl::OkStatus();
 }
 
 absl::Status InstrDecoder::Decode(const uint32_t instr) {
   instr_ = instr;
+  // System selects only apply to the instruction that set them.
+  e_sel_ = ESel::kNone;
+  csr_op_ = CsrOp::kNone;
   absl::StatusOr<const logic::Opcode> opcode = logic::GetOpcode(instr_);
   if (!opcode.ok()) {
     if (absl::IsNotFound(opcode.status())) {
@@ -22,6 +22,7 @@ enum class WbSel {
     kMemOut,
     kAluOut,
     kPcPlus4,
+    kCsrOut,
     kNone,
 };
 
@@ -46,6 +47,19 @@ enum class MemOp {
 enum class ESel {
     kEBreak,
     kECall,
+    kMRet,
+    kSRet,
+    kWfi,
+    kSfenceVma,
+    kFenceI,
+    kNone,
+};
+
+// Matches the low two bits of the csr* func3 encoding.
+enum class CsrOp {
+    kReadWrite = 0b01,
+    kReadSet = 0b10,
+    kReadClear = 0b11,
     kNone,
 };
 
@@ -67,6 +81,10 @@ class InstrDecoder final {
   inline MemOp GetMemOp() const { return mem_op_; }
   inline bool IsBranchUnsigned() const { return is_branch_unsigned_; }
   inline ESel GetESel() const { return e_sel_; }
+  inline CsrOp GetCsrOp() const { return csr_op_; }
+  inline uint32_t GetCsrAddr() const { return csr_addr_; }
+  // csr*i forms take a 5-bit immediate from the rs1 field.
+  inline bool IsCsrImm() const { return is_csr_imm_; }
   
 
  private:
@@ -81,6 +99,7 @@ class InstrDecoder final {
   absl::Status DecodeJalrTypeInstr();
   absl::Status DecodeFenceTypeInstr();
   absl::Status DecodeETypeInstr();
+  absl::Status DecodeCsrInstr(uint32_t func3);
 
   bool is_invalid_instr_ = false;
   uint32_t instr_;
@@ -99,6 +118,9 @@ class InstrDecoder final {
   WbSel wb_sel_ = WbSel::kNone;
   bool is_branch_unsigned_;
   ESel e_sel_ = ESel::kNone;
+  CsrOp csr_op_ = CsrOp::kNone;
+  uint32_t csr_addr_ = 0;
+  bool is_csr_imm_ = false;
 };
 
 }  // namespace riscv_emu::decoder
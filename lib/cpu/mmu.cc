@@ -0,0 +1,167 @@
+#include "mmu.h"
+#include <cstring>
+#include "glog/logging.h"
+
+namespace riscv_emu::mmu {
+
+namespace {
+
+constexpr uint32_t kPteV = 1U << 0;
+constexpr uint32_t kPteR = 1U << 1;
+constexpr uint32_t kPteW = 1U << 2;
+constexpr uint32_t kPteX = 1U << 3;
+constexpr uint32_t kPteU = 1U << 4;
+constexpr uint32_t kPteA = 1U << 6;
+constexpr uint32_t kPteD = 1U << 7;
+constexpr uint32_t kPtePpnShift = 10;
+constexpr uint32_t kVpnBits = 10;
+constexpr uint32_t kVpnMask = (1U << kVpnBits) - 1;
+
+csr::Exception PageFault(const Access access) {
+  switch (access) {
+   case Access::kFetch:
+    return csr::Exception::kInstrPageFault;
+   case Access::kLoad:
+    return csr::Exception::kLoadPageFault;
+   case Access::kStore:
+   default:
+    return csr::Exception::kStorePageFault;
+  }
+}
+
+csr::Exception AccessFault(const Access access) {
+  switch (access) {
+   case Access::kFetch:
+    return csr::Exception::kInstrAccessFault;
+   case Access::kLoad:
+    return csr::Exception::kLoadAccessFault;
+   case Access::kStore:
+   default:
+    return csr::Exception::kStoreAccessFault;
+  }
+}
+
+}  // namespace
+
+Mmu::Mmu(memory::Dram& dram, pmp::Pmp& pmp)
+    : dram_(dram), dram_base_(dram.GetHostPtr(0, memory::constants::kDramSize).value()), pmp_(pmp) {}
+
+void Mmu::SetSatp(const uint32_t satp) {
+  satp_ = satp;
+  Flush();
+}
+
+void Mmu::SetStatus(const bool sum, const bool mxr) {
+  if (sum != sum_ || mxr != mxr_) {
+    sum_ = sum;
+    mxr_ = mxr;
+    Flush();
+  }
+}
+
+void Mmu::Flush(const std::optional<uint32_t> vaddr) {
+  if (vaddr.has_value() && !has_megapages_) {
+    const uint32_t vpn = *vaddr >> constants::kPageShift;
+    for (Tlb& tlb : tlbs_) {
+      tlb[vpn & (constants::kTlbEntries - 1)] = TlbEntry();
+    }
+    return;
+  }
+  for (Tlb& tlb : tlbs_) {
+    tlb.fill(TlbEntry());
+  }
+  has_megapages_ = false;
+}
+
+bool Mmu::IsAllowed(const uint32_t pte, const Access access, const csr::Privilege priv) const {
+  if (priv == csr::Privilege::kUser && !(pte & kPteU)) {
+    return false;
+  }
+  if (priv == csr::Privilege::kSupervisor && (pte & kPteU) &&
+      (access == Access::kFetch || !sum_)) {
+    return false;
+  }
+  switch (access) {
+   case Access::kFetch:
+    return pte & kPteX;
+   case Access::kLoad:
+    return (pte & kPteR) || (mxr_ && (pte & kPteX));
+   case Access::kStore:
+    return pte & kPteW;
+  }
+  return false;
+}
+
+Translation Mmu::Walk(const uint32_t vaddr, const Access access, const csr::Privilege priv) {
+  const uint32_t vpn[2] = {(vaddr >> constants::kPageShift) & kVpnMask,
+                           vaddr >> (constants::kPageShift + kVpnBits)};
+  uint64_t table = static_cast<uint64_t>(satp_ & csr::constants::kSatpPpnMask)
+                   << constants::kPageShift;
+  for (int level = 1; level >= 0; --level) {
+    // The walk's implicit accesses are checked as S-mode.
+    const uint64_t pte_addr = table + vpn[level] * sizeof(uint32_t);
+    uint8_t* pte_host = HostPtr(pte_addr);
+    if (pte_host == nullptr || !pmp_.IsAllowed(pte_addr, sizeof(uint32_t), pmp::constants::kRead,
+                                               csr::Privilege::kSupervisor)) {
+      return {.fault = AccessFault(access)};
+    }
+    uint32_t pte;
+    std::memcpy(&pte, pte_host, sizeof(pte));
+    if (!(pte & kPteV) || (!(pte & kPteR) && (pte & kPteW))) {
+      break;
+    }
+    const uint64_t ppn = pte >> kPtePpnShift;
+    if (!(pte & (kPteR | kPteX))) {
+      table = ppn << constants::kPageShift;
+      continue;
+    }
+
+    // Leaf. A superpage must be aligned to its size.
+    if (level == 1 && (ppn & kVpnMask) != 0) {
+      break;
+    }
+    if (!IsAllowed(pte, access, priv)) {
+      break;
+    }
+    // Hardware A/D update.
+    const uint32_t updated = pte | kPteA | (access == Access::kStore ? kPteD : 0);
+    if (updated != pte) {
+      if (!pmp_.IsAllowed(pte_addr, sizeof(uint32_t), pmp::constants::kWrite,
+                          csr::Privilege::kSupervisor)) {
+        return {.fault = AccessFault(access)};
+      }
+      std::memcpy(pte_host, &updated, sizeof(updated));
+      dram_.NotifyWrite(pte_addr, sizeof(updated));
+    }
+    const uint64_t page = level == 1 ?
+        ((ppn >> kVpnBits) << (constants::kPageShift + kVpnBits)) |
+            (vpn[0] << constants::kPageShift) :
+        ppn << constants::kPageShift;
+    if (page > UINT32_MAX) {
+      return {.fault = AccessFault(access)};
+    }
+
+    has_megapages_ |= level == 1;
+    const uint32_t tag = vaddr >> constants::kPageShift;
+    TlbEntry& entry = tlbs_[TlbIndex(priv)][tag & (constants::kTlbEntries - 1)];
+    entry = TlbEntry();
+    entry.paddr = static_cast<uint32_t>(page);
+    entry.host = HostPtr(page);
+    if (IsAllowed(updated, Access::kFetch, priv)) {
+      entry.tags[static_cast<int>(Access::kFetch)] = tag;
+    }
+    if (IsAllowed(updated, Access::kLoad, priv)) {
+      entry.tags[static_cast<int>(Access::kLoad)] = tag;
+    }
+    // Stores to a clean page must come back here to set D.
+    if ((updated & kPteD) && IsAllowed(updated, Access::kStore, priv)) {
+      entry.tags[static_cast<int>(Access::kStore)] = tag;
+    }
+    const uint32_t offset = vaddr & constants::kPageOffsetMask;
+    VLOG(3) << "TLB fill 0x" << std::hex << vaddr << " -> 0x" << page;
+    return {entry.paddr | offset, entry.host ? entry.host + offset : nullptr};
+  }
+  return {.fault = PageFault(access)};
+}
+
+}  // namespace riscv_emu::mmu
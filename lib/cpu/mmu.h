@@ -0,0 +1,103 @@
+#ifndef LIB_CPU_MMU_H
+#define LIB_CPU_MMU_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include "csr.h"
+#include "pmp.h"
+#include "lib/memory/dram.h"
+
+namespace riscv_emu::mmu {
+
+namespace constants {
+  constexpr uint32_t kPageShift = 12;
+  constexpr uint32_t kPageOffsetMask = (1U << kPageShift) - 1;
+  // Direct-mapped, indexed by the low bits of the virtual page number.
+  constexpr uint32_t kTlbEntries = 256;
+  // Never equal to a 20-bit virtual page number.
+  constexpr uint32_t kInvalidTag = UINT32_MAX;
+}  // namespace constants
+
+enum class Access {
+  kFetch = 0,
+  kLoad = 1,
+  kStore = 2,
+};
+
+struct Translation {
+  uint32_t paddr = 0;
+  // Host view of `paddr` when it is backed by DRAM, null for MMIO.
+  uint8_t* host = nullptr;
+  // Set instead of the above when the access must trap.
+  std::optional<csr::Exception> fault;
+};
+
+// Sv32 address translation. Walks are cached in a software TLB holding one
+// tag per access type, each valid only if that access is permitted, so a
+// hit needs a single compare and yields the host pointer directly. There
+// is one TLB per translated privilege (U and S), which keeps the tags free
+// of mode checks.
+class Mmu final {
+ public:
+  // Page-table reads and A/D updates are checked against `pmp`.
+  Mmu(memory::Dram& dram, pmp::Pmp& pmp);
+
+  // `priv` is the effective privilege of the access; M-mode is never
+  // translated.
+  inline Translation Translate(const uint32_t vaddr, const Access access,
+                               const csr::Privilege priv) {
+    if (!(satp_ & csr::constants::kSatpModeSv32) || priv == csr::Privilege::kMachine) {
+      return {vaddr, HostPtr(vaddr)};
+    }
+    const uint32_t vpn = vaddr >> constants::kPageShift;
+    const TlbEntry& entry = tlbs_[TlbIndex(priv)][vpn & (constants::kTlbEntries - 1)];
+    if (entry.tags[static_cast<int>(access)] == vpn) {
+      const uint32_t offset = vaddr & constants::kPageOffsetMask;
+      return {entry.paddr | offset, entry.host ? entry.host + offset : nullptr};
+    }
+    return Walk(vaddr, access, priv);
+  }
+
+  // Installs a new root page table; flushes the TLB.
+  void SetSatp(uint32_t satp);
+  // Tracks `mstatus.SUM`/`MXR`, which are folded into the cached
+  // permissions; flushes the TLB when they change.
+  void SetStatus(bool sum, bool mxr);
+  // sfence.vma; `vaddr` restricts the flush to one page, or to the whole
+  // TLB while it holds megapage translations.
+  void Flush(std::optional<uint32_t> vaddr = std::nullopt);
+
+ private:
+  struct TlbEntry {
+    std::array<uint32_t, 3> tags = {constants::kInvalidTag, constants::kInvalidTag,
+                                    constants::kInvalidTag};
+    uint32_t paddr = 0;
+    uint8_t* host = nullptr;
+  };
+  using Tlb = std::array<TlbEntry, constants::kTlbEntries>;
+
+  static inline int TlbIndex(const csr::Privilege priv) {
+    return priv == csr::Privilege::kUser ? 0 : 1;
+  }
+  inline uint8_t* HostPtr(const uint64_t paddr) const {
+    return paddr < memory::constants::kDramSize ? dram_base_ + paddr : nullptr;
+  }
+  bool IsAllowed(uint32_t pte, Access access, csr::Privilege priv) const;
+  Translation Walk(uint32_t vaddr, Access access, csr::Privilege priv);
+
+  memory::Dram& dram_;
+  uint8_t* dram_base_;
+  pmp::Pmp& pmp_;
+  uint32_t satp_ = 0;
+  bool sum_ = false;
+  bool mxr_ = false;
+  // Megapages are cached per 4 KiB page, in up to every slot of a TLB, so
+  // a flush of one address in them cannot pick out their entries.
+  bool has_megapages_ = false;
+  std::array<Tlb, 2> tlbs_;
+};
+
+}  // namespace riscv_emu::mmu
+
+#endif  // LIB_CPU_MMU_H
@@ -0,0 +1,164 @@
+#include "pmp.h"
+#include <algorithm>
+#include "glog/logging.h"
+
+namespace riscv_emu::pmp {
+
+namespace {
+
+constexpr uint8_t kCfgAShift = 3;
+constexpr uint8_t kCfgAMask = 0b11U << kCfgAShift;
+constexpr uint8_t kCfgLock = 1U << 7;
+constexpr uint8_t kCfgWriteMask = constants::kAll | kCfgAMask | kCfgLock;
+
+enum class AddrMatch : uint8_t {
+  kOff = 0,
+  kTor = 1,
+  kNa4 = 2,
+  kNapot = 3,
+};
+
+constexpr uint64_t kPhysEnd = 1ULL << 32;
+
+AddrMatch GetMatch(const uint8_t cfg) {
+  return static_cast<AddrMatch>((cfg & kCfgAMask) >> kCfgAShift);
+}
+
+}  // namespace
+
+Pmp::Pmp() : pages_(constants::kNumPages) {}
+
+void Pmp::SetRegisters(const Registers& registers) {
+  if (registers.cfg != cfg_ || registers.addr != addr_) {
+    cfg_ = registers.cfg;
+    addr_ = registers.addr;
+    dirty_ = true;
+  }
+}
+
+uint32_t Pmp::Read(const uint32_t addr) const {
+  if (addr >= constants::kPmpaddr0) {
+    return addr_[addr - constants::kPmpaddr0];
+  }
+  const uint32_t first = (addr - constants::kPmpcfg0) * 4;
+  uint32_t val = 0;
+  for (uint32_t i = 0; i < 4; ++i) {
+    val |= static_cast<uint32_t>(cfg_[first + i]) << (8 * i);
+  }
+  return val;
+}
+
+bool Pmp::IsLocked(const uint32_t entry) const {
+  return cfg_[entry] & kCfgLock;
+}
+
+void Pmp::Write(const uint32_t addr, const uint32_t val) {
+  if (addr >= constants::kPmpaddr0) {
+    const uint32_t entry = addr - constants::kPmpaddr0;
+    // A locked TOR entry also locks the address below it.
+    const bool locked_by_next = entry + 1 < constants::kNumEntries && IsLocked(entry + 1) &&
+                                GetMatch(cfg_[entry + 1]) == AddrMatch::kTor;
+    if (!IsLocked(entry) && !locked_by_next) {
+      addr_[entry] = val;
+      dirty_ = true;
+    }
+    return;
+  }
+  const uint32_t first = (addr - constants::kPmpcfg0) * 4;
+  for (uint32_t i = 0; i < 4; ++i) {
+    if (IsLocked(first + i)) {
+      continue;
+    }
+    uint8_t cfg = (val >> (8 * i)) & kCfgWriteMask;
+    // R=0, W=1 is reserved.
+    if ((cfg & constants::kWrite) && !(cfg & constants::kRead)) {
+      cfg &= ~constants::kWrite;
+    }
+    cfg_[first + i] = cfg;
+  }
+  dirty_ = true;
+}
+
+Pmp::Range Pmp::GetRange(const uint32_t entry) const {
+  const uint64_t addr = static_cast<uint64_t>(addr_[entry]) << 2;
+  Range range;
+  switch (GetMatch(cfg_[entry])) {
+   case AddrMatch::kOff:
+    return range;
+   case AddrMatch::kTor:
+    range.lo = entry == 0 ? 0 : static_cast<uint64_t>(addr_[entry - 1]) << 2;
+    range.hi = std::max(range.lo, addr);
+    break;
+   case AddrMatch::kNa4:
+    range.lo = addr;
+    range.hi = addr + 4;
+    break;
+   case AddrMatch::kNapot: {
+    // The trailing ones of pmpaddr encode the size: 2^(ones + 3) bytes.
+    const uint64_t ones = static_cast<uint64_t>(addr_[entry]) ^ (addr_[entry] + 1ULL);
+    range.lo = (addr_[entry] & ~ones) << 2;
+    range.hi = range.lo + ((ones + 1) << 2);
+    break;
+   }
+  }
+  // Only the low 4 GiB are physically addressable here.
+  range.lo = std::min(range.lo, kPhysEnd);
+  range.hi = std::min(range.hi, kPhysEnd);
+  return range;
+}
+
+void Pmp::Rebuild() {
+  dirty_ = false;
+  const bool any_enabled = std::any_of(cfg_.begin(), cfg_.end(), [](const uint8_t cfg) {
+    return GetMatch(cfg) != AddrMatch::kOff;
+  });
+  // Unmatched accesses: M-mode is allowed, S/U are not once PMP is in use.
+  std::fill(pages_.begin(), pages_.end(),
+            any_enabled ? constants::kAll : constants::kAll | constants::kAll << kLowerShift);
+  // Lowest-numbered entry wins, so apply them in reverse.
+  for (int entry = constants::kNumEntries - 1; entry >= 0; --entry) {
+    const Range range = GetRange(entry);
+    if (range.lo >= range.hi) {
+      continue;
+    }
+    const uint8_t perms = cfg_[entry] & constants::kAll;
+    const uint8_t m_perms = IsLocked(entry) ? perms : constants::kAll;
+    const uint64_t first = range.lo >> constants::kPageShift;
+    const uint64_t last = (range.hi - 1) >> constants::kPageShift;
+    for (uint64_t page = first; page <= last; ++page) {
+      const uint64_t page_lo = page << constants::kPageShift;
+      const uint64_t page_hi = page_lo + (1ULL << constants::kPageShift);
+      if (range.lo <= page_lo && range.hi >= page_hi) {
+        pages_[page] = m_perms | perms << kLowerShift;
+      } else {
+        pages_[page] |= kPartial;
+      }
+    }
+  }
+  VLOG(2) << "Rebuilt PMP page table";
+}
+
+bool Pmp::IsAllowedExact(const uint32_t paddr, const uint32_t len, const uint8_t perm,
+                         const csr::Privilege priv) const {
+  const uint64_t lo = paddr;
+  const uint64_t hi = lo + len;
+  bool any_enabled = false;
+  for (uint32_t entry = 0; entry < constants::kNumEntries; ++entry) {
+    const Range range = GetRange(entry);
+    any_enabled |= GetMatch(cfg_[entry]) != AddrMatch::kOff;
+    if (range.lo >= range.hi || hi <= range.lo || lo >= range.hi) {
+      continue;
+    }
+    // An access straddling the region boundary fails.
+    if (lo < range.lo || hi > range.hi) {
+      return false;
+    }
+    if (priv == csr::Privilege::kMachine && !IsLocked(entry)) {
+      return true;
+    }
+    return cfg_[entry] & perm;
+  }
+  return priv == csr::Privilege::kMachine || !any_enabled;
+}
+
+}  // namespace riscv_emu::pmp
@@ -0,0 +1,91 @@
+#ifndef LIB_CPU_PMP_H
+#define LIB_CPU_PMP_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "csr.h"
+
+namespace riscv_emu::pmp {
+
+namespace constants {
+  constexpr uint32_t kPmpcfg0 = 0x3a0;
+  constexpr uint32_t kPmpaddr0 = 0x3b0;
+  constexpr uint32_t kNumEntries = 16;
+
+  // Permission bits, as laid out in a pmpcfg byte.
+  constexpr uint8_t kRead = 1U << 0;
+  constexpr uint8_t kWrite = 1U << 1;
+  constexpr uint8_t kExec = 1U << 2;
+  constexpr uint8_t kAll = kRead | kWrite | kExec;
+
+  constexpr uint32_t kPageShift = 12;
+  constexpr uint32_t kNumPages = 1U << (32 - kPageShift);
+}  // namespace constants
+
+// Physical memory protection. Rather than matching up to 16 regions on
+// every access, the decision for each 4 KiB physical page is precomputed
+// into a table that is rebuilt lazily after a PMP CSR changes. Only pages
+// that a region boundary cuts through take the exact check.
+//
+// Like QEMU, and unlike the letter of the spec, S/U accesses are allowed
+// while no entry is enabled at all, so guests that never program PMP keep
+// working.
+class Pmp final {
+ public:
+  Pmp();
+
+  static inline bool IsPmpCsr(const uint32_t addr) {
+    return (addr >= constants::kPmpcfg0 && addr < constants::kPmpcfg0 + 4) ||
+           (addr >= constants::kPmpaddr0 && addr < constants::kPmpaddr0 + constants::kNumEntries);
+  }
+  uint32_t Read(uint32_t addr) const;
+  void Write(uint32_t addr, uint32_t val);
+
+  // The raw CSR contents, for snapshots. Setting them only rebuilds the
+  // permission table if they changed.
+  struct Registers {
+    std::array<uint8_t, constants::kNumEntries> cfg{};
+    std::array<uint32_t, constants::kNumEntries> addr{};
+  };
+  inline Registers GetRegisters() const { return {cfg_, addr_}; }
+  void SetRegisters(const Registers& registers);
+
+  // True if `priv` may access [paddr, paddr + len) with permission `perm`
+  // (one of kRead/kWrite/kExec).
+  inline bool IsAllowed(const uint32_t paddr, const uint32_t len, const uint8_t perm,
+                        const csr::Privilege priv) {
+    if (dirty_) {
+      Rebuild();
+    }
+    const uint8_t page = pages_[paddr >> constants::kPageShift];
+    if (page & kPartial) {
+      return IsAllowedExact(paddr, len, perm, priv);
+    }
+    return page & (priv == csr::Privilege::kMachine ? perm : perm << kLowerShift);
+  }
+
+ private:
+  // Page table byte: M-mode permissions in bits 0-2, S/U in bits 3-5.
+  static constexpr uint32_t kLowerShift = 3;
+  static constexpr uint8_t kPartial = 1U << 6;
+
+  struct Range {
+    uint64_t lo = 0;
+    uint64_t hi = 0;  // Exclusive; lo == hi when the entry is off.
+  };
+
+  Range GetRange(uint32_t entry) const;
+  bool IsLocked(uint32_t entry) const;
+  bool IsAllowedExact(uint32_t paddr, uint32_t len, uint8_t perm, csr::Privilege priv) const;
+  void Rebuild();
+
+  std::array<uint8_t, constants::kNumEntries> cfg_{};
+  std::array<uint32_t, constants::kNumEntries> addr_{};
+  std::vector<uint8_t> pages_;
+  bool dirty_ = true;
+};
+
+}  // namespace riscv_emu::pmp
+
+#endif  // LIB_CPU_PMP_H
@@ -0,0 +1,76 @@
+#include "pmp.h"
+#include "gtest/gtest.h"
+
+namespace riscv_emu::pmp {
+
+namespace {
+
+// pmpcfg address-matching modes, in the A field.
+constexpr uint8_t kTor = 1U << 3;
+constexpr uint8_t kNa4 = 2U << 3;
+constexpr uint8_t kNapot = 3U << 3;
+
+// Once any entry is enabled, S-mode only gets what an entry grants, so
+// probing reads from S maps out each entry's range exactly.
+bool CanRead(Pmp& pmp, const uint32_t paddr, const uint32_t len = 1) {
+  return pmp.IsAllowed(paddr, len, constants::kRead, csr::Privilege::kSupervisor);
+}
+
+TEST(PmpTest, TorSpansFromThePreviousAddress) {
+  Pmp pmp;
+  pmp.Write(constants::kPmpaddr0, 0x1000 >> 2);
+  pmp.Write(constants::kPmpaddr0 + 1, 0x2800 >> 2);
+  pmp.Write(constants::kPmpcfg0, static_cast<uint32_t>(kTor | constants::kRead) << 8);
+  EXPECT_FALSE(CanRead(pmp, 0xfff));
+  EXPECT_TRUE(CanRead(pmp, 0x1000));
+  EXPECT_TRUE(CanRead(pmp, 0x27ff));
+  EXPECT_FALSE(CanRead(pmp, 0x2800));
+  // Straddling the top is not enough.
+  EXPECT_FALSE(CanRead(pmp, 0x27fe, 4));
+}
+
+TEST(PmpTest, TorInEntryZeroStartsAtZero) {
+  Pmp pmp;
+  pmp.Write(constants::kPmpaddr0, 0x3000 >> 2);
+  pmp.Write(constants::kPmpcfg0, kTor | constants::kRead);
+  EXPECT_TRUE(CanRead(pmp, 0));
+  EXPECT_TRUE(CanRead(pmp, 0x2fff));
+  EXPECT_FALSE(CanRead(pmp, 0x3000));
+}
+
+TEST(PmpTest, Na4CoversFourBytes) {
+  Pmp pmp;
+  pmp.Write(constants::kPmpaddr0, 0x5004 >> 2);
+  pmp.Write(constants::kPmpcfg0, kNa4 | constants::kRead);
+  EXPECT_FALSE(CanRead(pmp, 0x5003));
+  EXPECT_TRUE(CanRead(pmp, 0x5004, 4));
+  EXPECT_FALSE(CanRead(pmp, 0x5008));
+}
+
+TEST(PmpTest, NapotSizeComesFromTrailingOnes) {
+  Pmp pmp;
+  // 4 KiB at 0x6000: the address ORed with (size / 8 - 1).
+  pmp.Write(constants::kPmpaddr0, (0x6000 >> 2) | ((0x1000 >> 3) - 1));
+  // The smallest NAPOT region, 8 bytes at 0x9000.
+  pmp.Write(constants::kPmpaddr0 + 1, 0x9000 >> 2);
+  pmp.Write(constants::kPmpcfg0, static_cast<uint32_t>(kNapot | constants::kRead) * 0x0101);
+  EXPECT_FALSE(CanRead(pmp, 0x5fff));
+  EXPECT_TRUE(CanRead(pmp, 0x6000));
+  EXPECT_TRUE(CanRead(pmp, 0x6fff));
+  EXPECT_FALSE(CanRead(pmp, 0x7000));
+  EXPECT_FALSE(CanRead(pmp, 0x8fff));
+  EXPECT_TRUE(CanRead(pmp, 0x9000, 8));
+  EXPECT_FALSE(CanRead(pmp, 0x9008));
+}
+
+TEST(PmpTest, NapotWithAllOnesCoversEverything) {
+  Pmp pmp;
+  pmp.Write(constants::kPmpaddr0, 0xffffffff);
+  pmp.Write(constants::kPmpcfg0, kNapot | constants::kRead);
+  EXPECT_TRUE(CanRead(pmp, 0));
+  EXPECT_TRUE(CanRead(pmp, 0xfffffffc, 4));
+}
+
+}  // namespace
+
+}  // namespace riscv_emu::pmp
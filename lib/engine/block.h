@@ -0,0 +1,137 @@
+#ifndef LIB_ENGINE_BLOCK_H
+#define LIB_ENGINE_BLOCK_H
+
+#include <cstdint>
+#include "lib/memory/dram.h"
+
+namespace riscv_emu::engine {
+
+namespace constants {
+  // A block ends at the first control transfer, at the first instruction
+  // left to the interpreter, at a page boundary or after this many
+  // instructions, whichever comes first.
+  constexpr uint32_t kMaxBlockInstrs = 16;
+  constexpr uint32_t kMaxBlockBytes = kMaxBlockInstrs * sizeof(uint32_t);
+  // Link registers per the calling convention: ra, and t0 for millicode.
+  constexpr uint8_t kReturnAddressReg = 1;
+  constexpr uint8_t kAltLinkReg = 5;
+}  // namespace constants
+
+enum class OpKind : uint8_t {
+  kNop,  // fence, or an ALU op writing x0
+  kLoadImm,  // lui, and auipc with the pc folded in
+  kJal,
+  kJalr,
+  kBeq,
+  kBne,
+  kBlt,
+  kBge,
+  kBltu,
+  kBgeu,
+  kLoad,
+  kStore,
+  kAddi,
+  kXori,
+  kOri,
+  kAndi,
+  kSlli,
+  kSrli,
+  kSrai,
+  kAdd,
+  kSub,
+  kXor,
+  kOr,
+  kAnd,
+  kSll,
+  kSrl,
+  kSra,
+
+  // Fused pairs. The op stands for itself and the op after it, which
+  // stays in place with its own operands; its own kind is implied by the
+  // fused kind.
+  kLoadImmAddi,  // lui/auipc rd; addi rd, rd
+  kLoadImmJalr,  // auipc/lui t; jalr t (far call/tail)
+  kLoadImmLoad,  // auipc/lui t; load from t
+  kLoadImmStore,  // auipc/lui t; store to t
+  kSlliSrli,  // zero-extend
+  kSlliSrai,  // sign-extend
+  kAddiBranch,  // li t; branch on t
+  kAndiBranch,  // bit test; branch on the result
+};
+
+inline bool IsBranch(const OpKind kind) {
+  return kind >= OpKind::kBeq && kind <= OpKind::kBgeu;
+}
+// True if `kind` stands for a fused pair.
+inline bool IsFused(const OpKind kind) { return kind >= OpKind::kLoadImmAddi; }
+
+inline bool IsLinkReg(const uint8_t reg) {
+  return reg == constants::kReturnAddressReg || reg == constants::kAltLinkReg;
+}
+
+// One predecoded instruction. `imm` is already sign-extended; for jal and
+// branches it holds the absolute target.
+struct Op {
+  OpKind kind;
+  uint8_t rd;
+  uint8_t rs1;
+  uint8_t rs2;
+  memory::AccessType mem_type;
+  uint32_t imm;
+};
+
+// A jal or jalr that saves a return address.
+inline bool IsCall(const Op& op) {
+  return (op.kind == OpKind::kJal || op.kind == OpKind::kJalr) && IsLinkReg(op.rd);
+}
+// `ret` and its equivalents: a jalr through a link register that saves
+// nothing.
+inline bool IsReturn(const Op& op) {
+  return op.kind == OpKind::kJalr && op.rd == 0 && IsLinkReg(op.rs1);
+}
+
+enum Exit {
+  kTaken = 0,
+  kFallthrough = 1,
+  // Where a block ending in a call resumes once the callee returns.
+  kReturn = 2,
+  kNumExits = 3,
+  // A jalr, whose target is only known when it runs. Never chained.
+  kIndirect = kNumExits,
+};
+
+struct Block;
+
+// A direct jump from a block exit into the block that follows it. Links
+// pointing at a block are threaded onto its `incoming` list so evicting
+// either end can unhook them.
+struct Link {
+  Block* target = nullptr;
+  Link* prev = nullptr;
+  Link* next = nullptr;
+};
+
+// A run of predecoded instructions from one guest page. Blocks live in
+// fixed-size slots of the code cache arena, so the op array is inline.
+struct Block {
+  uint32_t pc = 0;
+  uint32_t paddr = 0;
+  // 0 if the first instruction must be interpreted.
+  uint32_t size = 0;
+  // Statically known successors; `has_exit` is false for jalr.
+  uint32_t exit_pc[kNumExits] = {};
+  bool has_exit[kNumExits] = {};
+  // CLOCK reference bit, set whenever the block runs.
+  bool referenced = false;
+  bool in_use = false;
+  Link exits[kNumExits];
+  Link* incoming = nullptr;
+  // Blocks translated from the same physical page.
+  Block* page_prev = nullptr;
+  Block* page_next = nullptr;
+  Op ops[constants::kMaxBlockInstrs];
+};
+
+}  // namespace riscv_emu::engine
+
+#endif  // LIB_ENGINE_BLOCK_H
@@ -0,0 +1,200 @@
+#include "code_cache.h"
+#include <algorithm>
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+
+namespace riscv_emu::engine {
+
+namespace {
+
+constexpr uint64_t kInstrBytes = 4;
+
+uint64_t BlockEnd(const Block& block) {
+  return block.paddr + kInstrBytes * std::max<uint64_t>(block.size, 1);
+}
+
+}  // namespace
+
+CodeCache::CodeCache(memory::Dram& dram, const uint64_t budget_bytes)
+    : dram_(dram),
+      capacity_(std::max<uint64_t>(budget_bytes / sizeof(Block), 1)),
+      slots_(std::make_unique<Block[]>(capacity_)),
+      pages_((memory::constants::kDramSize >> memory::constants::kPageShift) + 1, nullptr) {
+  free_.reserve(capacity_);
+  index_.reserve(capacity_);
+}
+
+Block* CodeCache::Lookup(const uint32_t pc, const uint32_t paddr) {
+  ++stats_.lookups;
+  const auto it = index_.find(Key(pc, paddr));
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  ++stats_.hits;
+  return it->second;
+}
+
+Block* CodeCache::Insert(const Block& translated) {
+  const auto it = index_.find(Key(translated.pc, translated.paddr));
+  if (it != index_.end()) {
+    return it->second;
+  }
+  Block* block = Allocate(translated.pc, translated.paddr);
+  block->size = translated.size;
+  std::copy(std::begin(translated.exit_pc), std::end(translated.exit_pc), block->exit_pc);
+  std::copy(std::begin(translated.has_exit), std::end(translated.has_exit), block->has_exit);
+  std::copy(translated.ops, translated.ops + translated.size, block->ops);
+  return block;
+}
+
+Block* CodeCache::Allocate(const uint32_t pc, const uint32_t paddr) {
+  Block* block;
+  if (!free_.empty()) {
+    block = free_.back();
+    free_.pop_back();
+  } else if (next_unused_ < capacity_) {
+    block = &slots_[next_unused_++];
+  } else {
+    // Every slot is live here, so the hand finds a victim within two laps.
+    while (slots_[hand_].referenced) {
+      slots_[hand_].referenced = false;
+      hand_ = (hand_ + 1) % capacity_;
+    }
+    block = &slots_[hand_];
+    hand_ = (hand_ + 1) % capacity_;
+    Evict(*block);
+    ++stats_.evictions;
+  }
+
+  block->pc = pc;
+  block->paddr = paddr;
+  block->size = 0;
+  block->referenced = true;
+  block->in_use = true;
+  index_[Key(pc, paddr)] = block;
+  ++size_;
+  ++stats_.translations;
+
+  Block*& head = pages_[paddr >> memory::constants::kPageShift];
+  block->page_prev = nullptr;
+  block->page_next = head;
+  if (head != nullptr) {
+    head->page_prev = block;
+  }
+  head = block;
+  dram_.MarkCodePage(paddr);
+  return block;
+}
+
+void CodeCache::Chain(Block& from, const Exit exit, Block& to) {
+  Link& link = from.exits[exit];
+  Unchain(link);
+  link.target = &to;
+  link.prev = nullptr;
+  link.next = to.incoming;
+  if (to.incoming != nullptr) {
+    to.incoming->prev = &link;
+  }
+  to.incoming = &link;
+  ++stats_.chains;
+}
+
+void CodeCache::Unchain(Link& link) {
+  if (link.target == nullptr) {
+    return;
+  }
+  if (link.prev != nullptr) {
+    link.prev->next = link.next;
+  } else {
+    link.target->incoming = link.next;
+  }
+  if (link.next != nullptr) {
+    link.next->prev = link.prev;
+  }
+  link.target = nullptr;
+  link.prev = nullptr;
+  link.next = nullptr;
+}
+
+void CodeCache::Evict(Block& block) {
+  VLOG(3) << "Evicting block at 0x" << std::hex << block.pc;
+  for (Link& link : block.exits) {
+    Unchain(link);
+  }
+  // Blocks jumping here fall back to a lookup from now on.
+  while (block.incoming != nullptr) {
+    Unchain(*block.incoming);
+  }
+
+  if (block.page_prev != nullptr) {
+    block.page_prev->page_next = block.page_next;
+  } else {
+    pages_[block.paddr >> memory::constants::kPageShift] = block.page_next;
+  }
+  if (block.page_next != nullptr) {
+    block.page_next->page_prev = block.page_prev;
+  }
+  if (pages_[block.paddr >> memory::constants::kPageShift] == nullptr) {
+    dram_.UnmarkCodePage(block.paddr);
+  }
+
+  index_.erase(Key(block.pc, block.paddr));
+  block.in_use = false;
+  block.referenced = false;
+  --size_;
+}
+
+void CodeCache::Invalidate(const uint64_t paddr, const uint64_t len) {
+  const uint64_t end = paddr + len;
+  const uint64_t last_page = std::min<uint64_t>(
+      (end - 1) >> memory::constants::kPageShift, pages_.size() - 1);
+  bool dropped = false;
+  for (uint64_t page = paddr >> memory::constants::kPageShift; page <= last_page; ++page) {
+    Block* block = pages_[page];
+    while (block != nullptr) {
+      Block* next = block->page_next;
+      if (block->paddr < end && BlockEnd(*block) > paddr) {
+        Evict(*block);
+        free_.push_back(block);
+        ++stats_.invalidations;
+        dropped = true;
+      }
+      block = next;
+    }
+  }
+  if (dropped) {
+    ++epoch_;
+  }
+}
+
+void CodeCache::Flush() {
+  for (uint64_t i = 0; i < next_unused_; ++i) {
+    if (slots_[i].in_use) {
+      Evict(slots_[i]);
+    }
+  }
+  free_.clear();
+  next_unused_ = 0;
+  hand_ = 0;
+  ++epoch_;
+  ++stats_.flushes;
+}
+
+std::string CodeCache::FormatStats() const {
+  uint64_t ops = 0;
+  for (uint64_t i = 0; i < next_unused_; ++i) {
+    if (slots_[i].in_use) {
+      ops += slots_[i].size;
+    }
+  }
+  const double hit_rate =
+      stats_.lookups == 0 ? 0.0 : 100.0 * stats_.hits / stats_.lookups;
+  return absl::StrFormat(
+      "code cache: %d/%d blocks (%d/%d KiB, %d ops), lookups %d, hit rate %.2f%%, "
+      "translations %d, evictions %d, invalidations %d, flushes %d, chains %d",
+      size_, capacity_, size_ * sizeof(Block) >> 10, capacity_ * sizeof(Block) >> 10, ops,
+      stats_.lookups, hit_rate, stats_.translations, stats_.evictions, stats_.invalidations,
+      stats_.flushes, stats_.chains);
+}
+
+}  // namespace riscv_emu::engine
@@ -0,0 +1,88 @@
+#ifndef LIB_ENGINE_CODE_CACHE_H
+#define LIB_ENGINE_CODE_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "lib/engine/block.h"
+#include "lib/memory/dram.h"
+#include "absl/container/flat_hash_map.h"
+
+namespace riscv_emu::engine {
+
+namespace constants {
+  constexpr uint64_t kDefaultCodeCacheBytes = 4 << 20;
+}  // namespace constants
+
+struct CodeCacheStats {
+  uint64_t lookups = 0;
+  uint64_t hits = 0;
+  uint64_t translations = 0;
+  // Blocks dropped to make room, as opposed to invalidated by code writes.
+  uint64_t evictions = 0;
+  uint64_t invalidations = 0;
+  uint64_t flushes = 0;
+  uint64_t chains = 0;
+};
+
+// Fixed-budget store of translated blocks. The budget is carved into
+// block-sized slots up front, so the cache never allocates per block and
+// its footprint stays flat however much code the guest runs. When every
+// slot is taken, a CLOCK hand sweeps the slots and evicts the first block
+// that has not run since the hand last passed it; hot blocks keep getting
+// their reference bit set and survive.
+//
+// Blocks are keyed by virtual and physical pc, so a stale mapping never
+// hits. The cache marks the DRAM pages it holds code from and drops
+// exactly the overlapping blocks when one is written.
+class CodeCache final {
+ public:
+  CodeCache(memory::Dram& dram, uint64_t budget_bytes);
+
+  // Returns the cached block for `pc` at `paddr`, or nullptr.
+  Block* Lookup(uint32_t pc, uint32_t paddr);
+  // Caches a copy of `translated`, evicting a cold block if the cache is
+  // full, and returns the cached block. Any block pointer obtained before
+  // this call may no longer be valid.
+  Block* Insert(const Block& translated);
+  // Chains `exit` of `from` straight to `to`.
+  void Chain(Block& from, Exit exit, Block& to);
+  // Drops every block with code in [paddr, paddr + len).
+  void Invalidate(uint64_t paddr, uint64_t len);
+  void Flush();
+
+  // Bumped whenever blocks are invalidated, so a caller running a block
+  // can tell that a store just rewrote it.
+  inline uint64_t GetEpoch() const { return epoch_; }
+  inline const CodeCacheStats& GetStats() const { return stats_; }
+  inline uint64_t GetCapacity() const { return capacity_; }
+  inline uint64_t GetSize() const { return size_; }
+  std::string FormatStats() const;
+
+ private:
+  static inline uint64_t Key(const uint32_t pc, const uint32_t paddr) {
+    return (static_cast<uint64_t>(paddr) << 32) | pc;
+  }
+  Block* Allocate(uint32_t pc, uint32_t paddr);
+  void Evict(Block& block);
+  void Unchain(Link& link);
+
+  memory::Dram& dram_;
+  const uint64_t capacity_;
+  std::unique_ptr<Block[]> slots_;
+  // Slots released by invalidation, reused before the CLOCK hand runs.
+  std::vector<Block*> free_;
+  uint64_t size_ = 0;
+  uint64_t next_unused_ = 0;
+  uint64_t hand_ = 0;
+  uint64_t epoch_ = 0;
+  absl::flat_hash_map<uint64_t, Block*> index_;
+  // Blocks per DRAM page, for invalidation.
+  std::vector<Block*> pages_;
+  CodeCacheStats stats_;
+};
+
+}  // namespace riscv_emu::engine
+
+#endif  // LIB_ENGINE_CODE_CACHE_H
@@ -0,0 +1,126 @@
+#include "compiler.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include "lib/engine/translator.h"
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+
+namespace riscv_emu::engine {
+
+Compiler::Compiler(const uint32_t threads, const uint32_t threshold)
+    : threshold_(std::min(threshold, kQueued - 1)) {
+  for (uint32_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this] { Work(); });
+  }
+}
+
+Compiler::~Compiler() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+Compiler::Heat& Compiler::GetHeat(const uint64_t key) {
+  // Fibonacci hashing spreads heads that share low address bits.
+  constexpr uint32_t kShift = 64 - std::countr_zero(constants::kHeatSlots);
+  return heat_[(key * 0x9e3779b97f4a7c15ULL) >> kShift];
+}
+
+bool Compiler::Touch(const uint32_t pc, const uint32_t paddr) {
+  const uint64_t key = Key(pc, paddr);
+  Heat& heat = GetHeat(key);
+  if (heat.key != key) {
+    if (heat.count == kQueued) {
+      return false;
+    }
+    heat = Heat{key, 0};
+  }
+  if (heat.count == kQueued || ++heat.count < threshold_) {
+    return false;
+  }
+  heat.count = kQueued;
+  return true;
+}
+
+void Compiler::Enqueue(const uint32_t pc, const uint32_t paddr, const uint8_t* code) {
+  CompiledBlock job;
+  job.block.pc = pc;
+  job.block.paddr = paddr;
+  job.code_len = CodeBytes(pc);
+  std::memcpy(job.code.data(), code, job.code_len);
+  ++stats_.queued;
+  VLOG(3) << "Queueing block at 0x" << std::hex << pc << " for compilation";
+
+  if (workers_.empty()) {
+    Translate(pc, job.code.data(), job.block);
+    std::lock_guard<std::mutex> lock(mu_);
+    done_.push_back(std::move(job));
+    ready_.store(true, std::memory_order_release);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    queue_.push_back(std::move(job));
+  }
+  cv_.notify_one();
+}
+
+void Compiler::Work() {
+  while (true) {
+    CompiledBlock job;
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (stop_) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    // Only the snapshot is read, so guest memory can change meanwhile.
+    Translate(job.block.pc, job.code.data(), job.block);
+    std::lock_guard<std::mutex> lock(mu_);
+    done_.push_back(std::move(job));
+    ready_.store(true, std::memory_order_release);
+  }
+}
+
+void Compiler::Drain(const std::function<bool(const CompiledBlock&)>& install) {
+  std::vector<CompiledBlock> done;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    done.swap(done_);
+    ready_.store(false, std::memory_order_relaxed);
+  }
+  for (const CompiledBlock& compiled : done) {
+    ++stats_.compiled;
+    if (install(compiled)) {
+      ++stats_.installed;
+    } else {
+      ++stats_.stale;
+    }
+    // Stale heads start over and are recompiled if they stay hot.
+    Heat& heat = GetHeat(Key(compiled.block.pc, compiled.block.paddr));
+    if (heat.key == Key(compiled.block.pc, compiled.block.paddr)) {
+      heat = Heat();
+    }
+  }
+}
+
+void Compiler::Reset() {
+  heat_.fill(Heat());
+}
+
+std::string Compiler::FormatStats() const {
+  return absl::StrFormat("compiler: %d threads, queued %d, compiled %d, installed %d, stale %d",
+                         workers_.size(), stats_.queued, stats_.compiled, stats_.installed,
+                         stats_.stale);
+}
+
+}  // namespace riscv_emu::engine
@@ -0,0 +1,102 @@
+#ifndef LIB_ENGINE_COMPILER_H
+#define LIB_ENGINE_COMPILER_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lib/engine/block.h"
+
+namespace riscv_emu::engine {
+
+namespace constants {
+  // Interpreted runs of a block head before it is compiled.
+  constexpr uint32_t kDefaultTierUpThreshold = 16;
+  constexpr uint32_t kDefaultCompileThreads = 1;
+  // Heat counters, direct-mapped by block head; a power of two.
+  constexpr uint32_t kHeatSlots = 4096;
+}  // namespace constants
+
+// A block compiled off the guest thread, with the code bytes it was
+// compiled from so the installer can tell whether they changed since.
+struct CompiledBlock {
+  Block block;
+  std::array<uint8_t, constants::kMaxBlockBytes> code;
+  uint32_t code_len = 0;
+};
+
+struct CompilerStats {
+  uint64_t queued = 0;
+  uint64_t compiled = 0;
+  uint64_t installed = 0;
+  // Finished blocks whose code was rewritten while they compiled.
+  uint64_t stale = 0;
+};
+
+// Tier-up from the interpreter to predecoded blocks. The guest thread
+// counts interpreted runs per block head; heads that cross the threshold
+// are compiled by a pool of background threads from a snapshot of their
+// code, so the guest never waits on the compiler. Results are handed back
+// to the guest thread, which installs them between blocks. With no
+// threads, blocks are compiled inline when they cross the threshold.
+class Compiler final {
+ public:
+  Compiler(uint32_t threads, uint32_t threshold);
+  ~Compiler();
+  Compiler(const Compiler&) = delete;
+  Compiler& operator=(const Compiler&) = delete;
+
+  // Counts one interpreted run of the block head at `pc`/`paddr`. Returns
+  // true, once, when the head turns hot; the caller then enqueues it.
+  bool Touch(uint32_t pc, uint32_t paddr);
+  // Compiles the block at `pc` from `code` (`CodeBytes(pc)` bytes, copied
+  // before returning). Inline compiles are installed by the next `Drain`.
+  void Enqueue(uint32_t pc, uint32_t paddr, const uint8_t* code);
+  inline bool HasResults() const { return ready_.load(std::memory_order_acquire); }
+  // Passes every finished block to `install`, which returns false if the
+  // block is stale. Runs on the calling thread.
+  void Drain(const std::function<bool(const CompiledBlock&)>& install);
+  // Forgets all heat, e.g. after the code cache is flushed.
+  void Reset();
+  inline const CompilerStats& GetStats() const { return stats_; }
+  std::string FormatStats() const;
+
+ private:
+  static inline uint64_t Key(const uint32_t pc, const uint32_t paddr) {
+    return (static_cast<uint64_t>(paddr) << 32) | pc;
+  }
+  struct Heat {
+    uint64_t key = kNoKey;
+    uint32_t count = 0;
+  };
+  Heat& GetHeat(uint64_t key);
+  void Work();
+
+  const uint32_t threshold_;
+  // Guest thread only. A head that maps to a slot held by another starts
+  // counting from zero in its place, so cold heads cannot grow the table;
+  // queued heads stay at `kQueued`, and keep their slot, until drained.
+  static constexpr uint32_t kQueued = UINT32_MAX;
+  // Never a key: pcs and physical addresses are 32 bits.
+  static constexpr uint64_t kNoKey = UINT64_MAX;
+  std::array<Heat, constants::kHeatSlots> heat_;
+  CompilerStats stats_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::deque<CompiledBlock> queue_;
+  std::vector<CompiledBlock> done_;
+  std::atomic<bool> ready_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace riscv_emu::engine
+
+#endif  // LIB_ENGINE_COMPILER_H
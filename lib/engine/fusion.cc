@@ -0,0 +1,72 @@
+#include "fusion.h"
+
+namespace riscv_emu::engine {
+
+namespace {
+
+// Returns the fused kind for `first` followed by `second`, or `first`'s
+// own kind if the pair is not fusible.
+OpKind FusedKind(const Op& first, const Op& second) {
+  switch (first.kind) {
+   case OpKind::kLoadImm:
+    if (second.rs1 != first.rd) {
+      break;
+    }
+    switch (second.kind) {
+     case OpKind::kAddi:
+      // Only the combined constant may stay observable.
+      return second.rd == first.rd ? OpKind::kLoadImmAddi : first.kind;
+     case OpKind::kJalr:
+      return OpKind::kLoadImmJalr;
+     case OpKind::kLoad:
+      return OpKind::kLoadImmLoad;
+     case OpKind::kStore:
+      return OpKind::kLoadImmStore;
+     default:
+      break;
+    }
+    break;
+   case OpKind::kSlli:
+    if (second.rs1 != first.rd) {
+      break;
+    }
+    if (second.kind == OpKind::kSrli) {
+      return OpKind::kSlliSrli;
+    }
+    if (second.kind == OpKind::kSrai) {
+      return OpKind::kSlliSrai;
+    }
+    break;
+   case OpKind::kAddi:
+   case OpKind::kAndi:
+    if (IsBranch(second.kind) && (second.rs1 == first.rd || second.rs2 == first.rd)) {
+      return first.kind == OpKind::kAddi ? OpKind::kAddiBranch : OpKind::kAndiBranch;
+    }
+    break;
+   default:
+    break;
+  }
+  return first.kind;
+}
+
+}  // namespace
+
+void Fuse(Block& block) {
+  for (uint32_t i = 0; i + 1 < block.size; ++i) {
+    Op& first = block.ops[i];
+    const Op& second = block.ops[i + 1];
+    const OpKind fused = FusedKind(first, second);
+    if (fused == first.kind) {
+      continue;
+    }
+    first.kind = fused;
+    if (fused == OpKind::kLoadImmJalr) {
+      // The target is a constant, so the jump can be chained.
+      block.exit_pc[kTaken] = (first.imm + second.imm) & ~0b1U;
+      block.has_exit[kTaken] = true;
+    }
+    ++i;
+  }
+}
+
+}  // namespace riscv_emu::engine
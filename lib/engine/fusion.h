@@ -0,0 +1,16 @@
+#ifndef LIB_ENGINE_FUSION_H
+#define LIB_ENGINE_FUSION_H
+
+#include "lib/engine/block.h"
+
+namespace riscv_emu::engine {
+
+// Rewrites the first op of each recognised instruction pair in `block`
+// into a fused op, so the pair is dispatched once. Pairs are fused only
+// where the second op consumes the first one's result, and the executor
+// still retires them one at a time, so traps stay precise.
+void Fuse(Block& block);
+
+}  // namespace riscv_emu::engine
+
+#endif  // LIB_ENGINE_FUSION_H
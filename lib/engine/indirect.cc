@@ -0,0 +1,66 @@
+#include "indirect.h"
+#include "absl/strings/str_format.h"
+
+namespace riscv_emu::engine {
+
+namespace {
+
+  constexpr uint32_t kInstrBytes = 4;
+
+  bool IsCachedAt(const Block* block, const uint32_t pc) {
+    return block != nullptr && block->in_use && block->pc == pc;
+  }
+
+}  // namespace
+
+void IndirectPredictor::PushCall(Block& caller) {
+  top_ = (top_ + 1) % constants::kReturnStackDepth;
+  returns_[top_] = &caller;
+}
+
+Block* IndirectPredictor::PopCaller(const uint32_t target) {
+  ++stats_.returns;
+  Block* caller = returns_[top_];
+  returns_[top_] = nullptr;
+  top_ = (top_ + constants::kReturnStackDepth - 1) % constants::kReturnStackDepth;
+  // The slot may have been reused for another block since the call.
+  if (caller == nullptr || !caller->in_use || !caller->has_exit[kReturn] ||
+      caller->exit_pc[kReturn] != target) {
+    return nullptr;
+  }
+  ++stats_.return_hits;
+  return caller;
+}
+
+Block* IndirectPredictor::Find(const Block& from, const uint32_t target) {
+  ++stats_.lookups;
+  const uint32_t site = Site(from);
+  const Entry& entry = Slot(site, target);
+  if (entry.site != site || entry.target != target || !IsCachedAt(entry.block, target)) {
+    return nullptr;
+  }
+  ++stats_.hits;
+  return entry.block;
+}
+
+void IndirectPredictor::Record(const Block& from, const uint32_t target, Block& to) {
+  const uint32_t site = Site(from);
+  Slot(site, target) = Entry{site, target, &to};
+}
+
+uint32_t IndirectPredictor::Site(const Block& from) {
+  return from.pc + kInstrBytes * (from.size - 1);
+}
+
+IndirectPredictor::Entry& IndirectPredictor::Slot(const uint32_t site, const uint32_t target) {
+  // Instructions are word aligned, so the low bits carry nothing.
+  const uint32_t hash = (site >> 2) ^ (target >> 2) ^ (target >> 12);
+  return targets_[hash % constants::kTargetCacheEntries];
+}
+
+std::string IndirectPredictor::FormatStats() const {
+  return absl::StrFormat("indirect: lookups %d, hits %d, returns %d, return hits %d",
+                         stats_.lookups, stats_.hits, stats_.returns, stats_.return_hits);
+}
+
+}  // namespace riscv_emu::engine
@@ -0,0 +1,64 @@
+#ifndef LIB_ENGINE_INDIRECT_H
+#define LIB_ENGINE_INDIRECT_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include "lib/engine/block.h"
+
+namespace riscv_emu::engine {
+
+namespace constants {
+  constexpr uint32_t kTargetCacheEntries = 1024;
+  constexpr uint32_t kReturnStackDepth = 16;
+}  // namespace constants
+
+struct IndirectStats {
+  uint64_t lookups = 0;
+  uint64_t hits = 0;
+  uint64_t returns = 0;
+  // Returns whose target matched the top of the return stack.
+  uint64_t return_hits = 0;
+};
+
+// Predicts the block a jalr lands in, so blocks ending in one can be
+// dispatched without a code cache lookup. Returns are predicted by a
+// shadow return-address stack of the blocks that made the calls; the
+// caller's `kReturn` exit is then chained like any static exit. Other
+// jalrs go through a direct-mapped cache keyed by jalr site and target.
+//
+// Predictions are hints: blocks they name may have been evicted since,
+// so they are only returned while still cached at the predicted pc, and
+// the caller must still check the physical address.
+class IndirectPredictor final {
+ public:
+  // Records that `caller` ended in a call that was taken.
+  void PushCall(Block& caller);
+  // Pops the return stack for a return to `target`. Returns the block
+  // whose `kReturn` exit resumes at `target`, or nullptr on a mispredict.
+  Block* PopCaller(uint32_t target);
+  // Returns the block last seen at `target` after the jalr ending `from`.
+  Block* Find(const Block& from, uint32_t target);
+  void Record(const Block& from, uint32_t target, Block& to);
+  inline const IndirectStats& GetStats() const { return stats_; }
+  std::string FormatStats() const;
+
+ private:
+  struct Entry {
+    uint32_t site = 0;
+    uint32_t target = 0;
+    Block* block = nullptr;
+  };
+  static uint32_t Site(const Block& from);
+  Entry& Slot(uint32_t site, uint32_t target);
+
+  std::array<Entry, constants::kTargetCacheEntries> targets_;
+  // Circular, so deep recursion overwrites the oldest calls.
+  std::array<Block*, constants::kReturnStackDepth> returns_ = {};
+  uint32_t top_ = 0;
+  IndirectStats stats_;
+};
+
+}  // namespace riscv_emu::engine
+
+#endif  // LIB_ENGINE_INDIRECT_H
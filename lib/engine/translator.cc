@@ -0,0 +1,203 @@
+#include "translator.h"
+#include <algorithm>
+#include "lib/alu/alu.h"
+#include "lib/engine/fusion.h"
+#include "lib/immediates/imm_decoder.h"
+#include "lib/logic/opcodes.h"
+#include "lib/logic/wire.h"
+#include "glog/logging.h"
+
+namespace riscv_emu::engine {
+
+namespace {
+
+constexpr uint32_t kInstrBytes = 4;
+constexpr uint32_t kPageSize = 1U << memory::constants::kPageShift;
+constexpr uint32_t kFunc7Alt = 0b0100000;  // sub, sra, srai
+
+uint32_t Imm(const imm::ImmSel sel, const uint32_t instr) {
+  return imm::DecodeImm(sel, instr).value();
+}
+
+uint32_t ReadInstr(const uint8_t* code) {
+  return memory::LoadFromHost(code, memory::AccessType::kWord);
+}
+
+// Predecodes one instruction. Returns false if it has to be interpreted.
+bool DecodeOp(const uint32_t pc, const uint32_t instr, Op& op) {
+  // Fields are extracted unconditionally; unused ones are never read.
+  const uint32_t func3 = (instr & logic::constants::kFunc3Mask) >> logic::constants::kFunc3Shift;
+  const uint32_t func7 = (instr & logic::constants::kFunc7Mask) >> logic::constants::kFunc7Shift;
+  op.rd = (instr & logic::constants::kRdMask) >> logic::constants::kRdShift;
+  op.rs1 = (instr & logic::constants::kRs1Mask) >> logic::constants::kRs1Shift;
+  op.rs2 = (instr & logic::constants::kRs2Mask) >> logic::constants::kRs2Shift;
+  op.mem_type = memory::AccessType::kWord;
+  op.imm = 0;
+
+  switch (static_cast<logic::Opcode>(instr & logic::constants::kOpcodeMask)) {
+   case logic::Opcode::kLuiType:
+    op.kind = OpKind::kLoadImm;
+    op.imm = Imm(imm::ImmSel::kUType, instr);
+    break;
+   case logic::Opcode::kAuiPcType:
+    op.kind = OpKind::kLoadImm;
+    op.imm = pc + Imm(imm::ImmSel::kUType, instr);
+    break;
+   case logic::Opcode::kJalType:
+    op.kind = OpKind::kJal;
+    op.imm = pc + Imm(imm::ImmSel::kJType, instr);
+    return true;
+   case logic::Opcode::kJalrType:
+    if (func3 != 0) {
+      return false;
+    }
+    op.kind = OpKind::kJalr;
+    op.imm = Imm(imm::ImmSel::kIType, instr);
+    return true;
+   case logic::Opcode::kBType:
+    switch (func3) {
+     case 0b000: op.kind = OpKind::kBeq; break;
+     case 0b001: op.kind = OpKind::kBne; break;
+     case 0b100: op.kind = OpKind::kBlt; break;
+     case 0b101: op.kind = OpKind::kBge; break;
+     case 0b110: op.kind = OpKind::kBltu; break;
+     case 0b111: op.kind = OpKind::kBgeu; break;
+     default: return false;
+    }
+    op.imm = pc + Imm(imm::ImmSel::kBType, instr);
+    return true;
+   case logic::Opcode::kLType:
+    switch (static_cast<memory::AccessType>(func3)) {
+     case memory::AccessType::kByte:
+     case memory::AccessType::kHalfword:
+     case memory::AccessType::kWord:
+     case memory::AccessType::kByteUnsigned:
+     case memory::AccessType::kHalfwordUnsigned:
+      break;
+     default:
+      return false;
+    }
+    op.kind = OpKind::kLoad;
+    op.mem_type = static_cast<memory::AccessType>(func3);
+    op.imm = Imm(imm::ImmSel::kIType, instr);
+    // Loads into x0 still access memory.
+    return true;
+   case logic::Opcode::kSType:
+    if (func3 > static_cast<uint32_t>(memory::AccessType::kWord)) {
+      return false;
+    }
+    op.kind = OpKind::kStore;
+    op.mem_type = static_cast<memory::AccessType>(func3);
+    op.imm = Imm(imm::ImmSel::kSType, instr);
+    return true;
+   case logic::Opcode::kIType:
+    op.imm = Imm(imm::ImmSel::kIType, instr);
+    switch (func3) {
+     case 0b000: op.kind = OpKind::kAddi; break;
+     case 0b100: op.kind = OpKind::kXori; break;
+     case 0b110: op.kind = OpKind::kOri; break;
+     case 0b111: op.kind = OpKind::kAndi; break;
+     case 0b001:
+      if (func7 != 0) {
+        return false;
+      }
+      op.kind = OpKind::kSlli;
+      break;
+     case 0b101:
+      if (func7 != 0 && func7 != kFunc7Alt) {
+        return false;
+      }
+      op.kind = func7 == 0 ? OpKind::kSrli : OpKind::kSrai;
+      break;
+     default:
+      return false;
+    }
+    if (op.kind == OpKind::kSlli || op.kind == OpKind::kSrli || op.kind == OpKind::kSrai) {
+      op.imm &= alu::constants::kMaxShiftMask;
+    }
+    break;
+   case logic::Opcode::kRType:
+    if (func7 == 0) {
+      switch (func3) {
+       case 0b000: op.kind = OpKind::kAdd; break;
+       case 0b001: op.kind = OpKind::kSll; break;
+       case 0b100: op.kind = OpKind::kXor; break;
+       case 0b101: op.kind = OpKind::kSrl; break;
+       case 0b110: op.kind = OpKind::kOr; break;
+       case 0b111: op.kind = OpKind::kAnd; break;
+       default: return false;
+      }
+    } else if (func7 == kFunc7Alt && func3 == 0b000) {
+      op.kind = OpKind::kSub;
+    } else if (func7 == kFunc7Alt && func3 == 0b101) {
+      op.kind = OpKind::kSra;
+    } else {
+      return false;
+    }
+    break;
+   case logic::Opcode::kFenceType:
+    if (func3 != 0) {
+      return false;  // fence.i
+    }
+    op.kind = OpKind::kNop;
+    return true;
+   default:
+    return false;
+  }
+  // ALU results written to x0 are discarded.
+  if (op.rd == 0) {
+    op.kind = OpKind::kNop;
+  }
+  return true;
+}
+
+bool EndsBlock(const OpKind kind) {
+  return kind == OpKind::kJal || kind == OpKind::kJalr || IsBranch(kind);
+}
+
+}  // namespace
+
+uint32_t CodeBytes(const uint32_t pc) {
+  const uint32_t page_end = (pc & ~(kPageSize - 1)) + kPageSize;
+  return std::min(page_end - pc, constants::kMaxBlockBytes);
+}
+
+void Translate(const uint32_t pc, const uint8_t* code, Block& block) {
+  block.pc = pc;
+  block.size = 0;
+  block.has_exit[kTaken] = false;
+  block.has_exit[kFallthrough] = false;
+  block.has_exit[kReturn] = false;
+
+  const uint32_t end = pc + CodeBytes(pc);
+  uint32_t at = pc;
+  bool falls_through = true;
+  while (at < end) {
+    Op& op = block.ops[block.size];
+    if (!DecodeOp(at, ReadInstr(code + (at - pc)), op)) {
+      break;
+    }
+    ++block.size;
+    at += kInstrBytes;
+    if (!EndsBlock(op.kind)) {
+      continue;
+    }
+    if (op.kind != OpKind::kJalr) {
+      block.exit_pc[kTaken] = op.imm;
+      block.has_exit[kTaken] = true;
+    }
+    falls_through = op.kind != OpKind::kJal && op.kind != OpKind::kJalr;
+    if (IsCall(op)) {
+      block.exit_pc[kReturn] = at;
+      block.has_exit[kReturn] = true;
+    }
+    break;
+  }
+  block.exit_pc[kFallthrough] = at;
+  block.has_exit[kFallthrough] = falls_through && block.size > 0;
+  Fuse(block);
+  VLOG(3) << "Translated block at 0x" << std::hex << pc << " with " << std::dec << block.size
+          << " ops";
+}
+
+}  // namespace riscv_emu::engine
@@ -0,0 +1,20 @@
+#ifndef LIB_ENGINE_TRANSLATOR_H
+#define LIB_ENGINE_TRANSLATOR_H
+
+#include <cstdint>
+#include "lib/engine/block.h"
+
+namespace riscv_emu::engine {
+
+// Predecodes the straight-line run of instructions at `pc` into `block`,
+// reading at most `CodeBytes(pc)` bytes from `code`. System instructions
+// and encodings the interpreter rejects are left to the interpreter,
+// which keeps traps and errors identical between both engines. Common
+// instruction pairs are then fused (see fusion.h).
+void Translate(uint32_t pc, const uint8_t* code, Block& block);
+// Number of code bytes `Translate` may read at `pc`.
+uint32_t CodeBytes(uint32_t pc);
+
+}  // namespace riscv_emu::engine
+
+#endif  // LIB_ENGINE_TRANSLATOR_H
@@ -0,0 +1,103 @@
+#include "translator.h"
+#include <cstring>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace riscv_emu::engine {
+
+namespace {
+
+constexpr uint32_t kPc = 0x8000;
+
+// Translates `instrs` at `kPc`. The rest of the block's code bytes are
+// zero, which is not a valid instruction and ends the block.
+Block TranslateAt(const std::vector<uint32_t>& instrs) {
+  std::vector<uint8_t> code(CodeBytes(kPc));
+  std::memcpy(code.data(), instrs.data(), instrs.size() * sizeof(uint32_t));
+  Block block;
+  Translate(kPc, code.data(), block);
+  return block;
+}
+
+TEST(TranslatorTest, FusesLoadImmAddiIntoTheSameRegister) {
+  const Block block = TranslateAt({
+    0x12345537,  // lui a0, 0x12345
+    0x67850513,  // addi a0, a0, 0x678
+  });
+  ASSERT_EQ(block.size, 2);
+  EXPECT_EQ(block.ops[0].kind, OpKind::kLoadImmAddi);
+  EXPECT_EQ(block.ops[0].imm, 0x12345000);
+  EXPECT_EQ(block.ops[1].kind, OpKind::kAddi);
+}
+
+TEST(TranslatorTest, LoadImmAddiNeedsRdEqualToRs1) {
+  // The lui result stays live in a0, so the pair cannot collapse.
+  const Block block = TranslateAt({
+    0x12345537,  // lui a0, 0x12345
+    0x00150593,  // addi a1, a0, 1
+  });
+  ASSERT_EQ(block.size, 2);
+  EXPECT_EQ(block.ops[0].kind, OpKind::kLoadImm);
+  EXPECT_EQ(block.ops[1].kind, OpKind::kAddi);
+}
+
+TEST(TranslatorTest, DoesNotFusePairsWritingX0) {
+  const Block block = TranslateAt({
+    0x00001037,  // lui zero, 1
+    0x00100013,  // addi zero, zero, 1
+    0x00000013,  // nop
+    0x00000463,  // beq zero, zero, 8
+  });
+  ASSERT_EQ(block.size, 4);
+  EXPECT_EQ(block.ops[0].kind, OpKind::kNop);
+  EXPECT_EQ(block.ops[1].kind, OpKind::kNop);
+  EXPECT_EQ(block.ops[2].kind, OpKind::kNop);
+  EXPECT_EQ(block.ops[3].kind, OpKind::kBeq);
+}
+
+TEST(TranslatorTest, FusesShiftPairsAndBranchOnImmediate) {
+  const Block block = TranslateAt({
+    0x01051513,  // slli a0, a0, 16
+    0x41055513,  // srai a0, a0, 16
+    0x00500293,  // li t0, 5
+    0x00a29463,  // bne t0, a0, 8
+  });
+  ASSERT_EQ(block.size, 4);
+  EXPECT_EQ(block.ops[0].kind, OpKind::kSlliSrai);
+  EXPECT_EQ(block.ops[2].kind, OpKind::kAddiBranch);
+  EXPECT_EQ(block.ops[3].kind, OpKind::kBne);
+  EXPECT_EQ(block.ops[3].imm, kPc + 12 + 8);
+  EXPECT_TRUE(block.has_exit[kTaken]);
+  EXPECT_EQ(block.exit_pc[kTaken], kPc + 12 + 8);
+  EXPECT_TRUE(block.has_exit[kFallthrough]);
+  EXPECT_EQ(block.exit_pc[kFallthrough], kPc + 16);
+}
+
+TEST(TranslatorTest, FarCallGetsAStaticTarget) {
+  const Block block = TranslateAt({
+    0x00000317,  // auipc t1, 0
+    0x010300e7,  // jalr ra, 16(t1)
+  });
+  ASSERT_EQ(block.size, 2);
+  EXPECT_EQ(block.ops[0].kind, OpKind::kLoadImmJalr);
+  EXPECT_EQ(block.ops[0].imm, kPc);
+  EXPECT_TRUE(block.has_exit[kTaken]);
+  EXPECT_EQ(block.exit_pc[kTaken], kPc + 16);
+  EXPECT_FALSE(block.has_exit[kFallthrough]);
+  EXPECT_TRUE(block.has_exit[kReturn]);
+  EXPECT_EQ(block.exit_pc[kReturn], kPc + 8);
+}
+
+TEST(TranslatorTest, StopsAtInstructionsLeftToTheInterpreter) {
+  const Block block = TranslateAt({
+    0x00150593,  // addi a1, a0, 1
+    0x00100073,  // ebreak
+  });
+  EXPECT_EQ(block.size, 1);
+  EXPECT_TRUE(block.has_exit[kFallthrough]);
+  EXPECT_EQ(block.exit_pc[kFallthrough], kPc + 4);
+}
+
+}  // namespace
+
+}  // namespace riscv_emu::engine
@@ -0,0 +1,274 @@
+#include "hostcall.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "status_macros.h"
+
+namespace riscv_emu::hostcall {
+
+namespace {
+
+// Guest open(2) flags the host is asked to honour (generic Linux values).
+constexpr uint32_t kOpenFlagMask = O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND;
+
+// Strings are read page by page, down to the smallest PMP region where a
+// page is not readable as a whole.
+constexpr uint32_t kPageBytes = 1U << memory::constants::kPageShift;
+constexpr uint32_t kGranuleBytes = 4;
+
+constexpr uint32_t kLuiOpcode = 0b0110111;
+constexpr uint32_t kOpImmOpcode = 0b0010011;
+constexpr uint32_t kJalrOpcode = 0b1100111;
+constexpr uint32_t kEcall = 0x00000073;
+constexpr uint32_t kRa = 1;
+
+constexpr uint32_t EncodeU(const uint32_t opcode, const uint32_t rd, const uint32_t imm) {
+  return (imm & 0xfffff000) | (rd << 7) | opcode;
+}
+
+constexpr uint32_t EncodeI(const uint32_t opcode, const uint32_t rd, const uint32_t rs1,
+                           const uint32_t imm) {
+  return (imm << 20) | (rs1 << 15) | (rd << 7) | opcode;
+}
+
+// lui a7, %hi(kMagic); addi a7, a7, %lo(kMagic); addi a6, x0, func; ecall; ret
+std::array<uint32_t, 5> MakeStub(const Func func) {
+  const uint32_t hi = (constants::kMagic + 0x800) & 0xfffff000;
+  const uint32_t lo = constants::kMagic - hi;
+  return {
+    EncodeU(kLuiOpcode, constants::kMagicReg, hi),
+    EncodeI(kOpImmOpcode, constants::kMagicReg, constants::kMagicReg, lo & 0xfff),
+    EncodeI(kOpImmOpcode, constants::kFuncReg, 0, static_cast<uint32_t>(func)),
+    kEcall,
+    EncodeI(kJalrOpcode, 0, kRa, 0),
+  };
+}
+
+constexpr std::pair<const char*, Func> kPatchable[] = {
+  {"memcpy", Func::kMemcpy},
+  {"memset", Func::kMemset},
+  {"memcmp", Func::kMemcmp},
+  {"strlen", Func::kStrlen},
+};
+
+uint32_t NegErrno() {
+  return static_cast<uint32_t>(-errno);
+}
+
+}  // namespace
+
+HostCalls::HostCalls(memory::Dram& dram) : dram_(dram) {
+  CloseFiles();
+}
+
+HostCalls::~HostCalls() {
+  for (const auto& [guest_fd, host_fd] : fds_) {
+    if (host_fd > STDERR_FILENO) {
+      close(host_fd);
+    }
+  }
+}
+
+void HostCalls::CloseFiles() {
+  for (const auto& [guest_fd, host_fd] : fds_) {
+    if (host_fd > STDERR_FILENO) {
+      close(host_fd);
+    }
+  }
+  fds_ = {{STDIN_FILENO, STDIN_FILENO},
+          {STDOUT_FILENO, STDOUT_FILENO},
+          {STDERR_FILENO, STDERR_FILENO}};
+  next_fd_ = STDERR_FILENO + 1;
+}
+
+bool HostCalls::HasOpenFiles() const {
+  return std::any_of(fds_.begin(), fds_.end(),
+                     [](const auto& fd) { return fd.first > STDERR_FILENO; });
+}
+
+absl::StatusOr<uint32_t> HostCalls::Call(const uint32_t func, const Args& args) {
+  VLOG(3) << "Host call " << std::dec << func;
+  switch (static_cast<Func>(func)) {
+   case Func::kMemcpy: {
+    const std::optional<uint32_t> dst = Map(args[0], args[2], /*is_write=*/true);
+    const std::optional<uint32_t> src = Map(args[1], args[2], /*is_write=*/false);
+    // memcpy with overlap is undefined, so memmove is a valid refinement.
+    if (!dst.has_value() || !src.has_value() || !dram_.Copy(*dst, *src, args[2]).ok()) {
+      return static_cast<uint32_t>(-EFAULT);
+    }
+    return args[0];
+   }
+   case Func::kMemset: {
+    const std::optional<uint32_t> dst = Map(args[0], args[2], /*is_write=*/true);
+    if (!dst.has_value() ||
+        !dram_.Fill(*dst, args[2], (args[1] & 0xff) * 0x01010101U).ok()) {
+      return static_cast<uint32_t>(-EFAULT);
+    }
+    return args[0];
+   }
+   case Func::kMemcmp: {
+    const std::optional<uint32_t> a_addr = Map(args[0], args[2], /*is_write=*/false);
+    const std::optional<uint32_t> b_addr = Map(args[1], args[2], /*is_write=*/false);
+    if (!a_addr.has_value() || !b_addr.has_value()) {
+      return static_cast<uint32_t>(-EFAULT);
+    }
+    const absl::StatusOr<uint8_t*> a = dram_.GetHostPtr(*a_addr, args[2]);
+    const absl::StatusOr<uint8_t*> b = dram_.GetHostPtr(*b_addr, args[2]);
+    if (!a.ok() || !b.ok()) {
+      return static_cast<uint32_t>(-EFAULT);
+    }
+    const int res = std::memcmp(*a, *b, args[2]);
+    return static_cast<uint32_t>(res < 0 ? -1 : (res > 0 ? 1 : 0));
+   }
+   case Func::kStrlen: {
+    const absl::StatusOr<std::string> s = ReadString(args[0]);
+    if (!s.ok()) {
+      return static_cast<uint32_t>(-EFAULT);
+    }
+    return static_cast<uint32_t>(s->size());
+   }
+   case Func::kOpen:
+    return Open(args);
+   case Func::kRead:
+   case Func::kWrite:
+    return Transfer(static_cast<Func>(func), args);
+   case Func::kClose:
+    return Close(args[0]);
+   case Func::kExit:
+    exit_code_ = static_cast<int>(args[0]);
+    VLOG(1) << "Guest exited with code " << std::dec << *exit_code_;
+    return args[0];
+   default:
+    VLOG(1) << "Unknown host call " << std::dec << func;
+    return static_cast<uint32_t>(-ENOSYS);
+  }
+}
+
+std::optional<uint32_t> HostCalls::Map(const uint32_t addr, const uint32_t len,
+                                       const bool is_write) const {
+  return map_ ? map_(addr, len, is_write) : std::optional<uint32_t>(addr);
+}
+
+absl::StatusOr<std::string> HostCalls::ReadString(const uint32_t addr) {
+  std::string s;
+  for (uint64_t at = addr; at <= UINT32_MAX && at - addr < memory::constants::kDramSize;) {
+    uint32_t chunk = kPageBytes - (at & (kPageBytes - 1));
+    std::optional<uint32_t> paddr = Map(at, chunk, /*is_write=*/false);
+    if (!paddr.has_value()) {
+      chunk = kGranuleBytes - (at & (kGranuleBytes - 1));
+      paddr = Map(at, chunk, /*is_write=*/false);
+    }
+    if (!paddr.has_value()) {
+      return absl::OutOfRangeError("String out of range");
+    }
+    ASSIGN_OR_RETURN(const uint8_t* p, dram_.GetHostPtr(*paddr, chunk));
+    const void* nul = std::memchr(p, '\0', chunk);
+    if (nul != nullptr) {
+      s.append(reinterpret_cast<const char*>(p), static_cast<const uint8_t*>(nul) - p);
+      return s;
+    }
+    s.append(reinterpret_cast<const char*>(p), chunk);
+    at += chunk;
+  }
+  return absl::OutOfRangeError("Unterminated guest string");
+}
+
+absl::StatusOr<uint32_t> HostCalls::Open(const Args& args) {
+  absl::StatusOr<std::string> path = ReadString(args[0]);
+  if (!path.ok()) {
+    return static_cast<uint32_t>(-EFAULT);
+  }
+  const int host_fd = open(path->c_str(), (args[1] & kOpenFlagMask) | O_CLOEXEC, args[2]);
+  if (host_fd < 0) {
+    return NegErrno();
+  }
+  const uint32_t guest_fd = next_fd_++;
+  fds_[guest_fd] = host_fd;
+  VLOG(2) << "Opened " << *path << " as guest fd " << std::dec << guest_fd;
+  return guest_fd;
+}
+
+absl::StatusOr<uint32_t> HostCalls::Transfer(const Func func, const Args& args) {
+  const auto fd = fds_.find(args[0]);
+  if (fd == fds_.end()) {
+    return static_cast<uint32_t>(-EBADF);
+  }
+  const std::optional<uint32_t> addr = Map(args[1], args[2], func == Func::kRead);
+  if (!addr.has_value()) {
+    return static_cast<uint32_t>(-EFAULT);
+  }
+  absl::StatusOr<uint8_t*> buf = dram_.GetHostPtr(*addr, args[2]);
+  if (!buf.ok()) {
+    return static_cast<uint32_t>(-EFAULT);
+  }
+  if (func == Func::kRead) {
+    ASSIGN_OR_RETURN(const int64_t n, Read(args[0], fd->second, *buf, args[2]));
+    if (n > 0) {
+      dram_.NotifyWrite(*addr, n);
+    }
+    return static_cast<uint32_t>(n);
+  }
+  // Keep ordering with UART output, which goes through std::cout.
+  std::cout.flush();
+  const ssize_t n = write(fd->second, *buf, args[2]);
+  return n < 0 ? NegErrno() : static_cast<uint32_t>(n);
+}
+
+absl::StatusOr<int64_t> HostCalls::Read(const uint32_t guest_fd, const int host_fd,
+                                        uint8_t* buf, const uint32_t len) {
+  if (input_log_ != nullptr && input_log_->IsReplaying()) {
+    ASSIGN_OR_RETURN(const replay::Input input, input_log_->Take(replay::Kind::kHostRead));
+    if (input.tag != guest_fd || input.data.size() > len) {
+      return absl::FailedPreconditionError(absl::StrCat(
+          "Replay diverged: recorded read of ", input.data.size(), " bytes from fd ", input.tag,
+          ", now ", len, " bytes from fd ", guest_fd));
+    }
+    std::memcpy(buf, input.data.data(), input.data.size());
+    return input.value;
+  }
+  const ssize_t n = read(host_fd, buf, len);
+  const int64_t result = n < 0 ? -static_cast<int64_t>(errno) : n;
+  if (input_log_ != nullptr) {
+    input_log_->Append(replay::Kind::kHostRead, guest_fd, result,
+                       absl::string_view(reinterpret_cast<const char*>(buf), n > 0 ? n : 0));
+  }
+  return result;
+}
+
+absl::StatusOr<uint32_t> HostCalls::Close(const uint32_t fd) {
+  const auto it = fds_.find(fd);
+  if (it == fds_.end()) {
+    return static_cast<uint32_t>(-EBADF);
+  }
+  if (it->second > STDERR_FILENO && close(it->second) < 0) {
+    return NegErrno();
+  }
+  fds_.erase(it);
+  return 0;
+}
+
+absl::Status HostCalls::PatchFunctions(const loader::Image& image) {
+  for (const auto& [name, func] : kPatchable) {
+    const auto it = image.functions.find(name);
+    if (it == image.functions.end()) {
+      continue;
+    }
+    const std::array<uint32_t, 5> stub = MakeStub(func);
+    if (it->second.size < sizeof(stub)) {
+      VLOG(1) << "Not patching " << name << ": too small for the stub";
+      continue;
+    }
+    ASSIGN_OR_RETURN(uint8_t* entry, dram_.GetHostPtr(it->second.addr, sizeof(stub)));
+    std::memcpy(entry, stub.data(), sizeof(stub));
+    dram_.NotifyWrite(it->second.addr, sizeof(stub));
+    VLOG(1) << "Patched " << name << " at 0x" << std::hex << it->second.addr;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace riscv_emu::hostcall
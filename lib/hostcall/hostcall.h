@@ -0,0 +1,99 @@
+#ifndef LIB_HOSTCALL_HOSTCALL_H
+#define LIB_HOSTCALL_HOSTCALL_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "lib/loader/elf.h"
+#include "lib/memory/dram.h"
+#include "lib/replay/input_log.h"
+
+namespace riscv_emu::hostcall {
+
+namespace constants {
+  // An ecall is a host call when a7 holds `kMagic`; a6 then selects the
+  // function, a0-a5 carry the arguments and a0 receives the result.
+  constexpr uint32_t kMagic = 0x484f5354;  // "HOST"
+  constexpr uint32_t kMagicReg = 17;  // a7
+  constexpr uint32_t kFuncReg = 16;  // a6
+  constexpr uint32_t kArgReg = 10;  // a0
+  constexpr size_t kNumArgs = 6;
+}  // namespace constants
+
+enum class Func : uint32_t {
+  kMemcpy = 0,  // (dst, src, n) -> dst
+  kMemset = 1,  // (dst, c, n) -> dst
+  kMemcmp = 2,  // (a, b, n) -> <0, 0, >0
+  kStrlen = 3,  // (s) -> length
+  kOpen = 4,  // (path, flags, mode) -> fd
+  kRead = 5,  // (fd, buf, n) -> bytes read
+  kWrite = 6,  // (fd, buf, n) -> bytes written
+  kClose = 7,  // (fd) -> 0
+  kExit = 8,  // (code) -> does not return
+};
+
+using Args = std::array<uint32_t, constants::kNumArgs>;
+
+// Runs guest libc routines natively on guest RAM. The memory routines use
+// the host's vectorised libc; I/O goes straight to host file descriptors.
+// Guest buffers are checked and translated through the buffer map the CPU
+// installs, so a host call can touch no memory the calling code could not.
+// Guest fds 0-2 are the emulator's own stdio. Failures, bad guest
+// pointers and unknown functions included, return -errno to the guest, as
+// a Linux syscall would.
+class HostCalls final {
+ public:
+  explicit HostCalls(memory::Dram& dram);
+  ~HostCalls();
+  HostCalls(const HostCalls&) = delete;
+  HostCalls& operator=(const HostCalls&) = delete;
+
+  // The physical address of the guest buffer [addr, addr + len), or
+  // nullopt if the caller may not access all of it as a read (or a write).
+  using BufferMap =
+      std::function<std::optional<uint32_t>(uint32_t addr, uint32_t len, bool is_write)>;
+  // Without a map, guest addresses are physical and unchecked.
+  inline void SetBufferMap(BufferMap map) { map_ = std::move(map); }
+
+  absl::StatusOr<uint32_t> Call(uint32_t func, const Args& args);
+  // Set once the guest has called `Func::kExit`.
+  inline std::optional<int> GetExitCode() const { return exit_code_; }
+  inline void ResetExitCode() { exit_code_.reset(); }
+  // True while the guest holds host files other than stdio.
+  bool HasOpenFiles() const;
+  // Closes the files the guest opened and reopens stdio, e.g. when the
+  // machine is rolled back to before it opened them.
+  void CloseFiles();
+  // Overwrites the entry of known libc routines in a loaded image with a
+  // host-call stub, so unmodified guests take the native path.
+  absl::Status PatchFunctions(const loader::Image& image);
+  // Records what reads return, or replays it instead of reading.
+  inline void SetInputLog(replay::InputLog* input_log) { input_log_ = input_log; }
+
+ private:
+  std::optional<uint32_t> Map(uint32_t addr, uint32_t len, bool is_write) const;
+  absl::StatusOr<std::string> ReadString(uint32_t addr);
+  absl::StatusOr<uint32_t> Open(const Args& args);
+  absl::StatusOr<uint32_t> Transfer(Func func, const Args& args);
+  // Reads into `buf` from `host_fd`, or from the input log when replaying.
+  // Returns the byte count or -errno.
+  absl::StatusOr<int64_t> Read(uint32_t guest_fd, int host_fd, uint8_t* buf, uint32_t len);
+  absl::StatusOr<uint32_t> Close(uint32_t fd);
+
+  memory::Dram& dram_;
+  BufferMap map_;
+  // Guest fd -> host fd.
+  absl::flat_hash_map<uint32_t, int> fds_;
+  uint32_t next_fd_ = 3;
+  std::optional<int> exit_code_;
+  replay::InputLog* input_log_ = nullptr;
+};
+
+}  // namespace riscv_emu::hostcall
+
+#endif  // LIB_HOSTCALL_HOSTCALL_H
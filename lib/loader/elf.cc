@@ -0,0 +1,101 @@
+#include "elf.h"
+#include <elf.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "status_macros.h"
+
+namespace riscv_emu::loader {
+
+namespace {
+
+// Bounds-checked view of a struct at `offset` in the file contents.
+template <typename T>
+absl::StatusOr<T> ReadAt(const std::string& file, const uint64_t offset) {
+  if (offset > file.size() || sizeof(T) > file.size() - offset) {
+    return absl::InvalidArgumentError("Truncated ELF file");
+  }
+  T out;
+  std::memcpy(&out, file.data() + offset, sizeof(T));
+  return out;
+}
+
+absl::Status LoadSegment(const std::string& file, const Elf32_Phdr& phdr, memory::Dram& dram) {
+  if (phdr.p_filesz > phdr.p_memsz || phdr.p_offset > file.size() ||
+      phdr.p_filesz > file.size() - phdr.p_offset) {
+    return absl::InvalidArgumentError("Malformed ELF program header");
+  }
+  ASSIGN_OR_RETURN(uint8_t* dst, dram.GetHostPtr(phdr.p_paddr, phdr.p_memsz));
+  std::memcpy(dst, file.data() + phdr.p_offset, phdr.p_filesz);
+  dram.NotifyWrite(phdr.p_paddr, phdr.p_filesz);
+  RETURN_IF_ERROR(dram.Fill(phdr.p_paddr + phdr.p_filesz, phdr.p_memsz - phdr.p_filesz, 0));
+  VLOG(1) << "Loaded segment at 0x" << std::hex << phdr.p_paddr << " (0x" << phdr.p_memsz
+          << " bytes)";
+  return absl::OkStatus();
+}
+
+absl::Status ReadSymbols(const std::string& file, const Elf32_Ehdr& ehdr, Image& image) {
+  for (uint32_t i = 0; i < ehdr.e_shnum; ++i) {
+    ASSIGN_OR_RETURN(const Elf32_Shdr symtab,
+                     ReadAt<Elf32_Shdr>(file, ehdr.e_shoff + i * ehdr.e_shentsize));
+    if (symtab.sh_type != SHT_SYMTAB) {
+      continue;
+    }
+    ASSIGN_OR_RETURN(const Elf32_Shdr strtab,
+                     ReadAt<Elf32_Shdr>(file, ehdr.e_shoff + symtab.sh_link * ehdr.e_shentsize));
+    if (strtab.sh_offset > file.size() || strtab.sh_size > file.size() - strtab.sh_offset) {
+      return absl::InvalidArgumentError("Malformed ELF string table");
+    }
+    for (uint32_t off = 0; off + sizeof(Elf32_Sym) <= symtab.sh_size; off += sizeof(Elf32_Sym)) {
+      ASSIGN_OR_RETURN(const Elf32_Sym sym, ReadAt<Elf32_Sym>(file, symtab.sh_offset + off));
+      const uint32_t type = ELF32_ST_TYPE(sym.st_info);
+      if ((type != STT_FUNC && type != STT_OBJECT) || sym.st_shndx == SHN_UNDEF ||
+          sym.st_name >= strtab.sh_size) {
+        continue;
+      }
+      const char* name = file.data() + strtab.sh_offset + sym.st_name;
+      const size_t len = strnlen(name, strtab.sh_size - sym.st_name);
+      auto& symbols = type == STT_FUNC ? image.functions : image.objects;
+      symbols[std::string(name, len)] = {sym.st_value, sym.st_size};
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<Image> LoadElf(const absl::string_view path, memory::Dram& dram) {
+  std::ifstream input_file(std::string(path), std::ios::in | std::ios::binary);
+  if (!input_file.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to open ", path));
+  }
+  const std::string file((std::istreambuf_iterator<char>(input_file)),
+                         std::istreambuf_iterator<char>());
+
+  ASSIGN_OR_RETURN(const Elf32_Ehdr ehdr, ReadAt<Elf32_Ehdr>(file, 0));
+  if (std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0) {
+    return absl::InvalidArgumentError(absl::StrCat(path, " is not an ELF file"));
+  }
+  if (ehdr.e_ident[EI_CLASS] != ELFCLASS32 || ehdr.e_ident[EI_DATA] != ELFDATA2LSB ||
+      ehdr.e_machine != EM_RISCV || ehdr.e_type != ET_EXEC) {
+    return absl::InvalidArgumentError(absl::StrCat(path, " is not an RV32 executable"));
+  }
+
+  Image image;
+  image.entry = ehdr.e_entry;
+  for (uint32_t i = 0; i < ehdr.e_phnum; ++i) {
+    ASSIGN_OR_RETURN(const Elf32_Phdr phdr,
+                     ReadAt<Elf32_Phdr>(file, ehdr.e_phoff + i * ehdr.e_phentsize));
+    if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0) {
+      continue;
+    }
+    RETURN_IF_ERROR(LoadSegment(file, phdr, dram));
+    image.end = std::max(image.end, phdr.p_paddr + phdr.p_memsz);
+  }
+  RETURN_IF_ERROR(ReadSymbols(file, ehdr, image));
+  return image;
+}
+
+}  // namespace riscv_emu::loader
@@ -0,0 +1,36 @@
+#ifndef LIB_LOADER_ELF_H
+#define LIB_LOADER_ELF_H
+
+#include <cstdint>
+#include <string>
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "lib/memory/dram.h"
+
+namespace riscv_emu::loader {
+
+struct Symbol {
+  uint32_t addr = 0;
+  uint32_t size = 0;
+};
+
+struct Image {
+  uint32_t entry = 0;
+  // End of the highest loaded segment, i.e. the initial program break.
+  uint32_t end = 0;
+  // Function symbols from .symtab, keyed by name. Empty for stripped
+  // binaries.
+  absl::flat_hash_map<std::string, Symbol> functions;
+  // Data object symbols, likewise.
+  absl::flat_hash_map<std::string, Symbol> objects;
+};
+
+// Loads the PT_LOAD segments of a statically linked little-endian RV32
+// executable into `dram` (zero-filling .bss) and returns its entry point
+// and symbols.
+absl::StatusOr<Image> LoadElf(absl::string_view path, memory::Dram& dram);
+
+}  // namespace riscv_emu::loader
+
+#endif  // LIB_LOADER_ELF_H
@@ -17,6 +17,7 @@ absl::StatusOr<bool> HasFunc3(const Opcode opcode) {
    case Opcode::kSType:
    case Opcode::kBType:
    case Opcode::kEType:
+   case Opcode::kFenceType:
     return true;
    case Opcode::kLuiType:
    case Opcode::kAuiPcType:
@@ -40,6 +41,7 @@ absl::StatusOr<bool> HasFunc7(const Opcode opcode) {
    case Opcode::kLuiType:
    case Opcode::kEType:
    case Opcode::kJalType:
+   case Opcode::kFenceType:
     return false;
    default:
     return absl::InternalError("Invalid opcode found");
@@ -54,10 +56,11 @@ absl::StatusOr<bool> HasRs1(const Opcode opcode) {
    case Opcode::kLType:
    case Opcode::kSType:
    case Opcode::kBType:
+   case Opcode::kEType:
+   case Opcode::kFenceType:
     return true;
    case Opcode::kLuiType:
    case Opcode::kAuiPcType:
-   case Opcode::kEType:
    case Opcode::kJalType:
     return false;
    default:
@@ -78,6 +81,7 @@ absl::StatusOr<bool> HasRs2(const Opcode opcode) {
    case Opcode::kAuiPcType:
    case Opcode::kLuiType:
    case Opcode::kJalType:
+   case Opcode::kFenceType:
     return false;
    default:
     return absl::InternalError("Invalid opcode found");
@@ -97,6 +101,7 @@ absl::StatusOr<bool> HasCsr(const Opcode opcode) {
    case Opcode::kAuiPcType:
    case Opcode::kLuiType:
    case Opcode::kJalType:
+   case Opcode::kFenceType:
     return false;
    default:
     return absl::InternalError("Invalid opcode found");
@@ -112,10 +117,11 @@ absl::StatusOr<bool> HasRd(const Opcode opcode) {
    case Opcode::kAuiPcType:
    case Opcode::kJalType:
    case Opcode::kJalrType:
+   case Opcode::kEType:
+   case Opcode::kFenceType:
     return true;
    case Opcode::kSType:
    case Opcode::kBType:
-   case Opcode::kEType:
     return false;
    default:
     return absl::InternalError("Invalid opcode found");
@@ -147,6 +153,8 @@ absl::StatusOr<Opcode> GetOpcode(const uint32_t val) {
     return Opcode::kLType;
    case static_cast<uint32_t>(Opcode::kEType):
     return Opcode::kEType;
+   case static_cast<uint32_t>(Opcode::kFenceType):
+    return Opcode::kFenceType;
    default:
     return absl::NotFoundError("No valid opcode found in instruction");
   }
@@ -1,6 +1,12 @@
 #include "dram.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "absl/strings/str_cat.h"
 #include "glog/logging.h"
 #include "status_macros.h"
 
@@ -8,6 +14,9 @@ namespace riscv_emu::memory {
 
 namespace {
 
+constexpr uint64_t kPageSize = uint64_t{1} << constants::kPageShift;
+static_assert(constants::kDramSize % kPageSize == 0, "DRAM must be whole pages");
+
 absl::StatusOr<bool> IsUnalignedAccess(const AccessType access_type, size_t at_index) {
   switch (access_type) {
     case AccessType::kByte:
@@ -74,6 +83,51 @@ void WriteWord(uint8_t* loc, const size_t at_index, const uint32_t val) {
 
 }  // namespace
 
+bool IsAligned(const uint64_t addr, const AccessType type) {
+  switch (type) {
+   case AccessType::kHalfword:
+   case AccessType::kHalfwordUnsigned:
+    return addr % sizeof(uint16_t) == 0;
+   case AccessType::kWord:
+    return addr % sizeof(uint32_t) == 0;
+   default:
+    return true;
+  }
+}
+
+uint32_t LoadFromHost(const uint8_t* loc, const AccessType type) {
+  switch (type) {
+   case AccessType::kByte:
+    return ReadByte(loc, 0, /*signed=*/true);
+   case AccessType::kByteUnsigned:
+    return ReadByte(loc, 0, /*signed=*/false);
+   case AccessType::kHalfword:
+    return ReadHalfWord(loc, 0, /*signed=*/true);
+   case AccessType::kHalfwordUnsigned:
+    return ReadHalfWord(loc, 0, /*signed=*/false);
+   case AccessType::kWord:
+   default:
+    return ReadWord(loc, 0);
+  }
+}
+
+void StoreToHost(uint8_t* loc, const AccessType type, const uint32_t val) {
+  switch (type) {
+   case AccessType::kByte:
+   case AccessType::kByteUnsigned:
+    WriteByte(loc, 0, val);
+    break;
+   case AccessType::kHalfword:
+   case AccessType::kHalfwordUnsigned:
+    WriteHalfword(loc, 0, val);
+    break;
+   case AccessType::kWord:
+   default:
+    WriteWord(loc, 0, val);
+    break;
+  }
+}
+
 absl::StatusOr<uint32_t> Dram::Read(const size_t at_index) {
   if (at_index >= constants::kDramSize) {
     return absl::OutOfRangeError("Memory address out of range");
@@ -82,17 +136,20 @@ absl::StatusOr<uint32_t> Dram::Read(const size_t at_index) {
   if (isUnaligned) {
     return absl::FailedPreconditionError("unaligned memory access detected");
   }
+  if (heatmap_ != nullptr) {
+    heatmap_->Record(at_index, Access::kRead);
+  }
   switch (access_type_) {
    case AccessType::kByte:
-    return ReadByte(data_.get(), at_index, /*signed=*/true);
+    return ReadByte(data_, at_index, /*signed=*/true);
    case AccessType::kByteUnsigned:
-    return ReadByte(data_.get(), at_index, /*signed=*/false);
+    return ReadByte(data_, at_index, /*signed=*/false);
    case AccessType::kHalfword:
-    return ReadHalfWord(data_.get(), at_index, /*signed=*/true);
+    return ReadHalfWord(data_, at_index, /*signed=*/true);
    case AccessType::kHalfwordUnsigned:
-    return ReadHalfWord(data_.get(), at_index, /*signed=*/false);
+    return ReadHalfWord(data_, at_index, /*signed=*/false);
    case AccessType::kWord:
-    return ReadWord(data_.get(), at_index);
+    return ReadWord(data_, at_index);
    default:
     return absl::InternalError("Invalid DRAM access type");
   }
@@ -109,18 +166,23 @@ absl::Status Dram::Write(const size_t at_index, const uint32_t val) {
   switch (access_type_) {
    case AccessType::kByte:
    case AccessType::kByteUnsigned:
-    WriteByte(data_.get(), at_index, val);
-    return absl::OkStatus();
+    WriteByte(data_, at_index, val);
+    break;
    case AccessType::kHalfword:
    case AccessType::kHalfwordUnsigned:
-    WriteHalfword(data_.get(), at_index, val);
-    return absl::OkStatus();
+    WriteHalfword(data_, at_index, val);
+    break;
    case AccessType::kWord:
-    WriteWord(data_.get(), at_index, val);
-    return absl::OkStatus();
+    WriteWord(data_, at_index, val);
+    break;
    default:
     return absl::InternalError("Invalid DRAM access type");
   }
+  MarkDirty(at_index);
+  if (IsCodePage(at_index)) {
+    NotifyWrite(at_index, sizeof(uint32_t));
+  }
+  return absl::OkStatus();
 }
 
 absl::Status Dram::Flash(const absl::string_view filename) {
@@ -139,10 +201,175 @@ absl::Status Dram::Flash(const absl::string_view filename) {
     written++;
   }
   input_file.close();
+  MarkDirty(0, written);
+
+  return absl::OkStatus();
+}
+
+absl::StatusOr<uint8_t*> Dram::GetHostPtr(const uint64_t at_index, const uint64_t len) {
+  if (at_index > constants::kDramSize || len > constants::kDramSize - at_index) {
+    return absl::OutOfRangeError("Memory range out of range");
+  }
+  return data_ + at_index;
+}
+
+absl::Status Dram::Copy(const uint64_t dst, const uint64_t src, const uint64_t len) {
+  ASSIGN_OR_RETURN(uint8_t* to, GetHostPtr(dst, len));
+  ASSIGN_OR_RETURN(const uint8_t* from, GetHostPtr(src, len));
+  std::memmove(to, from, len);
+  if (heatmap_ != nullptr) {
+    heatmap_->RecordRange(src, len, Access::kRead);
+  }
+  NotifyWrite(dst, len);
+  return absl::OkStatus();
+}
 
+absl::Status Dram::Fill(const uint64_t dst, const uint64_t len, const uint32_t pattern) {
+  ASSIGN_OR_RETURN(uint8_t* to, GetHostPtr(dst, len));
+  const uint8_t byte = pattern & 0xff;
+  if (pattern == byte * 0x01010101U) {
+    std::memset(to, byte, len);
+  } else {
+    // Seed one word, then keep doubling the filled prefix.
+    uint8_t seed[sizeof(pattern)];
+    std::memcpy(seed, &pattern, sizeof(pattern));
+    uint64_t filled = std::min<uint64_t>(len, sizeof(pattern));
+    std::memcpy(to, seed, filled);
+    while (filled < len) {
+      const uint64_t chunk = std::min(filled, len - filled);
+      std::memcpy(to + filled, to, chunk);
+      filled += chunk;
+    }
+  }
+  NotifyWrite(dst, len);
   return absl::OkStatus();
 }
 
-Dram::Dram() : data_(std::move(std::make_unique<uint8_t[]>(constants::kDramSize))) {}
+void Dram::MarkCodePage(const uint64_t at_index) {
+  code_pages_[at_index >> constants::kPageShift] = 1;
+}
+
+void Dram::UnmarkCodePage(const uint64_t at_index) {
+  code_pages_[at_index >> constants::kPageShift] = 0;
+}
+
+void Dram::NotifyWrite(const uint64_t at_index, const uint64_t len) {
+  MarkDirty(at_index, len);
+  if (heatmap_ != nullptr) {
+    heatmap_->RecordRange(at_index, len, Access::kWrite);
+  }
+  if (len == 0 || !code_write_listener_) {
+    return;
+  }
+  const uint64_t first = at_index >> constants::kPageShift;
+  const uint64_t last = (at_index + len - 1) >> constants::kPageShift;
+  for (uint64_t page = first; page <= last && page < code_pages_.size(); ++page) {
+    if (code_pages_[page]) {
+      code_write_listener_(at_index, len);
+      return;
+    }
+  }
+}
+
+void Dram::NotifyHostWrite(const void* host, const uint64_t len) {
+  NotifyWrite(static_cast<const uint8_t*>(host) - data_, len);
+}
+
+void Dram::InvalidateCode() {
+  if (code_write_listener_) {
+    code_write_listener_(0, constants::kDramSize);
+  }
+  std::fill(code_pages_.begin(), code_pages_.end(), 0);
+}
+
+void Dram::MarkDirty(const uint64_t at_index, const uint64_t len) {
+  if (len == 0) {
+    return;
+  }
+  if (watch_hit_ && at_index < watch_end_ && at_index + len > watch_begin_) {
+    watch_hit_();
+  }
+  const uint64_t last = std::min<uint64_t>(at_index + len - 1, constants::kDramSize - 1);
+  for (uint64_t page = at_index >> constants::kPageShift; page <= last >> constants::kPageShift;
+       ++page) {
+    MarkDirty(page << constants::kPageShift);
+  }
+}
+
+void Dram::SetWriteWatch(const uint64_t begin, const uint64_t end, WriteWatch hit) {
+  watch_begin_ = begin;
+  watch_end_ = end;
+  watch_hit_ = std::move(hit);
+}
+
+void Dram::ClearWriteWatch() {
+  watch_hit_ = nullptr;
+}
+
+std::vector<uint8_t> Dram::TakeSnapshot() {
+  ClearDirty();
+  return std::vector<uint8_t>(data_, data_ + constants::kDramSize);
+}
+
+void Dram::RestoreSnapshot(const std::vector<uint8_t>& snapshot) {
+  for (const uint32_t page : dirty_list_) {
+    const uint64_t at_index = uint64_t{page} << constants::kPageShift;
+    const uint64_t len = std::min<uint64_t>(kPageSize, constants::kDramSize - at_index);
+    std::memcpy(data_ + at_index, snapshot.data() + at_index, len);
+    if (code_pages_[page] && code_write_listener_) {
+      code_write_listener_(at_index, len);
+    }
+  }
+  ClearDirty();
+}
+
+void Dram::ClearDirty() {
+  for (const uint32_t page : dirty_list_) {
+    dirty_pages_[page] = 0;
+  }
+  dirty_list_.clear();
+}
+
+absl::Status Dram::CheckPageRange(const uint64_t at_index, const uint64_t len) const {
+  if (at_index % kPageSize != 0 || len % kPageSize != 0 || at_index > constants::kDramSize ||
+      len > constants::kDramSize - at_index) {
+    return absl::OutOfRangeError("Not a range of whole DRAM pages");
+  }
+  if (sysconf(_SC_PAGESIZE) != kPageSize) {
+    return absl::FailedPreconditionError("Mapping DRAM needs a host page size of 4 KiB");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Dram::MapFile(const uint64_t at_index, const uint64_t len, const int fd,
+                           const uint64_t offset) {
+  RETURN_IF_ERROR(CheckPageRange(at_index, len));
+  if (mmap(data_ + at_index, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+           offset) == MAP_FAILED) {
+    return absl::InternalError(absl::StrCat("Failed to map DRAM: ", strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Dram::ZeroPages(const uint64_t at_index, const uint64_t len) {
+  RETURN_IF_ERROR(CheckPageRange(at_index, len));
+  if (mmap(data_ + at_index, len, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+    return absl::InternalError(absl::StrCat("Failed to map DRAM: ", strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+Dram::Dram()
+    : data_(static_cast<uint8_t*>(mmap(nullptr, constants::kDramSize, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0))),
+      code_pages_((constants::kDramSize >> constants::kPageShift) + 1),
+      dirty_pages_((constants::kDramSize >> constants::kPageShift) + 1) {
+  CHECK(data_ != MAP_FAILED) << "Failed to allocate DRAM";
+}
+
+Dram::~Dram() {
+  munmap(data_, constants::kDramSize);
+}
 
 }  // namespace riscv_emu::memory
@@ -2,10 +2,13 @@
 #define LIB_MEMORY_DRAM_H
 
 #include <cstdint>
+#include <functional>
+#include <vector>
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "lib/logic/wire.h"
+#include "lib/memory/heatmap.h"
 
 namespace riscv_emu::memory {
   
@@ -14,6 +17,8 @@ namespace riscv_emu::memory {
     // from accessing non-existing memory (out of range).
     constexpr uint32_t kDramSize = 1024 * 1000;  // 1000 KiB
     constexpr uint32_t kDramFetchMask = 0b11111;
+    // Granularity of code-page tracking.
+    constexpr uint32_t kPageShift = 12;
 
   }  // namespace constants
 
@@ -25,17 +30,100 @@ enum class AccessType {
   kHalfwordUnsigned = 0b101,
 };
 
+// Natural alignment check and accessors for a host pointer into DRAM (e.g.
+// from a TLB hit); they behave like `Dram::Read`/`Write` on aligned data.
+bool IsAligned(uint64_t addr, AccessType type);
+uint32_t LoadFromHost(const uint8_t* loc, AccessType type);
+void StoreToHost(uint8_t* loc, AccessType type, uint32_t val);
+
 class Dram final {
  public:
   // TODO: Consider including `AccessType` as an parameter?
   Dram();
+  ~Dram();
+  Dram(const Dram&) = delete;
+  Dram& operator=(const Dram&) = delete;
   absl::StatusOr<uint32_t> Read(size_t at_index);
   absl::Status Write(size_t at_index, uint32_t val);
   absl::Status Flash(absl::string_view filename);
   inline void SetAccessType(const AccessType type) { access_type_ = type; }
+  // Host view of [at_index, at_index + len), for devices that move data
+  // in and out of guest memory directly.
+  absl::StatusOr<uint8_t*> GetHostPtr(uint64_t at_index, uint64_t len);
+  // Bulk transfers at host memory bandwidth. Overlapping copies behave
+  // like memmove; `Fill` repeats the little-endian `pattern` from `dst`.
+  absl::Status Copy(uint64_t dst, uint64_t src, uint64_t len);
+  absl::Status Fill(uint64_t dst, uint64_t len, uint32_t pattern);
+
+  // Code-page tracking. An execution engine marks the pages it has cached
+  // code from; any write into such a page is reported to the listener,
+  // which invalidates the affected code and may unmark the page. Writes to
+  // unmarked pages cost only a bitmap test.
+  using CodeWriteListener = std::function<void(uint64_t at_index, uint64_t len)>;
+  inline void SetCodeWriteListener(CodeWriteListener listener) {
+    code_write_listener_ = std::move(listener);
+  }
+  void MarkCodePage(uint64_t at_index);
+  void UnmarkCodePage(uint64_t at_index);
+  inline bool IsCodePage(const uint64_t at_index) const {
+    return code_pages_[at_index >> constants::kPageShift];
+  }
+  // Must be called after writing through `GetHostPtr`. `Write`, `Copy`
+  // and `Fill` report their own writes.
+  void NotifyWrite(uint64_t at_index, uint64_t len);
+  void NotifyHostWrite(const void* host, uint64_t len);
+  // Drops every cached translation (fence.i).
+  void InvalidateCode();
+
+  // Counts the accesses made through `Read`, `Write` and `Copy`, and the
+  // writes reported through `NotifyWrite`, into `heatmap` unless null.
+  // Callers writing through host pointers record their own accesses.
+  inline void SetHeatmap(Heatmap* heatmap) { heatmap_ = heatmap; }
+
+  // Snapshots and checkpoints. Every write is also recorded in a
+  // dirty-page list, so going back to a snapshot only copies the pages
+  // written since it was taken (or last restored) rather than all of RAM,
+  // and an incremental checkpoint only stores those pages.
+  inline void MarkDirty(const uint64_t at_index) {
+    const uint64_t page = at_index >> constants::kPageShift;
+    if (!dirty_pages_[page]) {
+      dirty_pages_[page] = 1;
+      dirty_list_.push_back(page);
+    }
+  }
+  void MarkDirty(uint64_t at_index, uint64_t len);
+  // Runs `hit` for every write into [begin, end) recorded through the
+  // ranged `MarkDirty`, which covers `NotifyWrite`, `Copy` and `Fill`:
+  // device, host-call and page-table writes. The hart's own stores only
+  // mark a single address and are watched by the hart.
+  using WriteWatch = std::function<void()>;
+  void SetWriteWatch(uint64_t begin, uint64_t end, WriteWatch hit);
+  void ClearWriteWatch();
+  std::vector<uint8_t> TakeSnapshot();
+  // Cached code on the restored pages is invalidated.
+  void RestoreSnapshot(const std::vector<uint8_t>& snapshot);
+  inline const std::vector<uint32_t>& GetDirtyPages() const { return dirty_list_; }
+  void ClearDirty();
+  // Checkpoint restore: replaces whole pages with a private copy-on-write
+  // mapping of `fd` from `offset`, or with fresh zero pages. Cached code
+  // is not invalidated.
+  absl::Status MapFile(uint64_t at_index, uint64_t len, int fd, uint64_t offset);
+  absl::Status ZeroPages(uint64_t at_index, uint64_t len);
 
  private:
-  std::unique_ptr<uint8_t[]> data_;
+  absl::Status CheckPageRange(uint64_t at_index, uint64_t len) const;
+
+  // Page-aligned anonymous mapping, so checkpoint pages can be mapped over
+  // it in place.
+  uint8_t* data_;
+  std::vector<uint8_t> code_pages_;
+  std::vector<uint8_t> dirty_pages_;
+  std::vector<uint32_t> dirty_list_;
+  CodeWriteListener code_write_listener_;
+  uint64_t watch_begin_ = 0;
+  uint64_t watch_end_ = 0;
+  WriteWatch watch_hit_;
+  Heatmap* heatmap_ = nullptr;
   AccessType access_type_ = memory::AccessType::kWord;
 };
 
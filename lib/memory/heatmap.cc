@@ -0,0 +1,167 @@
+#include "heatmap.h"
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <utility>
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "lib/memory/dram.h"
+
+namespace riscv_emu::memory {
+
+namespace {
+
+  constexpr uint32_t kPageBytes = 1U << constants::kPageShift;
+  constexpr uint32_t kNumPages = (constants::kDramSize + kPageBytes - 1) / kPageBytes;
+  // The smallest access.
+  constexpr uint32_t kMinLineBytes = 4;
+
+  uint64_t Sum(const AccessCounts& counts) {
+    return std::accumulate(counts.begin(), counts.end(), uint64_t{0});
+  }
+
+}  // namespace
+
+absl::Status Validate(const HeatmapConfig& config) {
+  if (config.interval == 0) {
+    return absl::InvalidArgumentError("The heatmap interval must be at least a tick");
+  }
+  const uint32_t line = config.line_bytes;
+  if (line != 0 && (line < kMinLineBytes || line > kPageBytes || (line & (line - 1)) != 0)) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Heatmap lines must be a power of two from ", kMinLineBytes, " to ", kPageBytes,
+        " bytes, not ", line));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::unique_ptr<Heatmap>> Heatmap::Create(const HeatmapConfig& config,
+                                                        const absl::string_view path) {
+  std::ofstream out(std::string(path), std::ios::out | std::ios::trunc);
+  if (!out.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to create ", path));
+  }
+  out << "tick,addr,reads,writes,executes\n";
+  return std::unique_ptr<Heatmap>(new Heatmap(config, std::move(out)));
+}
+
+Heatmap::Heatmap(const HeatmapConfig& config, std::ofstream out)
+    : config_(config),
+      out_(std::move(out)),
+      unit_shift_(config.line_bytes == 0 ? constants::kPageShift
+                                         : std::countr_zero(config.line_bytes)),
+      pages_(kNumPages),
+      window_(((constants::kDramSize - 1) >> unit_shift_) + 1),
+      page_touched_(kNumPages) {}
+
+void Heatmap::RecordRange(const uint64_t paddr, const uint64_t len, const Access access) {
+  if (len == 0 || paddr >= constants::kDramSize) {
+    return;
+  }
+  const uint64_t last = std::min<uint64_t>(paddr + len, constants::kDramSize) - 1;
+  for (uint64_t unit = paddr >> unit_shift_; unit <= last >> unit_shift_; ++unit) {
+    Record(static_cast<uint32_t>(unit << unit_shift_), access);
+  }
+}
+
+void Heatmap::Flush() {
+  const bool by_line = unit_shift_ != constants::kPageShift;
+  for (size_t i = 0; i < batched_; ++i) {
+    const uint32_t paddr = batch_[i] >> 2;
+    const size_t access = batch_[i] & 0b11;
+    const uint32_t page = paddr >> constants::kPageShift;
+    ++pages_[page][access];
+    AccessCounts& counts = window_[paddr >> unit_shift_];
+    if (Sum(counts) == 0) {
+      touched_.push_back(paddr >> unit_shift_);
+    }
+    ++counts[access];
+    if (by_line && !page_touched_[page]) {
+      page_touched_[page] = 1;
+      ++window_pages_;
+    }
+  }
+  batched_ = 0;
+}
+
+absl::Status Heatmap::EndWindow(const uint64_t tick) {
+  Flush();
+  const bool by_line = unit_shift_ != constants::kPageShift;
+  const uint32_t units = static_cast<uint32_t>(touched_.size());
+  working_set_.push_back(
+      {.tick = tick, .pages = by_line ? window_pages_ : units, .lines = by_line ? units : 0});
+  std::sort(touched_.begin(), touched_.end());
+  for (const uint32_t unit : touched_) {
+    AccessCounts& counts = window_[unit];
+    out_ << absl::StrFormat("%d,0x%x,%d,%d,%d\n", tick, unit << unit_shift_, counts[0],
+                            counts[1], counts[2]);
+    counts = {};
+  }
+  touched_.clear();
+  std::fill(page_touched_.begin(), page_touched_.end(), 0);
+  window_pages_ = 0;
+  out_.flush();
+  if (out_.fail()) {
+    return absl::DataLossError("Failed to write the heatmap");
+  }
+  return absl::OkStatus();
+}
+
+std::string Heatmap::FormatReport(const size_t top) {
+  Flush();
+  AccessCounts total = {};
+  uint32_t touched = 0;
+  std::vector<uint32_t> order;
+  for (uint32_t page = 0; page < pages_.size(); ++page) {
+    for (size_t i = 0; i < total.size(); ++i) {
+      total[i] += pages_[page][i];
+    }
+    if (Sum(pages_[page]) > 0) {
+      ++touched;
+      order.push_back(page);
+    }
+  }
+  uint32_t peak = 0;
+  uint64_t pages = 0;
+  for (const WorkingSetSample& sample : working_set_) {
+    peak = std::max(peak, sample.pages);
+    pages += sample.pages;
+  }
+  std::string report = absl::StrFormat(
+      "memory heatmap (%d tick windows%s): reads %d, writes %d, executes %d, pages touched %d "
+      "of %d (%d KiB)\nworking set: %d windows, peak %d pages, mean %.1f pages, last %d pages\n",
+      config_.interval,
+      config_.line_bytes == 0 ? "" : absl::StrFormat(", %d byte lines", config_.line_bytes),
+      total[0], total[1], total[2], touched, pages_.size(), touched * kPageBytes >> 10,
+      working_set_.size(), peak,
+      working_set_.empty() ? 0.0 : static_cast<double>(pages) / working_set_.size(),
+      working_set_.empty() ? 0 : working_set_.back().pages);
+  std::sort(order.begin(), order.end(), [this](const uint32_t a, const uint32_t b) {
+    return Sum(pages_[a]) != Sum(pages_[b]) ? Sum(pages_[a]) > Sum(pages_[b]) : a < b;
+  });
+  absl::StrAppend(&report, "pages by accesses:\n");
+  for (size_t i = 0; i < std::min(top, order.size()); ++i) {
+    const AccessCounts& counts = pages_[order[i]];
+    absl::StrAppendFormat(&report, "  0x%08x: reads %d, writes %d, executes %d\n",
+                          order[i] << constants::kPageShift, counts[0], counts[1], counts[2]);
+  }
+  return report;
+}
+
+absl::Status Heatmap::WriteWorkingSet(const absl::string_view path) const {
+  std::ofstream out(std::string(path), std::ios::out | std::ios::trunc);
+  if (!out.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to create ", path));
+  }
+  out << "tick,pages,lines\n";
+  for (const WorkingSetSample& sample : working_set_) {
+    out << absl::StrFormat("%d,%d,%d\n", sample.tick, sample.pages, sample.lines);
+  }
+  out.close();
+  if (out.fail()) {
+    return absl::DataLossError(absl::StrCat("Failed to write ", path));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace riscv_emu::memory
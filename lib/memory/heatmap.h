@@ -0,0 +1,101 @@
+#ifndef LIB_MEMORY_HEATMAP_H
+#define LIB_MEMORY_HEATMAP_H
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace riscv_emu::memory {
+
+  namespace constants {
+    // Accesses buffered before they are counted.
+    constexpr size_t kHeatmapBatchSize = 4096;
+  }  // namespace constants
+
+struct HeatmapConfig {
+  // Ticks per window. Each window adds a working-set sample and a row of
+  // the heatmap.
+  uint64_t interval = 1'000'000;
+  // Counts per cache line of this many bytes as well as per page; a power
+  // of two no larger than a page. 0 counts per page only.
+  uint32_t line_bytes = 0;
+};
+
+absl::Status Validate(const HeatmapConfig& config);
+
+enum class Access : uint8_t { kRead, kWrite, kExecute, kNumAccesses };
+
+// Indexed by `Access`.
+using AccessCounts = std::array<uint64_t, static_cast<size_t>(Access::kNumAccesses)>;
+
+struct WorkingSetSample {
+  // End of the window.
+  uint64_t tick = 0;
+  // Pages and lines accessed in the window; lines only with line counting.
+  uint32_t pages = 0;
+  uint32_t lines = 0;
+};
+
+// Read, write and execute counters over RAM, per page and optionally per
+// cache line, kept for the whole run and per window. Each window ends with
+// a working-set sample and with the counts of every page (or line) it
+// accessed streamed to the heatmap file, as CSV rows of
+// "tick,addr,reads,writes,executes".
+//
+// Accesses are buffered and counted in batches, so recording one costs a
+// store into the buffer. All of RAM's accesses are recorded on the guest
+// thread, device DMA and host I/O included, so one buffer serves them all.
+class Heatmap final {
+ public:
+  // `config` must be valid.
+  static absl::StatusOr<std::unique_ptr<Heatmap>> Create(const HeatmapConfig& config,
+                                                         absl::string_view path);
+  inline void Record(const uint32_t paddr, const Access access) {
+    batch_[batched_++] = paddr << 2 | static_cast<uint32_t>(access);
+    if (batched_ == batch_.size()) {
+      Flush();
+    }
+  }
+  // Counts one access to every page (or line) [paddr, paddr + len) touches.
+  void RecordRange(uint64_t paddr, uint64_t len, Access access);
+  // Counts the buffered accesses; counts are only current after this.
+  void Flush();
+  // Ends the window at `tick`.
+  absl::Status EndWindow(uint64_t tick);
+
+  inline const HeatmapConfig& GetConfig() const { return config_; }
+  // Whole-run counts per page.
+  inline const std::vector<AccessCounts>& GetPages() const { return pages_; }
+  inline const std::vector<WorkingSetSample>& GetWorkingSet() const { return working_set_; }
+  // Totals, the working set over time, and the `top` pages by accesses.
+  std::string FormatReport(size_t top);
+  // Writes the working-set samples as CSV rows of "tick,pages,lines".
+  absl::Status WriteWorkingSet(absl::string_view path) const;
+
+ private:
+  Heatmap(const HeatmapConfig& config, std::ofstream out);
+
+  HeatmapConfig config_;
+  std::ofstream out_;
+  // log2 of the heatmap's granularity: a line or a page.
+  uint32_t unit_shift_;
+  std::array<uint32_t, constants::kHeatmapBatchSize> batch_;
+  size_t batched_ = 0;
+  std::vector<AccessCounts> pages_;
+  // The current window's counts per unit, and the units it touched.
+  std::vector<AccessCounts> window_;
+  std::vector<uint32_t> touched_;
+  std::vector<uint8_t> page_touched_;
+  uint32_t window_pages_ = 0;
+  std::vector<WorkingSetSample> working_set_;
+};
+
+}  // namespace riscv_emu::memory
+
+#endif  // LIB_MEMORY_HEATMAP_H
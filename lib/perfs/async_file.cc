@@ -0,0 +1,188 @@
+#include "async_file.h"
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+
+namespace riscv_emu::perfs::async_file {
+
+namespace {
+
+int IoUringSetup(const uint32_t entries, struct io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(const int ring_fd, const uint32_t to_submit) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, 0, 0, nullptr, 0));
+}
+
+template <typename T>
+T* At(void* base, const uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<AsyncFile>> AsyncFile::Open(const absl::string_view path,
+                                                           const bool read_only) {
+  const std::string path_str(path);
+  const int fd = open(path_str.c_str(), (read_only ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+  if (fd < 0) {
+    return absl::NotFoundError(absl::StrCat("Failed to open ", path, ": ", strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return absl::InternalError(absl::StrCat("Failed to stat ", path, ": ", strerror(errno)));
+  }
+  std::unique_ptr<AsyncFile> file(new AsyncFile(fd, static_cast<uint64_t>(st.st_size)));
+  if (!file->SetUpRing()) {
+    LOG(WARNING) << "io_uring unavailable, falling back to synchronous I/O for " << path;
+  }
+  return file;
+}
+
+bool AsyncFile::SetUpRing() {
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  const int ring_fd = IoUringSetup(constants::kRingEntries, &params);
+  if (ring_fd < 0) {
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    close(ring_fd);
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd, IORING_OFF_CQ_RING);
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+               ring_fd, IORING_OFF_SQES);
+  if (cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+    if (!single_mmap && cq_ring_ != MAP_FAILED) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    sq_ring_ = cq_ring_ = sqes_ = nullptr;
+    close(ring_fd);
+    return false;
+  }
+
+  sq_tail_ = At<uint32_t>(sq_ring_, params.sq_off.tail);
+  sq_mask_ = At<uint32_t>(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = At<uint32_t>(sq_ring_, params.sq_off.array);
+  cq_head_ = At<uint32_t>(cq_ring_, params.cq_off.head);
+  cq_tail_ = At<uint32_t>(cq_ring_, params.cq_off.tail);
+  cq_mask_ = At<uint32_t>(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = At<void>(cq_ring_, params.cq_off.cqes);
+  ring_fd_ = ring_fd;
+  return true;
+}
+
+AsyncFile::~AsyncFile() {
+  if (ring_fd_ >= 0) {
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+  }
+  close(fd_);
+}
+
+absl::Status AsyncFile::Submit(const Op op, const struct iovec* iov, const int iovcnt,
+                               const uint64_t offset, const uint64_t tag) {
+  if (ring_fd_ < 0) {
+    ssize_t result = 0;
+    switch (op) {
+     case Op::kRead:
+      result = preadv(fd_, iov, iovcnt, static_cast<off_t>(offset));
+      break;
+     case Op::kWrite:
+      result = pwritev(fd_, iov, iovcnt, static_cast<off_t>(offset));
+      break;
+     case Op::kFlush:
+      result = fdatasync(fd_);
+      break;
+    }
+    completed_.emplace_back(tag, result < 0 ? -errno : result);
+    return absl::OkStatus();
+  }
+
+  // Single producer: a plain load of our own tail is enough.
+  const uint32_t tail = *sq_tail_;
+  const uint32_t index = tail & *sq_mask_;
+  struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes_) + index;
+  std::memset(sqe, 0, sizeof(*sqe));
+  switch (op) {
+   case Op::kRead:
+    sqe->opcode = IORING_OP_READV;
+    break;
+   case Op::kWrite:
+    sqe->opcode = IORING_OP_WRITEV;
+    break;
+   case Op::kFlush:
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    break;
+  }
+  sqe->fd = fd_;
+  sqe->addr = reinterpret_cast<uint64_t>(iov);
+  sqe->len = static_cast<uint32_t>(iovcnt);
+  sqe->off = offset;
+  sqe->user_data = tag;
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  if (IoUringEnter(ring_fd_, 1) < 0) {
+    // The kernel took nothing; take the entry back so it is never run.
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    return absl::InternalError(absl::StrCat("io_uring_enter failed: ", strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+void AsyncFile::Reap(const std::function<void(uint64_t tag, int64_t result)>& done) {
+  if (ring_fd_ < 0) {
+    std::vector<std::pair<uint64_t, int64_t>> completed;
+    completed.swap(completed_);
+    for (const auto& [tag, result] : completed) {
+      done(tag, result);
+    }
+    return;
+  }
+  uint32_t head = *cq_head_;
+  const uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    const struct io_uring_cqe* cqe = static_cast<struct io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+    done(cqe->user_data, cqe->res);
+    ++head;
+  }
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+}  // namespace riscv_emu::perfs::async_file
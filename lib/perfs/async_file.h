@@ -0,0 +1,75 @@
+#ifndef LIB_PERFS_ASYNC_FILE_H
+#define LIB_PERFS_ASYNC_FILE_H
+
+#include <sys/uio.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace riscv_emu::perfs::async_file {
+
+namespace constants {
+  // Submission queue depth; completions are sized at twice this.
+  constexpr uint32_t kRingEntries = 128;
+}  // namespace constants
+
+enum class Op {
+  kRead,
+  kWrite,
+  kFlush,
+};
+
+// Host file with asynchronous vectored I/O. Requests go through io_uring
+// when the kernel allows it, so the caller's thread never blocks on the
+// disk. Otherwise they run synchronously with preadv/pwritev and are
+// reported on the next `Reap`, which keeps the caller's logic identical.
+class AsyncFile final {
+ public:
+  static absl::StatusOr<std::unique_ptr<AsyncFile>> Open(absl::string_view path, bool read_only);
+  ~AsyncFile();
+
+  // `iov` and the buffers it points to must stay valid until the request
+  // is reaped. Data moves directly between the file and those buffers.
+  // Nothing is left queued when this fails.
+  absl::Status Submit(Op op, const struct iovec* iov, int iovcnt, uint64_t offset, uint64_t tag);
+  // Invokes `done(tag, result)` for every finished request; `result` is
+  // the number of bytes transferred or a negated errno.
+  void Reap(const std::function<void(uint64_t tag, int64_t result)>& done);
+  inline uint64_t GetSize() const { return size_; }
+  inline bool IsAsync() const { return ring_fd_ >= 0; }
+
+ private:
+  AsyncFile(int fd, uint64_t size) : fd_(fd), size_(size) {}
+  // Returns false if io_uring is unavailable.
+  bool SetUpRing();
+
+  int fd_;
+  uint64_t size_;
+
+  int ring_fd_ = -1;
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  void* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  uint32_t* sq_tail_ = nullptr;
+  uint32_t* sq_mask_ = nullptr;
+  uint32_t* sq_array_ = nullptr;
+  uint32_t* cq_head_ = nullptr;
+  uint32_t* cq_tail_ = nullptr;
+  uint32_t* cq_mask_ = nullptr;
+  void* cqes_ = nullptr;
+
+  // Synchronous fallback: results waiting for the next `Reap`.
+  std::vector<std::pair<uint64_t, int64_t>> completed_;
+};
+
+}  // namespace riscv_emu::perfs::async_file
+
+#endif  // LIB_PERFS_ASYNC_FILE_H
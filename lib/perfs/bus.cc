@@ -4,18 +4,119 @@
 
 namespace riscv_emu::perfs::bus {
 
+Bus::Bus(sched::Scheduler& scheduler, const uint64_t& clock, irq::Sink irq_sink)
+    : scheduler_(scheduler), clock_(clock), irq_sink_(irq_sink),
+      clint_(scheduler, clock, irq_sink),
+      uart_(scheduler, clock),
+      dma_(dram_, scheduler, clock,
+           [this](bool level) { SetExternalIrq(constants::kDmaIrq, level); }) {
+  dram_.Flash("/tmp/progs/foo.o").IgnoreError();
+}
+
+absl::Status Bus::AttachDisk(const absl::string_view path, const bool read_only) {
+  ASSIGN_OR_RETURN(virtio_blk_, virtio::VirtioBlk::Create(
+      path, read_only, dram_, scheduler_, clock_,
+      [this](bool level) { SetExternalIrq(constants::kVirtioBlkIrq, level); }));
+  virtio_blk_->SetInputLog(input_log_);
+  return absl::OkStatus();
+}
+
+void Bus::SetInputLog(replay::InputLog* input_log) {
+  // The UART has no receiver and the CLINT runs on virtual time, so the
+  // disk is the only device whose inputs depend on the host.
+  input_log_ = input_log;
+  if (virtio_blk_ != nullptr) {
+    virtio_blk_->SetInputLog(input_log);
+  }
+}
+
+absl::Status Bus::Save(checkpoint::StateWriter& out) const {
+  out.U32(external_irqs_);
+  clint_.Save(out);
+  uart_.Save(out);
+  dma_.Save(out);
+  out.Bool(virtio_blk_ != nullptr);
+  if (virtio_blk_ != nullptr) {
+    RETURN_IF_ERROR(virtio_blk_->Save(out));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Bus::Load(checkpoint::StateReader& in) {
+  // Devices re-drive their interrupt lines as they load, which leaves this
+  // unchanged.
+  external_irqs_ = in.U32();
+  RETURN_IF_ERROR(clint_.Load(in));
+  RETURN_IF_ERROR(uart_.Load(in));
+  RETURN_IF_ERROR(dma_.Load(in));
+  const bool has_disk = in.Bool();
+  RETURN_IF_ERROR(in.GetStatus());
+  if (has_disk != (virtio_blk_ != nullptr)) {
+    return absl::FailedPreconditionError(has_disk ? "The checkpoint needs a disk attached"
+                                                  : "The checkpoint was saved without a disk");
+  }
+  if (virtio_blk_ != nullptr) {
+    RETURN_IF_ERROR(virtio_blk_->Load(in));
+  }
+  return absl::OkStatus();
+}
+
+void Bus::SetExternalIrq(const uint32_t source, const bool level) {
+  const bool was_raised = external_irqs_ != 0;
+  if (level) {
+    external_irqs_ |= source;
+  } else {
+    external_irqs_ &= ~source;
+  }
+  if (was_raised != (external_irqs_ != 0)) {
+    irq_sink_(irq::Line::kExternal, external_irqs_ != 0);
+  }
+}
+
 absl::Status Bus::Write(uint32_t addr, uint32_t val) {
-  if (addr == constants::kUartStartAddr) {
-    // Ignore upper 3 bytes.
-    std::cout << *(reinterpret_cast<char*>(&val));
-    return absl::OkStatus();
+  if (addr >= constants::kUartStartAddr && addr < constants::kUartEndAddr) {
+    return uart_.Write(addr - constants::kUartStartAddr, val);
+  }
+  if (addr >= constants::kClintStartAddr && addr < constants::kClintEndAddr) {
+    return clint_.Write(addr - constants::kClintStartAddr, val);
+  }
+  if (addr >= constants::kVirtioBlkStartAddr && addr < constants::kVirtioBlkEndAddr) {
+    if (virtio_blk_ == nullptr) {
+      return absl::OkStatus();
+    }
+    return virtio_blk_->Write(addr - constants::kVirtioBlkStartAddr, val);
+  }
+  if (addr >= constants::kDmaStartAddr && addr < constants::kDmaEndAddr) {
+    return dma_.Write(addr - constants::kDmaStartAddr, val);
   }
   return dram_.Write(addr, val);
 }
 
 absl::StatusOr<uint32_t> Bus::Read(uint32_t addr) {
   // Redirect address to proper device.
+  if (addr >= constants::kClintStartAddr && addr < constants::kClintEndAddr) {
+    return clint_.Read(addr - constants::kClintStartAddr);
+  }
+  if (addr >= constants::kUartStartAddr && addr < constants::kUartEndAddr) {
+    return uart_.Read(addr - constants::kUartStartAddr);
+  }
+  if (addr >= constants::kVirtioBlkStartAddr && addr < constants::kVirtioBlkEndAddr) {
+    if (virtio_blk_ == nullptr) {
+      return 0;
+    }
+    return virtio_blk_->Read(addr - constants::kVirtioBlkStartAddr);
+  }
+  if (addr >= constants::kDmaStartAddr && addr < constants::kDmaEndAddr) {
+    return dma_.Read(addr - constants::kDmaStartAddr);
+  }
   return dram_.Read(addr);
 }
 
+bool Bus::IsTimeSource(const uint32_t addr) const {
+  if (addr >= constants::kClintStartAddr && addr < constants::kClintEndAddr) {
+    return clint::Clint::IsTimeRegister(addr - constants::kClintStartAddr);
+  }
+  return false;
+}
+
 }  // namespace riscv_emu::perfs::bus
\ No newline at end of file
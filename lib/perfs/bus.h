@@ -2,32 +2,83 @@
 #define LIB_PERFS_BUS_H
 
 #include <cstdint>
+#include <memory>
+#include "lib/checkpoint/state.h"
 #include "lib/memory/dram.h"
-// #include "uart.h"
+#include "lib/perfs/clint.h"
+#include "lib/perfs/dma.h"
+#include "lib/perfs/irq.h"
+#include "lib/perfs/uart.h"
+#include "lib/perfs/virtio_blk.h"
+#include "lib/replay/input_log.h"
+#include "lib/sched/scheduler.h"
 #include "glog/logging.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 
 namespace riscv_emu::perfs::bus {
 
 namespace constants {
   constexpr uint32_t kDramStartAddr = 0x0;
   constexpr uint32_t kDramEndAddr = kDramStartAddr + memory::constants::kDramSize;  // 0x000fa000
+  constexpr uint32_t kClintStartAddr = 0x02000000;
+  constexpr uint32_t kClintEndAddr = kClintStartAddr + clint::constants::kSize;
   constexpr uint32_t kUartStartAddr = 0x0fff0000;
+  constexpr uint32_t kUartEndAddr = kUartStartAddr + uart::constants::kSize;
+  constexpr uint32_t kVirtioBlkStartAddr = 0x10001000;
+  constexpr uint32_t kVirtioBlkEndAddr = kVirtioBlkStartAddr + virtio::constants::kSize;
+  constexpr uint32_t kDmaStartAddr = 0x10002000;
+  constexpr uint32_t kDmaEndAddr = kDmaStartAddr + dma::constants::kSize;
+
+  // Sources sharing the machine external interrupt line. Drivers find the
+  // one that fired through the device's own interrupt status register.
+  constexpr uint32_t kVirtioBlkIrq = 1U << 0;
+  constexpr uint32_t kDmaIrq = 1U << 1;
 }  // namespace constants
 
 class Bus final {
  public:
-  Bus() { dram_.Flash("/tmp/progs/foo.o").IgnoreError(); }
+  Bus(sched::Scheduler& scheduler, const uint64_t& clock, irq::Sink irq_sink);
+  // Backs the virtio block device with a host file.
+  absl::Status AttachDisk(absl::string_view path, bool read_only);
+  // Records or replays the inputs devices deliver with host timing.
+  void SetInputLog(replay::InputLog* input_log);
+  inline memory::Dram& GetDram() { return dram_; }
   absl::Status Write(uint32_t addr, uint32_t val);
   absl::StatusOr<uint32_t> Read(uint32_t addr);
   inline void SetDramAccessType(memory::AccessType access_type) { dram_.SetAccessType(access_type); }
-  
+  inline uint64_t GetMtime() const { return clint_.GetMtime(); }
+  // True if reading `addr` observes state that advances with time alone,
+  // i.e. the value can change without any scheduler event firing.
+  bool IsTimeSource(uint32_t addr) const;
+  // Device state for checkpoints; RAM is saved separately. The same disk
+  // must be attached when loading.
+  absl::Status Save(checkpoint::StateWriter& out) const;
+  absl::Status Load(checkpoint::StateReader& in);
+  // See `VirtioBlk::DropRequests`.
+  inline void DropDiskRequests() {
+    if (virtio_blk_ != nullptr) {
+      virtio_blk_->DropRequests();
+    }
+  }
 
  private:
+  void SetExternalIrq(uint32_t source, bool level);
+
+  sched::Scheduler& scheduler_;
+  const uint64_t& clock_;
+  irq::Sink irq_sink_;
+  uint32_t external_irqs_ = 0;
   memory::Dram dram_;
+  clint::Clint clint_;
+  uart::Uart uart_;
+  dma::Dma dma_;
+  // Absent until a disk is attached; the slot then reads as no device.
+  std::unique_ptr<virtio::VirtioBlk> virtio_blk_;
+  replay::InputLog* input_log_ = nullptr;
 };
 
 }  // namespace riscv_emu::perfs::bus
 
-#endif  // LIB_PERFS_BUS_H
\ No newline at end of file
+#endif  // LIB_PERFS_BUS_H
@@ -0,0 +1,106 @@
+#include "clint.h"
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "status_macros.h"
+
+namespace riscv_emu::perfs::clint {
+
+namespace {
+
+uint64_t SetLow(const uint64_t reg, const uint32_t val) {
+  return (reg & 0xffffffff00000000ULL) | val;
+}
+
+uint64_t SetHigh(const uint64_t reg, const uint32_t val) {
+  return (reg & 0xffffffffULL) | (static_cast<uint64_t>(val) << 32);
+}
+
+}  // namespace
+
+Clint::Clint(sched::Scheduler& scheduler, const uint64_t& clock, irq::Sink irq_sink)
+    : scheduler_(scheduler), clock_(clock), irq_sink_(std::move(irq_sink)) {}
+
+absl::StatusOr<uint32_t> Clint::Read(const uint32_t offset) const {
+  switch (offset) {
+   case constants::kMsipOffset:
+    return msip_ ? 1 : 0;
+   case constants::kMtimecmpOffset:
+    return static_cast<uint32_t>(mtimecmp_);
+   case constants::kMtimecmphOffset:
+    return static_cast<uint32_t>(mtimecmp_ >> 32);
+   case constants::kMtimeOffset:
+    return static_cast<uint32_t>(GetMtime());
+   case constants::kMtimehOffset:
+    return static_cast<uint32_t>(GetMtime() >> 32);
+   default:
+    return absl::OutOfRangeError(absl::StrCat("Invalid CLINT offset 0x", absl::Hex(offset)));
+  }
+}
+
+absl::Status Clint::Write(const uint32_t offset, const uint32_t val) {
+  switch (offset) {
+   case constants::kMsipOffset:
+    msip_ = val & 0b1;
+    irq_sink_(irq::Line::kSoftware, msip_);
+    return absl::OkStatus();
+   case constants::kMtimecmpOffset:
+    mtimecmp_ = SetLow(mtimecmp_, val);
+    break;
+   case constants::kMtimecmphOffset:
+    mtimecmp_ = SetHigh(mtimecmp_, val);
+    break;
+   case constants::kMtimeOffset:
+    mtime_offset_ = SetLow(GetMtime(), val) - clock_;
+    break;
+   case constants::kMtimehOffset:
+    mtime_offset_ = SetHigh(GetMtime(), val) - clock_;
+    break;
+   default:
+    return absl::OutOfRangeError(absl::StrCat("Invalid CLINT offset 0x", absl::Hex(offset)));
+  }
+  ArmTimer();
+  return absl::OkStatus();
+}
+
+void Clint::Save(checkpoint::StateWriter& out) const {
+  out.U64(mtime_offset_);
+  out.U64(mtimecmp_);
+  out.Bool(msip_);
+}
+
+absl::Status Clint::Load(checkpoint::StateReader& in) {
+  mtime_offset_ = in.U64();
+  mtimecmp_ = in.U64();
+  msip_ = in.Bool();
+  RETURN_IF_ERROR(in.GetStatus());
+  timer_event_.reset();
+  irq_sink_(irq::Line::kSoftware, msip_);
+  ArmTimer();
+  return absl::OkStatus();
+}
+
+void Clint::ArmTimer() {
+  if (timer_event_.has_value()) {
+    scheduler_.Cancel(*timer_event_);
+    timer_event_.reset();
+  }
+  const uint64_t mtime = GetMtime();
+  if (mtime >= mtimecmp_) {
+    irq_sink_(irq::Line::kTimer, true);
+    return;
+  }
+  irq_sink_(irq::Line::kTimer, false);
+  const uint64_t ticks = mtimecmp_ - mtime;
+  if (ticks >= sched::constants::kNever - clock_) {
+    // Effectively disarmed; firmware parks `mtimecmp` at all-ones.
+    return;
+  }
+  timer_event_ = scheduler_.Schedule(clock_ + ticks, [this](uint64_t now) {
+    VLOG(2) << "CLINT timer fired at " << now;
+    timer_event_.reset();
+    irq_sink_(irq::Line::kTimer, true);
+    return absl::OkStatus();
+  });
+}
+
+}  // namespace riscv_emu::perfs::clint
@@ -0,0 +1,58 @@
+#ifndef LIB_PERFS_CLINT_H
+#define LIB_PERFS_CLINT_H
+
+#include <cstdint>
+#include <optional>
+#include "lib/checkpoint/state.h"
+#include "lib/perfs/irq.h"
+#include "lib/sched/scheduler.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace riscv_emu::perfs::clint {
+
+namespace constants {
+  // Register offsets follow the SiFive CLINT layout used by most firmware.
+  constexpr uint32_t kMsipOffset = 0x0;
+  constexpr uint32_t kMtimecmpOffset = 0x4000;
+  constexpr uint32_t kMtimecmphOffset = kMtimecmpOffset + 4;
+  constexpr uint32_t kMtimeOffset = 0xbff8;
+  constexpr uint32_t kMtimehOffset = kMtimeOffset + 4;
+  constexpr uint32_t kSize = 0x10000;
+}  // namespace constants
+
+// Core-local interruptor. `mtime` is derived from the virtual clock, so it
+// never needs to be ticked; a pending `mtimecmp` is a single scheduler
+// event rather than a comparison after every instruction.
+class Clint final {
+ public:
+  Clint(sched::Scheduler& scheduler, const uint64_t& clock, irq::Sink irq_sink);
+  absl::StatusOr<uint32_t> Read(uint32_t offset) const;
+  absl::Status Write(uint32_t offset, uint32_t val);
+  inline uint64_t GetMtime() const { return clock_ + mtime_offset_; }
+  // Checkpoints. `Load` expects a cleared scheduler and re-arms any
+  // pending event against the restored clock.
+  void Save(checkpoint::StateWriter& out) const;
+  absl::Status Load(checkpoint::StateReader& in);
+  // `mtime` is the only register that changes without a scheduler event.
+  static inline bool IsTimeRegister(const uint32_t offset) {
+    return offset == constants::kMtimeOffset || offset == constants::kMtimehOffset;
+  }
+
+ private:
+  // Re-evaluates MTIP and (re)schedules the timer event.
+  void ArmTimer();
+
+  sched::Scheduler& scheduler_;
+  const uint64_t& clock_;
+  irq::Sink irq_sink_;
+  // Guest writes to `mtime` shift it relative to the virtual clock.
+  uint64_t mtime_offset_ = 0;
+  uint64_t mtimecmp_ = UINT64_MAX;
+  bool msip_ = false;
+  std::optional<sched::EventId> timer_event_;
+};
+
+}  // namespace riscv_emu::perfs::clint
+
+#endif  // LIB_PERFS_CLINT_H
@@ -0,0 +1,73 @@
+#ifndef LIB_PERFS_DMA_H
+#define LIB_PERFS_DMA_H
+
+#include <cstdint>
+#include <optional>
+#include "lib/checkpoint/state.h"
+#include "lib/memory/dram.h"
+#include "lib/perfs/irq.h"
+#include "lib/sched/scheduler.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace riscv_emu::perfs::dma {
+
+namespace constants {
+  constexpr uint32_t kSrcOffset = 0x00;
+  constexpr uint32_t kDstOffset = 0x04;
+  constexpr uint32_t kLenOffset = 0x08;
+  constexpr uint32_t kFillOffset = 0x0c;
+  constexpr uint32_t kCtrlOffset = 0x10;
+  constexpr uint32_t kStatusOffset = 0x14;
+  constexpr uint32_t kSize = 0x100;
+
+  constexpr uint32_t kCtrlStart = 1U << 0;
+  constexpr uint32_t kCtrlFill = 1U << 1;  // memset with FILL instead of copying from SRC.
+  constexpr uint32_t kCtrlIrqEnable = 1U << 2;
+
+  constexpr uint32_t kStatusBusy = 1U << 0;
+  constexpr uint32_t kStatusDone = 1U << 1;  // Write 1 to clear.
+  constexpr uint32_t kStatusError = 1U << 2;  // Write 1 to clear.
+
+  // Modelled transfer bandwidth; the host copy itself is immediate.
+  constexpr uint64_t kBytesPerTick = 16;
+}  // namespace constants
+
+// Memory-to-memory DMA controller. A transfer runs as a single host
+// memmove/memset over guest RAM when started; BUSY then stays set for the
+// modelled transfer time, after which DONE (and optionally the interrupt)
+// is raised by a scheduler event.
+class Dma final {
+ public:
+  Dma(memory::Dram& dram, sched::Scheduler& scheduler, const uint64_t& clock, irq::Pin irq);
+  absl::StatusOr<uint32_t> Read(uint32_t offset) const;
+  absl::Status Write(uint32_t offset, uint32_t val);
+  // Checkpoints. `Load` expects a cleared scheduler and re-arms any
+  // pending event against the restored clock.
+  void Save(checkpoint::StateWriter& out) const;
+  absl::Status Load(checkpoint::StateReader& in);
+
+ private:
+  void Start();
+  // Completes the busy transfer at `done_at_`.
+  void ScheduleDone();
+  void UpdateIrq();
+
+  memory::Dram& dram_;
+  sched::Scheduler& scheduler_;
+  const uint64_t& clock_;
+  irq::Pin irq_;
+
+  uint32_t src_ = 0;
+  uint32_t dst_ = 0;
+  uint32_t len_ = 0;
+  uint32_t fill_ = 0;
+  uint32_t ctrl_ = 0;
+  uint32_t status_ = 0;
+  uint64_t done_at_ = 0;
+  std::optional<sched::EventId> done_event_;
+};
+
+}  // namespace riscv_emu::perfs::dma
+
+#endif  // LIB_PERFS_DMA_H
@@ -0,0 +1,24 @@
+#ifndef LIB_PERFS_IRQ_H
+#define LIB_PERFS_IRQ_H
+
+#include <functional>
+
+namespace riscv_emu::perfs::irq {
+
+// Interrupt lines a device can drive into the hart.
+enum class Line {
+  kSoftware,
+  kTimer,
+  kExternal,
+};
+
+// Sets the level of `line`. Devices call this with the current level on
+// every change; the sink owns the mapping onto `mip`.
+using Sink = std::function<void(Line line, bool level)>;
+
+// A single interrupt output of a device, wired to an external source.
+using Pin = std::function<void(bool level)>;
+
+}  // namespace riscv_emu::perfs::irq
+
+#endif  // LIB_PERFS_IRQ_H
@@ -1 +1,126 @@
-#include "uart.h"
\ No newline at end of file
+#include "uart.h"
+#include <algorithm>
+#include <iostream>
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+
+namespace riscv_emu::perfs::uart {
+
+Uart::Uart(sched::Scheduler& scheduler, const uint64_t& clock)
+    : scheduler_(scheduler), clock_(clock) {}
+
+absl::StatusOr<uint32_t> Uart::Read(const uint32_t offset) const {
+  if (lcr_ & constants::kLcrDlab) {
+    if (offset == constants::kDllOffset) {
+      return dll_;
+    }
+    if (offset == constants::kDlmOffset) {
+      return dlm_;
+    }
+  }
+  switch (offset) {
+   case constants::kThrOffset:
+    // Nothing is ever received.
+    return 0;
+   case constants::kIerOffset:
+    return ier_;
+   case constants::kIirOffset:
+    return constants::kIirNoInterrupt;
+   case constants::kLcrOffset:
+    return lcr_;
+   case constants::kMcrOffset:
+    return mcr_;
+   case constants::kLsrOffset:
+    return tx_empty_ ? (constants::kLsrThrEmpty | constants::kLsrTxEmpty) : 0;
+   case constants::kMsrOffset:
+    return 0;
+   case constants::kScrOffset:
+    return scr_;
+   default:
+    return absl::OutOfRangeError(absl::StrCat("Invalid UART offset 0x", absl::Hex(offset)));
+  }
+}
+
+absl::Status Uart::Write(const uint32_t offset, const uint32_t val) {
+  if (lcr_ & constants::kLcrDlab) {
+    if (offset == constants::kDllOffset) {
+      dll_ = val;
+      return absl::OkStatus();
+    }
+    if (offset == constants::kDlmOffset) {
+      dlm_ = val;
+      return absl::OkStatus();
+    }
+  }
+  switch (offset) {
+   case constants::kThrOffset:
+    break;
+   case constants::kIerOffset:
+    ier_ = val;
+    return absl::OkStatus();
+   case constants::kIirOffset:
+    // FIFO control; the FIFO is not modelled.
+    return absl::OkStatus();
+   case constants::kLcrOffset:
+    lcr_ = val;
+    return absl::OkStatus();
+   case constants::kMcrOffset:
+    mcr_ = val;
+    return absl::OkStatus();
+   case constants::kLsrOffset:
+   case constants::kMsrOffset:
+    return absl::OkStatus();
+   case constants::kScrOffset:
+    scr_ = val;
+    return absl::OkStatus();
+   default:
+    return absl::OutOfRangeError(absl::StrCat("Invalid UART offset 0x", absl::Hex(offset)));
+  }
+
+  // Ignore upper 3 bytes.
+  std::cout << static_cast<char>(val & 0xff);
+  tx_empty_ = false;
+  tx_drained_at_ = std::max(tx_drained_at_, clock_) + constants::kTicksPerByte;
+  if (drain_event_.has_value()) {
+    scheduler_.Cancel(*drain_event_);
+  }
+  ScheduleDrain();
+  return absl::OkStatus();
+}
+
+void Uart::ScheduleDrain() {
+  drain_event_ = scheduler_.Schedule(tx_drained_at_, [this](uint64_t) {
+    drain_event_.reset();
+    tx_empty_ = true;
+    return absl::OkStatus();
+  });
+}
+
+void Uart::Save(checkpoint::StateWriter& out) const {
+  out.Bool(tx_empty_);
+  out.U64(tx_drained_at_);
+  out.U8(ier_);
+  out.U8(lcr_);
+  out.U8(mcr_);
+  out.U8(scr_);
+  out.U8(dll_);
+  out.U8(dlm_);
+}
+
+absl::Status Uart::Load(checkpoint::StateReader& in) {
+  tx_empty_ = in.Bool();
+  tx_drained_at_ = in.U64();
+  ier_ = in.U8();
+  lcr_ = in.U8();
+  mcr_ = in.U8();
+  scr_ = in.U8();
+  dll_ = in.U8();
+  dlm_ = in.U8();
+  drain_event_.reset();
+  if (!tx_empty_) {
+    ScheduleDrain();
+  }
+  return in.GetStatus();
+}
+
+}  // namespace riscv_emu::perfs::uart
@@ -1,20 +1,71 @@
 #ifndef LIB_PERFS_UART_H
 #define LIB_PERFS_UART_H
 
+#include <cstdint>
+#include <optional>
+#include "lib/checkpoint/state.h"
+#include "lib/sched/scheduler.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
 namespace riscv_emu::perfs::uart {
 
 namespace constants {
+  // 16550-compatible register offsets (one byte apart).
+  constexpr uint32_t kThrOffset = 0;  // Transmit holding (write) / receive buffer (read).
+  constexpr uint32_t kIerOffset = 1;
+  constexpr uint32_t kIirOffset = 2;  // Interrupt ident (read) / FIFO control (write).
+  constexpr uint32_t kLcrOffset = 3;
+  constexpr uint32_t kMcrOffset = 4;
+  constexpr uint32_t kLsrOffset = 5;
+  constexpr uint32_t kMsrOffset = 6;
+  constexpr uint32_t kScrOffset = 7;
+  constexpr uint32_t kSize = 8;
+
+  // With LCR.DLAB set, offsets 0 and 1 hold the baud divisor instead.
+  constexpr uint32_t kDllOffset = 0;
+  constexpr uint32_t kDlmOffset = 1;
+  constexpr uint32_t kLcrDlab = 1U << 7;
 
+  constexpr uint32_t kLsrThrEmpty = 1U << 5;
+  constexpr uint32_t kLsrTxEmpty = 1U << 6;
+  constexpr uint32_t kIirNoInterrupt = 0b1;
+
+  // 115200 baud 8N1 (10 bits per byte) at the 10 MHz virtual clock.
+  constexpr uint64_t kTicksPerByte = 868;
 }  // namespace constants
 
+// Transmit-only 16550. Bytes reach the host immediately, but the line is
+// kept busy for the time they would take on the wire, so drivers that poll
+// LSR behave as on hardware. LSR only changes when the drain event fires.
+// The divisor latch is stored for drivers that program it but does not
+// change the line rate.
 class Uart final {
  public:
-  
+  Uart(sched::Scheduler& scheduler, const uint64_t& clock);
+  absl::StatusOr<uint32_t> Read(uint32_t offset) const;
+  absl::Status Write(uint32_t offset, uint32_t val);
+  // Checkpoints. `Load` expects a cleared scheduler and re-arms any
+  // pending event against the restored clock.
+  void Save(checkpoint::StateWriter& out) const;
+  absl::Status Load(checkpoint::StateReader& in);
 
  private:
-  
-}
+  void ScheduleDrain();
+
+  sched::Scheduler& scheduler_;
+  const uint64_t& clock_;
+  bool tx_empty_ = true;
+  uint64_t tx_drained_at_ = 0;
+  std::optional<sched::EventId> drain_event_;
+  uint8_t ier_ = 0;
+  uint8_t lcr_ = 0;
+  uint8_t mcr_ = 0;
+  uint8_t scr_ = 0;
+  uint8_t dll_ = 0;
+  uint8_t dlm_ = 0;
+};
 
 }  // namespace riscv_emu::perfs::uart
 
-#endif  // LIB_PERFS_UART_H
\ No newline at end of file
+#endif  // LIB_PERFS_UART_H
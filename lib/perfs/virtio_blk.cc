@@ -0,0 +1,488 @@
+#include "virtio_blk.h"
+#include <cstring>
+#include <thread>
+#include <utility>
+#include "absl/strings/str_cat.h"
+#include "status_macros.h"
+#include "glog/logging.h"
+
+namespace riscv_emu::perfs::virtio {
+
+namespace {
+
+constexpr uint32_t kStatusNeedsReset = 0x40;
+
+constexpr uint16_t kDescFlagNext = 0b01;
+constexpr uint16_t kDescFlagWrite = 0b10;
+constexpr uint32_t kDescSize = 16;
+constexpr uint32_t kBlkHeaderSize = 16;
+
+constexpr uint32_t kBlkTypeIn = 0;
+constexpr uint32_t kBlkTypeOut = 1;
+constexpr uint32_t kBlkTypeFlush = 4;
+constexpr uint32_t kBlkTypeGetId = 8;
+
+constexpr uint8_t kBlkStatusOk = 0;
+constexpr uint8_t kBlkStatusIoErr = 1;
+constexpr uint8_t kBlkStatusUnsupported = 2;
+
+constexpr char kDeviceSerial[] = "riscv-emu-blk";
+
+// Guest structures are little-endian, as is the host.
+template <typename T>
+T LoadLe(const uint8_t* ptr) {
+  T val;
+  std::memcpy(&val, ptr, sizeof(T));
+  return val;
+}
+
+template <typename T>
+void StoreLe(uint8_t* ptr, const T val) {
+  std::memcpy(ptr, &val, sizeof(T));
+}
+
+uint64_t SetLow(const uint64_t reg, const uint32_t val) {
+  return (reg & 0xffffffff00000000ULL) | val;
+}
+
+uint64_t SetHigh(const uint64_t reg, const uint32_t val) {
+  return (reg & 0xffffffffULL) | (static_cast<uint64_t>(val) << 32);
+}
+
+struct Descriptor {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t flags;
+  uint16_t next;
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<VirtioBlk>> VirtioBlk::Create(
+    const absl::string_view path, const bool read_only, memory::Dram& dram,
+    sched::Scheduler& scheduler, const uint64_t& clock, irq::Pin irq) {
+  ASSIGN_OR_RETURN(std::unique_ptr<async_file::AsyncFile> file,
+                   async_file::AsyncFile::Open(path, read_only));
+  return std::unique_ptr<VirtioBlk>(
+      new VirtioBlk(std::move(file), read_only, dram, scheduler, clock, std::move(irq)));
+}
+
+VirtioBlk::VirtioBlk(std::unique_ptr<async_file::AsyncFile> file, const bool read_only,
+                     memory::Dram& dram, sched::Scheduler& scheduler, const uint64_t& clock,
+                     irq::Pin irq)
+    : file_(std::move(file)), read_only_(read_only), dram_(dram), scheduler_(scheduler),
+      clock_(clock), irq_(std::move(irq)) {}
+
+uint64_t VirtioBlk::GetDeviceFeatures() const {
+  return constants::kFeatureVersion1 | constants::kFeatureBlkFlush |
+         (read_only_ ? constants::kFeatureBlkReadOnly : 0);
+}
+
+absl::StatusOr<uint32_t> VirtioBlk::Read(const uint32_t offset) const {
+  const uint64_t capacity = file_->GetSize() / constants::kSectorSize;
+  switch (offset) {
+   case constants::kMagicValueOffset:
+    return constants::kMagicValue;
+   case constants::kVersionOffset:
+    return constants::kVersion;
+   case constants::kDeviceIdOffset:
+    return constants::kBlockDeviceId;
+   case constants::kVendorIdOffset:
+    return constants::kVendorId;
+   case constants::kDeviceFeaturesOffset:
+    return device_features_sel_ == 0 ? static_cast<uint32_t>(GetDeviceFeatures()) :
+           device_features_sel_ == 1 ? static_cast<uint32_t>(GetDeviceFeatures() >> 32) : 0;
+   case constants::kQueueNumMaxOffset:
+    return queue_sel_ == 0 ? constants::kQueueNumMax : 0;
+   case constants::kQueueReadyOffset:
+    return queue_ready_ ? 1 : 0;
+   case constants::kInterruptStatusOffset:
+    return interrupt_status_;
+   case constants::kStatusOffset:
+    return status_;
+   case constants::kConfigGenerationOffset:
+    return 0;
+   case constants::kConfigCapacityLowOffset:
+    return static_cast<uint32_t>(capacity);
+   case constants::kConfigCapacityHighOffset:
+    return static_cast<uint32_t>(capacity >> 32);
+   default:
+    return 0;
+  }
+}
+
+absl::Status VirtioBlk::Write(const uint32_t offset, const uint32_t val) {
+  switch (offset) {
+   case constants::kDeviceFeaturesSelOffset:
+    device_features_sel_ = val;
+    break;
+   case constants::kDriverFeaturesOffset:
+    if (driver_features_sel_ == 0) {
+      driver_features_ = SetLow(driver_features_, val);
+    } else if (driver_features_sel_ == 1) {
+      driver_features_ = SetHigh(driver_features_, val);
+    }
+    break;
+   case constants::kDriverFeaturesSelOffset:
+    driver_features_sel_ = val;
+    break;
+   case constants::kQueueSelOffset:
+    queue_sel_ = val;
+    break;
+   case constants::kQueueNumOffset:
+    if (queue_sel_ == 0 && val <= constants::kQueueNumMax) {
+      queue_num_ = val;
+    }
+    break;
+   case constants::kQueueReadyOffset:
+    if (queue_sel_ == 0) {
+      queue_ready_ = val & 0b1;
+    }
+    break;
+   case constants::kQueueNotifyOffset:
+    if (val == 0) {
+      ProcessQueue();
+    }
+    break;
+   case constants::kInterruptAckOffset:
+    interrupt_status_ &= ~val;
+    if (interrupt_status_ == 0) {
+      irq_(false);
+    }
+    break;
+   case constants::kStatusOffset:
+    if (val == 0) {
+      Reset();
+    } else {
+      status_ = val;
+    }
+    break;
+   case constants::kQueueDescLowOffset:
+    desc_addr_ = SetLow(desc_addr_, val);
+    break;
+   case constants::kQueueDescHighOffset:
+    desc_addr_ = SetHigh(desc_addr_, val);
+    break;
+   case constants::kQueueDriverLowOffset:
+    avail_addr_ = SetLow(avail_addr_, val);
+    break;
+   case constants::kQueueDriverHighOffset:
+    avail_addr_ = SetHigh(avail_addr_, val);
+    break;
+   case constants::kQueueDeviceLowOffset:
+    used_addr_ = SetLow(used_addr_, val);
+    break;
+   case constants::kQueueDeviceHighOffset:
+    used_addr_ = SetHigh(used_addr_, val);
+    break;
+   default:
+    // Read-only or unimplemented registers ignore writes.
+    break;
+  }
+  return absl::OkStatus();
+}
+
+void VirtioBlk::Reset() {
+  status_ = 0;
+  driver_features_ = 0;
+  queue_num_ = 0;
+  queue_ready_ = false;
+  desc_addr_ = avail_addr_ = used_addr_ = 0;
+  last_avail_idx_ = 0;
+  interrupt_status_ = 0;
+  irq_(false);
+  // Requests still owned by the host kernel complete into the void.
+  ++generation_;
+}
+
+void VirtioBlk::ProcessQueue() {
+  if (!queue_ready_ || queue_num_ == 0 || (status_ & kStatusNeedsReset)) {
+    return;
+  }
+  absl::StatusOr<uint8_t*> avail = dram_.GetHostPtr(avail_addr_, 4 + 2 * queue_num_);
+  if (!avail.ok()) {
+    LOG(WARNING) << "virtio-blk: " << avail.status();
+    status_ |= kStatusNeedsReset;
+    return;
+  }
+  const uint16_t avail_idx = LoadLe<uint16_t>(*avail + 2);
+  while (last_avail_idx_ != avail_idx) {
+    const uint16_t head = LoadLe<uint16_t>(*avail + 4 + 2 * (last_avail_idx_ % queue_num_));
+    ++last_avail_idx_;
+    const absl::Status status = StartRequest(head);
+    if (!status.ok()) {
+      LOG(WARNING) << "virtio-blk: " << status;
+      status_ |= kStatusNeedsReset;
+      return;
+    }
+  }
+  SchedulePoll();
+}
+
+absl::Status VirtioBlk::StartRequest(const uint16_t head) {
+  std::vector<Descriptor> chain;
+  uint16_t index = head;
+  while (true) {
+    if (index >= queue_num_ || chain.size() >= queue_num_) {
+      return absl::InvalidArgumentError("Malformed descriptor chain");
+    }
+    ASSIGN_OR_RETURN(const uint8_t* desc, dram_.GetHostPtr(desc_addr_ + kDescSize * index, kDescSize));
+    chain.push_back(Descriptor { LoadLe<uint64_t>(desc), LoadLe<uint32_t>(desc + 8),
+                                 LoadLe<uint16_t>(desc + 12), LoadLe<uint16_t>(desc + 14) });
+    if (!(chain.back().flags & kDescFlagNext)) {
+      break;
+    }
+    index = chain.back().next;
+  }
+  const Descriptor& header = chain.front();
+  const Descriptor& status_desc = chain.back();
+  if (chain.size() < 2 || header.len < kBlkHeaderSize || status_desc.len < 1 ||
+      !(status_desc.flags & kDescFlagWrite)) {
+    return absl::InvalidArgumentError("Malformed block request");
+  }
+  // Without a status byte the request cannot be failed, only the device.
+  ASSIGN_OR_RETURN(uint8_t* status, dram_.GetHostPtr(status_desc.addr + status_desc.len - 1, 1));
+  const absl::StatusOr<uint8_t*> header_ptr = dram_.GetHostPtr(header.addr, kBlkHeaderSize);
+  if (!header_ptr.ok()) {
+    Complete(head, status, 1, kBlkStatusIoErr);
+    return absl::OkStatus();
+  }
+  const uint32_t type = LoadLe<uint32_t>(*header_ptr);
+  const uint64_t sector = LoadLe<uint64_t>(*header_ptr + 8);
+
+  Request request { head, generation_, {}, status, /*written=*/1 };
+  uint64_t len = 0;
+  for (size_t i = 1; i + 1 < chain.size(); ++i) {
+    const bool device_writes = chain[i].flags & kDescFlagWrite;
+    const absl::StatusOr<uint8_t*> data = dram_.GetHostPtr(chain[i].addr, chain[i].len);
+    if (device_writes != (type == kBlkTypeIn || type == kBlkTypeGetId) || !data.ok()) {
+      Complete(head, status, 1, kBlkStatusIoErr);
+      return absl::OkStatus();
+    }
+    request.iov.push_back(iovec { *data, chain[i].len });
+    len += chain[i].len;
+  }
+
+  async_file::Op op;
+  const uint64_t offset = sector * constants::kSectorSize;
+  switch (type) {
+   case kBlkTypeIn:
+    op = async_file::Op::kRead;
+    request.written += len;
+    break;
+   case kBlkTypeOut:
+    if (read_only_) {
+      Complete(head, status, 1, kBlkStatusIoErr);
+      return absl::OkStatus();
+    }
+    op = async_file::Op::kWrite;
+    break;
+   case kBlkTypeFlush:
+    op = async_file::Op::kFlush;
+    break;
+   case kBlkTypeGetId:
+    if (!request.iov.empty()) {
+      const size_t n = std::min(sizeof(kDeviceSerial), request.iov.front().iov_len);
+      std::memcpy(request.iov.front().iov_base, kDeviceSerial, n);
+      dram_.NotifyHostWrite(request.iov.front().iov_base, n);
+    }
+    Complete(head, status, 1 + len, kBlkStatusOk);
+    return absl::OkStatus();
+   default:
+    Complete(head, status, 1, kBlkStatusUnsupported);
+    return absl::OkStatus();
+  }
+  if (op != async_file::Op::kFlush && (offset > file_->GetSize() || len > file_->GetSize() - offset)) {
+    Complete(head, status, 1, kBlkStatusIoErr);
+    return absl::OkStatus();
+  }
+
+  const uint64_t tag = next_tag_++;
+  Request& queued = in_flight_[tag] = std::move(request);
+  VLOG(3) << "virtio-blk: request type " << type << " sector " << sector << " len " << len;
+  const absl::Status submitted =
+      file_->Submit(op, queued.iov.data(), static_cast<int>(queued.iov.size()), offset, tag);
+  if (!submitted.ok()) {
+    LOG(WARNING) << "virtio-blk: " << submitted;
+    in_flight_.erase(tag);
+    Complete(head, status, 1, kBlkStatusIoErr);
+  }
+  return absl::OkStatus();
+}
+
+void VirtioBlk::Complete(const uint16_t head, uint8_t* status_ptr, const uint32_t written,
+                         const uint8_t status) {
+  *status_ptr = status;
+  dram_.NotifyHostWrite(status_ptr, 1);
+  absl::StatusOr<uint8_t*> used = dram_.GetHostPtr(used_addr_, 4 + 8 * queue_num_);
+  if (!used.ok()) {
+    status_ |= kStatusNeedsReset;
+    return;
+  }
+  const uint16_t used_idx = LoadLe<uint16_t>(*used + 2);
+  uint8_t* elem = *used + 4 + 8 * (used_idx % queue_num_);
+  StoreLe<uint32_t>(elem, head);
+  StoreLe<uint32_t>(elem + 4, written);
+  StoreLe<uint16_t>(*used + 2, used_idx + 1);
+  dram_.NotifyHostWrite(*used, 4 + 8 * queue_num_);
+  interrupt_status_ |= 0b1;
+  irq_(true);
+  VLOG(3) << "virtio-blk: completed head " << head << " status " << static_cast<int>(status);
+}
+
+void VirtioBlk::FinishRequest(const uint64_t tag, const int64_t result) {
+  const auto it = in_flight_.find(tag);
+  if (it == in_flight_.end()) {
+    return;
+  }
+  const Request request = std::move(it->second);
+  in_flight_.erase(it);
+  if (request.generation != generation_) {
+    return;
+  }
+  uint64_t expected = 0;
+  for (const struct iovec& iov : request.iov) {
+    expected += iov.iov_len;
+  }
+  // Flushes carry no data and report 0 on success.
+  const bool ok = result >= 0 && static_cast<uint64_t>(result) == expected;
+  if (ok && request.written > 1) {
+    // The host kernel wrote guest RAM behind the CPU's back.
+    for (const struct iovec& iov : request.iov) {
+      dram_.NotifyHostWrite(iov.iov_base, iov.iov_len);
+    }
+  }
+  Complete(request.head, request.status, ok ? request.written : 1,
+           ok ? kBlkStatusOk : kBlkStatusIoErr);
+}
+
+absl::Status VirtioBlk::PollCompletions() {
+  if (input_log_ != nullptr && input_log_->IsReplaying()) {
+    RETURN_IF_ERROR(ReplayCompletions());
+  } else {
+    // Results reaped by a replay that has since caught up with the host.
+    for (const auto& [tag, result] : std::exchange(reaped_, {})) {
+      if (input_log_ != nullptr && in_flight_.contains(tag)) {
+        input_log_->Append(replay::Kind::kDiskCompletion, tag, result);
+      }
+      FinishRequest(tag, result);
+    }
+    file_->Reap([this](const uint64_t tag, const int64_t result) {
+      if (input_log_ != nullptr && in_flight_.contains(tag)) {
+        input_log_->Append(replay::Kind::kDiskCompletion, tag, result);
+      }
+      FinishRequest(tag, result);
+    });
+  }
+  SchedulePoll();
+  return absl::OkStatus();
+}
+
+absl::Status VirtioBlk::ReplayCompletions() {
+  const auto reap = [this] {
+    file_->Reap([this](const uint64_t tag, const int64_t result) { reaped_[tag] = result; });
+  };
+  reap();
+  while (true) {
+    ASSIGN_OR_RETURN(const bool due, input_log_->IsDue(replay::Kind::kDiskCompletion));
+    if (!due) {
+      return absl::OkStatus();
+    }
+    ASSIGN_OR_RETURN(const replay::Input input,
+                     input_log_->Take(replay::Kind::kDiskCompletion));
+    if (!in_flight_.contains(input.tag)) {
+      return absl::FailedPreconditionError(absl::StrCat(
+          "Replay diverged: virtio-blk request ", input.tag, " is not in flight"));
+    }
+    // The recording saw this request done by now; wait for the host.
+    while (!reaped_.contains(input.tag)) {
+      std::this_thread::yield();
+      reap();
+    }
+    reaped_.erase(input.tag);
+    // The recorded result wins, so the guest sees what it saw then.
+    FinishRequest(input.tag, input.value);
+  }
+}
+
+absl::Status VirtioBlk::Save(checkpoint::StateWriter& out) const {
+  if (!in_flight_.empty() || !reaped_.empty()) {
+    return absl::FailedPreconditionError("Disk requests are in flight");
+  }
+  out.U32(status_);
+  out.U32(device_features_sel_);
+  out.U32(driver_features_sel_);
+  out.U64(driver_features_);
+  out.U32(queue_sel_);
+  out.U32(queue_num_);
+  out.Bool(queue_ready_);
+  out.U64(desc_addr_);
+  out.U64(avail_addr_);
+  out.U64(used_addr_);
+  out.U16(last_avail_idx_);
+  out.U32(interrupt_status_);
+  out.U32(generation_);
+  // Replayed completions are matched by tag.
+  out.U64(next_tag_);
+  return absl::OkStatus();
+}
+
+absl::Status VirtioBlk::Load(checkpoint::StateReader& in) {
+  if (!in_flight_.empty()) {
+    return absl::FailedPreconditionError("Disk requests are in flight");
+  }
+  status_ = in.U32();
+  device_features_sel_ = in.U32();
+  driver_features_sel_ = in.U32();
+  driver_features_ = in.U64();
+  queue_sel_ = in.U32();
+  queue_num_ = in.U32();
+  queue_ready_ = in.Bool();
+  desc_addr_ = in.U64();
+  avail_addr_ = in.U64();
+  used_addr_ = in.U64();
+  last_avail_idx_ = in.U16();
+  interrupt_status_ = in.U32();
+  generation_ = in.U32();
+  next_tag_ = in.U64();
+  RETURN_IF_ERROR(in.GetStatus());
+  poll_event_.reset();
+  irq_(interrupt_status_ != 0);
+  return absl::OkStatus();
+}
+
+void VirtioBlk::DropRequests() {
+  while (!in_flight_.empty()) {
+    file_->Reap([this](const uint64_t tag, int64_t) {
+      const auto it = in_flight_.find(tag);
+      if (it == in_flight_.end()) {
+        return;
+      }
+      if (it->second.written > 1) {
+        // The host may have filled the buffers either way.
+        for (const struct iovec& iov : it->second.iov) {
+          dram_.NotifyHostWrite(iov.iov_base, iov.iov_len);
+        }
+      }
+      in_flight_.erase(it);
+    });
+    std::this_thread::yield();
+  }
+  reaped_.clear();
+  if (poll_event_.has_value()) {
+    scheduler_.Cancel(*poll_event_);
+    poll_event_.reset();
+  }
+}
+
+void VirtioBlk::SchedulePoll() {
+  if (poll_event_.has_value() || in_flight_.empty()) {
+    return;
+  }
+  poll_event_ = scheduler_.Schedule(clock_ + constants::kPollTicks, [this](uint64_t) {
+    poll_event_.reset();
+    return PollCompletions();
+  });
+}
+
+}  // namespace riscv_emu::perfs::virtio
@@ -0,0 +1,149 @@
+#ifndef LIB_PERFS_VIRTIO_BLK_H
+#define LIB_PERFS_VIRTIO_BLK_H
+
+#include <sys/uio.h>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "lib/checkpoint/state.h"
+#include "lib/memory/dram.h"
+#include "lib/perfs/async_file.h"
+#include "lib/perfs/irq.h"
+#include "lib/replay/input_log.h"
+#include "lib/sched/scheduler.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace riscv_emu::perfs::virtio {
+
+namespace constants {
+  // virtio-mmio (version 2) register offsets.
+  constexpr uint32_t kMagicValueOffset = 0x000;
+  constexpr uint32_t kVersionOffset = 0x004;
+  constexpr uint32_t kDeviceIdOffset = 0x008;
+  constexpr uint32_t kVendorIdOffset = 0x00c;
+  constexpr uint32_t kDeviceFeaturesOffset = 0x010;
+  constexpr uint32_t kDeviceFeaturesSelOffset = 0x014;
+  constexpr uint32_t kDriverFeaturesOffset = 0x020;
+  constexpr uint32_t kDriverFeaturesSelOffset = 0x024;
+  constexpr uint32_t kQueueSelOffset = 0x030;
+  constexpr uint32_t kQueueNumMaxOffset = 0x034;
+  constexpr uint32_t kQueueNumOffset = 0x038;
+  constexpr uint32_t kQueueReadyOffset = 0x044;
+  constexpr uint32_t kQueueNotifyOffset = 0x050;
+  constexpr uint32_t kInterruptStatusOffset = 0x060;
+  constexpr uint32_t kInterruptAckOffset = 0x064;
+  constexpr uint32_t kStatusOffset = 0x070;
+  constexpr uint32_t kQueueDescLowOffset = 0x080;
+  constexpr uint32_t kQueueDescHighOffset = 0x084;
+  constexpr uint32_t kQueueDriverLowOffset = 0x090;
+  constexpr uint32_t kQueueDriverHighOffset = 0x094;
+  constexpr uint32_t kQueueDeviceLowOffset = 0x0a0;
+  constexpr uint32_t kQueueDeviceHighOffset = 0x0a4;
+  constexpr uint32_t kConfigGenerationOffset = 0x0fc;
+  constexpr uint32_t kConfigCapacityLowOffset = 0x100;
+  constexpr uint32_t kConfigCapacityHighOffset = 0x104;
+  constexpr uint32_t kSize = 0x1000;
+
+  constexpr uint32_t kMagicValue = 0x74726976;  // "virt"
+  constexpr uint32_t kVersion = 2;
+  constexpr uint32_t kBlockDeviceId = 2;
+  constexpr uint32_t kVendorId = 0x554d4552;  // "REMU"
+  constexpr uint32_t kQueueNumMax = 128;
+  constexpr uint64_t kSectorSize = 512;
+
+  // Feature bits.
+  constexpr uint64_t kFeatureBlkReadOnly = 1ULL << 5;
+  constexpr uint64_t kFeatureBlkFlush = 1ULL << 9;
+  constexpr uint64_t kFeatureVersion1 = 1ULL << 32;
+
+  // How often in-flight requests are checked for completion.
+  constexpr uint64_t kPollTicks = 1000;
+}  // namespace constants
+
+// virtio-mmio block device backed by a host file. Request buffers are
+// handed to the host kernel as iovecs pointing straight into guest RAM,
+// and completions are picked up by a scheduler event that only exists
+// while requests are in flight, so the CPU never waits on the disk.
+class VirtioBlk final {
+ public:
+  static absl::StatusOr<std::unique_ptr<VirtioBlk>> Create(
+      absl::string_view path, bool read_only, memory::Dram& dram,
+      sched::Scheduler& scheduler, const uint64_t& clock, irq::Pin irq);
+  absl::StatusOr<uint32_t> Read(uint32_t offset) const;
+  absl::Status Write(uint32_t offset, uint32_t val);
+  // When recording, logs when each request completes; when replaying,
+  // completes requests exactly when the log says, waiting on the host if
+  // it is slower this time.
+  inline void SetInputLog(replay::InputLog* input_log) { input_log_ = input_log; }
+  // Checkpoints. Requests handed to the host cannot be saved, so saving
+  // fails until they have completed.
+  absl::Status Save(checkpoint::StateWriter& out) const;
+  absl::Status Load(checkpoint::StateReader& in);
+  // Waits for the host to finish every request in flight and drops them
+  // without completing them, e.g. before rolling RAM back to a state
+  // that predates them.
+  void DropRequests();
+
+ private:
+  struct Request {
+    uint16_t head;
+    // Device generation the request was submitted in; a reset makes it stale.
+    uint32_t generation;
+    std::vector<struct iovec> iov;
+    uint8_t* status;
+    // Bytes reported in the used ring on success.
+    uint32_t written;
+  };
+
+  VirtioBlk(std::unique_ptr<async_file::AsyncFile> file, bool read_only, memory::Dram& dram,
+            sched::Scheduler& scheduler, const uint64_t& clock, irq::Pin irq);
+  void Reset();
+  // Starts every request the driver made available since the last notify.
+  void ProcessQueue();
+  absl::Status StartRequest(uint16_t head);
+  void Complete(uint16_t head, uint8_t* status_ptr, uint32_t written, uint8_t status);
+  // Completes the request handed to the host as `tag` with `result`.
+  void FinishRequest(uint64_t tag, int64_t result);
+  absl::Status PollCompletions();
+  absl::Status ReplayCompletions();
+  void SchedulePoll();
+  uint64_t GetDeviceFeatures() const;
+
+  std::unique_ptr<async_file::AsyncFile> file_;
+  const bool read_only_;
+  memory::Dram& dram_;
+  sched::Scheduler& scheduler_;
+  const uint64_t& clock_;
+  irq::Pin irq_;
+
+  uint32_t status_ = 0;
+  uint32_t device_features_sel_ = 0;
+  uint32_t driver_features_sel_ = 0;
+  uint64_t driver_features_ = 0;
+  uint32_t queue_sel_ = 0;
+  uint32_t queue_num_ = 0;
+  bool queue_ready_ = false;
+  uint64_t desc_addr_ = 0;
+  uint64_t avail_addr_ = 0;
+  uint64_t used_addr_ = 0;
+  uint16_t last_avail_idx_ = 0;
+  uint32_t interrupt_status_ = 0;
+  uint32_t generation_ = 0;
+
+  // Keyed by the tag handed to the host. The map node keeps `iov` alive
+  // until the host kernel is done with it, even across a device reset.
+  std::unordered_map<uint64_t, Request> in_flight_;
+  uint64_t next_tag_ = 0;
+  std::optional<sched::EventId> poll_event_;
+  replay::InputLog* input_log_ = nullptr;
+  // Replaying: host results reaped before the log lets them complete.
+  std::unordered_map<uint64_t, int64_t> reaped_;
+};
+
+}  // namespace riscv_emu::perfs::virtio
+
+#endif  // LIB_PERFS_VIRTIO_BLK_H
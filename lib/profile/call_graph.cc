@@ -0,0 +1,242 @@
+#include "call_graph.h"
+#include <algorithm>
+#include <fstream>
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+
+namespace riscv_emu::profile {
+
+namespace {
+
+  bool IsLinkReg(const uint32_t reg) {
+    return reg == constants::kLinkReg || reg == constants::kAltLinkReg;
+  }
+
+  double Percent(const uint64_t part, const uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * part / whole;
+  }
+
+  // A callgrind cost line: the position, then the events in the order the
+  // header lists them.
+  std::string CostLine(const uint32_t position, const Cost& cost) {
+    return absl::StrFormat("0x%x %d %d %d %d\n", position, cost.instructions, cost.loads,
+                           cost.stores, cost.cycles);
+  }
+
+}  // namespace
+
+Cost& Cost::operator+=(const Cost& other) {
+  instructions += other.instructions;
+  loads += other.loads;
+  stores += other.stores;
+  cycles += other.cycles;
+  return *this;
+}
+
+Cost Cost::operator-(const Cost& other) const {
+  return {instructions - other.instructions, loads - other.loads, stores - other.stores,
+          cycles - other.cycles};
+}
+
+void CallGraph::SetSymbols(const absl::flat_hash_map<std::string, loader::Symbol>& functions) {
+  ranges_.clear();
+  for (const auto& [name, symbol] : functions) {
+    if (symbol.size == 0) {
+      continue;
+    }
+    ranges_.push_back({symbol.addr, symbol.size, static_cast<uint32_t>(functions_.size())});
+    functions_.push_back({.name = name, .addr = symbol.addr});
+    active_.push_back(0);
+  }
+  std::sort(ranges_.begin(), ranges_.end(),
+            [](const Range& a, const Range& b) { return a.addr < b.addr; });
+}
+
+uint32_t CallGraph::FunctionAt(const uint32_t pc) {
+  const auto it = std::upper_bound(ranges_.begin(), ranges_.end(), pc,
+                                   [](uint32_t pc, const Range& range) { return pc < range.addr; });
+  if (it != ranges_.begin() && pc - std::prev(it)->addr < std::prev(it)->size) {
+    return std::prev(it)->function;
+  }
+  const auto [unnamed, inserted] =
+      unnamed_.try_emplace(pc, static_cast<uint32_t>(functions_.size()));
+  if (inserted) {
+    functions_.push_back({.name = absl::StrFormat("0x%08x", pc), .addr = pc});
+    active_.push_back(0);
+  }
+  return unnamed->second;
+}
+
+void CallGraph::Push(const uint32_t function, const uint32_t return_addr, const Frame::Kind kind,
+                     const uint32_t site) {
+  uint32_t edge = 0;
+  if (kind != Frame::Kind::kRoot) {
+    if (stack_.size() >= constants::kMaxDepth) {
+      return;
+    }
+    const uint32_t caller = stack_.back().function;
+    const auto [it, inserted] =
+        edge_index_.try_emplace({caller, site, function}, static_cast<uint32_t>(edges_.size()));
+    if (inserted) {
+      edges_.push_back({.caller = caller, .site = site, .callee = function});
+    }
+    edge = it->second;
+    ++edges_[edge].calls;
+    ++functions_[function].calls;
+  }
+  ++active_[function];
+  stack_.push_back({function, return_addr, kind, edge, total_});
+}
+
+void CallGraph::Pop() {
+  const Frame& frame = stack_.back();
+  const Cost cost = total_ - frame.entry;
+  if (frame.kind != Frame::Kind::kRoot) {
+    edges_[frame.edge].inclusive += cost;
+  }
+  if (--active_[frame.function] == 0) {
+    functions_[frame.function].inclusive += cost;
+  }
+  stack_.pop_back();
+}
+
+void CallGraph::Retire(const uint32_t pc, const timing::InstrInfo& instr, const uint32_t target,
+                       const uint64_t cycles) {
+  if (stack_.empty()) {
+    Push(FunctionAt(pc), 0, Frame::Kind::kRoot, 0);
+  }
+  const Cost cost = {1, instr.kind == timing::InstrKind::kLoad,
+                     instr.kind == timing::InstrKind::kStore, cycles - last_cycles_};
+  last_cycles_ = cycles;
+  functions_[stack_.back().function].self += cost;
+  total_ += cost;
+  if (instr.kind != timing::InstrKind::kJump && instr.kind != timing::InstrKind::kIndirectJump) {
+    return;
+  }
+  const bool links = IsLinkReg(instr.rd);
+  if (instr.kind == timing::InstrKind::kIndirectJump && IsLinkReg(instr.rs1) &&
+      (!links || instr.rd != instr.rs1)) {
+    Return(target);
+  }
+  if (links) {
+    Push(FunctionAt(target), pc + 4, Frame::Kind::kCall, pc);
+  }
+}
+
+void CallGraph::Return(const uint32_t target) {
+  // Frames skipped over returned without a return of their own, e.g. by
+  // longjmp.
+  for (size_t i = stack_.size(); i-- > 0 && stack_[i].kind == Frame::Kind::kCall;) {
+    if (stack_[i].return_addr == target) {
+      while (stack_.size() > i) {
+        Pop();
+      }
+      return;
+    }
+  }
+  ++unmatched_returns_;
+}
+
+void CallGraph::Trap(const uint32_t epc, const uint32_t handler) {
+  if (stack_.empty()) {
+    Push(FunctionAt(epc), 0, Frame::Kind::kRoot, 0);
+  }
+  Push(FunctionAt(handler), epc, Frame::Kind::kTrap, epc);
+}
+
+void CallGraph::TrapReturn() {
+  for (size_t i = stack_.size(); i-- > 0;) {
+    if (stack_[i].kind == Frame::Kind::kTrap) {
+      while (stack_.size() > i) {
+        Pop();
+      }
+      return;
+    }
+  }
+  ++unmatched_returns_;
+}
+
+void CallGraph::Unwind() {
+  while (!stack_.empty()) {
+    Pop();
+  }
+}
+
+std::string CallGraph::FormatReport(const size_t top) const {
+  std::string report = absl::StrFormat(
+      "call graph: instructions %d, loads %d, stores %d, cycles %d, functions %d, call edges %d, "
+      "unmatched returns %d\nfunctions by inclusive cycles:\n",
+      total_.instructions, total_.loads, total_.stores, total_.cycles, functions_.size(),
+      edges_.size(), unmatched_returns_);
+  std::vector<uint32_t> order(functions_.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [this](const uint32_t a, const uint32_t b) {
+    return functions_[a].inclusive.cycles != functions_[b].inclusive.cycles
+               ? functions_[a].inclusive.cycles > functions_[b].inclusive.cycles
+               : a < b;
+  });
+  for (size_t i = 0; i < std::min(top, order.size()); ++i) {
+    const FunctionStats& function = functions_[order[i]];
+    if (function.inclusive.instructions == 0) {
+      break;
+    }
+    absl::StrAppendFormat(&report,
+                          "  %s: calls %d, inclusive %d instructions, %d cycles (%.1f%%), self "
+                          "%d instructions, %d cycles (%.1f%%), %d loads, %d stores\n",
+                          function.name, function.calls, function.inclusive.instructions,
+                          function.inclusive.cycles,
+                          Percent(function.inclusive.cycles, total_.cycles),
+                          function.self.instructions, function.self.cycles,
+                          Percent(function.self.cycles, total_.cycles), function.self.loads,
+                          function.self.stores);
+  }
+  return report;
+}
+
+absl::Status CallGraph::WriteCallgrind(const absl::string_view path) const {
+  std::ofstream out(std::string(path), std::ios::out | std::ios::trunc);
+  if (!out.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to create ", path));
+  }
+  out << "# callgrind format\nversion: 1\ncreator: riscv_emu\npositions: instr\n"
+      << "events: Ir Ld St Cy\n"
+      << absl::StrFormat("summary: %d %d %d %d\n", total_.instructions, total_.loads,
+                         total_.stores, total_.cycles)
+      << "\nfl=???\n";
+  // Names are written once and referred to by number after.
+  std::vector<bool> named(functions_.size());
+  const auto name = [&](const uint32_t function) {
+    if (named[function]) {
+      return absl::StrFormat("(%d)", function + 1);
+    }
+    named[function] = true;
+    return absl::StrFormat("(%d) %s", function + 1, functions_[function].name);
+  };
+  std::vector<std::vector<uint32_t>> calls(functions_.size());
+  for (uint32_t i = 0; i < edges_.size(); ++i) {
+    calls[edges_[i].caller].push_back(i);
+  }
+  for (uint32_t i = 0; i < functions_.size(); ++i) {
+    const FunctionStats& function = functions_[i];
+    if (function.self.instructions == 0 && calls[i].empty()) {
+      continue;
+    }
+    // Self cost is given at the entry point, which keeps the file small.
+    out << "\nfn=" << name(i) << "\n" << CostLine(function.addr, function.self);
+    for (const uint32_t edge : calls[i]) {
+      const CallEdge& call = edges_[edge];
+      out << "cfn=" << name(call.callee) << "\n"
+          << absl::StrFormat("calls=%d 0x%x\n", call.calls, functions_[call.callee].addr)
+          << CostLine(call.site, call.inclusive);
+    }
+  }
+  out.close();
+  if (out.fail()) {
+    return absl::DataLossError(absl::StrCat("Failed to write ", path));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace riscv_emu::profile
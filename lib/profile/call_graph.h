@@ -0,0 +1,128 @@
+#ifndef LIB_PROFILE_CALL_GRAPH_H
+#define LIB_PROFILE_CALL_GRAPH_H
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "lib/loader/elf.h"
+#include "lib/timing/pipeline.h"
+
+namespace riscv_emu::profile {
+
+namespace constants {
+  // Registers the calling convention links through (ra and t0).
+  constexpr uint32_t kLinkReg = 1;
+  constexpr uint32_t kAltLinkReg = 5;
+  // Calls beyond this depth are not tracked, which bounds the shadow
+  // stack of a guest that calls without returning.
+  constexpr size_t kMaxDepth = 1 << 16;
+}  // namespace constants
+
+struct Cost {
+  uint64_t instructions = 0;
+  uint64_t loads = 0;
+  uint64_t stores = 0;
+  uint64_t cycles = 0;
+
+  Cost& operator+=(const Cost& other);
+  Cost operator-(const Cost& other) const;
+};
+
+struct FunctionStats {
+  std::string name;
+  uint32_t addr = 0;
+  // Spent in the function itself, and in it and everything it called.
+  Cost self;
+  Cost inclusive;
+  uint64_t calls = 0;
+};
+
+struct CallEdge {
+  uint32_t caller = 0;
+  uint32_t site = 0;
+  uint32_t callee = 0;
+  uint64_t calls = 0;
+  Cost inclusive;
+};
+
+// An exact profile of the hart's calls, fed every retired instruction in
+// order. Calls and returns are the jal and jalr the calling convention
+// marks by linking through, or returning to, ra or t0; a shadow stack of
+// the functions entered attributes each instruction's cost to the one
+// running, and on return the cost of the whole call to its caller. Tail
+// calls stay in the frame that made them. Traps enter their handler as a
+// call from the code they interrupted, which xret returns from.
+class CallGraph final {
+ public:
+  CallGraph() = default;
+  // Names functions by the ELF's symbols; functions without one are named
+  // by address. Call before the first instruction.
+  void SetSymbols(const absl::flat_hash_map<std::string, loader::Symbol>& functions);
+  // `target` is where a taken transfer went. `cycles` is any counter that
+  // only goes up; its increase since the last instruction is this one's.
+  void Retire(uint32_t pc, const timing::InstrInfo& instr, uint32_t target, uint64_t cycles);
+  // The hart trapped into `handler` from `epc`.
+  void Trap(uint32_t epc, uint32_t handler);
+  // xret: returns from the innermost trap.
+  void TrapReturn();
+  // Returns from every open call, e.g. before the hart jumps elsewhere or
+  // the profile is read; the next instruction starts a new stack.
+  void Unwind();
+
+  inline const std::vector<FunctionStats>& GetFunctions() const { return functions_; }
+  inline const Cost& GetTotal() const { return total_; }
+  // The `top` functions by inclusive cycles. Call `Unwind` first to count
+  // calls still open.
+  std::string FormatReport(size_t top) const;
+  // Writes the profile in callgrind's format, for kcachegrind and
+  // callgrind_annotate. Call `Unwind` first to count calls still open.
+  absl::Status WriteCallgrind(absl::string_view path) const;
+
+ private:
+  struct Range {
+    uint32_t addr;
+    uint32_t size;
+    uint32_t function;
+  };
+  struct Frame {
+    uint32_t function;
+    // Where the caller resumes, for calls.
+    uint32_t return_addr;
+    enum class Kind : uint8_t { kRoot, kCall, kTrap } kind;
+    // Index into `edges_`; unused for roots.
+    uint32_t edge;
+    // `total_` on entry.
+    Cost entry;
+  };
+
+  // The function holding `pc`, added if new.
+  uint32_t FunctionAt(uint32_t pc);
+  void Push(uint32_t function, uint32_t return_addr, Frame::Kind kind, uint32_t site);
+  void Pop();
+  // Returns to `target` from the innermost call that resumes there.
+  void Return(uint32_t target);
+
+  // Sorted by address.
+  std::vector<Range> ranges_;
+  // Functions without a symbol, by the address they were entered at.
+  absl::flat_hash_map<uint32_t, uint32_t> unnamed_;
+  std::vector<FunctionStats> functions_;
+  // By (caller, site, callee).
+  absl::flat_hash_map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> edge_index_;
+  std::vector<CallEdge> edges_;
+  std::vector<Frame> stack_;
+  // Open frames per function, so that recursive calls count once in its
+  // inclusive cost.
+  std::vector<uint32_t> active_;
+  Cost total_;
+  uint64_t last_cycles_ = 0;
+  uint64_t unmatched_returns_ = 0;
+};
+
+}  // namespace riscv_emu::profile
+
+#endif  // LIB_PROFILE_CALL_GRAPH_H
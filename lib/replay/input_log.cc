@@ -0,0 +1,230 @@
+#include "input_log.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "status_macros.h"
+
+namespace riscv_emu::replay {
+
+namespace {
+
+  void PutVarint(std::string& out, uint64_t val) {
+    while (val >= 0x80) {
+      out.push_back(static_cast<char>(val | 0x80));
+      val >>= 7;
+    }
+    out.push_back(static_cast<char>(val));
+  }
+
+  absl::StatusOr<uint64_t> GetVarint(absl::string_view& in) {
+    uint64_t val = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+      if (in.empty()) {
+        break;
+      }
+      const uint8_t byte = in.front();
+      in.remove_prefix(1);
+      val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return val;
+      }
+    }
+    return absl::DataLossError("Truncated input log");
+  }
+
+  uint64_t ZigZag(const int64_t val) {
+    return (static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63);
+  }
+
+  int64_t UnZigZag(const uint64_t val) {
+    return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1);
+  }
+
+  const char* KindName(const Kind kind) {
+    switch (kind) {
+     case Kind::kDiskCompletion:
+      return "disk completion";
+     case Kind::kHostRead:
+      return "host read";
+     case Kind::kClockGettime:
+      return "clock_gettime";
+    }
+    return "unknown input";
+  }
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<InputLog>> InputLog::Record(
+    const absl::string_view path, const uint64_t& clock, const uint64_t& instret) {
+  std::unique_ptr<InputLog> log(new InputLog(/*recording=*/true, clock, instret));
+  log->out_.open(std::string(path), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!log->out_.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to create ", path));
+  }
+  log->buffer_.append(constants::kMagic, sizeof(constants::kMagic));
+  log->buffer_.push_back(static_cast<char>(constants::kVersion));
+  return log;
+}
+
+absl::StatusOr<std::unique_ptr<InputLog>> InputLog::Replay(
+    const absl::string_view path, const uint64_t& clock, const uint64_t& instret) {
+  std::ifstream input_file(std::string(path), std::ios::in | std::ios::binary);
+  if (!input_file.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to open ", path));
+  }
+  const std::string file((std::istreambuf_iterator<char>(input_file)),
+                         std::istreambuf_iterator<char>());
+  absl::string_view in(file);
+  if (in.size() < sizeof(constants::kMagic) + 1 ||
+      std::memcmp(in.data(), constants::kMagic, sizeof(constants::kMagic)) != 0 ||
+      static_cast<uint8_t>(in[sizeof(constants::kMagic)]) != constants::kVersion) {
+    return absl::InvalidArgumentError(absl::StrCat(path, " is not an input log"));
+  }
+  in.remove_prefix(sizeof(constants::kMagic) + 1);
+
+  std::unique_ptr<InputLog> log(new InputLog(/*recording=*/false, clock, instret));
+  uint64_t at_clock = 0;
+  uint64_t at_instret = 0;
+  while (!in.empty()) {
+    Input input;
+    input.kind = static_cast<Kind>(in.front());
+    in.remove_prefix(1);
+    ASSIGN_OR_RETURN(const uint64_t clock_delta, GetVarint(in));
+    ASSIGN_OR_RETURN(const uint64_t instret_delta, GetVarint(in));
+    ASSIGN_OR_RETURN(input.tag, GetVarint(in));
+    ASSIGN_OR_RETURN(const uint64_t value, GetVarint(in));
+    ASSIGN_OR_RETURN(const uint64_t len, GetVarint(in));
+    if (len > in.size()) {
+      return absl::DataLossError("Truncated input log");
+    }
+    at_clock += clock_delta;
+    at_instret += instret_delta;
+    input.clock = at_clock;
+    input.instret = at_instret;
+    input.value = UnZigZag(value);
+    input.data = std::string(in.substr(0, len));
+    in.remove_prefix(len);
+    log->inputs_.push_back(std::move(input));
+  }
+  VLOG(1) << "Replaying " << log->inputs_.size() << " inputs from " << path;
+  return log;
+}
+
+std::unique_ptr<InputLog> InputLog::Journal(const uint64_t& clock, const uint64_t& instret) {
+  std::unique_ptr<InputLog> log(new InputLog(/*recording=*/true, clock, instret));
+  log->KeepInputs();
+  return log;
+}
+
+InputLog::~InputLog() {
+  if (!recording_) {
+    if (next_ < inputs_.size()) {
+      LOG(WARNING) << "Replay ended with " << inputs_.size() - next_ << " inputs unused";
+    }
+    return;
+  }
+  if (!out_.is_open()) {
+    return;
+  }
+  Flush();
+  out_.close();
+  if (out_.fail()) {
+    LOG(ERROR) << "Failed to write the input log";
+  }
+}
+
+void InputLog::Append(const Kind kind, const uint64_t tag, const int64_t value,
+                      const absl::string_view data) {
+  if (keep_) {
+    inputs_.push_back(Input{kind, clock_, instret_, tag, value, std::string(data)});
+  }
+  if (!out_.is_open()) {
+    return;
+  }
+  buffer_.push_back(static_cast<char>(kind));
+  PutVarint(buffer_, clock_ - last_clock_);
+  PutVarint(buffer_, instret_ - last_instret_);
+  PutVarint(buffer_, tag);
+  PutVarint(buffer_, ZigZag(value));
+  PutVarint(buffer_, data.size());
+  buffer_.append(data.data(), data.size());
+  last_clock_ = clock_;
+  last_instret_ = instret_;
+  if (buffer_.size() >= constants::kFlushBytes) {
+    Flush();
+  }
+}
+
+void InputLog::Flush() {
+  out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  buffer_.clear();
+}
+
+absl::StatusOr<bool> InputLog::IsDue(const Kind kind) const {
+  if (next_ == inputs_.size()) {
+    return false;
+  }
+  const Input& input = inputs_[next_];
+  if (input.clock < clock_) {
+    return Diverged(absl::StrCat(KindName(input.kind), " due at clock ", input.clock,
+                                 " was never taken"));
+  }
+  return input.clock == clock_ && input.kind == kind;
+}
+
+absl::StatusOr<Input> InputLog::Take(const Kind kind) {
+  if (next_ == inputs_.size()) {
+    return Diverged(absl::StrCat(KindName(kind), " past the end of the log"));
+  }
+  Input& input = inputs_[next_];
+  if (input.kind != kind || input.clock != clock_ || input.instret != instret_) {
+    return Diverged(absl::StrCat(KindName(kind), " where the log has a ", KindName(input.kind),
+                                 " at clock ", input.clock, ", instret ", input.instret));
+  }
+  ++next_;
+  if (recording_ && next_ == inputs_.size()) {
+    // Caught up with where the rewind started; the host takes over again.
+    replaying_ = false;
+  }
+  if (keep_) {
+    return input;
+  }
+  return std::move(input);
+}
+
+absl::Status InputLog::Rewind(const uint64_t position) {
+  if (!keep_) {
+    return absl::FailedPreconditionError("The input log does not keep its inputs");
+  }
+  const uint64_t end = forgotten_ + inputs_.size();
+  if (position < forgotten_ || position > end) {
+    return absl::OutOfRangeError(absl::StrCat("Cannot rewind the input log to input ", position,
+                                              "; it holds ", forgotten_, " to ", end));
+  }
+  next_ = position - forgotten_;
+  replaying_ = !recording_ || next_ < inputs_.size();
+  return absl::OkStatus();
+}
+
+void InputLog::Forget(const uint64_t position) {
+  if (position <= forgotten_) {
+    return;
+  }
+  // Inputs not handed out yet stay.
+  const size_t count =
+      std::min<uint64_t>(position - forgotten_, replaying_ ? next_ : inputs_.size());
+  inputs_.erase(inputs_.begin(), inputs_.begin() + count);
+  forgotten_ += count;
+  if (replaying_) {
+    next_ -= count;
+  }
+}
+
+absl::Status InputLog::Diverged(const absl::string_view what) const {
+  return absl::FailedPreconditionError(absl::StrCat(
+      "Replay diverged at clock ", clock_, ", instret ", instret_, ": ", what));
+}
+
+}  // namespace riscv_emu::replay
@@ -0,0 +1,110 @@
+#ifndef LIB_REPLAY_INPUT_LOG_H
+#define LIB_REPLAY_INPUT_LOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace riscv_emu::replay {
+
+namespace constants {
+  constexpr char kMagic[4] = {'R', 'V', 'I', 'L'};
+  constexpr uint8_t kVersion = 1;
+  // Recorded inputs are written out in chunks of about this size.
+  constexpr size_t kFlushBytes = 64 * 1024;
+}  // namespace constants
+
+// Inputs whose value or arrival time depends on the host.
+enum class Kind : uint8_t {
+  kDiskCompletion = 0,  // tag: virtio request, value: host result
+  kHostRead = 1,  // tag: guest fd, value: read() result, data: bytes read
+  kClockGettime = 2,  // tag: clock id, value: result, data: the timespec
+};
+
+struct Input {
+  Kind kind;
+  // Virtual time and retired instructions when the input arrived.
+  uint64_t clock = 0;
+  uint64_t instret = 0;
+  uint64_t tag = 0;
+  int64_t value = 0;
+  std::string data;
+};
+
+// Log of every non-deterministic input delivered to the guest, for
+// reproducible runs. Recording appends each input with the virtual time
+// and instret it arrived at. Replaying hands the same inputs back at the
+// same points instead of asking the host, so the run repeats exactly
+// whichever engine executes it. Inputs are matched on virtual time, and
+// instret is checked against it, so any divergence is reported at the
+// first input where it shows rather than silently replaying garbage.
+//
+// The file is a header followed by one record per input: the kind, the
+// clock and instret as deltas from the previous input, the tag, the
+// zigzagged value and the data, all varint encoded.
+class InputLog final {
+ public:
+  static absl::StatusOr<std::unique_ptr<InputLog>> Record(
+      absl::string_view path, const uint64_t& clock, const uint64_t& instret);
+  static absl::StatusOr<std::unique_ptr<InputLog>> Replay(
+      absl::string_view path, const uint64_t& clock, const uint64_t& instret);
+  // Records into memory only, for rewinding.
+  static std::unique_ptr<InputLog> Journal(const uint64_t& clock, const uint64_t& instret);
+  // Flushes a recording; warns about inputs a replay never consumed.
+  ~InputLog();
+
+  inline bool IsReplaying() const { return replaying_; }
+  // Recording: logs an input arriving now.
+  void Append(Kind kind, uint64_t tag, int64_t value, absl::string_view data = "");
+  // Replaying: true if the next input is a `kind` due now. Fails if the
+  // next input was due earlier and never consumed.
+  absl::StatusOr<bool> IsDue(Kind kind) const;
+  // Replaying: consumes the next input, which must be a `kind` due now.
+  absl::StatusOr<Input> Take(Kind kind);
+
+  // Rewinding, for reverse execution. Once `KeepInputs` is called, a
+  // recording also keeps its inputs in memory and a replay keeps the ones
+  // it handed out. After `Rewind` to an earlier position, the inputs from
+  // there on are replayed, and a recording goes back to asking the host
+  // once they run out.
+  inline void KeepInputs() { keep_ = true; }
+  // Inputs delivered so far.
+  inline uint64_t GetPosition() const {
+    return forgotten_ + (replaying_ ? next_ : inputs_.size());
+  }
+  absl::Status Rewind(uint64_t position);
+  // Frees the inputs before `position`, which can no longer be rewound to.
+  void Forget(uint64_t position);
+
+ private:
+  InputLog(bool recording, const uint64_t& clock, const uint64_t& instret)
+      : recording_(recording), replaying_(!recording), clock_(clock), instret_(instret) {}
+  void Flush();
+  absl::Status Diverged(absl::string_view what) const;
+
+  const bool recording_;
+  // A recording replays after being rewound.
+  bool replaying_;
+  const uint64_t& clock_;
+  const uint64_t& instret_;
+  // Recording. A journal has no file.
+  std::ofstream out_;
+  std::string buffer_;
+  uint64_t last_clock_ = 0;
+  uint64_t last_instret_ = 0;
+  bool keep_ = false;
+  // Replaying, or kept from the recording.
+  std::vector<Input> inputs_;
+  size_t next_ = 0;
+  // Inputs dropped from the front of `inputs_` by `Forget`.
+  uint64_t forgotten_ = 0;
+};
+
+}  // namespace riscv_emu::replay
+
+#endif  // LIB_REPLAY_INPUT_LOG_H
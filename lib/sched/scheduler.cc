@@ -0,0 +1,90 @@
+#include "scheduler.h"
+#include <algorithm>
+#include "status_macros.h"
+#include "glog/logging.h"
+
+namespace riscv_emu::sched {
+
+namespace {
+
+// `std::*_heap` builds a max-heap, so order by "fires later".
+struct FiresLater {
+  template <typename T>
+  bool operator()(const T& lhs, const T& rhs) const {
+    if (lhs.deadline != rhs.deadline) {
+      return lhs.deadline > rhs.deadline;
+    }
+    return lhs.id > rhs.id;
+  }
+};
+
+}  // namespace
+
+void Scheduler::UpdateNextDeadline() {
+  next_deadline_ = heap_.empty() ? constants::kNever : heap_.front().deadline;
+}
+
+void Scheduler::Clear() {
+  heap_.clear();
+  UpdateNextDeadline();
+}
+
+EventId Scheduler::Schedule(const uint64_t deadline, Callback callback) {
+  const EventId id = next_id_++;
+  heap_.push_back(Event { deadline, id, /*background=*/false, std::move(callback) });
+  std::push_heap(heap_.begin(), heap_.end(), FiresLater());
+  UpdateNextDeadline();
+  VLOG(4) << "Scheduled event " << id << " at " << deadline;
+  return id;
+}
+
+EventId Scheduler::ScheduleBackground(const uint64_t deadline, Callback callback) {
+  const EventId id = next_id_++;
+  heap_.push_back(Event { deadline, id, /*background=*/true, std::move(callback) });
+  std::push_heap(heap_.begin(), heap_.end(), FiresLater());
+  UpdateNextDeadline();
+  VLOG(4) << "Scheduled background event " << id << " at " << deadline;
+  return id;
+}
+
+uint64_t Scheduler::NextWakeDeadline() const {
+  if (!heap_.empty() && !heap_.front().background) {
+    return heap_.front().deadline;
+  }
+  uint64_t deadline = constants::kNever;
+  for (const Event& event : heap_) {
+    if (!event.background) {
+      deadline = std::min(deadline, event.deadline);
+    }
+  }
+  return deadline;
+}
+
+bool Scheduler::Cancel(const EventId id) {
+  const auto it = std::find_if(heap_.begin(), heap_.end(),
+                               [id](const Event& event) { return event.id == id; });
+  if (it == heap_.end()) {
+    return false;
+  }
+  heap_.erase(it);
+  std::make_heap(heap_.begin(), heap_.end(), FiresLater());
+  UpdateNextDeadline();
+  return true;
+}
+
+absl::Status Scheduler::RunDue(const uint64_t now) {
+  while (!heap_.empty() && heap_.front().deadline <= now) {
+    std::pop_heap(heap_.begin(), heap_.end(), FiresLater());
+    Event event = std::move(heap_.back());
+    heap_.pop_back();
+    UpdateNextDeadline();
+    if (!event.background) {
+      ++wake_count_;
+    }
+    VLOG(4) << "Firing event " << event.id << " at " << now;
+    RETURN_IF_ERROR(event.callback(now));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace riscv_emu::sched
@@ -0,0 +1,67 @@
+#ifndef LIB_SCHED_SCHEDULER_H
+#define LIB_SCHED_SCHEDULER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "absl/status/status.h"
+
+namespace riscv_emu::sched {
+
+namespace constants {
+  // Deadline reported while no event is pending.
+  constexpr uint64_t kNever = UINT64_MAX;
+}  // namespace constants
+
+using EventId = uint64_t;
+
+// Invoked with the current virtual time once an event's deadline is reached.
+using Callback = std::function<absl::Status(uint64_t now)>;
+
+// Discrete-event queue keyed by virtual time (one tick per retired
+// instruction). Devices post events instead of being polled by the CPU,
+// so the cost of servicing them scales with the number of events.
+class Scheduler final {
+ public:
+  // Events with equal deadlines fire in the order they were scheduled.
+  EventId Schedule(uint64_t deadline, Callback callback);
+  // For the emulator's own bookkeeping rather than devices. A hart idling
+  // until the next event sleeps through background events, which fire
+  // late, once it wakes, and firing one does not count as a wakeup. So
+  // they never change what the guest observes.
+  EventId ScheduleBackground(uint64_t deadline, Callback callback);
+  // Returns false if the event already fired or was never scheduled.
+  bool Cancel(EventId id);
+  // Fires every event whose deadline is at or before `now`. Callbacks
+  // may schedule further events, including ones that are already due.
+  absl::Status RunDue(uint64_t now);
+  // Drops every pending event, e.g. before restoring devices that re-arm
+  // their own.
+  void Clear();
+  inline uint64_t NextDeadline() const { return next_deadline_; }
+  // Earliest deadline of an event that is not in the background.
+  uint64_t NextWakeDeadline() const;
+  // Events fired so far that were not in the background.
+  inline uint64_t GetWakeCount() const { return wake_count_; }
+  inline bool IsEmpty() const { return heap_.empty(); }
+
+ private:
+  struct Event {
+    uint64_t deadline;
+    EventId id;
+    bool background;
+    Callback callback;
+  };
+
+  void UpdateNextDeadline();
+
+  // Min-heap ordered by (deadline, id).
+  std::vector<Event> heap_;
+  EventId next_id_ = 1;
+  uint64_t next_deadline_ = constants::kNever;
+  uint64_t wake_count_ = 0;
+};
+
+}  // namespace riscv_emu::sched
+
+#endif  // LIB_SCHED_SCHEDULER_H
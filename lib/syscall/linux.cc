@@ -0,0 +1,239 @@
+#include "linux.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include "absl/strings/str_cat.h"
+#include "glog/logging.h"
+#include "status_macros.h"
+
+namespace riscv_emu::syscall {
+
+namespace {
+
+// Auxiliary vector tags (linux/auxvec.h).
+constexpr uint32_t kAtNull = 0;
+constexpr uint32_t kAtPageSz = 6;
+constexpr uint32_t kAtEntry = 9;
+constexpr uint32_t kAtSecure = 23;
+constexpr uint32_t kAtRandom = 25;
+
+constexpr uint32_t kAtFdCwd = static_cast<uint32_t>(-100);
+
+uint32_t Errno(const int err) {
+  return static_cast<uint32_t>(-err);
+}
+
+uint32_t PageAlignUp(const uint32_t addr) {
+  return (addr + constants::kPageSize - 1) & ~(constants::kPageSize - 1);
+}
+
+absl::Status PutWord(memory::Dram& dram, const uint32_t addr, const uint32_t val) {
+  ASSIGN_OR_RETURN(uint8_t* dst, dram.GetHostPtr(addr, sizeof(val)));
+  std::memcpy(dst, &val, sizeof(val));
+  dram.NotifyWrite(addr, sizeof(val));
+  return absl::OkStatus();
+}
+
+// Copies `s` with its NUL terminator just below `top` and returns its
+// guest address.
+absl::StatusOr<uint32_t> PushString(memory::Dram& dram, uint32_t& top, const std::string& s) {
+  if (s.size() + 1 > top) {
+    return absl::OutOfRangeError("Process arguments do not fit in memory");
+  }
+  top -= s.size() + 1;
+  ASSIGN_OR_RETURN(uint8_t* dst, dram.GetHostPtr(top, s.size() + 1));
+  std::memcpy(dst, s.c_str(), s.size() + 1);
+  dram.NotifyWrite(top, s.size() + 1);
+  return top;
+}
+
+}  // namespace
+
+LinuxSyscalls::LinuxSyscalls(memory::Dram& dram, hostcall::HostCalls& hostcalls)
+    : dram_(dram), hostcalls_(hostcalls) {}
+
+absl::StatusOr<uint32_t> LinuxSyscalls::SetupProcess(const loader::Image& image,
+                                                     const std::vector<std::string>& argv,
+                                                     const std::vector<std::string>& envp) {
+  const uint32_t stack_top = memory::constants::kDramSize & ~0xfU;
+  mmap_top_ = (stack_top - constants::kStackSize) & ~(constants::kPageSize - 1);
+  brk_start_ = PageAlignUp(image.end);
+  brk_ = brk_start_;
+  if (brk_start_ >= mmap_top_) {
+    return absl::OutOfRangeError("Program image overlaps the stack");
+  }
+
+  // Strings go at the very top, then the pointer vectors below them.
+  uint32_t top = stack_top;
+  // AT_RANDOM seeds stack protectors; a fixed value keeps runs repeatable.
+  ASSIGN_OR_RETURN(const uint32_t random, PushString(dram_, top, std::string(15, '\x5a')));
+  std::vector<uint32_t> argv_ptrs;
+  for (const std::string& arg : argv) {
+    ASSIGN_OR_RETURN(argv_ptrs.emplace_back(), PushString(dram_, top, arg));
+  }
+  std::vector<uint32_t> envp_ptrs;
+  for (const std::string& env : envp) {
+    ASSIGN_OR_RETURN(envp_ptrs.emplace_back(), PushString(dram_, top, env));
+  }
+
+  std::vector<uint32_t> words;
+  words.push_back(argv_ptrs.size());
+  words.insert(words.end(), argv_ptrs.begin(), argv_ptrs.end());
+  words.push_back(0);
+  words.insert(words.end(), envp_ptrs.begin(), envp_ptrs.end());
+  words.push_back(0);
+  for (const uint32_t aux : {kAtPageSz, constants::kPageSize, kAtEntry, image.entry,
+                             kAtSecure, 0U, kAtRandom, random, kAtNull, 0U}) {
+    words.push_back(aux);
+  }
+  const uint32_t sp = (top - words.size() * sizeof(uint32_t)) & ~0xfU;
+  if (sp < mmap_top_) {
+    return absl::OutOfRangeError("Process arguments overflow the stack");
+  }
+  for (size_t i = 0; i < words.size(); ++i) {
+    RETURN_IF_ERROR(PutWord(dram_, sp + i * sizeof(uint32_t), words[i]));
+  }
+  VLOG(1) << "Process stack at 0x" << std::hex << sp << ", heap at 0x" << brk_start_;
+  return sp;
+}
+
+absl::StatusOr<uint32_t> LinuxSyscalls::Call(const uint32_t number, const Args& args) {
+  VLOG(3) << "syscall " << std::dec << number;
+  switch (static_cast<Number>(number)) {
+   case Number::kRead:
+    return hostcalls_.Call(static_cast<uint32_t>(hostcall::Func::kRead), args);
+   case Number::kWrite:
+    return hostcalls_.Call(static_cast<uint32_t>(hostcall::Func::kWrite), args);
+   case Number::kWritev:
+    return Writev(args);
+   case Number::kOpenat:
+    if (args[0] != kAtFdCwd) {
+      return Errno(ENOTSUP);
+    }
+    return hostcalls_.Call(static_cast<uint32_t>(hostcall::Func::kOpen),
+                           {args[1], args[2], args[3]});
+   case Number::kClose:
+    return hostcalls_.Call(static_cast<uint32_t>(hostcall::Func::kClose), args);
+   case Number::kExit:
+   case Number::kExitGroup:
+    return hostcalls_.Call(static_cast<uint32_t>(hostcall::Func::kExit), args);
+   case Number::kBrk:
+    return Brk(args[0]);
+   case Number::kMmap:
+    return Mmap(args);
+   case Number::kMunmap:
+    // Mappings are never reused, so unmapping only has to succeed.
+    return 0;
+   case Number::kClockGettime64:
+    return ClockGettime(args);
+   case Number::kIoctl:
+    return Errno(ENOTTY);
+   case Number::kSetTidAddress:
+    return 1;  // The only thread's tid.
+   default:
+    LOG_FIRST_N(WARNING, 8) << "Unsupported syscall " << std::dec << number;
+    return Errno(ENOSYS);
+  }
+}
+
+uint32_t LinuxSyscalls::Brk(const uint32_t addr) {
+  if (addr < brk_start_ || addr > mmap_top_) {
+    return brk_;
+  }
+  if (addr > brk_) {
+    // Memory released by an earlier shrink must read back as zero.
+    dram_.Fill(brk_, addr - brk_, 0).IgnoreError();
+  }
+  brk_ = addr;
+  return brk_;
+}
+
+uint32_t LinuxSyscalls::Mmap(const Args& args) {
+  const uint32_t len = PageAlignUp(args[1]);
+  const uint32_t flags = args[3];
+  if (!(flags & MAP_ANONYMOUS) || (flags & MAP_FIXED)) {
+    LOG_FIRST_N(WARNING, 1) << "Only anonymous, non-fixed mmap is supported";
+    return Errno(ENODEV);
+  }
+  if (len == 0 || len > mmap_top_ - brk_) {
+    return Errno(ENOMEM);
+  }
+  mmap_top_ -= len;
+  dram_.Fill(mmap_top_, len, 0).IgnoreError();
+  return mmap_top_;
+}
+
+absl::StatusOr<uint32_t> LinuxSyscalls::Writev(const Args& args) {
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < args[2]; ++i) {
+    absl::StatusOr<uint8_t*> iov = dram_.GetHostPtr(args[1] + i * 8, 8);
+    if (!iov.ok()) {
+      return Errno(EFAULT);
+    }
+    uint32_t base, len;
+    std::memcpy(&base, *iov, sizeof(base));
+    std::memcpy(&len, *iov + 4, sizeof(len));
+    ASSIGN_OR_RETURN(const uint32_t n, hostcalls_.Call(
+        static_cast<uint32_t>(hostcall::Func::kWrite), {args[0], base, len}));
+    if (static_cast<int32_t>(n) < 0) {
+      return total > 0 ? total : n;
+    }
+    total += n;
+    if (n < len) {
+      break;
+    }
+  }
+  return total;
+}
+
+absl::StatusOr<uint32_t> LinuxSyscalls::ClockGettime(const Args& args) {
+  // struct __kernel_timespec: two 64-bit fields.
+  int64_t fields[2];
+  if (input_log_ != nullptr && input_log_->IsReplaying()) {
+    ASSIGN_OR_RETURN(const replay::Input input, input_log_->Take(replay::Kind::kClockGettime));
+    if (input.value < 0) {
+      return static_cast<uint32_t>(input.value);
+    }
+    if (input.data.size() != sizeof(fields)) {
+      return absl::DataLossError("Malformed clock_gettime input");
+    }
+    std::memcpy(fields, input.data.data(), sizeof(fields));
+  } else {
+    struct timespec ts = {};
+    const int64_t result = clock_gettime(static_cast<clockid_t>(args[0]), &ts) < 0 ? -errno : 0;
+    fields[0] = ts.tv_sec;
+    fields[1] = ts.tv_nsec;
+    if (input_log_ != nullptr) {
+      input_log_->Append(replay::Kind::kClockGettime, args[0], result,
+                         result < 0 ? "" : absl::string_view(
+                             reinterpret_cast<const char*>(fields), sizeof(fields)));
+    }
+    if (result < 0) {
+      return static_cast<uint32_t>(result);
+    }
+  }
+  absl::StatusOr<uint8_t*> dst = dram_.GetHostPtr(args[1], sizeof(fields));
+  if (!dst.ok()) {
+    return Errno(EFAULT);
+  }
+  std::memcpy(*dst, fields, sizeof(fields));
+  dram_.NotifyWrite(args[1], sizeof(fields));
+  return 0;
+}
+
+void LinuxSyscalls::Save(checkpoint::StateWriter& out) const {
+  out.U32(brk_start_);
+  out.U32(brk_);
+  out.U32(mmap_top_);
+}
+
+absl::Status LinuxSyscalls::Load(checkpoint::StateReader& in) {
+  brk_start_ = in.U32();
+  brk_ = in.U32();
+  mmap_top_ = in.U32();
+  return in.GetStatus();
+}
+
+}  // namespace riscv_emu::syscall
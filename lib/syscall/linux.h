@@ -0,0 +1,88 @@
+#ifndef LIB_SYSCALL_LINUX_H
+#define LIB_SYSCALL_LINUX_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "lib/checkpoint/state.h"
+#include "lib/hostcall/hostcall.h"
+#include "lib/loader/elf.h"
+#include "lib/memory/dram.h"
+#include "lib/replay/input_log.h"
+
+namespace riscv_emu::syscall {
+
+namespace constants {
+  // Linux RV32 calling convention: a7 holds the number, a0-a5 the
+  // arguments and a0 the result (or -errno).
+  constexpr uint32_t kNumberReg = 17;  // a7
+  constexpr uint32_t kArgReg = 10;  // a0
+  constexpr size_t kNumArgs = 6;
+
+  constexpr uint32_t kPageSize = 4096;
+  constexpr uint32_t kStackSize = 64 * 1024;
+}  // namespace constants
+
+// Generic (asm-generic/unistd.h) syscall numbers, with the time64 variants
+// RV32 uses.
+enum class Number : uint32_t {
+  kIoctl = 29,
+  kOpenat = 56,
+  kClose = 57,
+  kRead = 63,
+  kWrite = 64,
+  kWritev = 66,
+  kExit = 93,
+  kExitGroup = 94,
+  kSetTidAddress = 96,
+  kBrk = 214,
+  kMunmap = 215,
+  kMmap = 222,
+  kClockGettime64 = 403,
+};
+
+using Args = std::array<uint32_t, constants::kNumArgs>;
+
+// User-mode Linux personality: the guest runs as a single process and its
+// ecalls are forwarded to host syscalls on guest buffers. File descriptors
+// are shared with the host-call interface.
+class LinuxSyscalls final {
+ public:
+  LinuxSyscalls(memory::Dram& dram, hostcall::HostCalls& hostcalls);
+
+  // Lays out argv, envp and the auxiliary vector at the top of guest
+  // memory and sets up the heap after `image`. Returns the initial sp.
+  absl::StatusOr<uint32_t> SetupProcess(const loader::Image& image,
+                                        const std::vector<std::string>& argv,
+                                        const std::vector<std::string>& envp);
+  // Returns the value for a0. Unsupported syscalls return -ENOSYS.
+  absl::StatusOr<uint32_t> Call(uint32_t number, const Args& args);
+  // Records the host clock readings, or replays them. Reads go through
+  // the host calls, which have their own log.
+  inline void SetInputLog(replay::InputLog* input_log) { input_log_ = input_log; }
+  // The process layout, for checkpoints.
+  void Save(checkpoint::StateWriter& out) const;
+  absl::Status Load(checkpoint::StateReader& in);
+
+ private:
+  uint32_t Brk(uint32_t addr);
+  uint32_t Mmap(const Args& args);
+  absl::StatusOr<uint32_t> Writev(const Args& args);
+  absl::StatusOr<uint32_t> ClockGettime(const Args& args);
+
+  memory::Dram& dram_;
+  hostcall::HostCalls& hostcalls_;
+  // Program break and its lower bound.
+  uint32_t brk_start_ = 0;
+  uint32_t brk_ = 0;
+  // Anonymous mappings grow down from below the stack towards the break.
+  uint32_t mmap_top_ = 0;
+  replay::InputLog* input_log_ = nullptr;
+};
+
+}  // namespace riscv_emu::syscall
+
+#endif  // LIB_SYSCALL_LINUX_H
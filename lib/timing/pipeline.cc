@@ -0,0 +1,164 @@
+#include "pipeline.h"
+#include <algorithm>
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "lib/logic/opcodes.h"
+
+namespace riscv_emu::timing {
+
+namespace {
+
+  constexpr uint32_t kMulDivFunct7 = 0b0000001;
+  // funct3 of the first divide; the multiplies sit below it.
+  constexpr uint32_t kFirstDivFunct3 = 0b100;
+
+  constexpr std::array<const char*, static_cast<size_t>(Stall::kNumStalls)> kStallNames = {
+      "load-use", "data", "memory", "execute", "control", "serialize", "trap"};
+
+  uint8_t Rd(const uint32_t instr) { return (instr >> 7) & 0x1f; }
+  uint8_t Rs1(const uint32_t instr) { return (instr >> 15) & 0x1f; }
+  uint8_t Rs2(const uint32_t instr) { return (instr >> 20) & 0x1f; }
+
+}  // namespace
+
+InstrInfo Classify(const uint32_t instr) {
+  switch (static_cast<logic::Opcode>(instr & logic::constants::kOpcodeMask)) {
+   case logic::Opcode::kRType:
+    if ((instr >> 25) == kMulDivFunct7) {
+      const bool divides = ((instr >> 12) & 0b111) >= kFirstDivFunct3;
+      return {divides ? InstrKind::kDiv : InstrKind::kMul, Rd(instr), Rs1(instr), Rs2(instr)};
+    }
+    return {InstrKind::kAlu, Rd(instr), Rs1(instr), Rs2(instr)};
+   case logic::Opcode::kIType:
+    return {InstrKind::kAlu, Rd(instr), Rs1(instr), 0};
+   case logic::Opcode::kLuiType:
+   case logic::Opcode::kAuiPcType:
+    return {InstrKind::kAlu, Rd(instr), 0, 0};
+   case logic::Opcode::kLType:
+    return {InstrKind::kLoad, Rd(instr), Rs1(instr), 0};
+   case logic::Opcode::kSType:
+    return {InstrKind::kStore, 0, Rs1(instr), Rs2(instr)};
+   case logic::Opcode::kBType:
+    return {InstrKind::kBranch, 0, Rs1(instr), Rs2(instr)};
+   case logic::Opcode::kJalType:
+    return {InstrKind::kJump, Rd(instr), 0, 0};
+   case logic::Opcode::kJalrType:
+    return {InstrKind::kIndirectJump, Rd(instr), Rs1(instr), 0};
+   default:
+    // csr*i encode an immediate in rs1, which costs at most a false
+    // dependency before a drain.
+    return {InstrKind::kSystem, Rd(instr), Rs1(instr), 0};
+  }
+}
+
+Pipeline::Pipeline(const PipelineConfig& config) : config_(config) {}
+
+void Pipeline::Hold(const uint64_t cycle, const Stall cause) {
+  if (cycle > fetch_ready_) {
+    fetch_ready_ = cycle;
+    fetch_cause_ = cause;
+  }
+}
+
+void Pipeline::Retire(const InstrInfo& instr, const bool redirect) {
+  uint64_t issue = issue_ + 1;
+  Stall cause = Stall::kNumStalls;
+  const auto wait = [&](const uint64_t cycle, const Stall why) {
+    if (cycle > issue) {
+      issue = cycle;
+      cause = why;
+    }
+  };
+  wait(fetch_ready_, fetch_cause_);
+  wait(ex_free_, Stall::kExecute);
+  // MEM is entered the cycle after EX.
+  wait(mem_free_ > 0 ? mem_free_ - 1 : 0, Stall::kMemory);
+  for (const uint8_t reg : {instr.rs1, instr.rs2}) {
+    if (reg != 0) {
+      wait(ready_[reg], ready_cause_[reg]);
+    }
+  }
+  if (cause != Stall::kNumStalls) {
+    stats_.stalls[static_cast<size_t>(cause)] += issue - (issue_ + 1);
+  }
+  issue_ = issue;
+  ++stats_.instructions;
+
+  // Cycle the result can be forwarded into EX; without forwarding,
+  // consumers read it in ID once WB has written it.
+  uint64_t result = issue + 1;
+  uint64_t writeback = issue + 2;
+  Stall result_cause = Stall::kData;
+  switch (instr.kind) {
+   case InstrKind::kLoad:
+    mem_free_ = issue + 1 + config_.load_latency;
+    result = mem_free_;
+    writeback = mem_free_;
+    result_cause = Stall::kLoadUse;
+    break;
+   case InstrKind::kStore:
+    mem_free_ = issue + 1 + config_.store_latency;
+    break;
+   case InstrKind::kMul:
+   case InstrKind::kDiv:
+    ex_free_ = issue + (instr.kind == InstrKind::kMul ? config_.mul_latency : config_.div_latency);
+    result = ex_free_;
+    writeback = ex_free_ + 1;
+    break;
+   case InstrKind::kBranch:
+   case InstrKind::kIndirectJump:
+    if (redirect) {
+      Hold(issue + 1 + config_.branch_penalty, Stall::kControl);
+    }
+    break;
+   case InstrKind::kJump:
+    if (redirect) {
+      Hold(issue + 1 + config_.jump_penalty, Stall::kControl);
+    }
+    break;
+   case InstrKind::kSystem:
+    Hold(issue + 1 + config_.serialize_penalty, Stall::kSerialize);
+    break;
+   case InstrKind::kAlu:
+    break;
+  }
+  if (instr.rd != 0) {
+    ready_[instr.rd] = config_.forwarding ? result : writeback + 1;
+    ready_cause_[instr.rd] = result_cause;
+  }
+}
+
+void Pipeline::Trap() {
+  Hold(issue_ + 1 + config_.trap_penalty, Stall::kTrap);
+}
+
+uint64_t Pipeline::GetCycles() const {
+  if (stats_.instructions == 0) {
+    return 0;
+  }
+  // The last instruction's MEM and WB, or its tail in a busy unit.
+  return std::max({issue_ + 3, mem_free_ + 1, ex_free_ + 2});
+}
+
+std::string Pipeline::FormatReport() const {
+  const uint64_t cycles = GetCycles();
+  const double instructions = std::max<uint64_t>(stats_.instructions, 1);
+  uint64_t stalled = 0;
+  for (const uint64_t stall : stats_.stalls) {
+    stalled += stall;
+  }
+  std::string report = absl::StrFormat(
+      "pipeline (%s, load %d, store %d, mul %d, div %d, branch penalty %d, jump penalty %d): "
+      "instructions %d, cycles %d, CPI %.3f\n  base %.3f",
+      config_.forwarding ? "forwarding" : "no forwarding", config_.load_latency,
+      config_.store_latency, config_.mul_latency, config_.div_latency, config_.branch_penalty,
+      config_.jump_penalty, stats_.instructions, cycles, cycles / instructions,
+      (cycles - stalled) / instructions);
+  for (size_t i = 0; i < stats_.stalls.size(); ++i) {
+    absl::StrAppendFormat(&report, ", %s +%.3f (%d cycles)", kStallNames[i],
+                          stats_.stalls[i] / instructions, stats_.stalls[i]);
+  }
+  return report;
+}
+
+}  // namespace riscv_emu::timing
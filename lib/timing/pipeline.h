@@ -0,0 +1,117 @@
+#ifndef LIB_TIMING_PIPELINE_H
+#define LIB_TIMING_PIPELINE_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace riscv_emu::timing {
+
+enum class InstrKind : uint8_t {
+  kAlu,
+  kLoad,
+  kStore,
+  kBranch,
+  // jal.
+  kJump,
+  // jalr.
+  kIndirectJump,
+  // M extension, for when the hart implements it.
+  kMul,
+  kDiv,
+  // CSR accesses, fences and environment calls, which drain the pipeline.
+  kSystem,
+};
+
+// What the pipeline needs to know about an instruction. Registers an
+// instruction does not read or write are 0.
+struct InstrInfo {
+  InstrKind kind = InstrKind::kAlu;
+  uint8_t rd = 0;
+  uint8_t rs1 = 0;
+  uint8_t rs2 = 0;
+};
+
+InstrInfo Classify(uint32_t instr);
+
+struct PipelineConfig {
+  // Results are forwarded from EX and MEM; otherwise consumers wait for
+  // writeback.
+  bool forwarding = true;
+  // Cycles loads and stores spend in MEM.
+  uint32_t load_latency = 1;
+  uint32_t store_latency = 1;
+  // Cycles multiplies and divides spend in EX.
+  uint32_t mul_latency = 3;
+  uint32_t div_latency = 34;
+  // Bubbles after a redirect found in EX (branches, jalr) and in ID (jal).
+  uint32_t branch_penalty = 2;
+  uint32_t jump_penalty = 1;
+  // Bubbles while the pipeline drains for a system instruction or a trap.
+  uint32_t serialize_penalty = 4;
+  uint32_t trap_penalty = 4;
+};
+
+enum class Stall : uint8_t {
+  // A load's result was needed by the next instructions.
+  kLoadUse,
+  // A result was needed before it could be forwarded or written back.
+  kData,
+  // MEM was busy with a slow load or store.
+  kMemory,
+  // EX was busy with a multiply or divide.
+  kExecute,
+  kControl,
+  kSerialize,
+  kTrap,
+  kNumStalls,
+};
+
+struct PipelineStats {
+  uint64_t instructions = 0;
+  std::array<uint64_t, static_cast<size_t>(Stall::kNumStalls)> stalls = {};
+};
+
+// Timing of a classic in-order IF/ID/EX/MEM/WB pipeline, driven by the
+// instructions the hart retires, in order. Each instruction enters EX a
+// cycle after the one before unless a hazard holds it back; the cycles
+// lost are charged to the hazard that held it longest.
+//
+// The front end falls through by default, so every taken transfer is a
+// redirect; callers with a branch predictor pass its verdict instead.
+class Pipeline final {
+ public:
+  explicit Pipeline(const PipelineConfig& config);
+  // `redirect` is set if the front end fetched the wrong path after it.
+  void Retire(const InstrInfo& instr, bool redirect);
+  // The instruction being fetched trapped, or an interrupt was taken.
+  void Trap();
+  // Cycles until the last retired instruction leaves WB.
+  uint64_t GetCycles() const;
+  inline const PipelineStats& GetStats() const { return stats_; }
+  // CPI, broken down by stall cause.
+  std::string FormatReport() const;
+
+ private:
+  // Holds back whatever enters EX next until `cycle`.
+  void Hold(uint64_t cycle, Stall cause);
+
+  PipelineConfig config_;
+  // Cycle the last instruction entered EX. The first enters at 2, after
+  // IF and ID.
+  uint64_t issue_ = 1;
+  // First cycle EX and MEM are free again.
+  uint64_t ex_free_ = 0;
+  uint64_t mem_free_ = 0;
+  // First cycle the next instruction can enter EX, due to fetch.
+  uint64_t fetch_ready_ = 0;
+  Stall fetch_cause_ = Stall::kControl;
+  // First cycle each register can be read in EX, and what it waits for.
+  std::array<uint64_t, 32> ready_ = {};
+  std::array<Stall, 32> ready_cause_ = {};
+  PipelineStats stats_;
+};
+
+}  // namespace riscv_emu::timing
+
+#endif  // LIB_TIMING_PIPELINE_H
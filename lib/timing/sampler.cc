@@ -0,0 +1,68 @@
+#include "sampler.h"
+#include <algorithm>
+#include <cmath>
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+
+namespace riscv_emu::timing {
+
+absl::Status Validate(const SamplingConfig& config) {
+  if (config.measure == 0) {
+    return absl::InvalidArgumentError("Sampling needs a measurement window");
+  }
+  if (config.warmup > config.period || config.measure > config.period - config.warmup) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "A ", config.warmup, " tick warm-up and ", config.measure,
+        " tick measurement do not fit in a ", config.period, " tick period"));
+  }
+  return absl::OkStatus();
+}
+
+Sampler::Sampler(const SamplingConfig& config) : config_(config) {}
+
+void Sampler::AddWindow(const uint64_t instructions, const uint64_t cycles) {
+  if (instructions == 0) {
+    return;
+  }
+  const double cpi = static_cast<double>(cycles) / instructions;
+  ++windows_;
+  instructions_ += instructions;
+  sum_ += cpi;
+  sum_squares_ += cpi * cpi;
+}
+
+double Sampler::GetMeanCpi() const {
+  return windows_ == 0 ? 0.0 : sum_ / windows_;
+}
+
+std::optional<double> Sampler::GetConfidence() const {
+  if (windows_ < 2) {
+    return std::nullopt;
+  }
+  const double mean = GetMeanCpi();
+  const double variance =
+      std::max(0.0, (sum_squares_ - windows_ * mean * mean) / (windows_ - 1));
+  return constants::kZ95 * std::sqrt(variance / windows_);
+}
+
+std::string Sampler::FormatReport(const uint64_t instructions) const {
+  std::string report = absl::StrFormat(
+      "sampling (%d tick warm-up and %d tick measurement every %d ticks): %d windows, %d "
+      "instructions measured of %d",
+      config_.warmup, config_.measure, config_.period, windows_, instructions_, instructions);
+  if (windows_ == 0) {
+    return report;
+  }
+  const double mean = GetMeanCpi();
+  const std::optional<double> confidence = GetConfidence();
+  if (confidence.has_value()) {
+    absl::StrAppendFormat(&report, ", CPI %.3f +/- %.3f (95%%), cycles %.0f +/- %.0f", mean,
+                          *confidence, mean * instructions, *confidence * instructions);
+  } else {
+    absl::StrAppendFormat(&report, ", CPI %.3f (one window, no interval), cycles %.0f", mean,
+                          mean * instructions);
+  }
+  return report;
+}
+
+}  // namespace riscv_emu::timing
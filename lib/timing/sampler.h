@@ -0,0 +1,55 @@
+#ifndef LIB_TIMING_SAMPLER_H
+#define LIB_TIMING_SAMPLER_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include "absl/status/status.h"
+
+namespace riscv_emu::timing {
+
+namespace constants {
+  // Normal quantile of a two-sided 95% confidence interval.
+  constexpr double kZ95 = 1.96;
+}  // namespace constants
+
+// Periodic sampling, SMARTS style. Every `period` ticks the detailed
+// models warm up for `warmup` ticks, then measure for `measure` ticks; the
+// rest of the period runs without them.
+struct SamplingConfig {
+  uint64_t period = 0;
+  uint64_t warmup = 0;
+  uint64_t measure = 0;
+};
+
+// The measurement must be nonempty and fit in the period with its warm-up.
+absl::Status Validate(const SamplingConfig& config);
+
+// Estimates CPI from the windows measured.
+class Sampler final {
+ public:
+  explicit Sampler(const SamplingConfig& config);
+  // A window ran `instructions` in `cycles`. Empty windows, e.g. spent
+  // idle in wfi, are skipped.
+  void AddWindow(uint64_t instructions, uint64_t cycles);
+  inline uint64_t GetWindows() const { return windows_; }
+  // Mean CPI over the windows, each weighted alike.
+  double GetMeanCpi() const;
+  // Half width of the 95% confidence interval of the mean; absent with
+  // fewer than two windows.
+  std::optional<double> GetConfidence() const;
+  inline const SamplingConfig& GetConfig() const { return config_; }
+  // Includes the cycles estimated for `instructions`, the whole run.
+  std::string FormatReport(uint64_t instructions) const;
+
+ private:
+  SamplingConfig config_;
+  uint64_t windows_ = 0;
+  uint64_t instructions_ = 0;
+  double sum_ = 0;
+  double sum_squares_ = 0;
+};
+
+}  // namespace riscv_emu::timing
+
+#endif  // LIB_TIMING_SAMPLER_H
@@ -1,25 +1,343 @@
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "absl/status/status.h"
+#include "absl/strings/numbers.h"
 #include "glog/logging.h"
 #include "lib/cpu/cpu.h"
 #include "gflags/gflags.h"
 
+DEFINE_bool(sleep_on_wfi, false,
+            "Sleep the host thread while the guest idles in wfi instead of "
+            "only fast-forwarding virtual time.");
+DEFINE_string(disk_image, "", "Host file backing the virtio block device.");
+DEFINE_bool(disk_read_only, false, "Expose the disk image read-only.");
+DEFINE_string(elf, "", "Static RV32 ELF executable to boot instead of the raw image.");
+DEFINE_bool(user_mode, false,
+            "Run --elf as a Linux user process. Remaining command-line "
+            "arguments are passed to it as argv[1..].");
+DEFINE_bool(patch_libc, false,
+            "Redirect memcpy/memset/memcmp/strlen in --elf to native host calls.");
+DEFINE_uint64(code_cache_kb, riscv_emu::engine::constants::kDefaultCodeCacheBytes >> 10,
+              "Memory budget for predecoded code blocks. 0 interprets every "
+              "instruction.");
+DEFINE_uint32(compile_threads, riscv_emu::engine::constants::kDefaultCompileThreads,
+              "Background threads compiling hot blocks. 0 compiles on the "
+              "guest thread.");
+DEFINE_uint32(tier_up_threshold, riscv_emu::engine::constants::kDefaultTierUpThreshold,
+              "Interpreted runs of a block before it is compiled.");
+DEFINE_bool(code_cache_stats, false, "Log code cache statistics on exit.");
+DEFINE_uint32(lockstep_every, 0,
+              "Check every Nth compiled block against the interpreter; 0 disables checking.");
+DEFINE_string(record_inputs, "", "Log every input that depends on the host to this file.");
+DEFINE_string(replay_inputs, "",
+              "Replay the inputs logged by --record_inputs instead of asking the host.");
+DEFINE_uint64(history_interval, 0,
+              "Snapshot the machine every this many ticks for reverse execution; 0 "
+              "disables it.");
+DEFINE_uint64(history_mb, riscv_emu::history::constants::kDefaultBudgetBytes >> 20,
+              "Memory cap for reverse-execution snapshots; the oldest are dropped beyond it.");
+DEFINE_uint64(step_back, 0,
+              "Once the guest stops, go back this many instructions and log where the hart "
+              "was. Needs --history_interval.");
+DEFINE_string(last_write_to, "",
+              "Once the guest stops, go back to the last store to this 0x-prefixed physical "
+              "address and log the instruction that made it. Needs --history_interval.");
+DEFINE_string(restore_checkpoint, "",
+              "Resume from this checkpoint instead of booting. Pass the same --disk_image "
+              "and --user_mode it was saved with.");
+DEFINE_string(save_checkpoint, "", "Save a checkpoint to this file, then keep running.");
+DEFINE_uint32(checkpoint_pc, 0,
+              "Guest pc at which --save_checkpoint is taken, the first time a run of "
+              "instructions starts there (a jump or branch target). 0 saves when the guest "
+              "stops.");
+DEFINE_bool(incremental_checkpoint, false,
+            "Store only the RAM changed since --restore_checkpoint, which the new "
+            "checkpoint then depends on.");
+DEFINE_bool(cache_sim, false,
+            "Simulate L1 and L2 caches over the guest's RAM accesses and log hit and miss "
+            "counts per pc and data region on exit.");
+DEFINE_string(l1i_cache, "32k:8:64",
+              "L1 instruction cache for --cache_sim as <size>:<ways>:<line bytes>, optionally "
+              "followed by :plru, :wt (write through) and :nwa (no write allocate).");
+DEFINE_string(l1d_cache, "32k:8:64", "L1 data cache for --cache_sim, as --l1i_cache.");
+DEFINE_string(l2_cache, "256k:16:64", "Unified L2 cache for --cache_sim, as --l1i_cache.");
+DEFINE_uint32(cache_region_kb, riscv_emu::cachesim::constants::kDefaultRegionBytes >> 10,
+              "Size of the data regions --cache_sim counts misses in; a power of two.");
+DEFINE_uint32(cache_report_top, 10, "Pcs and data regions listed by the --cache_sim report.");
+DEFINE_string(branch_sim, "",
+              "Model branch prediction with this predictor (btfn, bimodal, gshare or tage) "
+              "and log misprediction rates per branch site on exit.");
+DEFINE_uint32(bp_table_bits, 12, "log2 of the --branch_sim pattern table entries.");
+DEFINE_uint32(bp_history_bits, 12, "Global history bits of the gshare --branch_sim.");
+DEFINE_uint32(btb_entries, 512, "Branch target buffer entries for --branch_sim; a power of two.");
+DEFINE_uint32(ras_depth, 8, "Return address stack entries for --branch_sim.");
+DEFINE_uint32(branch_report_top, 10, "Branch sites listed by the --branch_sim report.");
+DEFINE_bool(pipeline_sim, false,
+            "Time the guest's instructions on an in-order 5-stage pipeline and log CPI by "
+            "stall cause on exit. Control stalls follow --branch_sim if set, else every "
+            "taken transfer stalls.");
+DEFINE_bool(pipeline_forwarding, true, "Forward results in the --pipeline_sim pipeline.");
+DEFINE_uint32(mem_latency, 1, "Cycles loads and stores spend in MEM in --pipeline_sim.");
+DEFINE_uint32(mul_latency, 3, "Cycles multiplies spend in EX in --pipeline_sim.");
+DEFINE_uint32(div_latency, 34, "Cycles divides spend in EX in --pipeline_sim.");
+DEFINE_uint32(branch_penalty, 2, "Bubbles after a redirect resolved in EX in --pipeline_sim.");
+DEFINE_uint64(sample_period, 0,
+              "Run the models only in windows sampled every this many ticks and log the CPI "
+              "estimated from them on exit; 0 runs them throughout. Needs --pipeline_sim.");
+DEFINE_uint64(sample_warmup, 0,
+              "Ticks the models warm up for before each --sample_period window.");
+DEFINE_uint64(sample_measure, 10'000, "Ticks measured in each --sample_period window.");
+DEFINE_string(callgrind_out, "",
+              "Profile the guest's calls exactly and write the call graph to this file in "
+              "callgrind's format on exit. Functions are named from --elf.");
+DEFINE_uint32(call_graph_top, 10, "Functions listed in the log by --callgrind_out.");
+DEFINE_string(heatmap_out, "",
+              "Count reads, writes and executes per page of RAM and write them to this file "
+              "as CSV, one row per page accessed in each --heatmap_interval window.");
+DEFINE_uint64(heatmap_interval, 1'000'000, "Ticks per --heatmap_out window.");
+DEFINE_uint32(heatmap_line_bytes, 0,
+              "Count per line of this many bytes in --heatmap_out instead of per page; the "
+              "working set counts both.");
+DEFINE_string(working_set_out, "",
+              "Write the pages and lines accessed in each --heatmap_out window to this file "
+              "as CSV on exit.");
+DEFINE_uint32(heatmap_report_top, 10, "Pages listed in the log by --heatmap_out.");
 
 int main(int argc, char* argv[]) {
   // This may occasionally cause a deadlock with glibc
   // without libunwind on failure.
   google::InstallFailureSignalHandler();
   FLAGS_logtostderr = 1;
+  gflags::ParseCommandLineFlags(&argc, &argv, /*remove_flags=*/true);
   google::InitGoogleLogging(argv[0]);
 
-  riscv_emu::Cpu cpu;
-  absl::Status status = cpu.Boot();
+  riscv_emu::CpuOptions options;
+  options.sleep_on_wfi = FLAGS_sleep_on_wfi;
+  options.user_mode = FLAGS_user_mode;
+  options.code_cache_bytes = FLAGS_code_cache_kb << 10;
+  options.compile_threads = FLAGS_compile_threads;
+  options.tier_up_threshold = FLAGS_tier_up_threshold;
+  options.lockstep_interval = FLAGS_lockstep_every;
+  options.history_interval = FLAGS_history_interval;
+  options.history_bytes = FLAGS_history_mb << 20;
+  if (FLAGS_cache_sim) {
+    absl::StatusOr<riscv_emu::cachesim::CacheConfig> l1i =
+        riscv_emu::cachesim::ParseCacheConfig(FLAGS_l1i_cache);
+    absl::StatusOr<riscv_emu::cachesim::CacheConfig> l1d =
+        riscv_emu::cachesim::ParseCacheConfig(FLAGS_l1d_cache);
+    absl::StatusOr<riscv_emu::cachesim::CacheConfig> l2 =
+        riscv_emu::cachesim::ParseCacheConfig(FLAGS_l2_cache);
+    for (const absl::Status& status : {l1i.status(), l1d.status(), l2.status()}) {
+      if (!status.ok()) {
+        LOG(ERROR) << status;
+        return 1;
+      }
+    }
+    const uint32_t region_bytes = FLAGS_cache_region_kb << 10;
+    if (region_bytes == 0 || (region_bytes & (region_bytes - 1)) != 0) {
+      LOG(ERROR) << "--cache_region_kb must be a power of two";
+      return 1;
+    }
+    options.cache_sim = riscv_emu::cachesim::HierarchyConfig{*l1i, *l1d, *l2, region_bytes};
+  }
+  if (!FLAGS_branch_sim.empty()) {
+    const absl::StatusOr<riscv_emu::bpred::Scheme> scheme =
+        riscv_emu::bpred::ParseScheme(FLAGS_branch_sim);
+    if (!scheme.ok()) {
+      LOG(ERROR) << scheme.status();
+      return 1;
+    }
+    const riscv_emu::bpred::BranchConfig branch_sim = {
+        .direction = {.scheme = *scheme,
+                      .table_bits = FLAGS_bp_table_bits,
+                      .history_bits = FLAGS_bp_history_bits},
+        .btb_entries = FLAGS_btb_entries,
+        .ras_depth = FLAGS_ras_depth};
+    const absl::Status status = riscv_emu::bpred::Validate(branch_sim);
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+      return 1;
+    }
+    options.branch_sim = branch_sim;
+  }
+  if (FLAGS_pipeline_sim) {
+    if (FLAGS_mem_latency == 0 || FLAGS_mul_latency == 0 || FLAGS_div_latency == 0) {
+      LOG(ERROR) << "Pipeline latencies are at least a cycle";
+      return 1;
+    }
+    options.pipeline_sim = riscv_emu::timing::PipelineConfig{
+        .forwarding = FLAGS_pipeline_forwarding,
+        .load_latency = FLAGS_mem_latency,
+        .store_latency = FLAGS_mem_latency,
+        .mul_latency = FLAGS_mul_latency,
+        .div_latency = FLAGS_div_latency,
+        .branch_penalty = FLAGS_branch_penalty};
+  }
+  if (FLAGS_sample_period > 0) {
+    if (!FLAGS_pipeline_sim || FLAGS_history_interval > 0) {
+      LOG(ERROR) << "--sample_period needs --pipeline_sim and excludes --history_interval";
+      return 1;
+    }
+    const riscv_emu::timing::SamplingConfig sampling = {.period = FLAGS_sample_period,
+                                                        .warmup = FLAGS_sample_warmup,
+                                                        .measure = FLAGS_sample_measure};
+    const absl::Status status = riscv_emu::timing::Validate(sampling);
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+      return 1;
+    }
+    options.sampling = sampling;
+  }
+  options.call_graph = !FLAGS_callgrind_out.empty();
+  riscv_emu::Cpu cpu(options);
+  if (!FLAGS_record_inputs.empty() && !FLAGS_replay_inputs.empty()) {
+    LOG(ERROR) << "--record_inputs and --replay_inputs are mutually exclusive";
+    return 1;
+  }
+  if (!FLAGS_record_inputs.empty() || !FLAGS_replay_inputs.empty()) {
+    absl::Status status = FLAGS_replay_inputs.empty() ? cpu.RecordInputs(FLAGS_record_inputs)
+                                                      : cpu.ReplayInputs(FLAGS_replay_inputs);
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+      return 1;
+    }
+  }
+  if (!FLAGS_heatmap_out.empty()) {
+    const riscv_emu::memory::HeatmapConfig heatmap = {.interval = FLAGS_heatmap_interval,
+                                                      .line_bytes = FLAGS_heatmap_line_bytes};
+    absl::Status status = riscv_emu::memory::Validate(heatmap);
+    if (status.ok()) {
+      status = cpu.EnableHeatmap(heatmap, FLAGS_heatmap_out);
+    }
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+      return 1;
+    }
+  } else if (!FLAGS_working_set_out.empty()) {
+    LOG(ERROR) << "--working_set_out needs --heatmap_out";
+    return 1;
+  }
+  if (!FLAGS_disk_image.empty()) {
+    absl::Status status = cpu.AttachDisk(FLAGS_disk_image, FLAGS_disk_read_only);
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+      return 1;
+    }
+  }
+  if (!FLAGS_elf.empty()) {
+    std::vector<std::string> guest_argv = {FLAGS_elf};
+    guest_argv.insert(guest_argv.end(), argv + 1, argv + argc);
+    absl::Status status = cpu.LoadElf(FLAGS_elf, FLAGS_patch_libc, guest_argv);
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+      return 1;
+    }
+  }
+  if (!FLAGS_restore_checkpoint.empty()) {
+    absl::Status status = cpu.RestoreCheckpoint(FLAGS_restore_checkpoint);
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+      return 1;
+    }
+  }
+  absl::Status status;
+  bool resume = true;
+  if (!FLAGS_save_checkpoint.empty()) {
+    if (FLAGS_checkpoint_pc != 0) {
+      cpu.SetStopPc(FLAGS_checkpoint_pc);
+    }
+    status = cpu.Boot();
+    if (status.ok()) {
+      status = cpu.SaveCheckpoint(FLAGS_save_checkpoint, FLAGS_incremental_checkpoint);
+    }
+    cpu.SetStopPc(std::nullopt);
+    // Only a run stopped at --checkpoint_pc has anything left to run.
+    resume = FLAGS_checkpoint_pc != 0 && cpu.GetNextPc().value_or(0) == FLAGS_checkpoint_pc &&
+             !cpu.GetExitCode().has_value();
+  }
+  if (status.ok() && resume) {
+    status = cpu.Boot();
+  }
   if (!status.ok()) {
     LOG(ERROR) << status;
   }
-  
-  return 0;
+  // Reverse execution starts from where a successful run ended; a failed
+  // run keeps its error.
+  if (status.ok() && FLAGS_step_back > 0) {
+    status = cpu.StepBack(FLAGS_step_back);
+    if (status.ok()) {
+      LOG(INFO) << "Stepped back to instret " << cpu.GetInstret() << ", pc 0x" << std::hex
+                << cpu.GetNextPc().value_or(0);
+    } else {
+      LOG(ERROR) << status;
+    }
+  }
+  if (status.ok() && !FLAGS_last_write_to.empty()) {
+    uint32_t addr = 0;
+    if (!absl::SimpleHexAtoi(FLAGS_last_write_to, &addr)) {
+      LOG(ERROR) << "--last_write_to is not an address: " << FLAGS_last_write_to;
+      return 1;
+    }
+    status = cpu.RunBackToWrite(addr);
+    if (status.ok()) {
+      LOG(INFO) << "Last write to 0x" << std::hex << addr << ": pc 0x"
+                << cpu.GetNextPc().value_or(0) << std::dec << " at instret " << cpu.GetInstret();
+    } else {
+      LOG(ERROR) << status;
+    }
+  }
+  if (FLAGS_code_cache_stats && cpu.GetCodeCache() != nullptr) {
+    LOG(INFO) << cpu.GetCodeCache()->FormatStats();
+    LOG(INFO) << cpu.GetCompiler()->FormatStats();
+    LOG(INFO) << cpu.GetIndirectPredictor()->FormatStats();
+  }
+  if (FLAGS_lockstep_every > 0) {
+    LOG(INFO) << "lockstep: checked " << cpu.GetLockstepStats().checked << " blocks, skipped "
+              << cpu.GetLockstepStats().skipped;
+  }
+  if (cpu.GetCacheSim() != nullptr) {
+    LOG(INFO) << "cache simulation:\n" << cpu.GetCacheSim()->FormatReport(FLAGS_cache_report_top);
+  }
+  if (cpu.GetBranchSim() != nullptr) {
+    LOG(INFO) << "branch simulation:\n"
+              << cpu.GetBranchSim()->FormatReport(
+                     FLAGS_branch_report_top, [&cpu](uint32_t pc) { return cpu.Symbolize(pc); });
+  }
+  if (cpu.GetPipelineSim() != nullptr) {
+    LOG(INFO) << cpu.GetPipelineSim()->FormatReport();
+  }
+  if (cpu.GetSampler() != nullptr) {
+    LOG(INFO) << cpu.GetSampler()->FormatReport(cpu.GetInstret());
+  }
+  if (cpu.GetHeatmap() != nullptr) {
+    // The last window ends with the run.
+    absl::Status heatmap_status = cpu.GetHeatmap()->EndWindow(cpu.GetClock());
+    LOG(INFO) << cpu.GetHeatmap()->FormatReport(FLAGS_heatmap_report_top);
+    if (heatmap_status.ok() && !FLAGS_working_set_out.empty()) {
+      heatmap_status = cpu.GetHeatmap()->WriteWorkingSet(FLAGS_working_set_out);
+    }
+    if (!heatmap_status.ok()) {
+      LOG(ERROR) << heatmap_status;
+      status.Update(heatmap_status);
+    }
+  }
+  if (cpu.GetCallGraph() != nullptr) {
+    cpu.GetCallGraph()->Unwind();
+    LOG(INFO) << cpu.GetCallGraph()->FormatReport(FLAGS_call_graph_top);
+    const absl::Status callgrind_status = cpu.GetCallGraph()->WriteCallgrind(FLAGS_callgrind_out);
+    if (!callgrind_status.ok()) {
+      LOG(ERROR) << callgrind_status;
+      status.Update(callgrind_status);
+    }
+  }
+
+  // A run that failed, e.g. on a lockstep divergence, or a report that
+  // could not be written fails the process whatever the guest's exit code.
+  if (!status.ok()) {
+    return 1;
+  }
+  return cpu.GetExitCode().value_or(0);
 }
\ No newline at end of file